@@ -0,0 +1,78 @@
+/**
+ * @file
+ * @brief Defines the helpers shared by the benchmarks.
+ */
+
+#pragma once
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The number of heap allocations since the start of the process,
+ * counted by the replaced operator new in main.cpp.
+ */
+extern std::atomic<uint64_t> allocCount;
+
+/**
+ * @brief The sections disassembled by the sweeps, as in main.
+ */
+const std::vector<std::string> BENCH_SECTIONS = {
+    ".plt", ".plt.got", ".plt.sec", ".text", ".init", ".fini"};
+
+/**
+ * @brief Reports the time and the allocations per instruction.
+ * @param state The benchmark state.
+ * @param instructions The number of instructions over all iterations.
+ * @param allocs The number of allocations over all iterations.
+ */
+inline void reportPerInstruction(benchmark::State& state, uint64_t instructions,
+                                 uint64_t allocs) {
+    state.SetItemsProcessed((int64_t)instructions);
+    state.counters["time/insn"] = benchmark::Counter(
+        (double)instructions,
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["allocs/insn"] =
+        instructions == 0 ? 0.0 : (double)allocs / (double)instructions;
+}
+
+/**
+ * @brief Returns the ELF files to disassemble: the assembled examples, the
+ * benchmark binary itself, and the colon-separated paths in
+ * MYDISAS_BENCH_ELF.
+ */
+inline std::vector<std::string> benchElfFiles() {
+    std::vector<std::string> paths;
+
+    if (DIR* dir = opendir(BENCH_EXAMPLE_DIR)) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 2 && name.substr(name.size() - 2) == ".o") {
+                paths.push_back(std::string(BENCH_EXAMPLE_DIR) + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+    paths.push_back("/proc/self/exe");
+
+    if (const char* env = std::getenv("MYDISAS_BENCH_ELF")) {
+        std::string list = env;
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t next = list.find(':', pos);
+            if (next == std::string::npos) {
+                next = list.size();
+            }
+            if (next > pos) {
+                paths.push_back(list.substr(pos, next - pos));
+            }
+            pos = next + 1;
+        }
+    }
+    return paths;
+}
@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "state.h"
+
+namespace {
+
+/**
+ * @brief Repeats the instruction mix up to about 64 KiB.
+ */
+std::vector<unsigned char> makeMix(
+    const std::vector<std::vector<unsigned char>>& instructions) {
+    std::vector<unsigned char> bytes;
+    while (bytes.size() < (1 << 16)) {
+        for (const std::vector<unsigned char>& instruction : instructions) {
+            bytes.insert(bytes.end(), instruction.begin(), instruction.end());
+        }
+    }
+    return bytes;
+}
+
+const std::vector<unsigned char> ONE_BYTE_MIX = makeMix({
+    {0x90},        // nop
+    {0x55},        // push rbp
+    {0x50},        // push rax
+    {0x41, 0x57},  // push r15
+    {0xc3},        // ret
+});
+
+const std::vector<unsigned char> MODRM_SIB_DISP32_MIX = makeMix({
+    {0x8b, 0x84, 0x88, 0x78, 0x56, 0x34, 0x12},  // mov eax [rax+rcx*4+d32]
+    {0x4a, 0x8b, 0x84, 0x88, 0x78, 0x56, 0x34,
+     0x12},  // mov rax [rax+r9*4+d32]
+    {0x48, 0x89, 0x8c, 0x24, 0x10, 0x01, 0x00, 0x00},  // mov [rsp+d32] rcx
+    {0x48, 0x8d, 0x04, 0xc5, 0x10, 0x00, 0x00, 0x00},  // lea rax [d32+rax*8]
+});
+
+const std::vector<unsigned char> TWO_BYTE_MIX = makeMix({
+    {0x0f, 0xaf, 0xc1},                    // imul eax ecx
+    {0x0f, 0xb6, 0xc0},                    // movzx eax al
+    {0x0f, 0x84, 0x01, 0x00, 0x00, 0x00},  // jz rel32
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},        // nop [rax+rax*1+0x0]
+    {0x0f, 0x28, 0xc1},                    // movaps xmm0 xmm1
+});
+
+const std::vector<unsigned char> X87_MIX = makeMix({
+    {0xd8, 0xc1},        // fadd st(1)
+    {0xd9, 0xc9},        // fxch st(1)
+    {0xdc, 0xc1},        // fadd st(1)
+    {0xd8, 0x45, 0x10},  // fadd [rbp + 0x10]
+});
+
+/**
+ * @brief Measures State::step(), which decodes and renders the instruction.
+ */
+void BM_Step(benchmark::State& state, const std::vector<unsigned char>* mix) {
+    State decoder(*mix);
+    uint64_t instructions = 0;
+    uint64_t allocs = allocCount.load();
+
+    for (auto _ : state) {
+        for (uint64_t addr = 0; addr < mix->size();) {
+            DisassembledResult result = decoder.step(addr);
+            benchmark::DoNotOptimize(result.disassembledInstructionStr.data());
+            addr += result.disassembledInstructionSize;
+            instructions++;
+        }
+    }
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+}
+
+/**
+ * @brief Measures State::tryDecode() alone, without rendering the text.
+ */
+void BM_TryDecode(benchmark::State& state,
+                  const std::vector<unsigned char>* mix) {
+    State decoder(*mix);
+    uint64_t instructions = 0;
+    uint64_t allocs = allocCount.load();
+
+    for (auto _ : state) {
+        for (uint64_t addr = 0; addr < mix->size();) {
+            if (decoder.tryDecode(addr) != DecodeStatus::OK) {
+                state.SkipWithError("the instruction mix does not decode");
+                return;
+            }
+            benchmark::DoNotOptimize(decoder.decoded);
+            addr += decoder.decoded.length;
+            instructions++;
+        }
+    }
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+}
+
+/**
+ * @brief Measures State::decodeLength(), which decodes the length and the
+ * branch target only.
+ */
+void BM_DecodeLength(benchmark::State& state,
+                     const std::vector<unsigned char>* mix) {
+    State decoder(*mix);
+    uint64_t instructions = 0;
+    uint64_t allocs = allocCount.load();
+
+    for (auto _ : state) {
+        for (uint64_t addr = 0; addr < mix->size();) {
+            if (decoder.decodeLength(addr) != DecodeStatus::OK) {
+                state.SkipWithError("the instruction mix does not decode");
+                return;
+            }
+            benchmark::DoNotOptimize(decoder.boundary);
+            addr += decoder.boundary.length;
+            instructions++;
+        }
+    }
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_Step, one_byte, &ONE_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_Step, modrm_sib_disp32, &MODRM_SIB_DISP32_MIX);
+BENCHMARK_CAPTURE(BM_Step, two_byte_0f, &TWO_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_Step, x87, &X87_MIX);
+
+BENCHMARK_CAPTURE(BM_TryDecode, one_byte, &ONE_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_TryDecode, modrm_sib_disp32, &MODRM_SIB_DISP32_MIX);
+BENCHMARK_CAPTURE(BM_TryDecode, two_byte_0f, &TWO_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_TryDecode, x87, &X87_MIX);
+
+BENCHMARK_CAPTURE(BM_DecodeLength, one_byte, &ONE_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_DecodeLength, modrm_sib_disp32, &MODRM_SIB_DISP32_MIX);
+BENCHMARK_CAPTURE(BM_DecodeLength, two_byte_0f, &TWO_BYTE_MIX);
+BENCHMARK_CAPTURE(BM_DecodeLength, x87, &X87_MIX);
@@ -0,0 +1,201 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "disassembler.h"
+#include "elfdisas.h"
+#include "indirect.h"
+
+namespace {
+
+/**
+ * @brief Sweeps the sections of every ELF file with a fresh disassembler per
+ * iteration, as main does, with range(0) workers for recursive descent.
+ */
+void BM_Disas(benchmark::State& state, const char* strategy) {
+    std::vector<std::unique_ptr<ELFDisAssembler>> files;
+    for (const std::string& path : benchElfFiles()) {
+        files.emplace_back(new ELFDisAssembler(path, strategy));
+    }
+
+    uint64_t instructions = 0;
+    uint64_t bytes = 0;
+    uint64_t allocs = allocCount.load();
+
+    for (auto _ : state) {
+        for (std::unique_ptr<ELFDisAssembler>& eda : files) {
+            std::unique_ptr<DisAssembler> da(eda->_newDA());
+            for (const std::string& section_name : BENCH_SECTIONS) {
+                size_t sid = eda->elf.findSection(section_name);
+                if (sid != NO_SECTION) {
+                    const ELF64_SECTION_HEADER& sh = eda->elf.section(sid);
+                    eda->_disasRange(
+                        *da,
+                        {(uint64_t)sh.sh_offset,
+                         (uint64_t)sh.sh_offset + (uint64_t)sh.sh_size - 1},
+                        (size_t)state.range(0));
+                    bytes += sh.sh_size;
+                }
+            }
+            instructions += da->disassembledInstructions.size();
+        }
+    }
+
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+    state.SetBytesProcessed((int64_t)bytes);
+}
+
+/**
+ * @brief Measures ELFDisAssembler::print() of the disassembled files.
+ */
+void BM_Print(benchmark::State& state) {
+    std::vector<std::unique_ptr<ELFDisAssembler>> files;
+    for (const std::string& path : benchElfFiles()) {
+        files.emplace_back(new ELFDisAssembler(path, "linearsweep"));
+        files.back()->disas(BENCH_SECTIONS, 1);
+    }
+
+    int fd = open("/dev/null", O_WRONLY);
+    uint64_t instructions = 0;
+    uint64_t allocs = allocCount.load();
+
+    for (auto _ : state) {
+        for (std::unique_ptr<ELFDisAssembler>& eda : files) {
+            eda->print(fd);
+            instructions += eda->da->disassembledInstructions.size();
+        }
+    }
+
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+    close(fd);
+}
+
+/**
+ * @brief Returns calls to a number of switch (edi) blocks, each with its
+ * table of relative entries, followed by the blocks.
+ */
+std::vector<unsigned char> makeSwitches(size_t count) {
+    const std::vector<unsigned char> block = {
+        0x83, 0xff, 0x02,                          // 0: cmp edi 2
+        0x77, 0x17,                                // 3: ja 1c
+        0x48, 0x8d, 0x15, 0x14, 0x00, 0x00, 0x00,  // 5: lea rdx [rip + 0x14]
+        0x48, 0x63, 0x04, 0xba,                    // c: movsxd rax [rdx+rdi*4]
+        0x48, 0x01, 0xd0,                          // 10: add rax rdx
+        0xff, 0xe0,                                // 13: jmp rax
+        0x90, 0xc3,                                // 15: case 0
+        0x90, 0xc3,                                // 17: case 1
+        0x90, 0xc3,                                // 19: case 2
+        0xcc,                                      // 1b
+        0xc3,                                      // 1c: default
+        0xcc, 0xcc, 0xcc,                          // 1d
+        0xf5, 0xff, 0xff, 0xff,                    // 20: 15 - 20
+        0xf7, 0xff, 0xff, 0xff,                    // 24: 17 - 20
+        0xf9, 0xff, 0xff, 0xff,                    // 28: 19 - 20
+    };
+    const size_t CALL_SIZE = 5;
+    size_t blocksStart = count * CALL_SIZE + 1;
+
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; i < count; i++) {
+        int32_t rel = (int32_t)(blocksStart + i * block.size() -
+                                (i + 1) * CALL_SIZE);
+        bytes.push_back(0xe8);  // call rel32
+        for (int b = 0; b < 4; b++) {
+            bytes.push_back((unsigned char)(rel >> (8 * b)));
+        }
+    }
+    bytes.push_back(0xc3);
+    for (size_t i = 0; i < count; i++) {
+        bytes.insert(bytes.end(), block.begin(), block.end());
+    }
+    return bytes;
+}
+
+/**
+ * @brief Measures recursive descent through code with an indirect jump
+ * every few instructions, each read from the switch table of its block.
+ */
+void BM_Switches(benchmark::State& state) {
+    std::vector<unsigned char> bytes = makeSwitches((size_t)state.range(0));
+    IndirectTargets targets(bytes);
+
+    uint64_t instructions = 0;
+    uint64_t allocs = allocCount.load();
+    for (auto _ : state) {
+        RecursiveDescentDisAssembler rd(bytes);
+        rd.indirectTargets = &targets;
+        rd.disas(0, bytes.size() - 1);
+        instructions += rd.disassembledInstructions.size();
+    }
+
+    reportPerInstruction(state, instructions, allocCount.load() - allocs);
+    state.SetBytesProcessed((int64_t)(state.iterations() * bytes.size()));
+}
+
+/**
+ * @brief Measures redisas() of a patch of range(1) bytes in the middle of
+ * range(0) bytes of straight-line code, the patch turning the bytes into
+ * nops and back in turn.
+ */
+template <typename T>
+void BM_Redisas(benchmark::State& state) {
+    const std::vector<std::vector<unsigned char>> pieces = {
+        {0x90},                          // nop
+        {0x48, 0x83, 0xc0, 0x01},        // add rax 0x01
+        {0x8b, 0x45, 0x10},              // mov eax [rbp+0x10]
+        {0x74, 0x00},                    // je +0
+        {0x48, 0x8b, 0x44, 0x24, 0x08},  // mov rax [rsp+0x8]
+    };
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; bytes.size() < (size_t)state.range(0); i++) {
+        const std::vector<unsigned char>& piece = pieces[i * 7 % 5];
+        bytes.insert(bytes.end(), piece.begin(), piece.end());
+    }
+    bytes.push_back(0xc3);
+
+    uint64_t patchStart = bytes.size() / 2;
+    uint64_t patchEnd = patchStart + (uint64_t)state.range(1);
+    std::vector<unsigned char> original(bytes.begin() + patchStart,
+                                        bytes.begin() + patchEnd);
+
+    T da(bytes);
+    da.enableCFG();
+    da.disas(0, bytes.size() - 1);
+    bool isPatched = false;
+    for (auto _ : state) {
+        for (uint64_t i = patchStart; i < patchEnd; i++) {
+            bytes[i] = isPatched ? original[i - patchStart] : 0x90;
+        }
+        isPatched = !isPatched;
+        da.redisas(patchStart, patchEnd);
+    }
+    state.counters["instructions"] =
+        (double)da.disassembledInstructions.size();
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_Redisas, LinearSweepDisAssembler)
+    ->ArgsProduct({{1 << 14, 1 << 17, 1 << 20}, {16, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Redisas, RecursiveDescentDisAssembler)
+    ->ArgsProduct({{1 << 14, 1 << 17, 1 << 20}, {16, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Switches)
+    ->RangeMultiplier(8)
+    ->Range(1 << 9, 1 << 15)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Disas, linearsweep, "linearsweep")
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Disas, recursivedescent, "recursivedescent")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Print)->Unit(benchmark::kMillisecond);
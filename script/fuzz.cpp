@@ -0,0 +1,145 @@
+#include <getopt.h>
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bytespan.h"
+#include "differential.h"
+#include "elfview.h"
+
+uint64_t seed = 1;
+size_t numBuffers = 16;
+size_t bufferSize = 1 << 20;
+size_t mutationsPerMille = 10;
+std::vector<std::string> corpusPaths;
+std::string objdump = "objdump";
+bool reference = true;
+size_t maxSamples = DEFAULT_MISMATCH_SAMPLES;
+bool strict = false;
+
+const option LONG_OPTIONS[] = {
+    {"seed", required_argument, nullptr, 'r'},
+    {"buffers", required_argument, nullptr, 'n'},
+    {"size", required_argument, nullptr, 'z'},
+    {"mutations", required_argument, nullptr, 'm'},
+    {"corpus", required_argument, nullptr, 'c'},
+    {"objdump", required_argument, nullptr, 'O'},
+    {"no-reference", no_argument, nullptr, 'N'},
+    {"samples", required_argument, nullptr, 'k'},
+    {"strict", no_argument, nullptr, 'x'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief Returns the code of the corpus file: the executable sections of an
+ * ELF64 file, or the whole file otherwise.
+ */
+std::vector<std::vector<unsigned char>> readCorpus(const std::string& path) {
+    MappedFile file(path);
+    ByteSpan bytes = file.bytes();
+    std::vector<std::vector<unsigned char>> code;
+    try {
+        ElfView elf(bytes);
+        for (size_t sid = 0; sid < elf.numSections(); sid++) {
+            ByteSpan contents = elf.contents(sid);
+            if ((elf.section(sid).sh_flags & ELF_SECTION_FLAG_EXECINSTR) &&
+                !contents.empty()) {
+                code.emplace_back(contents.begin(), contents.end());
+            }
+        }
+    } catch (const std::runtime_error&) {
+        code.emplace_back(bytes.begin(), bytes.end());
+    }
+    return code;
+}
+
+/**
+ * @brief Measures the buffer and compares it with the reference.
+ */
+void run(DifferentialTester& tester, const std::vector<unsigned char>& bytes) {
+    tester.measure(bytes);
+    if (reference) {
+        tester.compare(bytes, runObjdump(bytes, objdump));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", LONG_OPTIONS, nullptr)) != -1) {
+        switch (opt) {
+            case 'r':
+                seed = std::stoull(optarg);
+                break;
+            case 'n':
+                numBuffers = std::stoul(optarg);
+                break;
+            case 'z':
+                bufferSize = std::stoul(optarg);
+                break;
+            case 'm':
+                mutationsPerMille = std::stoul(optarg);
+                break;
+            case 'c':
+                corpusPaths.push_back(std::string(optarg));
+                break;
+            case 'O':
+                objdump = std::string(optarg);
+                break;
+            case 'N':
+                reference = false;
+                break;
+            case 'k':
+                maxSamples = std::stoul(optarg);
+                break;
+            case 'x':
+                strict = true;
+                break;
+            default:
+                std::cerr << "usage: " << argv[0]
+                          << " [--seed N] [--buffers N] [--size BYTES]"
+                             " [--mutations PER_MILLE] [--corpus FILE]..."
+                             " [--objdump CMD] [--no-reference]"
+                             " [--samples N] [--strict]"
+                          << std::endl;
+                return 2;
+        }
+    }
+
+    std::mt19937_64 random(seed);
+    DifferentialTester tester(maxSamples);
+    try {
+        // uniformly random bytes, mostly invalid or rare encodings
+        for (size_t i = 0; i < numBuffers; i++) {
+            std::vector<unsigned char> bytes(bufferSize);
+            for (unsigned char& b : bytes) {
+                b = (unsigned char)random();
+            }
+            run(tester, bytes);
+        }
+
+        // real code as is, then with random bytes overwritten, which keeps
+        // the mix of the common encodings around the mutations
+        for (const std::string& path : corpusPaths) {
+            for (std::vector<unsigned char>& bytes : readCorpus(path)) {
+                run(tester, bytes);
+                for (unsigned char& b : bytes) {
+                    if (random() % 1000 < mutationsPerMille) {
+                        b = (unsigned char)random();
+                    }
+                }
+                run(tester, bytes);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    tester.print(std::cout);
+    std::cout << "mismatches: " << tester.mismatches() << std::endl;
+    return strict && tester.mismatches() > 0 ? 1 : 0;
+}
@@ -1,39 +1,361 @@
+#include <fcntl.h>
+#include <getopt.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "batch.h"
 #include "elfdisas.h"
+#include "server.h"
 
 std::string strategy = "linearsweep";
+size_t jobs = 1;
+std::string outputPath;
+bool streaming = false;
+std::string cacheDir;
+bool batch = false;
+bool stats = false;
+std::string exportPath;
+std::string addressRange;
+std::string symbolName;
+std::string cfgPath;
+std::string socketPath;
+bool boundaries = false;
+
+/** The most workers -j takes, well above the cores of any machine */
+const size_t MAX_JOBS = 1024;
+
+/** Written by -h, and with the error of an invalid -j */
+const char USAGE[] =
+    "usage: mydisas [-s ls|rd] [-j JOBS] [-o FILE] [-S] [--cache-dir DIR]\n"
+    "               [--stats] [--export FILE] [--cfg FILE] [--boundaries]\n"
+    "               [--range START-END | --symbol NAME] BINARY\n"
+    "       mydisas --batch -o DIR [-j JOBS] [BINARY...]\n"
+    "       mydisas --serve SOCKET\n"
+    "  -s            linearsweep (ls, the default) or recursivedescent (rd)\n"
+    "  -j JOBS       the number of workers, 0 for one per core\n"
+    "  --range       virtual addresses in hex, END excluded; the listing,\n"
+    "                like the one of --symbol, shows file offsets\n";
+
+const option LONG_OPTIONS[] = {
+    {"cache-dir", required_argument, nullptr, 'C'},
+    {"batch", no_argument, nullptr, 'B'},
+    {"stats", no_argument, nullptr, 'T'},
+    {"export", required_argument, nullptr, 'E'},
+    {"range", required_argument, nullptr, 'R'},
+    {"symbol", required_argument, nullptr, 'Y'},
+    {"cfg", required_argument, nullptr, 'G'},
+    {"serve", required_argument, nullptr, 'D'},
+    {"boundaries", no_argument, nullptr, 'L'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0},
+};
+
+/**
+ * @brief Parses the number of workers of -j: decimal digits only, all of
+ * the argument being consumed, and at most MAX_JOBS.
+ * @throws std::invalid_argument if it is not written so.
+ */
+size_t parseJobs(const std::string& arg) {
+    // stoul() would also skip spaces and take a sign
+    if (arg.empty() || !std::isdigit((unsigned char)arg[0])) {
+        throw std::invalid_argument("The number of jobs must be a number: " +
+                                    arg);
+    }
+    size_t pos = 0;
+    unsigned long n;
+    try {
+        n = std::stoul(arg, &pos, 10);
+    } catch (const std::out_of_range&) {
+        throw std::invalid_argument("The number of jobs is too large: " +
+                                    arg);
+    }
+    if (pos != arg.size()) {
+        throw std::invalid_argument("The number of jobs must be a number: " +
+                                    arg);
+    }
+    if (n > MAX_JOBS) {
+        throw std::invalid_argument("The number of jobs is too large: " +
+                                    arg);
+    }
+    return n;
+}
+
+/**
+ * @brief Disassembles the files given after the options, or listed on the
+ * standard input if there are none, writing each listing to <outputPath>/.
+ * @return The exit status of the process.
+ */
+int runBatch(int argc, char* argv[]) {
+    if (outputPath.empty()) {
+        std::cerr << "The batch mode needs the output directory (-o)."
+                  << std::endl;
+        return 1;
+    }
+    if (!makeOutputDir(outputPath)) {
+        std::cerr << "Failed to create the output directory: " << outputPath
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> inputPaths(argv + optind, argv + argc);
+    if (inputPaths.empty()) {
+        inputPaths = readManifest(std::cin);
+    }
+
+    BatchOptions options;
+    options.strategy = strategy;
+    options.cacheDir = cacheDir;
+    options.streaming = streaming;
+    options.workers = jobs;
+    BatchDisAssembler bda(options, std::cerr);
+
+    std::vector<BatchJob> batchJobs = planBatch(inputPaths, outputPath);
+    std::vector<BatchResult> results = bda.run(batchJobs);
+    size_t failed = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i].ok) {
+            std::cerr << batchJobs[i].inputPath << ": " << results[i].error
+                      << std::endl;
+            failed++;
+        }
+    }
+    std::cerr << "batch: " << results.size() - failed << " of "
+              << results.size() << " files disassembled" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Finds the file offsets to disassemble instead of the sections: the
+ * virtual addresses of --range (START-END in hex, END excluded), or the
+ * symbol of --symbol.
+ * @return False if neither option is given.
+ * @throws std::exception if the range is invalid or not in the file.
+ */
+bool selectRange(ELFDisAssembler& eda, DisasRange& range) {
+    if (!addressRange.empty()) {
+        std::pair<uint64_t, uint64_t> addrs = parseAddressRange(addressRange);
+        range = eda._addressRange(addrs.first, addrs.second);
+        return true;
+    } else if (!symbolName.empty()) {
+        range = eda._symbolRange(symbolName);
+        return true;
+    }
+    return false;
+}
 
 int main(int argc, char* argv[]) {
     int opt;
-    while ((opt = getopt(argc, argv, "s:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "s:j:o:SBh", LONG_OPTIONS,
+                              nullptr)) != -1) {
         switch (opt) {
             case 's':
                 strategy = std::string(optarg);
                 break;
+            case 'j':
+                try {
+                    jobs = parseJobs(optarg);
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl << USAGE;
+                    return 1;
+                }
+                if (jobs == 0) {
+                    jobs = std::max(1u, std::thread::hardware_concurrency());
+                }
+                break;
+            case 'S':
+                streaming = true;
+                break;
+            case 'o':
+                outputPath = std::string(optarg);
+                break;
+            case 'C':
+                cacheDir = std::string(optarg);
+                break;
+            case 'B':
+                batch = true;
+                break;
+            case 'T':
+                stats = true;
+                break;
+            case 'E':
+                exportPath = std::string(optarg);
+                break;
+            case 'R':
+                addressRange = std::string(optarg);
+                break;
+            case 'Y':
+                symbolName = std::string(optarg);
+                break;
+            case 'G':
+                cfgPath = std::string(optarg);
+                break;
+            case 'D':
+                socketPath = std::string(optarg);
+                break;
+            case 'L':
+                boundaries = true;
+                break;
+            case 'h':
+                std::cout << USAGE;
+                return 0;
             default:
                 std::cout << "unknown parameter is specified" << std::endl;
                 break;
         }
     }
 
+    if (batch) {
+        return runBatch(argc, argv);
+    }
+    if (!socketPath.empty()) {
+        // answers the requests of ServerRequest until a shutdown request
+        DisasServer server;
+        if (!server.serve(socketPath)) {
+            std::cerr << "Failed to listen on the socket: " << socketPath
+                      << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     std::string binaryPath = argv[optind];
 
+    const std::vector<std::string> sections = {".plt",  ".plt.got", ".plt.sec",
+                                               ".text", ".init",    ".fini"};
     ELFDisAssembler eda(binaryPath, strategy);
+    eda.cache = DecodeCache(cacheDir);
+    if (stats) {
+        eda.enableStats();
+    }
+    if (!cfgPath.empty()) {
+        eda.enableCFG();
+    }
+
+    DisasRange range;
+    bool ranged;
+    try {
+        ranged = selectRange(eda, range);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (boundaries) {
+        // the lengths and the branch targets replace the listing
+        std::vector<SectionRange> ranges =
+            ranged ? std::vector<SectionRange>{{range.startAddr,
+                                                range.endAddr + 1, nullptr}}
+                   : eda._printableSectionRanges();
+        eda.phases.time("boundaries",
+                        [&]() { eda.printBoundaries(std::cout, ranges); });
+        if (stats) {
+            eda.printStats();
+        }
+        return 0;
+    }
 
-    eda.disas(".plt");
-    eda.disas(".plt.got");
-    eda.disas(".plt.sec");
-    eda.disas(".text");
-    eda.disas(".init");
-    eda.disas(".fini");
+    auto disassemble = [&]() {
+        if (ranged) {
+            eda.disasRange(range, jobs);
+        } else {
+            eda.disas(sections, jobs);
+        }
+    };
 
-    eda.print();
+    bool cfgWritten = true;
+    auto writeCFG = [&]() {
+        if (cfgPath.empty()) {
+            return;
+        }
+        std::ofstream ofs(cfgPath);
+        if (!ofs) {
+            std::cerr << "Failed to open the CFG file: " << cfgPath
+                      << std::endl;
+            cfgWritten = false;
+            return;
+        }
+        eda.phases.time("cfg", [&]() { eda.printCFG(ofs); });
+    };
+
+    if (!exportPath.empty()) {
+        // the columnar file replaces the listing
+        eda.phases.time("disassemble", disassemble);
+        eda.phases.time("report errors", [&]() { eda.printDecodeErrors(); });
+        eda.phases.time("export",
+                        [&]() { eda.exportColumnar(exportPath); });
+        writeCFG();
+        if (stats) {
+            eda.printStats();
+        }
+        return cfgWritten ? 0 : 1;
+    }
+
+    int fd = -1;
+    if (!outputPath.empty()) {
+        fd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open the output file: " << outputPath
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (streaming && eda._isRecursiveDescent()) {
+        std::cerr << "The streaming mode only supports linear sweep, so the "
+                     "listing is written after the disassembly."
+                  << std::endl;
+        streaming = false;
+    }
+    if (streaming && ranged) {
+        std::cerr << "The streaming mode disassembles whole sections, so the "
+                     "listing is written after the disassembly."
+                  << std::endl;
+        streaming = false;
+    }
+    if (streaming && !cfgPath.empty()) {
+        std::cerr << "The streaming mode does not keep the instructions for "
+                     "the CFG, so the listing is written after the "
+                     "disassembly."
+                  << std::endl;
+        streaming = false;
+    }
+
+    auto run = [&](OutputWriter& out) {
+        if (streaming) {
+            eda.phases.time("stream", [&]() { eda.stream(sections, out); });
+            eda.printDecodeErrors();
+        } else {
+            eda.phases.time("disassemble", disassemble);
+            eda.phases.time("report errors",
+                            [&]() { eda.printDecodeErrors(); });
+            eda.phases.time("print", [&]() {
+                eda.print(out);
+                out.flush();
+            });
+            writeCFG();
+        }
+        out.flush();
+        if (stats) {
+            eda.printStats();
+        }
+    };
+
+    if (fd < 0) {
+        OutputWriter out(std::cout);
+        run(out);
+    } else {
+        OutputWriter out(fd);
+        run(out);
+        close(fd);
+    }
+    return cfgWritten ? 0 : 1;
 }
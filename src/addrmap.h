@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief Defines the mapping between the virtual addresses of an object file
+ * and the offsets of its bytes in the file.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The result of a lookup of an address that is not mapped.
+ */
+constexpr uint64_t NOT_MAPPED = ~0ULL;
+
+/**
+ * @struct MappedSegment
+ * @brief Represents bytes of the file loaded at a virtual address.
+ */
+struct MappedSegment {
+    uint64_t addr;   /**< The virtual address of the first byte */
+    uint64_t offset; /**< The file offset of the first byte */
+    uint64_t size;   /**< The number of bytes in the file */
+};
+
+/**
+ * @class AddressMap
+ * @brief Translates virtual addresses to file offsets and back, from the
+ * loadable segments of an executable, or the sections of a relocatable file.
+ */
+class AddressMap {
+   public:
+    /**
+     * @brief Maps the size bytes at the file offset to the address. The
+     * segments do not overlap.
+     */
+    void map(uint64_t addr, uint64_t offset, uint64_t size) {
+        if (size == 0) {
+            return;
+        }
+        auto it = std::upper_bound(
+            segments.begin(), segments.end(), addr,
+            [](uint64_t a, const MappedSegment& s) { return a < s.addr; });
+        segments.insert(it, {addr, offset, size});
+    }
+
+    /**
+     * @brief Returns the file offset of the address.
+     * @return The offset, or NOT_MAPPED if the address has no byte in the
+     * file.
+     */
+    uint64_t toOffset(uint64_t addr) const {
+        auto it = std::upper_bound(
+            segments.begin(), segments.end(), addr,
+            [](uint64_t a, const MappedSegment& s) { return a < s.addr; });
+        if (it == segments.begin() || addr - (it - 1)->addr >= (it - 1)->size) {
+            return NOT_MAPPED;
+        }
+        return (it - 1)->offset + (addr - (it - 1)->addr);
+    }
+
+    /**
+     * @brief Returns the address the byte at the file offset is loaded at.
+     * @return The address, or NOT_MAPPED if the byte is not loaded.
+     */
+    uint64_t toAddr(uint64_t offset) const {
+        for (const MappedSegment& s : segments) {
+            if (offset >= s.offset && offset - s.offset < s.size) {
+                return s.addr + (offset - s.offset);
+            }
+        }
+        return NOT_MAPPED;
+    }
+
+    /**
+     * @brief Checks whether [addr, addr + size) is a single run of bytes of
+     * the file.
+     */
+    bool isContiguous(uint64_t addr, uint64_t size) const {
+        uint64_t offset = toOffset(addr);
+        return size > 0 && offset != NOT_MAPPED &&
+               toOffset(addr + size - 1) == offset + size - 1;
+    }
+
+    bool empty() const { return segments.empty(); }
+
+   private:
+    std::vector<MappedSegment> segments; /**< Sorted by address */
+};
+
+/**
+ * @brief Parses an address of parseAddressRange(): hex digits only, with an
+ * optional 0x, all of the field being consumed.
+ * @throws std::invalid_argument naming the range if it is not written so.
+ */
+inline uint64_t parseRangeAddress(const std::string& field,
+                                  const std::string& range) {
+    // stoull() would also skip spaces and take a sign
+    if (field.empty() || !std::isxdigit((unsigned char)field[0])) {
+        throw std::invalid_argument("The range must be START-END: " + range);
+    }
+    size_t pos = 0;
+    uint64_t addr;
+    try {
+        addr = std::stoull(field, &pos, 16);
+    } catch (const std::out_of_range&) {
+        throw std::invalid_argument("The address is too large: " + range);
+    }
+    if (pos != field.size()) {
+        throw std::invalid_argument("The range must be START-END: " + range);
+    }
+    return addr;
+}
+
+/**
+ * @brief Parses a range of virtual addresses written START-END in hex, END
+ * excluded.
+ * @throws std::invalid_argument if it is not written so.
+ */
+inline std::pair<uint64_t, uint64_t> parseAddressRange(
+    const std::string& range) {
+    size_t dash = range.find('-');
+    if (dash == std::string::npos) {
+        throw std::invalid_argument("The range must be START-END: " + range);
+    }
+    return {parseRangeAddress(range.substr(0, dash), range),
+            parseRangeAddress(range.substr(dash + 1), range)};
+}
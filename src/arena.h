@@ -0,0 +1,169 @@
+/**
+ * @file
+ * @brief Defines a monotonic arena holding the data of one run.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The size of the blocks the arena allocates from.
+ */
+const size_t ARENA_BLOCK_SIZE = 1 << 16;
+
+/**
+ * @class Arena
+ * @brief Hands out memory from a few large blocks. Nothing is freed on its
+ * own: every block is released at once when the arena is destroyed, so
+ * that tearing down a run does not free its nodes and strings one by one.
+ */
+class Arena {
+   public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { release(); }
+
+    /**
+     * @brief Allocates size bytes aligned to align, a power of two.
+     */
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur) + align - 1) &
+                      ~(uintptr_t)(align - 1);
+        if (cur == nullptr || p + size > reinterpret_cast<uintptr_t>(end)) {
+            // a large allocation gets a block of its own so that the rest
+            // of the current block is not wasted
+            if (size + align > ARENA_BLOCK_SIZE / 4) {
+                return alignUp(newBlock(size + align, false), align);
+            }
+            cur = newBlock(ARENA_BLOCK_SIZE, true);
+            p = reinterpret_cast<uintptr_t>(alignUp(cur, align));
+        }
+        cur = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    /**
+     * @brief Copies the string into the arena.
+     * @return The copy, followed by a '\0'.
+     */
+    std::string_view copy(std::string_view str) {
+        char* p = static_cast<char*>(allocate(str.size() + 1, 1));
+        std::memcpy(p, str.data(), str.size());
+        p[str.size()] = '\0';
+        return std::string_view(p, str.size());
+    }
+
+    /**
+     * @brief Frees every block, invalidating all the memory handed out.
+     */
+    void release() {
+        while (blocks != nullptr) {
+            Block* next = blocks->next;
+            std::free(blocks);
+            blocks = next;
+        }
+        cur = end = nullptr;
+        reserved = 0;
+    }
+
+    /**
+     * @brief Returns the number of bytes of the blocks.
+     */
+    size_t bytesReserved() const { return reserved; }
+
+   private:
+    struct Block {
+        Block* next;
+    };
+
+    Block* blocks = nullptr; /**< The blocks, the newest first */
+    char* cur = nullptr;     /**< The free space of the current block */
+    char* end = nullptr;
+    size_t reserved = 0;
+
+    /**
+     * @brief Allocates a block of size usable bytes.
+     * @param current Whether the allocations continue from the block.
+     */
+    char* newBlock(size_t size, bool current) {
+        Block* block =
+            static_cast<Block*>(std::malloc(sizeof(Block) + size));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        block->next = blocks;
+        blocks = block;
+        reserved += size;
+        char* data = reinterpret_cast<char*>(block + 1);
+        if (current) {
+            end = data + size;
+        }
+        return data;
+    }
+
+    static char* alignUp(char* p, size_t align) {
+        return reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(p) + align - 1) &
+            ~(uintptr_t)(align - 1));
+    }
+};
+
+/**
+ * @class ArenaAllocator
+ * @brief Lets the standard containers allocate from an arena. Deallocation
+ * does nothing; the memory is reclaimed with the arena.
+ */
+template <typename T>
+class ArenaAllocator {
+   public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+
+   private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    Arena* arena;
+};
+
+/**
+ * @brief A hash map whose nodes and buckets live in an arena.
+ */
+template <typename K, typename V>
+using ArenaMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>,
+                                    ArenaAllocator<std::pair<const K, V>>>;
+
+/**
+ * @brief An array whose elements live in an arena.
+ */
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
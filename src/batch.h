@@ -0,0 +1,209 @@
+/**
+ * @file
+ * @brief Defines the batch mode disassembling many files in one process.
+ */
+
+#pragma once
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "elfdisas.h"
+
+/**
+ * @struct BatchJob
+ * @brief Represents a file to disassemble and where its listing goes.
+ */
+struct BatchJob {
+    std::string inputPath;  /**< The object file */
+    std::string outputPath; /**< The listing file */
+};
+
+/**
+ * @struct BatchOptions
+ * @brief Represents the options applied to every file of a batch.
+ */
+struct BatchOptions {
+    std::string strategy = "linearsweep"; /**< The disassembly strategy */
+    std::string cacheDir; /**< The decode cache directory, or "" */
+    bool streaming = false; /**< Whether the listings are streamed */
+    size_t workers = 1;     /**< The number of files disassembled at once */
+};
+
+/**
+ * @struct BatchResult
+ * @brief Represents the outcome of a file of a batch.
+ */
+struct BatchResult {
+    bool ok = false;   /**< Whether the listing has been written */
+    std::string error; /**< Why it has not, if !ok */
+};
+
+/**
+ * @brief Reads the paths of a manifest, one per line, skipping blank lines.
+ * @param is The stream of the manifest.
+ * @return The paths in order.
+ */
+inline std::vector<std::string> readManifest(std::istream& is) {
+    std::vector<std::string> paths;
+    std::string line;
+    while (std::getline(is, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(" \t") != std::string::npos) {
+            paths.push_back(line);
+        }
+    }
+    return paths;
+}
+
+/**
+ * @brief Assigns each input its listing file in the output directory, named
+ * after the input as <name>.lst. Inputs of the same name get <name>.<n>.lst
+ * in the order they are given.
+ * @param inputPaths The object files.
+ * @param outputDir The directory of the listings.
+ * @return The jobs in the order of the inputs.
+ */
+inline std::vector<BatchJob> planBatch(
+    const std::vector<std::string>& inputPaths, const std::string& outputDir) {
+    std::vector<BatchJob> jobs;
+    std::unordered_map<std::string, size_t> seen;
+    for (const std::string& inputPath : inputPaths) {
+        std::string name = inputPath.substr(inputPath.find_last_of('/') + 1);
+        size_t n = seen[name]++;
+        if (n > 0) {
+            name += "." + std::to_string(n);
+        }
+        jobs.push_back({inputPath, outputDir + "/" + name + ".lst"});
+    }
+    return jobs;
+}
+
+/**
+ * @class BatchDisAssembler
+ * @brief Disassembles many files on a pool of threads and writes each listing
+ * to its own file.
+ *
+ * The decoder tables are built once for the process and shared by all the
+ * threads; each thread takes the next file as soon as it is done with the
+ * previous one, and decodes it sequentially with its own disassembler, so
+ * that the listings are the same as the ones written one process per file.
+ * A file that cannot be disassembled is reported in its result without
+ * stopping the others.
+ */
+class BatchDisAssembler {
+   public:
+    /**
+     * @brief Constructor for BatchDisAssembler.
+     * @param options The options of every file.
+     * @param errors The stream receiving the decode errors of every file,
+     * each report preceded by the path of its file.
+     */
+    BatchDisAssembler(BatchOptions options, std::ostream& errors)
+        : options(std::move(options)), errors(errors) {}
+
+    /**
+     * @brief Disassembles the files.
+     * @param jobs The files and their listing files.
+     * @return The results in the order of the jobs.
+     */
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs) {
+        std::vector<BatchResult> results(jobs.size());
+        std::atomic<size_t> nextJob(0);
+
+        auto worker = [&]() {
+            size_t i;
+            while ((i = nextJob++) < jobs.size()) {
+                results[i] = runOne(jobs[i]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        size_t workers = std::min(options.workers, jobs.size());
+        for (size_t j = 1; j < workers; j++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+        return results;
+    }
+
+   private:
+    BatchOptions options;
+    std::ostream& errors;
+    std::mutex errorsMtx;
+
+    BatchResult runOne(const BatchJob& job) {
+        BatchResult result;
+        try {
+            ELFDisAssembler eda(job.inputPath, options.strategy);
+            eda.cache = DecodeCache(options.cacheDir);
+            bool streaming = options.streaming && !eda._isRecursiveDescent();
+
+            int fd = ::open(job.outputPath.c_str(),
+                            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                result.error = "Failed to open the output file: " +
+                               job.outputPath + " (" + std::strerror(errno) +
+                               ")";
+                return result;
+            }
+            try {
+                OutputWriter out(fd);
+                if (streaming) {
+                    eda.stream(PRINTABLE_SECTIONS, out);
+                } else {
+                    eda.disas(PRINTABLE_SECTIONS, 1);
+                    eda.print(out);
+                }
+                out.flush();
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+            if (::close(fd) != 0) {
+                result.error = "Failed to write the output file: " +
+                               job.outputPath;
+                return result;
+            }
+
+            std::ostringstream report;
+            eda.printDecodeErrors(report);
+            if (!report.str().empty()) {
+                std::lock_guard<std::mutex> lock(errorsMtx);
+                errors << job.inputPath << ":\n" << report.str();
+                errors.flush();
+            }
+            result.ok = true;
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Creates the directory unless it exists.
+ * @return False if it could not be created.
+ */
+inline bool makeOutputDir(const std::string& dir) {
+    return ::mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Defines the sweep finding the instruction boundaries and the branch
+ * targets without decoding the operands.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+#include "byteclass.h"
+#include "bytespan.h"
+#include "state.h"
+
+/**
+ * @brief Sweeps [startAddr, endAddr] linearly as LinearSweepDisAssembler
+ * does, skipping a byte after each failure, but decodes only the length and
+ * the branch target of each instruction (see State::decodeLength()).
+ * @param bytes The bytes to sweep.
+ * @param startAddr The starting address.
+ * @param endAddr The last address, included.
+ * @param visit Called with each InstructionBoundary in the address order.
+ * @param stats The counters updated, if any.
+ * @return The number of bytes failing to decode.
+ */
+template <typename F>
+uint64_t sweepBoundaries(ByteSpan bytes, uint64_t startAddr, uint64_t endAddr,
+                         F visit, DecodeStats* stats = nullptr) {
+    if (bytes.empty()) {
+        return 0;
+    }
+    endAddr = std::min<uint64_t>(endAddr, bytes.size() - 1);
+    State state(bytes);
+    state.stats = stats;
+    ByteClassMap byteClasses;
+    byteClasses.build(bytes, startAddr, startAddr + BYTE_CLASS_BLOCK_SIZE);
+    state.byteClasses = &byteClasses;
+
+    uint64_t failed = 0;
+    for (uint64_t addr = startAddr; addr <= endAddr;) {
+        if (!byteClasses.covers(addr)) {
+            byteClasses.build(bytes, addr, addr + BYTE_CLASS_BLOCK_SIZE);
+        }
+        if (state.decodeLength(addr) == DecodeStatus::OK) {
+            visit(state.boundary);
+            addr += state.boundary.length;
+        } else {
+            failed++;
+            addr++;
+        }
+    }
+    return failed;
+}
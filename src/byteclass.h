@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @brief Defines the classification of bytes used by the prefix decoding.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MYDISAS_X86_SIMD 1
+#endif
+
+#include "bytespan.h"
+#include "constants.h"
+
+/**
+ * @brief The class bits of a byte, as the first byte of a prefix or opcode.
+ */
+enum ByteClass : uint8_t {
+    BYTE_INSTRUCTION_PREFIX = 1 << 0, /**< lock/rep/bnd/notrack */
+    BYTE_SEGMENT_PREFIX = 1 << 1,     /**< fs/gs segment override */
+    BYTE_OPERAND_SIZE_PREFIX = 1 << 2, /**< 0x66 */
+    BYTE_REX = 1 << 3,                /**< 0x40-0x4F */
+    BYTE_TWO_BYTES_OPCODE = 1 << 4,   /**< TWO_BYTES_OPCODE_PREFIX */
+    BYTE_ENDBR = 1 << 5, /**< The start of f3 0f 1e fa or f3 0f 1e fb */
+};
+
+/**
+ * @brief Builds the classes of the single bytes (all but BYTE_ENDBR).
+ */
+struct ByteClassTable {
+    uint8_t classes[256];
+
+    constexpr ByteClassTable() : classes{} {
+        for (int byte : INSTRUCTION_PREFIXES) {
+            classes[byte] |= BYTE_INSTRUCTION_PREFIX;
+        }
+        classes[0x64] |= BYTE_SEGMENT_PREFIX;
+        classes[0x65] |= BYTE_SEGMENT_PREFIX;
+        classes[0x66] |= BYTE_OPERAND_SIZE_PREFIX;
+        for (int byte = 0x40; byte <= 0x4F; byte++) {
+            classes[byte] |= BYTE_REX;
+        }
+        for (int byte : TWO_BYTES_OPCODE_PREFIX) {
+            classes[byte] |= BYTE_TWO_BYTES_OPCODE;
+        }
+    }
+};
+
+constexpr ByteClassTable BYTE_CLASS_TABLE;
+
+/**
+ * @brief Classifies the byte at the address, looking ahead for endbr.
+ * @param bytes The object source.
+ * @param addr The address, which must be within the bytes.
+ */
+inline uint8_t classifyByte(ByteSpan bytes, uint64_t addr) {
+    uint8_t cls = BYTE_CLASS_TABLE.classes[bytes[addr]];
+    if (bytes[addr] == 0xF3 && addr + 3 < bytes.size() &&
+        bytes[addr + 1] == 0x0F && bytes[addr + 2] == 0x1E &&
+        (bytes[addr + 3] | 1) == 0xFB) {
+        cls |= BYTE_ENDBR;
+    }
+    return cls;
+}
+
+#ifdef MYDISAS_X86_SIMD
+namespace byteclass_detail {
+
+/**
+ * @brief Classifies VEC bytes at p with the vector type of the target.
+ * The bytes up to p + VEC + 3 must be readable.
+ */
+#define MYDISAS_CLASSIFY_BODY(VEC, LOADU, STOREU, SET1, EQ, AND, OR)       \
+    VEC v = LOADU((const VEC*)p);                                         \
+    VEC v1 = LOADU((const VEC*)(p + 1));                                  \
+    VEC v2 = LOADU((const VEC*)(p + 2));                                  \
+    VEC v3 = LOADU((const VEC*)(p + 3));                                  \
+    VEC instructionPrefix =                                               \
+        OR(OR(EQ(v, SET1((char)0xF0)), EQ(v, SET1((char)0xF2))),          \
+           OR(EQ(v, SET1((char)0xF3)), EQ(v, SET1((char)0x3E))));         \
+    VEC segment = OR(EQ(v, SET1(0x64)), EQ(v, SET1(0x65)));               \
+    VEC operandSize = EQ(v, SET1(0x66));                                  \
+    VEC rex = EQ(AND(v, SET1((char)0xF0)), SET1(0x40));                   \
+    VEC twoBytes =                                                        \
+        OR(OR(EQ(v, SET1(0x0F)), EQ(v, SET1((char)0xD8))),                \
+           OR(EQ(v, SET1((char)0xD9)), EQ(v, SET1((char)0xDC))));         \
+    VEC endbr =                                                           \
+        AND(AND(EQ(v, SET1((char)0xF3)), EQ(v1, SET1(0x0F))),             \
+            AND(EQ(v2, SET1(0x1E)),                                       \
+                EQ(OR(v3, SET1(1)), SET1((char)0xFB))));                  \
+    VEC cls = OR(                                                         \
+        OR(OR(AND(instructionPrefix, SET1(BYTE_INSTRUCTION_PREFIX)),      \
+              AND(segment, SET1(BYTE_SEGMENT_PREFIX))),                   \
+           OR(AND(operandSize, SET1(BYTE_OPERAND_SIZE_PREFIX)),           \
+              AND(rex, SET1(BYTE_REX)))),                                 \
+        OR(AND(twoBytes, SET1(BYTE_TWO_BYTES_OPCODE)),                    \
+           AND(endbr, SET1(BYTE_ENDBR))));                                \
+    STOREU((VEC*)out, cls);
+
+/**
+ * @brief Classifies n bytes at p, 16 at a time, with SSE2.
+ * @return The number of bytes classified.
+ */
+inline size_t classifySSE2(const unsigned char* p, size_t n, uint8_t* out) {
+    size_t done = 0;
+    for (; done + 16 <= n; done += 16, p += 16, out += 16) {
+        MYDISAS_CLASSIFY_BODY(__m128i, _mm_loadu_si128, _mm_storeu_si128,
+                              _mm_set1_epi8, _mm_cmpeq_epi8, _mm_and_si128,
+                              _mm_or_si128)
+    }
+    return done;
+}
+
+/**
+ * @brief Classifies n bytes at p, 32 at a time, with AVX2.
+ * @return The number of bytes classified.
+ */
+__attribute__((target("avx2"))) inline size_t classifyAVX2(
+    const unsigned char* p, size_t n, uint8_t* out) {
+    size_t done = 0;
+    for (; done + 32 <= n; done += 32, p += 32, out += 32) {
+        MYDISAS_CLASSIFY_BODY(__m256i, _mm256_loadu_si256, _mm256_storeu_si256,
+                              _mm256_set1_epi8, _mm256_cmpeq_epi8,
+                              _mm256_and_si256, _mm256_or_si256)
+    }
+    return done;
+}
+
+#undef MYDISAS_CLASSIFY_BODY
+
+inline bool hasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+}  // namespace byteclass_detail
+#endif
+
+/**
+ * @brief The implementations of classifyBytes().
+ */
+enum class ClassifyMode { AUTO, SCALAR };
+
+/**
+ * @brief Classifies the bytes of [startAddr, endAddr) in bulk.
+ * @param bytes The object source.
+ * @param startAddr The first byte to classify.
+ * @param endAddr The byte past the last one, at most bytes.size().
+ * @param out Receives endAddr - startAddr classes.
+ * @param mode SCALAR skips the vectorized paths.
+ */
+inline void classifyBytes(ByteSpan bytes, uint64_t startAddr,
+                          uint64_t endAddr, uint8_t* out,
+                          ClassifyMode mode = ClassifyMode::AUTO) {
+    uint64_t addr = startAddr;
+#ifdef MYDISAS_X86_SIMD
+    if (mode == ClassifyMode::AUTO) {
+        // the vectors look 3 bytes ahead for endbr
+        uint64_t end = std::min<uint64_t>(
+            endAddr, bytes.size() >= 3 ? bytes.size() - 3 : 0);
+        if (end > addr) {
+            size_t done =
+                byteclass_detail::hasAVX2()
+                    ? byteclass_detail::classifyAVX2(bytes.data() + addr,
+                                                     end - addr, out)
+                    : 0;
+            done += byteclass_detail::classifySSE2(
+                bytes.data() + addr + done, end - addr - done, out + done);
+            addr += done;
+        }
+    }
+#endif
+    for (; addr < endAddr; addr++) {
+        out[addr - startAddr] = classifyByte(bytes, addr);
+    }
+}
+
+/**
+ * @brief The number of bytes classified at a time ahead of a sweep, small
+ * enough for the classes to stay in the cache while they are read.
+ */
+const size_t BYTE_CLASS_BLOCK_SIZE = 1 << 16;
+
+/**
+ * @class ByteClassMap
+ * @brief Keeps the classes of a range of bytes, computed in bulk ahead of
+ * a sweep so that the decoder reads one class instead of testing each
+ * prefix in turn.
+ */
+class ByteClassMap {
+   public:
+    /**
+     * @brief Classifies [startAddr, endAddr) of the bytes, reusing the
+     * memory of the previous range.
+     */
+    void build(ByteSpan bytes, uint64_t startAddr, uint64_t endAddr,
+               ClassifyMode mode = ClassifyMode::AUTO) {
+        endAddr = std::min<uint64_t>(endAddr, bytes.size());
+        startAddr = std::min(startAddr, endAddr);
+        base = startAddr;
+        classes.resize(endAddr - startAddr);
+        classifyBytes(bytes, startAddr, endAddr, classes.data(), mode);
+    }
+
+    /**
+     * @brief Checks whether the address is within the classified range.
+     */
+    bool covers(uint64_t addr) const {
+        return addr - base < classes.size();
+    }
+
+    /**
+     * @brief Returns the class of a covered address.
+     */
+    uint8_t operator[](uint64_t addr) const { return classes[addr - base]; }
+
+   private:
+    uint64_t base = 0;
+    std::vector<uint8_t> classes;
+};
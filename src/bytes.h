@@ -48,9 +48,6 @@ struct ModRM {
     int regByte;
     int rmByte;
 
-    // std::string addressingMode;
-    // std::string reg;
-
     bool hasDisp8;
     bool hasDisp32;
     bool hasSib;
@@ -108,77 +105,6 @@ struct ModRM {
             hasDisp32 = true;
         }
     }
-
-    /**
-     * @brief Gets the register name based on the operand type.
-     * @param operand The operand type.
-     * @return The register name.
-     */
-    std::string getReg(Operand operand) {
-        if (operand == Operand::xmm) {
-            return "xmm" + std::to_string(regByte + (rex.rexR ? 8 : 0));
-        } else {
-            return operand2register(operand)->at(regByte + (rex.rexR ? 8 : 0));
-        }
-    }
-
-    /**
-     * @brief Generates the addressing mode string.
-     * @param operand The operand type.
-     * @param disp8 The 8-bit displacement.
-     * @param disp32 The 32-bit displacement.
-     * @return The addressing mode string.
-     */
-    std::string getAddrMode(Operand operand, std::string disp8,
-                            std::string disp32) {
-        std::string addrBaseReg;
-        if (modByte == 3) {
-            if (operand == Operand::xm128) {
-                addrBaseReg =
-                    "xmm" + std::to_string(rmByte + (rex.rexB ? 8 : 0));
-            } else {
-                addrBaseReg =
-                    operand2register(operand)->at(rmByte + (rex.rexB ? 8 : 0));
-            }
-        } else {
-            if (operand == Operand::xm128) {
-                addrBaseReg =
-                    "xmm" + std::to_string(rmByte + (rex.rexB ? 8 : 0));
-            } else {
-                addrBaseReg = REGISTERS64.at(rmByte + (rex.rexB ? 8 : 0));
-            }
-        }
-
-        if (modByte < 3 && rmByte == 4) {
-            addrBaseReg = "SIB";
-        }
-
-        std::string addressingMode;
-        switch (modByte) {
-            case 0: {
-                addressingMode = "[" + addrBaseReg + "]";
-                break;
-            }
-            case 1: {
-                addressingMode = "[" + addrBaseReg + disp8 + "]";
-                break;
-            }
-            case 2: {
-                addressingMode = "[" + addrBaseReg + disp32 + "]";
-                break;
-            }
-            case 3: {
-                addressingMode = addrBaseReg;
-                break;
-            }
-        }
-
-        if (modByte == 0 && rmByte == 5) {
-            addressingMode = "[rip" + disp32 + "]";
-        }
-
-        return addressingMode;
-    }
 };
 
 /**
@@ -193,16 +119,19 @@ struct SIB {
     unsigned char modByte;
     REX rex;
 
-    std::string address;
-    std::string addrBaseReg, indexReg;
-    int scale;
     bool hasDisp8;
     bool hasDisp32;
 
     /**
      * @brief Default constructor for SIB.
      */
-    SIB() : hasDisp8(false), hasDisp32(false) {}
+    SIB()
+        : scaleByte(0),
+          indexByte(0),
+          baseByte(0),
+          modByte(0),
+          hasDisp8(false),
+          hasDisp32(false) {}
 
     /**
      * @brief Constructor for SIB with byte parameters.
@@ -219,62 +148,5 @@ struct SIB {
         hasDisp8 = baseByte == 5 && modByte == 1;
         hasDisp32 = baseByte == 5 && modByte != 1;
     }
-
-    /**
-     * @brief Generates the address string.
-     * @param operand The operand type.
-     * @param disp8 The 8-bit displacement.
-     * @param disp32 The 32-bit displacement.
-     * @return The address string.
-     */
-    std::string getAddr(Operand operand, std::string disp8,
-                        std::string disp32) {
-        std::string offset = "";
-
-        if (baseByte == 5) {
-            switch (modByte) {
-                case 0: {
-                    if (disp32.size() > 2) {
-                        if (disp32[1] == '+') {
-                            addrBaseReg = disp32.substr(3, disp32.size() - 3);
-                        } else {
-                            addrBaseReg =
-                                "-" + disp32.substr(3, disp32.size() - 3);
-                        }
-                    }
-                    break;
-                }
-                case 1: {
-                    addrBaseReg = rex.rexB ? "r13" : "rbp";
-                    offset = disp8;
-                    break;
-                }
-                case 2: {
-                    addrBaseReg = rex.rexB ? "r13" : "rbp";
-                    offset = disp32;
-                    break;
-                }
-            }
-        } else {
-            addrBaseReg = REGISTERS64.at(baseByte + (rex.rexB ? 8 : 0));
-            if (modByte == 1) {
-                offset = disp8;
-            } else if (modByte == 2) {
-                offset = disp32;
-            }
-        }
-
-        if (modByte == 0 && baseByte == 5 && indexByte == 4) {
-            address = addrBaseReg;
-        } else if (indexByte == 4 && (!rex.rexX)) {
-            address = "[" + addrBaseReg + offset + "]";
-        } else {
-            indexReg = REGISTERS64.at(indexByte + (rex.rexX ? 8 : 0));
-            scale = SCALE_FACTOR.at(scaleByte);
-            address = "[" + addrBaseReg + " + " + indexReg + " * " +
-                      std::to_string(scale) + offset + "]";
-        }
-        return address;
-    }
 };
 
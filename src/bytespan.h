@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @brief Defines a non-owning view of bytes and a memory-mapped file.
+ */
+
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct ByteSpan
+ * @brief Represents a read-only view of contiguous bytes owned by someone
+ * else (e.g. a std::vector or a memory-mapped file).
+ */
+struct ByteSpan {
+    const unsigned char* ptr; /**< The first byte */
+    size_t len;               /**< The number of bytes */
+
+    ByteSpan() : ptr(nullptr), len(0) {}
+    ByteSpan(const unsigned char* ptr, size_t len) : ptr(ptr), len(len) {}
+
+    /**
+     * @brief Views the contents of the vector. The vector must outlive the
+     * span and must not be resized.
+     */
+    ByteSpan(const std::vector<unsigned char>& bytes)
+        : ptr(bytes.data()), len(bytes.size()) {}
+
+    const unsigned char* data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+
+    const unsigned char* begin() const { return ptr; }
+    const unsigned char* end() const { return ptr + len; }
+
+    const unsigned char& operator[](size_t i) const { return ptr[i]; }
+
+    /**
+     * @brief Returns the view of [offset, offset + count), clamped to the
+     * end of the span.
+     */
+    ByteSpan subspan(size_t offset, size_t count = (size_t)-1) const {
+        if (offset > len) {
+            return ByteSpan(ptr + len, 0);
+        }
+        return ByteSpan(ptr + offset, std::min(count, len - offset));
+    }
+};
+
+/**
+ * @class MappedFile
+ * @brief Maps a file into memory read-only, so that only the pages actually
+ * accessed are faulted in. Falls back to read() when the file cannot be
+ * mapped (e.g. pipes).
+ */
+class MappedFile {
+   public:
+    MappedFile() : addr(nullptr), len(0) {}
+
+    /**
+     * @brief Opens and maps the file.
+     * @param path The path of the file.
+     */
+    explicit MappedFile(const std::string& path) : addr(nullptr), len(0) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open object file: " + path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ,
+                             MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                addr = p;
+                len = (size_t)st.st_size;
+            }
+        }
+
+        if (addr == nullptr && !readAll(fd)) {
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to read object file: " + path +
+                                     ": " + std::strerror(err));
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : addr(other.addr), len(other.len), buf(std::move(other.buf)) {
+        other.addr = nullptr;
+        other.len = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            addr = other.addr;
+            len = other.len;
+            buf = std::move(other.buf);
+            other.addr = nullptr;
+            other.len = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile() { unmap(); }
+
+    /**
+     * @brief Checks whether the contents are memory-mapped.
+     */
+    bool isMapped() const { return addr != nullptr; }
+
+    /**
+     * @brief Returns the view of the whole file.
+     */
+    ByteSpan bytes() const {
+        if (addr != nullptr) {
+            return ByteSpan(static_cast<const unsigned char*>(addr), len);
+        }
+        return ByteSpan(buf);
+    }
+
+   private:
+    void* addr;                     /**< The mapped address, or nullptr */
+    size_t len;                     /**< The length of the mapping */
+    std::vector<unsigned char> buf; /**< The contents when not mapped */
+
+    bool readAll(int fd) {
+        unsigned char chunk[1 << 16];
+        while (true) {
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n == 0) {
+                return true;
+            } else if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            buf.insert(buf.end(), chunk, chunk + n);
+        }
+    }
+
+    void unmap() {
+        if (addr != nullptr) {
+            ::munmap(addr, len);
+            addr = nullptr;
+            len = 0;
+        }
+    }
+};
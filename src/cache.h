@@ -0,0 +1,291 @@
+/**
+ * @file
+ * @brief Defines an on-disk cache of the disassembled sections.
+ */
+
+#pragma once
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "bytespan.h"
+#include "disassembler.h"
+#include "table.h"
+
+/**
+ * @brief The version of the layout of the cache files.
+ */
+const uint32_t DECODE_CACHE_FORMAT_VERSION = 2;
+
+/**
+ * @brief The first bytes of every cache file.
+ */
+const char DECODE_CACHE_MAGIC[8] = {'M', 'Y', 'D', 'I', 'S', 'C', 'C', 0};
+
+/**
+ * @struct DecodeCacheHeader
+ * @brief The header of a cache file. It is followed by the instruction
+ * records, the error addresses, the decode errors and the string pool.
+ */
+struct DecodeCacheHeader {
+    char magic[8];           /**< DECODE_CACHE_MAGIC */
+    uint32_t formatVersion;  /**< DECODE_CACHE_FORMAT_VERSION */
+    uint32_t tableVersion;   /**< DECODER_TABLE_VERSION */
+    uint64_t key;            /**< The key the file is stored under */
+    uint64_t numRecords;     /**< The number of StoredInstruction records */
+    uint64_t numErrorAddrs;  /**< The number of pending error addresses */
+    uint64_t numErrors;      /**< The number of DecodeError records */
+    uint64_t poolSize;       /**< The length of the string pool */
+};
+
+static_assert(std::is_trivially_copyable<StoredInstruction>::value,
+              "StoredInstruction is written as is");
+static_assert(std::is_trivially_copyable<DecodeError>::value,
+              "DecodeError is written as is");
+
+/**
+ * @brief Mixes the bytes into the 64-bit hash, 8 bytes at a time.
+ * @param bytes The bytes to hash.
+ * @param seed The hash so far.
+ * @return The new hash.
+ */
+inline uint64_t hashBytes(ByteSpan bytes, uint64_t seed = 0) {
+    const uint64_t PRIME = 0x100000001b3ULL;
+    uint64_t h = seed ^ 0xcbf29ce484222325ULL ^ (bytes.size() * PRIME);
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        h = (h ^ word) * PRIME;
+        h ^= h >> 29;
+    }
+    for (; i < bytes.size(); i++) {
+        h = (h ^ bytes[i]) * PRIME;
+    }
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t hashBytes(std::string_view str, uint64_t seed = 0) {
+    return hashBytes(
+        ByteSpan(reinterpret_cast<const unsigned char*>(str.data()),
+                 str.size()),
+        seed);
+}
+
+inline uint64_t hashBytes(uint64_t val, uint64_t seed = 0) {
+    return hashBytes(
+        ByteSpan(reinterpret_cast<const unsigned char*>(&val), sizeof(val)),
+        seed);
+}
+
+/**
+ * @class DecodeCache
+ * @brief Stores the results of disassembling a section in a directory, one
+ * file per key, and loads them back through a memory mapping.
+ *
+ * The key is chosen by the caller and must cover everything the results
+ * depend on (the bytes and the strategy); the table version is checked on
+ * loading. A missing, outdated or corrupted file is a miss.
+ */
+class DecodeCache {
+   public:
+    /**
+     * @brief Creates a disabled cache.
+     */
+    DecodeCache() = default;
+
+    /**
+     * @brief Creates the cache over the directory, created if needed when
+     * the first file is saved.
+     */
+    explicit DecodeCache(std::string dir) : dir(std::move(dir)) {}
+
+    bool enabled() const { return !dir.empty(); }
+
+    /**
+     * @brief Returns the path of the file of the key.
+     */
+    std::string path(uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.mdc",
+                      (unsigned long long)key);
+        return dir + "/" + name;
+    }
+
+    /**
+     * @brief Loads the results stored under the key into the disassembler,
+     * as if it had decoded them.
+     * @return False on a miss, leaving the disassembler untouched.
+     */
+    bool load(uint64_t key, DisAssembler& da) const {
+        if (!enabled()) {
+            return false;
+        }
+        MappedFile file;
+        try {
+            file = MappedFile(path(key));
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        ByteSpan bytes = file.bytes();
+
+        DecodeCacheHeader header;
+        if (bytes.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, DECODE_CACHE_MAGIC, 8) != 0 ||
+            header.formatVersion != DECODE_CACHE_FORMAT_VERSION ||
+            header.tableVersion != DECODER_TABLE_VERSION ||
+            header.key != key) {
+            return false;
+        }
+
+        // each count is checked against the bytes left before it is
+        // multiplied, so that a corrupted header cannot overflow the sizes
+        size_t left = bytes.size() - sizeof(header);
+        if (header.numRecords > left / sizeof(StoredInstruction)) {
+            return false;
+        }
+        size_t recordsSize = header.numRecords * sizeof(StoredInstruction);
+        left -= recordsSize;
+        if (header.numErrorAddrs > left / sizeof(uint64_t)) {
+            return false;
+        }
+        size_t errorAddrsSize = header.numErrorAddrs * sizeof(uint64_t);
+        left -= errorAddrsSize;
+        if (header.numErrors > left / sizeof(DecodeError)) {
+            return false;
+        }
+        size_t errorsSize = header.numErrors * sizeof(DecodeError);
+        left -= errorsSize;
+        if (header.poolSize != left) {
+            return false;
+        }
+
+        const unsigned char* p = bytes.data() + sizeof(header);
+        std::vector<StoredInstruction> records(header.numRecords);
+        std::memcpy(records.data(), p, recordsSize);
+        p += recordsSize;
+        std::vector<uint64_t> errorAddrs(header.numErrorAddrs);
+        std::memcpy(errorAddrs.data(), p, errorAddrsSize);
+        p += errorAddrsSize;
+        std::vector<DecodeError> errors(header.numErrors);
+        std::memcpy(errors.data(), p, errorsSize);
+        p += errorsSize;
+        std::string_view pool(reinterpret_cast<const char*>(p),
+                              header.poolSize);
+
+        for (const StoredInstruction& record : records) {
+            if (record.strOffset > pool.size() ||
+                record.strSize > pool.size() - record.strOffset) {
+                return false;
+            }
+        }
+
+        for (const StoredInstruction& record : records) {
+            std::string_view str =
+                pool.substr(record.strOffset, record.strSize);
+            da.disassembledInstructions.put(record.startAddr,
+                                            record.endAddr(), str,
+                                            record.labelAddr);
+            if (str != UNKNOWN_INSTRUCTION) {
+                da.maxInstructionStrSize =
+                    std::max(da.maxInstructionStrSize, str.size());
+            }
+        }
+        da.errorAddrs.insert(da.errorAddrs.end(), errorAddrs.begin(),
+                             errorAddrs.end());
+        for (const DecodeError& error : errors) {
+            da.errorReport.add(error);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Stores the results of the disassembler under the key. The file
+     * is written next to its final path and renamed, so that concurrent
+     * readers never see a partial file.
+     * @return False if the file could not be written.
+     */
+    bool save(uint64_t key, const DisAssembler& da) const {
+        if (!enabled()) {
+            return false;
+        }
+        if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+
+        std::vector<StoredInstruction> records;
+        std::string pool;
+        for (const StoredInstruction& record : da.disassembledInstructions) {
+            std::string_view str = da.disassembledInstructions.str(record);
+            records.push_back(record);
+            records.back().strOffset = pool.size();
+            pool.append(str.data(), str.size());
+        }
+        const std::vector<DecodeError>& errors = da.errorReport.errors;
+
+        DecodeCacheHeader header = {};
+        std::memcpy(header.magic, DECODE_CACHE_MAGIC, 8);
+        header.formatVersion = DECODE_CACHE_FORMAT_VERSION;
+        header.tableVersion = DECODER_TABLE_VERSION;
+        header.key = key;
+        header.numRecords = records.size();
+        header.numErrorAddrs = da.errorAddrs.size();
+        header.numErrors = errors.size();
+        header.poolSize = pool.size();
+
+        std::string finalPath = path(key);
+        std::string tmpPath =
+            finalPath + ".tmp." + std::to_string((long long)::getpid());
+        int fd = ::open(tmpPath.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = writeAll(fd, &header, sizeof(header)) &&
+                  writeAll(fd, records.data(),
+                           records.size() * sizeof(StoredInstruction)) &&
+                  writeAll(fd, da.errorAddrs.data(),
+                           da.errorAddrs.size() * sizeof(uint64_t)) &&
+                  writeAll(fd, errors.data(),
+                           errors.size() * sizeof(DecodeError)) &&
+                  writeAll(fd, pool.data(), pool.size());
+        ok = (::close(fd) == 0) && ok;
+        if (!ok || ::rename(tmpPath.c_str(), finalPath.c_str()) != 0) {
+            ::unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    std::string dir; /**< The directory of the files, or "" if disabled */
+
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,518 @@
+/**
+ * @file
+ * @brief Defines the control flow graph of the disassembled instructions.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "store.h"
+
+/**
+ * @brief The block id of an edge whose target is not a decoded block, e.g.
+ * an indirect jump or a target out of the disassembled ranges.
+ */
+constexpr uint32_t NO_BLOCK = ~0U;
+
+/**
+ * @brief The target of an indirect control transfer.
+ */
+constexpr uint64_t INDIRECT_TARGET = ~0ULL;
+
+/**
+ * @enum EdgeKind
+ * @brief The kind of an edge between two basic blocks.
+ */
+enum class EdgeKind : uint8_t {
+    FALLTHROUGH, /**< To the next instruction */
+    BRANCH,      /**< To the target of a taken conditional jump */
+    JUMP,        /**< To the target of an unconditional jump */
+    CALL,        /**< To the called function */
+    LOOP,        /**< To the target of a taken loop instruction */
+};
+
+inline const char* to_string(EdgeKind kind) {
+    switch (kind) {
+        case EdgeKind::FALLTHROUGH:
+            return "fallthrough";
+        case EdgeKind::BRANCH:
+            return "branch";
+        case EdgeKind::JUMP:
+            return "jump";
+        case EdgeKind::CALL:
+            return "call";
+        case EdgeKind::LOOP:
+            return "loop";
+    }
+    return "";
+}
+
+/**
+ * @struct ControlTransfer
+ * @brief Represents a decoded instruction ending a basic block.
+ */
+struct ControlTransfer {
+    uint64_t addr;     /**< The address of the instruction */
+    uint64_t nextAddr; /**< The address past the instruction */
+    uint64_t target;   /**< The branch target, or INDIRECT_TARGET */
+    Mnemonic mnemonic; /**< The mnemonic of the instruction */
+};
+
+/**
+ * @class TransferLog
+ * @brief Records the control transfers as the disassembler stores the
+ * instructions, so that the graph is built without decoding them again.
+ *
+ * The transfers are kept in runs of about STORE_CHUNK_SIZE, so that the ones
+ * of a range are replaced by moving only the transfers of its run.
+ */
+class TransferLog {
+   public:
+    /**
+     * @brief Records the instruction if it ends a basic block.
+     * @param addr The address of the instruction.
+     * @param length The length of the instruction.
+     * @param mnemonic The mnemonic of the instruction.
+     * @param labelAddr The target of a relative branch, otherwise NO_LABEL.
+     */
+    void record(uint64_t addr, uint64_t length, Mnemonic mnemonic,
+                uint64_t labelAddr) {
+        if (mnemonic == Mnemonic::RET || isControlFlowInstruction(mnemonic)) {
+            push({addr, addr + length,
+                  labelAddr == NO_LABEL ? INDIRECT_TARGET : labelAddr,
+                  mnemonic});
+        }
+    }
+
+    /**
+     * @brief Adds the transfers of another log, recorded later.
+     * @param fromAddr Only the transfers from this address on are added.
+     */
+    void merge(const TransferLog& other, uint64_t fromAddr = 0) {
+        for (const Run& run : other.runs) {
+            for (const ControlTransfer& t : run) {
+                if (t.addr >= fromAddr) {
+                    push(t);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Forgets the transfers of [startAddr, endAddr), whose bytes are
+     * decoded again.
+     */
+    void erase(uint64_t startAddr, uint64_t endAddr) {
+        eraseIf([&](const ControlTransfer& t) {
+            return t.addr >= startAddr && t.addr < endAddr;
+        });
+    }
+
+    /**
+     * @brief Replaces the transfers of the spans [first, second), sorted and
+     * disjoint, with the ones of another log, all within the spans, as
+     * erasing them and merge() would. While the transfers are in the address
+     * order, only the runs of the spans are moved and the order is kept.
+     */
+    void replace(const std::vector<std::pair<uint64_t, uint64_t>>& spans,
+                 const TransferLog& other) {
+        if (!inOrder) {
+            eraseIf([&](const ControlTransfer& t) {
+                auto it = std::upper_bound(
+                    spans.begin(), spans.end(), t.addr,
+                    [](uint64_t addr,
+                       const std::pair<uint64_t, uint64_t>& span) {
+                        return addr < span.first;
+                    });
+                return it != spans.begin() && t.addr < std::prev(it)->second;
+            });
+            merge(other);
+            return;
+        }
+        std::vector<ControlTransfer> added = other.all();
+        std::stable_sort(added.begin(), added.end(),
+                         [](const ControlTransfer& a,
+                            const ControlTransfer& b) {
+                             return a.addr < b.addr;
+                         });
+        size_t i = 0;
+        for (const std::pair<uint64_t, uint64_t>& span : spans) {
+            TransferLog piece;
+            for (; i < added.size() && added[i].addr < span.second; i++) {
+                piece.push(added[i]);
+            }
+            replace(span.first, span.second, piece);
+        }
+    }
+
+    /**
+     * @brief Forgets the transfers the predicate holds for, keeping the
+     * order of the others.
+     */
+    template <typename F>
+    void eraseIf(F isErased) {
+        for (Run& run : runs) {
+            run.erase(std::remove_if(run.begin(), run.end(), isErased),
+                      run.end());
+        }
+        dropEmptyRuns(0, runs.size());
+    }
+
+    /**
+     * @brief Replaces the transfers of [startAddr, endAddr) with the ones of
+     * another log, all in the range, as erase() and merge() would. While the
+     * transfers have been recorded in the address order, as a linear sweep
+     * does, only the run of the range is moved and the order is kept.
+     */
+    void replace(uint64_t startAddr, uint64_t endAddr,
+                 const TransferLog& other) {
+        if (!inOrder || !other.inOrder) {
+            erase(startAddr, endAddr);
+            merge(other);
+            return;
+        }
+        auto byAddr = [](const ControlTransfer& t, uint64_t addr) {
+            return t.addr < addr;
+        };
+        size_t first = std::partition_point(runs.begin(), runs.end(),
+                                            [&](const Run& run) {
+                                                return run.back().addr <
+                                                       startAddr;
+                                            }) -
+                       runs.begin();
+        size_t last = first;
+        for (; last < runs.size(); last++) {
+            Run& run = runs[last];
+            auto from = std::lower_bound(run.begin(), run.end(), startAddr,
+                                         byAddr);
+            auto to = std::lower_bound(from, run.end(), endAddr, byAddr);
+            run.erase(from, to);
+            if (!run.empty() && run.back().addr >= endAddr) {
+                break;
+            }
+        }
+        dropEmptyRuns(first, std::min(last + 1, runs.size()));
+
+        std::vector<ControlTransfer> added = other.all();
+        if (added.empty()) {
+            return;
+        }
+        if (runs.empty()) {
+            runs.push_back(added);
+            return;
+        }
+        // into the run of the first transfer past the range, or the last one
+        size_t i = std::min(first, runs.size() - 1);
+        Run& run = runs[i];
+        auto at = std::lower_bound(run.begin(), run.end(), startAddr, byAddr);
+        run.insert(at, added.begin(), added.end());
+        if (run.size() >= 2 * STORE_CHUNK_SIZE) {
+            Run rest(run.begin() + run.size() / 2, run.end());
+            run.resize(run.size() / 2);
+            runs.insert(runs.begin() + i + 1, std::move(rest));
+        }
+    }
+
+    /**
+     * @brief Returns the transfers in the order they have been recorded, or
+     * replaced in the address order (see replace()).
+     */
+    std::vector<ControlTransfer> all() const {
+        std::vector<ControlTransfer> transfers;
+        for (const Run& run : runs) {
+            transfers.insert(transfers.end(), run.begin(), run.end());
+        }
+        return transfers;
+    }
+
+   private:
+    using Run = std::vector<ControlTransfer>;
+
+    std::vector<Run> runs; /**< None of them empty */
+    bool inOrder = true;   /**< Whether each transfer is past the previous */
+
+    void push(const ControlTransfer& t) {
+        if (!runs.empty()) {
+            inOrder = inOrder && runs.back().back().addr < t.addr;
+        }
+        if (runs.empty() || runs.back().size() >= STORE_CHUNK_SIZE) {
+            runs.emplace_back();
+        }
+        runs.back().push_back(t);
+    }
+
+    void dropEmptyRuns(size_t first, size_t last) {
+        runs.erase(std::remove_if(runs.begin() + first, runs.begin() + last,
+                                  [](const Run& run) { return run.empty(); }),
+                   runs.begin() + last);
+    }
+};
+
+/**
+ * @struct BasicBlock
+ * @brief Represents a run of instructions entered only at its start and left
+ * only at its end.
+ */
+struct BasicBlock {
+    uint64_t startAddr;        /**< The address of the first instruction */
+    uint64_t endAddr;          /**< The address past the last instruction */
+    uint64_t lastAddr;         /**< The address of the last instruction */
+    uint32_t numInstructions;  /**< The number of instructions */
+};
+
+/**
+ * @struct Edge
+ * @brief Represents an edge to another basic block.
+ */
+struct Edge {
+    uint64_t targetAddr; /**< The target, or INDIRECT_TARGET */
+    uint32_t block;      /**< The id of the other block, or NO_BLOCK */
+    EdgeKind kind;       /**< The kind of the edge */
+};
+
+/**
+ * @class ControlFlowGraph
+ * @brief Keeps the basic blocks in the address order, with their successors
+ * and predecessors in compact adjacency arrays: the edges of block b are
+ * those from offsets[b] to offsets[b + 1].
+ */
+class ControlFlowGraph {
+   public:
+    /**
+     * @brief A run of edges of a block.
+     */
+    struct Edges {
+        const Edge* first;
+        const Edge* last;
+
+        size_t size() const { return last - first; }
+        const Edge& operator[](size_t i) const { return first[i]; }
+        const Edge* begin() const { return first; }
+        const Edge* end() const { return last; }
+    };
+
+    ControlFlowGraph() = default;
+
+    /**
+     * @brief Builds the graph of the stored instructions.
+     * @param store The disassembled instructions.
+     * @param log The control transfers recorded while storing them.
+     * @param entries The addresses the functions start at, in addition to
+     * the targets of the calls.
+     */
+    ControlFlowGraph(const InstructionStore& store, const TransferLog& log,
+                     std::vector<uint64_t> entries) {
+        // the latest transfer recorded at an address wins
+        std::vector<ControlTransfer> transfers = log.all();
+        std::stable_sort(
+            transfers.begin(), transfers.end(),
+            [](const ControlTransfer& a, const ControlTransfer& b) {
+                return a.addr < b.addr;
+            });
+        std::vector<ControlTransfer> ends;
+        for (size_t i = 0; i < transfers.size(); i++) {
+            if (i + 1 < transfers.size() &&
+                transfers[i + 1].addr == transfers[i].addr) {
+                continue;
+            }
+            const StoredInstruction* record =
+                store.findStartingAt(transfers[i].addr);
+            if (record != nullptr &&
+                record->endAddr() == transfers[i].nextAddr) {
+                ends.push_back(transfers[i]);
+            }
+        }
+
+        std::vector<uint64_t> leaders = entries;
+        for (const ControlTransfer& t : ends) {
+            leaders.push_back(t.nextAddr);
+            if (t.target != INDIRECT_TARGET) {
+                leaders.push_back(t.target);
+            }
+            if (t.mnemonic == Mnemonic::CALL && t.target != INDIRECT_TARGET) {
+                entries.push_back(t.target);
+            }
+        }
+        std::sort(leaders.begin(), leaders.end());
+
+        // cut the runs of contiguous instructions at the leaders
+        size_t nextLeader = 0;
+        size_t nextEnd = 0;
+        bool open = false;
+        for (const StoredInstruction& record : store) {
+            if (store.str(record) == UNKNOWN_INSTRUCTION) {
+                open = false;
+                continue;
+            }
+            while (nextLeader < leaders.size() &&
+                   leaders[nextLeader] < record.startAddr) {
+                nextLeader++;
+            }
+            bool isLeader = nextLeader < leaders.size() &&
+                            leaders[nextLeader] == record.startAddr;
+            if (!open || isLeader ||
+                blocks.back().endAddr != record.startAddr) {
+                blocks.push_back({record.startAddr, record.endAddr(),
+                                  record.startAddr, 0});
+                blockEnds.push_back(nullptr);
+            }
+            BasicBlock& block = blocks.back();
+            block.endAddr = record.endAddr();
+            block.lastAddr = record.startAddr;
+            block.numInstructions++;
+            open = true;
+
+            while (nextEnd < ends.size() &&
+                   ends[nextEnd].addr < record.startAddr) {
+                nextEnd++;
+            }
+            if (nextEnd < ends.size() &&
+                ends[nextEnd].addr == record.startAddr) {
+                blockEnds.back() = &ends[nextEnd];
+                open = false;
+            }
+        }
+
+        buildEdges();
+        std::sort(entries.begin(), entries.end());
+        entries.erase(std::unique(entries.begin(), entries.end()),
+                      entries.end());
+        for (uint64_t entry : entries) {
+            uint32_t b = blockStartingAt(entry);
+            if (b != NO_BLOCK) {
+                functions.push_back(b);
+            }
+        }
+        blockEnds.clear();
+    }
+
+    size_t size() const { return blocks.size(); }
+    const BasicBlock& operator[](size_t b) const { return blocks[b]; }
+    const std::vector<BasicBlock>& allBlocks() const { return blocks; }
+
+    /**
+     * @brief Returns the blocks the functions start at, in the address
+     * order.
+     */
+    const std::vector<uint32_t>& functionEntries() const { return functions; }
+
+    /**
+     * @brief Returns the edges leaving the block.
+     */
+    Edges successors(uint32_t b) const {
+        return {succ.data() + succOffsets[b], succ.data() + succOffsets[b + 1]};
+    }
+
+    /**
+     * @brief Returns the edges entering the block, each one with the id of
+     * the block it leaves.
+     */
+    Edges predecessors(uint32_t b) const {
+        return {pred.data() + predOffsets[b], pred.data() + predOffsets[b + 1]};
+    }
+
+    /**
+     * @brief Finds the block containing the address, by a binary search
+     * which leaves the graph as is, so that threads may share it.
+     * @return The id of the block, or NO_BLOCK.
+     */
+    uint32_t blockAt(uint64_t addr) const {
+        auto it = std::upper_bound(
+            blocks.begin(), blocks.end(), addr,
+            [](uint64_t a, const BasicBlock& block) {
+                return a < block.startAddr;
+            });
+        if (it == blocks.begin() || !contains(*(it - 1), addr)) {
+            return NO_BLOCK;
+        }
+        return (uint32_t)(it - 1 - blocks.begin());
+    }
+
+    /**
+     * @brief Finds the block starting at the address.
+     * @return The id of the block, or NO_BLOCK.
+     */
+    uint32_t blockStartingAt(uint64_t addr) const {
+        uint32_t b = blockAt(addr);
+        return b != NO_BLOCK && blocks[b].startAddr == addr ? b : NO_BLOCK;
+    }
+
+   private:
+    std::vector<BasicBlock> blocks;
+    std::vector<uint32_t> succOffsets;
+    std::vector<Edge> succ;
+    std::vector<uint32_t> predOffsets;
+    std::vector<Edge> pred;
+    std::vector<uint32_t> functions;
+
+    /**
+     * @brief The transfer ending each block while building, or nullptr.
+     */
+    std::vector<const ControlTransfer*> blockEnds;
+
+    static bool contains(const BasicBlock& block, uint64_t addr) {
+        return addr >= block.startAddr && addr < block.endAddr;
+    }
+
+    void addEdge(uint64_t targetAddr, EdgeKind kind) {
+        uint32_t b = targetAddr == INDIRECT_TARGET
+                         ? NO_BLOCK
+                         : blockStartingAt(targetAddr);
+        succ.push_back({targetAddr, b, kind});
+    }
+
+    void buildEdges() {
+        succOffsets.reserve(blocks.size() + 1);
+        for (size_t b = 0; b < blocks.size(); b++) {
+            succOffsets.push_back((uint32_t)succ.size());
+            const ControlTransfer* t = blockEnds[b];
+            if (t == nullptr) {
+                // a block cut by a leader falls through to the next one
+                if (b + 1 < blocks.size() &&
+                    blocks[b + 1].startAddr == blocks[b].endAddr) {
+                    addEdge(blocks[b].endAddr, EdgeKind::FALLTHROUGH);
+                }
+                continue;
+            }
+            if (t->mnemonic == Mnemonic::RET) {
+                continue;
+            } else if (t->mnemonic == Mnemonic::JMP) {
+                addEdge(t->target, EdgeKind::JUMP);
+                continue;
+            } else if (t->mnemonic == Mnemonic::CALL) {
+                addEdge(t->target, EdgeKind::CALL);
+            } else if (isLOOPInstruction(t->mnemonic)) {
+                addEdge(t->target, EdgeKind::LOOP);
+            } else {
+                addEdge(t->target, EdgeKind::BRANCH);
+            }
+            addEdge(t->nextAddr, EdgeKind::FALLTHROUGH);
+        }
+        succOffsets.push_back((uint32_t)succ.size());
+
+        // the predecessors are the successors grouped by target
+        predOffsets.assign(blocks.size() + 1, 0);
+        for (const Edge& e : succ) {
+            if (e.block != NO_BLOCK) {
+                predOffsets[e.block + 1]++;
+            }
+        }
+        for (size_t b = 0; b < blocks.size(); b++) {
+            predOffsets[b + 1] += predOffsets[b];
+        }
+        pred.resize(predOffsets.back());
+        std::vector<uint32_t> fill(predOffsets.begin(), predOffsets.end() - 1);
+        for (uint32_t b = 0; b < blocks.size(); b++) {
+            for (const Edge& e : successors(b)) {
+                if (e.block != NO_BLOCK) {
+                    pred[fill[e.block]++] = {blocks[b].startAddr, b, e.kind};
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,400 @@
+/**
+ * @file
+ * @brief Defines a binary, columnar export of the disassembled instructions
+ * and its zero-copy reader.
+ */
+
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "bytespan.h"
+#include "instruction.h"
+#include "table.h"
+
+/**
+ * @brief The version of the layout of the columnar files.
+ */
+const uint32_t COLUMNAR_FORMAT_VERSION = 1;
+
+/**
+ * @brief The first bytes of every columnar file.
+ */
+const char COLUMNAR_MAGIC[8] = {'M', 'Y', 'D', 'I', 'S', 'C', 'O', 'L'};
+
+/**
+ * @brief The id of a missing section or symbol.
+ */
+constexpr uint32_t NO_ID = ~0U;
+
+/**
+ * @enum Column
+ * @brief The columns of a columnar file. The per-instruction columns have one
+ * entry per instruction, in the address order.
+ */
+enum class Column : uint32_t {
+    ADDR,          /**< uint64_t: the starting address */
+    LENGTH,        /**< uint8_t: the length in bytes */
+    MNEMONIC,      /**< uint16_t: the Mnemonic */
+    PREFIX_BYTE,   /**< uint8_t: the lock/rep/bnd/notrack byte, or 0 */
+    SEGMENT,       /**< uint8_t: the Segment override */
+    OPERAND_START, /**< uint32_t: the first operand in OPERANDS, plus one
+                        last entry for the end of the operands */
+    OPERANDS,      /**< ExportedOperand: the operands of every instruction */
+    BRANCH_TARGET, /**< uint64_t: the branch target, or NO_LABEL */
+    SECTION,       /**< uint32_t: the index in SECTIONS, or NO_ID */
+    SYMBOL,        /**< uint32_t: the index in SYMBOLS of the symbol at or
+                        before the address, or NO_ID */
+    SECTIONS,      /**< ExportedSection: the sections in the address order */
+    SYMBOLS,       /**< ExportedSymbol: the symbols in the address order */
+    STRINGS,       /**< char: the names of the sections and the symbols */
+    NUM,
+};
+
+constexpr size_t COLUMN_NUM = (size_t)Column::NUM;
+
+/**
+ * @struct ExportedOperand
+ * @brief The fixed-size descriptor of an operand, see DecodedOperand.
+ */
+struct ExportedOperand {
+    uint8_t kind;     /**< The OperandKind */
+    uint8_t regClass; /**< The RegClass of a register operand */
+    int8_t reg;       /**< The register id of a register operand */
+    int8_t base;      /**< The base register id, RIP_REG or NO_REG */
+    int8_t index;     /**< The index register id or NO_REG */
+    uint8_t scale;    /**< The multiplier of the index register */
+    uint8_t dispSize; /**< The size of the displacement in bytes */
+    uint8_t immSize;  /**< The size of the immediate value in bytes */
+    int32_t disp;     /**< The sign-extended displacement */
+    uint32_t type;    /**< The Operand type in the lookup table */
+    uint64_t imm;     /**< The zero-extended immediate value */
+};
+
+/**
+ * @struct ExportedSection
+ * @brief A section of the object file.
+ */
+struct ExportedSection {
+    uint64_t startAddr;  /**< The starting address */
+    uint64_t endAddr;    /**< The address past the end */
+    uint32_t nameOffset; /**< The offset of the name in STRINGS */
+    uint32_t nameSize;   /**< The length of the name */
+};
+
+/**
+ * @struct ExportedSymbol
+ * @brief A symbol of the object file.
+ */
+struct ExportedSymbol {
+    uint64_t addr;       /**< The address of the symbol */
+    uint32_t nameOffset; /**< The offset of the name in STRINGS */
+    uint32_t nameSize;   /**< The length of the name */
+};
+
+/**
+ * @struct ColumnarHeader
+ * @brief The header of a columnar file, followed by the columns, each one
+ * starting at a multiple of 8 bytes. All values are little-endian.
+ */
+struct ColumnarHeader {
+    char magic[8];             /**< COLUMNAR_MAGIC */
+    uint32_t formatVersion;    /**< COLUMNAR_FORMAT_VERSION */
+    uint32_t tableVersion;     /**< DECODER_TABLE_VERSION, for the ids */
+    uint64_t numInstructions;  /**< The entries of the instruction columns */
+    uint64_t offsets[COLUMN_NUM]; /**< Where each column starts */
+    uint64_t sizes[COLUMN_NUM];   /**< The number of bytes of each column */
+};
+
+static_assert(sizeof(ExportedOperand) == 24, "ExportedOperand is packed");
+static_assert(sizeof(ExportedSection) == 24, "ExportedSection is packed");
+static_assert(sizeof(ExportedSymbol) == 16, "ExportedSymbol is packed");
+
+/**
+ * @class ColumnarBuilder
+ * @brief Collects the instructions, the sections and the symbols, and writes
+ * them as a columnar file.
+ */
+class ColumnarBuilder {
+   public:
+    /**
+     * @brief Adds the section. Sections are added in the address order.
+     * @return The id of the section.
+     */
+    uint32_t addSection(uint64_t startAddr, uint64_t endAddr,
+                        std::string_view name) {
+        sections.push_back({startAddr, endAddr, (uint32_t)strings.size(),
+                            (uint32_t)name.size()});
+        strings.append(name.data(), name.size());
+        return (uint32_t)sections.size() - 1;
+    }
+
+    /**
+     * @brief Adds the symbol. Symbols are added in the address order.
+     * @return The id of the symbol.
+     */
+    uint32_t addSymbol(uint64_t addr, std::string_view name) {
+        symbols.push_back(
+            {addr, (uint32_t)strings.size(), (uint32_t)name.size()});
+        strings.append(name.data(), name.size());
+        return (uint32_t)symbols.size() - 1;
+    }
+
+    /**
+     * @brief Adds the instruction. Instructions are added in the address
+     * order.
+     * @param decoded The decoded instruction.
+     * @param section The id of its section, or NO_ID.
+     * @param symbol The id of the symbol it belongs to, or NO_ID.
+     */
+    void addInstruction(const DecodedInstruction& decoded, uint32_t section,
+                        uint32_t symbol) {
+        addrs.push_back(decoded.startAddr);
+        lengths.push_back(decoded.length);
+        mnemonics.push_back((uint16_t)decoded.mnemonic);
+        prefixBytes.push_back(decoded.instructionPrefixByte);
+        segments.push_back((uint8_t)decoded.segment);
+        operandStarts.push_back((uint32_t)operands.size());
+        for (size_t i = 0; i < decoded.numOperands; i++) {
+            const DecodedOperand& o = decoded.operands[i];
+            operands.push_back({(uint8_t)o.kind, (uint8_t)o.regClass, o.reg,
+                                o.base, o.index, o.scale, o.dispSize,
+                                o.immSize, o.disp, (uint32_t)o.type, o.imm});
+        }
+        branchTargets.push_back(labelAddr(decoded));
+        sectionIds.push_back(section);
+        symbolIds.push_back(symbol);
+    }
+
+    /**
+     * @brief Writes the file, replacing it if it exists.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void write(const std::string& path) const {
+        std::vector<uint32_t> starts = operandStarts;
+        starts.push_back((uint32_t)operands.size());
+
+        ColumnarHeader header = {};
+        std::memcpy(header.magic, COLUMNAR_MAGIC, 8);
+        header.formatVersion = COLUMNAR_FORMAT_VERSION;
+        header.tableVersion = DECODER_TABLE_VERSION;
+        header.numInstructions = addrs.size();
+
+        const void* data[COLUMN_NUM] = {
+            addrs.data(),         lengths.data(),   mnemonics.data(),
+            prefixBytes.data(),   segments.data(),  starts.data(),
+            operands.data(),      branchTargets.data(),
+            sectionIds.data(),    symbolIds.data(), sections.data(),
+            symbols.data(),       strings.data()};
+        uint64_t sizes[COLUMN_NUM] = {
+            bytesOf(addrs),         bytesOf(lengths),    bytesOf(mnemonics),
+            bytesOf(prefixBytes),   bytesOf(segments),   bytesOf(starts),
+            bytesOf(operands),      bytesOf(branchTargets),
+            bytesOf(sectionIds),    bytesOf(symbolIds),  bytesOf(sections),
+            bytesOf(symbols),       (uint64_t)strings.size()};
+        uint64_t offset = align8(sizeof(header));
+        for (size_t i = 0; i < COLUMN_NUM; i++) {
+            header.offsets[i] = offset;
+            header.sizes[i] = sizes[i];
+            offset = align8(offset + sizes[i]);
+        }
+
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open the export file: " +
+                                     path + ": " + std::strerror(errno));
+        }
+        const char padding[8] = {};
+        bool ok = writeAll(fd, &header, sizeof(header)) &&
+                  writeAll(fd, padding, align8(sizeof(header)) - sizeof(header));
+        for (size_t i = 0; ok && i < COLUMN_NUM; i++) {
+            ok = writeAll(fd, data[i], sizes[i]) &&
+                 writeAll(fd, padding, align8(sizes[i]) - sizes[i]);
+        }
+        ok = (::close(fd) == 0) && ok;
+        if (!ok) {
+            throw std::runtime_error("Failed to write the export file: " +
+                                     path);
+        }
+    }
+
+   private:
+    std::vector<uint64_t> addrs;
+    std::vector<uint8_t> lengths;
+    std::vector<uint16_t> mnemonics;
+    std::vector<uint8_t> prefixBytes;
+    std::vector<uint8_t> segments;
+    std::vector<uint32_t> operandStarts;
+    std::vector<ExportedOperand> operands;
+    std::vector<uint64_t> branchTargets;
+    std::vector<uint32_t> sectionIds;
+    std::vector<uint32_t> symbolIds;
+    std::vector<ExportedSection> sections;
+    std::vector<ExportedSymbol> symbols;
+    std::string strings;
+
+    template <typename T>
+    static uint64_t bytesOf(const std::vector<T>& column) {
+        return column.size() * sizeof(T);
+    }
+
+    static uint64_t align8(uint64_t size) { return (size + 7) & ~7ULL; }
+
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+};
+
+/**
+ * @class ColumnarListing
+ * @brief Reads a columnar file through a memory mapping. The columns are
+ * returned as pointers into the mapping, valid while the listing lives.
+ */
+class ColumnarListing {
+   public:
+    /**
+     * @brief Maps and validates the file.
+     * @throws std::runtime_error if the file cannot be read or is not a
+     * columnar file of this version.
+     */
+    explicit ColumnarListing(const std::string& path) : file(path) {
+        ByteSpan bytes = file.bytes();
+        if (bytes.size() < sizeof(header)) {
+            throw std::runtime_error("Truncated columnar file: " + path);
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, COLUMNAR_MAGIC, 8) != 0 ||
+            header.formatVersion != COLUMNAR_FORMAT_VERSION) {
+            throw std::runtime_error("Not a columnar file of version " +
+                                     std::to_string(COLUMNAR_FORMAT_VERSION) +
+                                     ": " + path);
+        }
+        if (header.tableVersion != DECODER_TABLE_VERSION) {
+            throw std::runtime_error(
+                "Columnar file written with another decoder table: " + path);
+        }
+
+        uint64_t n = header.numInstructions;
+        const uint64_t entrySizes[COLUMN_NUM] = {
+            8 * n,  n, 2 * n, n, n, 4 * (n + 1), 0, 8 * n, 4 * n, 4 * n,
+            0,      0, 0};
+        for (size_t i = 0; i < COLUMN_NUM; i++) {
+            if (header.offsets[i] % 8 != 0 ||
+                header.offsets[i] > bytes.size() ||
+                header.sizes[i] > bytes.size() - header.offsets[i] ||
+                (entrySizes[i] != 0 && header.sizes[i] != entrySizes[i])) {
+                throw std::runtime_error("Corrupted columnar file: " + path);
+            }
+        }
+        if (column<ExportedOperand>(Column::OPERANDS).size() <
+                (n == 0 ? 0 : operandStarts()[n]) ||
+            header.sizes[(size_t)Column::OPERANDS] % sizeof(ExportedOperand) ||
+            header.sizes[(size_t)Column::SECTIONS] % sizeof(ExportedSection) ||
+            header.sizes[(size_t)Column::SYMBOLS] % sizeof(ExportedSymbol)) {
+            throw std::runtime_error("Corrupted columnar file: " + path);
+        }
+    }
+
+    /**
+     * @brief Returns the number of instructions.
+     */
+    size_t size() const { return header.numInstructions; }
+
+    const uint64_t* addrs() const { return ptr<uint64_t>(Column::ADDR); }
+    const uint8_t* lengths() const { return ptr<uint8_t>(Column::LENGTH); }
+    const uint16_t* mnemonics() const {
+        return ptr<uint16_t>(Column::MNEMONIC);
+    }
+    const uint8_t* prefixBytes() const {
+        return ptr<uint8_t>(Column::PREFIX_BYTE);
+    }
+    const uint8_t* segments() const { return ptr<uint8_t>(Column::SEGMENT); }
+    const uint32_t* operandStarts() const {
+        return ptr<uint32_t>(Column::OPERAND_START);
+    }
+    const uint64_t* branchTargets() const {
+        return ptr<uint64_t>(Column::BRANCH_TARGET);
+    }
+    const uint32_t* sectionIds() const {
+        return ptr<uint32_t>(Column::SECTION);
+    }
+    const uint32_t* symbolIds() const { return ptr<uint32_t>(Column::SYMBOL); }
+
+    /**
+     * @brief A column as an array of fixed-size entries.
+     */
+    template <typename T>
+    struct Entries {
+        const T* data;
+        size_t count;
+
+        size_t size() const { return count; }
+        const T& operator[](size_t i) const { return data[i]; }
+        const T* begin() const { return data; }
+        const T* end() const { return data + count; }
+    };
+
+    /**
+     * @brief Returns the operands of the instruction.
+     */
+    Entries<ExportedOperand> operands(size_t i) const {
+        const ExportedOperand* all = ptr<ExportedOperand>(Column::OPERANDS);
+        return {all + operandStarts()[i],
+                operandStarts()[i + 1] - operandStarts()[i]};
+    }
+
+    Entries<ExportedSection> sections() const {
+        return column<ExportedSection>(Column::SECTIONS);
+    }
+    Entries<ExportedSymbol> symbols() const {
+        return column<ExportedSymbol>(Column::SYMBOLS);
+    }
+
+    /**
+     * @brief Returns the name of the section or the symbol.
+     */
+    template <typename T>
+    std::string_view name(const T& entry) const {
+        std::string_view strings(ptr<char>(Column::STRINGS),
+                                 header.sizes[(size_t)Column::STRINGS]);
+        return strings.substr(std::min<size_t>(entry.nameOffset, strings.size()),
+                              entry.nameSize);
+    }
+
+   private:
+    MappedFile file;
+    ColumnarHeader header;
+
+    template <typename T>
+    const T* ptr(Column c) const {
+        return reinterpret_cast<const T*>(file.bytes().data() +
+                                          header.offsets[(size_t)c]);
+    }
+
+    template <typename T>
+    Entries<T> column(Column c) const {
+        return {ptr<T>(c), header.sizes[(size_t)c] / sizeof(T)};
+    }
+};
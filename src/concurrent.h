@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Defines a result store shared by concurrent decoders.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "coverage.h"
+#include "store.h"
+
+/**
+ * @class ConcurrentStore
+ * @brief Collects the results of workers decoding the same bytes at the same
+ * time, without any of them waiting for another.
+ *
+ * A worker claims a start address with an atomic fetch-or on the visited
+ * bits of the shared coverage map, and decodes it only if the claim
+ * succeeds, so that no address is decoded twice. It then appends the result
+ * to its own shard, which no other worker touches, along with what is
+ * needed to follow the control flow past it; the bytes failing to decode
+ * are only claimed, and decoded again by whoever needs their error. Once
+ * the workers are done, seal() sorts each shard, findFlow() looks an
+ * instruction up by its address without decoding it again, and merge()
+ * visits the records of all the shards in the address order.
+ */
+class ConcurrentStore {
+   public:
+    /**
+     * @struct Flow
+     * @brief The control flow of a decoded instruction.
+     */
+    struct Flow {
+        uint64_t addr;        /**< The address of the instruction */
+        long long nextOffset; /**< The relative offset of the branch target */
+        Mnemonic mnemonic;    /**< The mnemonic of the instruction */
+        const StoredInstruction* record; /**< Its record, set by seal() */
+    };
+
+    /**
+     * @struct Shard
+     * @brief The append-only results of one worker.
+     */
+    struct Shard {
+        InstructionStore instructions; /**< The decoded instructions */
+        std::vector<Flow> flows; /**< One for each instruction, if any */
+    };
+
+    /**
+     * @brief Constructor for ConcurrentStore.
+     * @param coverage The map the start addresses are claimed on.
+     * @param numShards The number of workers.
+     */
+    ConcurrentStore(CoverageMap& coverage, size_t numShards)
+        : coverage(coverage),
+          shards(numShards),
+          owners(coverage.size()),
+          cursors(numShards, 0) {}
+
+    size_t size() const { return shards.size(); }
+    Shard& shard(size_t i) { return shards[i]; }
+    const Shard& shard(size_t i) const { return shards[i]; }
+
+    /**
+     * @brief Claims the start address for the calling worker.
+     * @return True if no worker has claimed it before and it is in the map.
+     */
+    bool claim(uint64_t addr) { return coverage.claimVisited(addr); }
+
+    /**
+     * @brief Claims the start address for the worker of the shard, which
+     * findFlow() then looks the address up in.
+     * @return True if no worker has claimed it before and it is in the map.
+     */
+    bool claim(uint64_t addr, size_t shard) {
+        if (!coverage.claimVisited(addr)) {
+            return false;
+        }
+        // each address is written by the one worker claiming it
+        owners[addr - coverage.baseAddr()] = (uint16_t)shard;
+        return true;
+    }
+
+    /**
+     * @brief Checks whether a worker has claimed the address.
+     */
+    bool isClaimed(uint64_t addr) const { return coverage.isVisited(addr); }
+
+    /**
+     * @brief Sorts the flows of the shard and links them to their records,
+     * once its worker is done. The shards may be sealed at the same time.
+     */
+    void seal(size_t i) {
+        Shard& s = shards[i];
+        std::sort(s.flows.begin(), s.flows.end(),
+                  [](const Flow& a, const Flow& b) { return a.addr < b.addr; });
+        // one flow for each record, both in the address order
+        size_t f = 0;
+        for (const StoredInstruction& record : s.instructions) {
+            if (f == s.flows.size()) {
+                break;
+            }
+            s.flows[f++].record = &record;
+        }
+    }
+
+    /**
+     * @brief Finds the flow of the instruction decoded at the address, once
+     * the shards are sealed. Not to be called concurrently, since the next
+     * instruction is looked for right after the previous one found.
+     * @return The flow, or nullptr if no instruction has been decoded there.
+     */
+    const Flow* findFlow(uint64_t addr) const {
+        if (!coverage.isVisited(addr)) {
+            return nullptr;
+        }
+        uint16_t shard = owners[addr - coverage.baseAddr()];
+        const std::vector<Flow>& flows = shards[shard].flows;
+        size_t& cursor = cursors[shard];
+        if (cursor + 1 < flows.size() && flows[cursor + 1].addr == addr) {
+            return &flows[++cursor];
+        }
+        auto it = std::lower_bound(
+            flows.begin(), flows.end(), addr,
+            [](const Flow& flow, uint64_t a) { return flow.addr < a; });
+        if (it == flows.end() || it->addr != addr) {
+            return nullptr;
+        }
+        cursor = it - flows.begin();
+        return &*it;
+    }
+
+    /**
+     * @brief Visits the instructions of every shard in the address order,
+     * merging the sorted shards instead of sorting all the records again.
+     * Every start address is claimed once, so no two of them are at the
+     * same address.
+     * @param instruction Called with each record and the store holding its
+     * string.
+     */
+    template <typename F>
+    void merge(F instruction) const {
+        // the next record of each shard, the lowest address on top
+        using Cursor = std::pair<uint64_t, size_t>;
+        std::vector<InstructionStore::const_iterator> next;
+        std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>>
+            heads;
+        for (size_t i = 0; i < shards.size(); i++) {
+            const InstructionStore& store = shards[i].instructions;
+            next.push_back(store.begin());
+            if (!store.empty()) {
+                heads.push({next[i]->startAddr, i});
+            }
+        }
+
+        while (!heads.empty()) {
+            size_t i = heads.top().second;
+            heads.pop();
+            const InstructionStore& store = shards[i].instructions;
+            instruction(*next[i], store);
+            if (++next[i] != store.end()) {
+                heads.push({next[i]->startAddr, i});
+            }
+        }
+    }
+
+   private:
+    CoverageMap& coverage;
+    std::vector<Shard> shards;
+    std::vector<uint16_t> owners; /**< The shard of each claimed address */
+    mutable std::vector<size_t> cursors; /**< The last flow found by shard */
+};
@@ -1,10 +1,10 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
-enum class Operand {
+enum class Operand : uint8_t {
     one,
     imm8,
     imm16,
@@ -129,7 +129,7 @@ inline std::string to_string(Prefix prefix) {
     }
 }
 
-enum class Mnemonic {
+enum class Mnemonic : uint8_t {
     SETNE,
     FXCH,
     FADD,
@@ -656,11 +656,10 @@ inline std::string to_string(OpEnc openc) {
     }
 }
 
-const std::unordered_set<int> TWO_BYTES_OPCODE_PREFIX = {0x0F, 0xD8, 0xD9,
-                                                         0xDC};
+constexpr int TWO_BYTES_OPCODE_PREFIX[] = {0x0F, 0xD8, 0xD9, 0xDC};
 
 // Predefined prefixes and their associated instructions
-const std::unordered_set<int> INSTRUCTION_PREFIX_SET = {
+constexpr int INSTRUCTION_PREFIXES[] = {
     0xF0,
     0xF2,
     0xF3,
@@ -670,3 +669,6 @@ const std::unordered_set<int> INSTRUCTION_PREFIX_SET = {
 const std::vector<int> SCALE_FACTOR = {1, 2, 4, 8};
 
 const size_t PLT_SEC_ENTRY_SIZE = 16;
+
+// The longest x86 instruction, in bytes
+const size_t MAX_INSTRUCTION_LENGTH = 15;
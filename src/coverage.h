@@ -0,0 +1,217 @@
+/**
+ * @file
+ * @brief Defines a bitmap tracking which bytes have been decoded or visited.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class CoverageMap
+ * @brief Keeps a decoded bit and a visited bit for every byte of the object.
+ *
+ * Both bits of 64 consecutive bytes live next to each other, so a byte's
+ * combined state is read with a single access, and ranges are tested and
+ * marked a word at a time. The map may cover only the bytes from a base
+ * address on, e.g. a single function; the bytes out of the map are never
+ * decoded nor visited.
+ */
+class CoverageMap {
+   public:
+    CoverageMap() : base(0), len(0) {}
+
+    /**
+     * @brief Creates the map of the size bytes from the base address on,
+     * none of them decoded or visited.
+     */
+    explicit CoverageMap(size_t size, uint64_t base = 0)
+        : base(base), len(size), words((size + WORD_BITS - 1) / WORD_BITS) {}
+
+    size_t size() const { return len; }
+    uint64_t baseAddr() const { return base; }
+
+    /**
+     * @brief Checks whether the byte is in the map.
+     */
+    bool covers(uint64_t addr) const {
+        return addr >= base && addr - base < len;
+    }
+
+    /**
+     * @brief Checks whether the byte has been decoded.
+     */
+    bool isDecoded(uint64_t addr) const {
+        return covers(addr) && (word(addr).decoded & bit(addr - base));
+    }
+
+    /**
+     * @brief Checks whether the byte has been visited.
+     */
+    bool isVisited(uint64_t addr) const {
+        return covers(addr) && (word(addr).visited & bit(addr - base));
+    }
+
+    /**
+     * @brief Checks whether the byte has been either decoded or visited.
+     */
+    bool isDecodedOrVisited(uint64_t addr) const {
+        if (!covers(addr)) {
+            return false;
+        }
+        const Word& w = word(addr);
+        return (w.decoded | w.visited) & bit(addr - base);
+    }
+
+    /**
+     * @brief Checks whether any byte of [startAddr, endAddr) has been decoded.
+     */
+    bool anyDecoded(uint64_t startAddr, uint64_t endAddr) const {
+        clamp(startAddr, endAddr);
+        for (uint64_t addr = startAddr; addr < endAddr;) {
+            uint64_t next = nextWordAddr(addr, endAddr);
+            if (words[addr / WORD_BITS].decoded & mask(addr, next)) {
+                return true;
+            }
+            addr = next;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Marks [startAddr, endAddr) as decoded unless any of its bytes
+     * has already been decoded.
+     * @return True if the range has been marked.
+     */
+    bool markDecoded(uint64_t startAddr, uint64_t endAddr) {
+        if (anyDecoded(startAddr, endAddr)) {
+            return false;
+        }
+        clamp(startAddr, endAddr);
+        for (uint64_t addr = startAddr; addr < endAddr;) {
+            uint64_t next = nextWordAddr(addr, endAddr);
+            words[addr / WORD_BITS].decoded |= mask(addr, next);
+            addr = next;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Marks [startAddr, endAddr) as not decoded.
+     */
+    void clearDecoded(uint64_t startAddr, uint64_t endAddr) {
+        clamp(startAddr, endAddr);
+        for (uint64_t addr = startAddr; addr < endAddr;) {
+            uint64_t next = nextWordAddr(addr, endAddr);
+            words[addr / WORD_BITS].decoded &= ~mask(addr, next);
+            addr = next;
+        }
+    }
+
+    /**
+     * @brief Marks the byte as visited.
+     */
+    void markVisited(uint64_t addr) {
+        if (covers(addr)) {
+            word(addr).visited |= bit(addr - base);
+        }
+    }
+
+    /**
+     * @brief Atomically marks the byte as visited, so that concurrent
+     * workers can claim bytes of the same map.
+     * @return True if the byte was not visited before, false if it was or
+     * it is out of the map.
+     */
+    bool claimVisited(uint64_t addr) {
+        if (!covers(addr)) {
+            return false;
+        }
+        uint64_t old = __atomic_fetch_or(&word(addr).visited, bit(addr - base),
+                                         __ATOMIC_RELAXED);
+        return (old & bit(addr - base)) == 0;
+    }
+
+    /**
+     * @brief Marks every byte as not visited.
+     */
+    void clearVisited() {
+        for (Word& w : words) {
+            w.visited = 0;
+        }
+    }
+
+    /**
+     * @brief Finds the first byte in [startAddr, endAddr) not decoded yet.
+     * @return The address of the byte, or endAddr if every byte (within the
+     * map) is decoded.
+     */
+    uint64_t nextUndecoded(uint64_t startAddr, uint64_t endAddr) const {
+        uint64_t limit = endAddr;
+        clamp(startAddr, endAddr);
+        for (uint64_t addr = startAddr; addr < endAddr;) {
+            uint64_t next = nextWordAddr(addr, endAddr);
+            uint64_t gaps = ~words[addr / WORD_BITS].decoded & mask(addr, next);
+            if (gaps != 0) {
+                return base + (addr & ~(WORD_BITS - 1)) + __builtin_ctzll(gaps);
+            }
+            addr = next;
+        }
+        return limit;
+    }
+
+   private:
+    static constexpr uint64_t WORD_BITS = 64;
+
+    struct Word {
+        uint64_t decoded = 0;
+        uint64_t visited = 0;
+    };
+
+    uint64_t base; /**< The address of the first byte of the map */
+    size_t len;
+    std::vector<Word> words;
+
+    Word& word(uint64_t addr) { return words[(addr - base) / WORD_BITS]; }
+    const Word& word(uint64_t addr) const {
+        return words[(addr - base) / WORD_BITS];
+    }
+
+    static uint64_t bit(uint64_t addr) {
+        return 1ULL << (addr & (WORD_BITS - 1));
+    }
+
+    /**
+     * @brief Returns the bits of [startAddr, endAddr) within a word.
+     */
+    static uint64_t mask(uint64_t startAddr, uint64_t endAddr) {
+        uint64_t lo = startAddr & (WORD_BITS - 1);
+        uint64_t hi = endAddr - (startAddr & ~(WORD_BITS - 1));
+        uint64_t upper = (hi >= WORD_BITS) ? ~0ULL : ((1ULL << hi) - 1);
+        return upper & (~0ULL << lo);
+    }
+
+    /**
+     * @brief Returns the start of the next word, or endAddr if it is closer.
+     */
+    static uint64_t nextWordAddr(uint64_t addr, uint64_t endAddr) {
+        uint64_t next = (addr & ~(WORD_BITS - 1)) + WORD_BITS;
+        return next < endAddr ? next : endAddr;
+    }
+
+    /**
+     * @brief Turns [startAddr, endAddr) into the range of the map it covers,
+     * relative to the base address.
+     */
+    void clamp(uint64_t& startAddr, uint64_t& endAddr) const {
+        startAddr = startAddr > base ? startAddr - base : 0;
+        endAddr = endAddr > base ? endAddr - base : 0;
+        if (endAddr > len) {
+            endAddr = len;
+        }
+        if (startAddr > endAddr) {
+            startAddr = endAddr;
+        }
+    }
+};
@@ -0,0 +1,549 @@
+/**
+ * @file
+ * @brief Defines the differential testing of the decoder against a
+ * reference disassembler (objdump), and the decode throughput by opcode
+ * class.
+ */
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bytespan.h"
+#include "state.h"
+
+/**
+ * @brief The classes of opcodes the throughput and the mismatches are
+ * counted by, after the legacy prefixes and REX.
+ */
+enum class OpcodeClass : uint8_t {
+    ONE_BYTE,   /**< The one-byte opcode map, except x87 */
+    TWO_BYTE,   /**< 0f xx */
+    THREE_BYTE, /**< 0f 38 xx and 0f 3a xx */
+    X87,        /**< d8 to df */
+    VEX,        /**< c4, c5 and 62 (EVEX) */
+    PREFIXES,   /**< Only prefixes before the end of the bytes */
+};
+constexpr size_t OPCODE_CLASS_NUM = 6;
+
+inline const char* to_string(OpcodeClass opcodeClass) {
+    switch (opcodeClass) {
+        case OpcodeClass::ONE_BYTE:
+            return "one-byte";
+        case OpcodeClass::TWO_BYTE:
+            return "0f";
+        case OpcodeClass::THREE_BYTE:
+            return "0f38/0f3a";
+        case OpcodeClass::X87:
+            return "x87";
+        case OpcodeClass::VEX:
+            return "vex/evex";
+        case OpcodeClass::PREFIXES:
+            return "prefixes";
+    }
+    return "";
+}
+
+/**
+ * @brief Returns the class of the opcode of the instruction at the address.
+ */
+inline OpcodeClass opcodeClass(ByteSpan bytes, uint64_t addr) {
+    for (; addr < bytes.size(); addr++) {
+        unsigned char b = bytes[addr];
+        bool isPrefix = b == 0x66 || b == 0x67 || b == 0xf0 || b == 0xf2 ||
+                        b == 0xf3 || b == 0x2e || b == 0x36 || b == 0x3e ||
+                        b == 0x26 || b == 0x64 || b == 0x65 ||
+                        (b >= 0x40 && b <= 0x4f);
+        if (isPrefix) {
+            continue;
+        }
+        if (b == 0x0f) {
+            if (addr + 1 < bytes.size() &&
+                (bytes[addr + 1] == 0x38 || bytes[addr + 1] == 0x3a)) {
+                return OpcodeClass::THREE_BYTE;
+            }
+            return OpcodeClass::TWO_BYTE;
+        }
+        if (b >= 0xd8 && b <= 0xdf) {
+            return OpcodeClass::X87;
+        }
+        if (b == 0xc4 || b == 0xc5 || b == 0x62) {
+            return OpcodeClass::VEX;
+        }
+        return OpcodeClass::ONE_BYTE;
+    }
+    return OpcodeClass::PREFIXES;
+}
+
+/**
+ * @struct ReferenceInstruction
+ * @brief Represents an instruction decoded by the reference disassembler.
+ */
+struct ReferenceInstruction {
+    uint64_t addr;        /**< The starting address */
+    size_t length;        /**< The number of bytes */
+    std::string mnemonic; /**< The mnemonic, without the prefixes */
+    std::string operands; /**< The operands as printed */
+    bool bad;             /**< True if the bytes do not decode */
+};
+
+/**
+ * @brief The words printed before the mnemonic for the prefixes, which are
+ * not compared.
+ */
+const std::vector<std::string_view> PREFIX_WORDS = {
+    "rep",  "repz", "repe", "repnz", "repne", "lock", "bnd", "notrack",
+    "data16", "addr32", "cs", "ds", "es", "ss", "fs", "gs"};
+
+/**
+ * @brief Splits the instruction text into the mnemonic and the operands,
+ * dropping the prefix words before the mnemonic.
+ */
+inline std::pair<std::string, std::string> splitInstruction(
+    std::string_view text) {
+    while (true) {
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string_view::npos) {
+            return {};
+        }
+        text.remove_prefix(start);
+        size_t end = std::min(text.find_first_of(" \t"), text.size());
+        std::string_view word = text.substr(0, end);
+        text.remove_prefix(end);
+        bool isPrefix = word.rfind("rex", 0) == 0;
+        for (std::string_view prefix : PREFIX_WORDS) {
+            isPrefix = isPrefix || word == prefix;
+        }
+        size_t operands = text.find_first_not_of(" \t");
+        if (!isPrefix || operands == std::string_view::npos) {
+            return {std::string(word),
+                    operands == std::string_view::npos
+                        ? std::string()
+                        : std::string(text.substr(operands))};
+        }
+    }
+}
+
+/**
+ * @brief Returns the mnemonic with the condition code of jcc, setcc and
+ * cmovcc spelled one way, e.g. je and jz as jz, ja and jnbe as jnbe.
+ */
+inline std::string canonicalMnemonic(std::string mnemonic) {
+    static const std::vector<std::pair<std::string_view, std::string_view>>
+        CONDITION_ALIASES = {
+            {"e", "z"},     {"ne", "nz"},  {"a", "nbe"},  {"ae", "nb"},
+            {"nc", "nb"},   {"c", "b"},    {"nae", "b"},  {"na", "be"},
+            {"g", "nle"},   {"nl", "ge"},  {"nge", "l"},  {"ng", "le"},
+            {"pe", "p"},    {"po", "np"},
+        };
+    for (std::string_view family : {"j", "set", "cmov"}) {
+        if (mnemonic.rfind(family, 0) != 0 || mnemonic == "jmp" ||
+            mnemonic == "jecxz" || mnemonic == "jrcxz") {
+            continue;
+        }
+        std::string_view cc = std::string_view(mnemonic).substr(family.size());
+        for (const auto& alias : CONDITION_ALIASES) {
+            if (cc == alias.first) {
+                return std::string(family) + std::string(alias.second);
+            }
+        }
+        return mnemonic;
+    }
+    return mnemonic == "movabs" ? "mov" : mnemonic;
+}
+
+/**
+ * @brief Returns the operands in a form both disassemblers agree on when
+ * they mean the same: without the comments, the symbols, the sizes of the
+ * memory operands, the separators and the leading zeros of the numbers.
+ */
+inline std::string normalizeOperands(std::string_view operands) {
+    operands = operands.substr(0, operands.find_first_of("#;"));
+    std::string spaced(operands);
+    std::replace(spaced.begin(), spaced.end(), ',', ' ');
+    std::string words;
+    std::istringstream is(spaced);
+    std::string word;
+    while (is >> word) {
+        for (char& c : word) {
+            c = (char)std::tolower((unsigned char)c);
+        }
+        if (word == "ptr" || word == "byte" || word == "word" ||
+            word == "dword" || word == "qword" || word == "tbyte" ||
+            word == "fword" || word == "xmmword" || word == "ymmword" ||
+            word == "zmmword" || word[0] == '<') {
+            continue;
+        }
+        words += word;
+    }
+
+    std::string out;
+    for (size_t i = 0; i < words.size(); i++) {
+        out += words[i];
+        if (words[i] == 'x' && i > 0 && words[i - 1] == '0') {
+            while (i + 2 < words.size() && words[i + 1] == '0' &&
+                   std::isxdigit((unsigned char)words[i + 2])) {
+                i++;
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Parses the listing of `objdump -d -w -M intel`: the lines
+ * `addr:\tbytes\ttext`, and the lines of bytes continuing an instruction
+ * without -w.
+ */
+inline std::vector<ReferenceInstruction> parseObjdump(std::istream& in) {
+    std::vector<ReferenceInstruction> instructions;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(":\t");
+        size_t start = line.find_first_not_of(' ');
+        if (colon == std::string::npos || start == std::string::npos ||
+            start >= colon ||
+            line.find_first_not_of("0123456789abcdef", start) != colon) {
+            continue;
+        }
+        uint64_t addr = std::stoull(line.substr(start, colon - start),
+                                    nullptr, 16);
+        size_t tab = line.find('\t', colon + 2);
+        std::string_view bytes = std::string_view(line).substr(
+            colon + 2, tab == std::string::npos ? std::string::npos
+                                                : tab - colon - 2);
+        size_t length = 0;
+        std::istringstream is{std::string(bytes)};
+        std::string byte;
+        while (is >> byte) {
+            length++;
+        }
+
+        if (tab == std::string::npos) {
+            if (!instructions.empty() &&
+                instructions.back().addr + instructions.back().length ==
+                    addr) {
+                instructions.back().length += length;
+            }
+            continue;
+        }
+        std::pair<std::string, std::string> text =
+            splitInstruction(std::string_view(line).substr(tab + 1));
+        instructions.push_back({addr, length, text.first, text.second,
+                                text.first == "(bad)"});
+    }
+    return instructions;
+}
+
+/**
+ * @brief Disassembles the raw bytes with objdump, as x86-64 code loaded at
+ * address 0.
+ * @param bytes The bytes.
+ * @param objdump The command running objdump.
+ * @throws std::runtime_error if objdump cannot be run.
+ */
+inline std::vector<ReferenceInstruction> runObjdump(
+    ByteSpan bytes, const std::string& objdump = "objdump") {
+    char path[] = "/tmp/mydisas-reference-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create a temporary file");
+    }
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    ::close(fd);
+
+    std::string command = objdump +
+                          " -D -w -b binary -m i386:x86-64 -M intel " + path +
+                          " 2>/dev/null";
+    FILE* pipe = written == bytes.size() ? popen(command.c_str(), "r")
+                                         : nullptr;
+    std::string listing;
+    if (pipe != nullptr) {
+        char buf[1 << 16];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), pipe)) > 0) {
+            listing.append(buf, n);
+        }
+    }
+    int status = pipe == nullptr ? -1 : pclose(pipe);
+    unlink(path);
+    if (status != 0) {
+        throw std::runtime_error("Failed to run the reference: " + command);
+    }
+    std::istringstream is(listing);
+    return parseObjdump(is);
+}
+
+/**
+ * @brief The kinds of disagreement with the reference.
+ */
+enum class MismatchKind : uint8_t {
+    LENGTH,    /**< Both decode, to different lengths */
+    MNEMONIC,  /**< Same length, different mnemonics */
+    OPERANDS,  /**< Same mnemonic, different operands */
+    UNDECODED, /**< The reference decodes bytes the decoder rejects */
+    SPURIOUS,  /**< The decoder accepts bytes the reference rejects */
+};
+constexpr size_t MISMATCH_KIND_NUM = 5;
+
+inline const char* to_string(MismatchKind kind) {
+    switch (kind) {
+        case MismatchKind::LENGTH:
+            return "length";
+        case MismatchKind::MNEMONIC:
+            return "mnemonic";
+        case MismatchKind::OPERANDS:
+            return "operands";
+        case MismatchKind::UNDECODED:
+            return "undecoded";
+        case MismatchKind::SPURIOUS:
+            return "spurious";
+    }
+    return "";
+}
+
+/**
+ * @struct Mismatch
+ * @brief Describes an instruction the decoder and the reference disagree
+ * on.
+ */
+struct Mismatch {
+    uint64_t addr;        /**< The starting address */
+    MismatchKind kind;    /**< What differs */
+    std::string bytes;    /**< The bytes of the longer decoding, in hex */
+    std::string expected; /**< The text of the reference */
+    std::string actual;   /**< The text of the decoder */
+};
+
+/**
+ * @struct ClassCounters
+ * @brief Counts the decodes and the mismatches of an opcode class.
+ */
+struct ClassCounters {
+    uint64_t instructions = 0; /**< The instructions timed */
+    uint64_t bytes = 0;        /**< Their bytes */
+    uint64_t failed = 0;       /**< The decode attempts that failed */
+    uint64_t nanoseconds = 0;  /**< The time spent in State::step() */
+    uint64_t compared = 0;     /**< The instructions of the reference */
+    uint64_t mismatches[MISMATCH_KIND_NUM] = {}; /**< By kind */
+};
+
+/**
+ * @brief The number of mismatches kept as samples by default.
+ */
+const size_t DEFAULT_MISMATCH_SAMPLES = 20;
+
+/**
+ * @class DifferentialTester
+ * @brief Streams buffers through State::step(), timing the decodes by
+ * opcode class, and compares the instructions of the buffers with the ones
+ * of a reference disassembler.
+ *
+ * Each instruction of the reference is decoded at its own address, so that
+ * a length mismatch is counted once instead of desynchronizing the rest of
+ * the buffer. The prefix words are not compared, and neither are the
+ * operands of the instructions whose mnemonics differ.
+ */
+class DifferentialTester {
+   public:
+    explicit DifferentialTester(size_t maxSamples = DEFAULT_MISMATCH_SAMPLES)
+        : maxSamples(maxSamples) {}
+
+    /**
+     * @brief Sweeps the buffer linearly, skipping a byte at each failure,
+     * and times State::step() on the decoded instructions by class.
+     */
+    void measure(ByteSpan bytes) {
+        State state(bytes);
+        std::vector<uint64_t> addrs[OPCODE_CLASS_NUM];
+        for (uint64_t addr = 0; addr < bytes.size();) {
+            size_t c = (size_t)opcodeClass(bytes, addr);
+            if (state.tryDecode(addr) != DecodeStatus::OK) {
+                counters[c].failed++;
+                addr++;
+                continue;
+            }
+            addrs[c].push_back(addr);
+            addr += state.decoded.length;
+        }
+
+        for (size_t c = 0; c < OPCODE_CLASS_NUM; c++) {
+            uint64_t decodedBytes = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t addr : addrs[c]) {
+                DisassembledResult result = state.step(addr);
+                decodedBytes += result.disassembledInstructionSize;
+            }
+            auto end = std::chrono::steady_clock::now();
+            counters[c].instructions += addrs[c].size();
+            counters[c].bytes += decodedBytes;
+            counters[c].nanoseconds +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count();
+        }
+    }
+
+    /**
+     * @brief Compares the decoded instructions of the buffer with the ones
+     * of the reference.
+     * @param bytes The buffer.
+     * @param reference The instructions of the buffer decoded by the
+     * reference, at the offsets in the buffer.
+     */
+    void compare(ByteSpan bytes,
+                 const std::vector<ReferenceInstruction>& reference) {
+        State state(bytes);
+        for (const ReferenceInstruction& expected : reference) {
+            if (expected.addr >= bytes.size()) {
+                continue;
+            }
+            ClassCounters& c =
+                counters[(size_t)opcodeClass(bytes, expected.addr)];
+            c.compared++;
+            std::string expectedText =
+                expected.mnemonic + " " + expected.operands;
+
+            if (state.tryDecode(expected.addr) != DecodeStatus::OK) {
+                if (!expected.bad) {
+                    record(c, bytes, expected.addr, expected.length,
+                           MismatchKind::UNDECODED, expectedText, "");
+                }
+                continue;
+            }
+            DisassembledResult result = state.step(expected.addr);
+            if (expected.bad) {
+                record(c, bytes, expected.addr,
+                       result.disassembledInstructionSize,
+                       MismatchKind::SPURIOUS, expectedText,
+                       result.disassembledInstructionStr);
+                continue;
+            }
+            std::pair<std::string, std::string> actual =
+                splitInstruction(result.disassembledInstructionStr);
+            if (isRelativeBranch(state.decoded)) {
+                // the reference prints the target as a number, not a label
+                char target[32];
+                std::snprintf(target, sizeof(target), "0x%llx",
+                              (unsigned long long)branchTarget(state.decoded));
+                actual.second = target;
+            }
+            size_t length = std::max<size_t>(
+                expected.length, result.disassembledInstructionSize);
+            if (result.disassembledInstructionSize != expected.length) {
+                record(c, bytes, expected.addr, length, MismatchKind::LENGTH,
+                       expectedText, result.disassembledInstructionStr);
+            } else if (canonicalMnemonic(actual.first) !=
+                       canonicalMnemonic(expected.mnemonic)) {
+                record(c, bytes, expected.addr, length,
+                       MismatchKind::MNEMONIC, expectedText,
+                       result.disassembledInstructionStr);
+            } else if (normalizeOperands(actual.second) !=
+                       normalizeOperands(expected.operands)) {
+                record(c, bytes, expected.addr, length,
+                       MismatchKind::OPERANDS, expectedText,
+                       result.disassembledInstructionStr);
+            }
+        }
+    }
+
+    const ClassCounters& classCounters(OpcodeClass opcodeClass) const {
+        return counters[(size_t)opcodeClass];
+    }
+
+    const std::vector<Mismatch>& samples() const { return mismatchSamples; }
+
+    /**
+     * @brief Returns the number of mismatches of every class and kind.
+     */
+    uint64_t mismatches() const {
+        uint64_t total = 0;
+        for (const ClassCounters& c : counters) {
+            for (uint64_t n : c.mismatches) {
+                total += n;
+            }
+        }
+        return total;
+    }
+
+    /**
+     * @brief Writes the throughput and the mismatches by class, then the
+     * samples of the mismatches.
+     * @param os The output stream.
+     */
+    void print(std::ostream& os) const {
+        os << "class      instrs     failed   Minstr/s     MB/s   compared";
+        for (size_t k = 0; k < MISMATCH_KIND_NUM; k++) {
+            os << " " << to_string((MismatchKind)k);
+        }
+        os << "\n";
+        for (size_t i = 0; i < OPCODE_CLASS_NUM; i++) {
+            const ClassCounters& c = counters[i];
+            double seconds = c.nanoseconds / 1e9;
+            char line[128];
+            std::snprintf(line, sizeof(line),
+                          "%-10s %6llu %10llu %10.2f %8.2f %10llu",
+                          to_string((OpcodeClass)i),
+                          (unsigned long long)c.instructions,
+                          (unsigned long long)c.failed,
+                          seconds > 0 ? c.instructions / seconds / 1e6 : 0.0,
+                          seconds > 0 ? c.bytes / seconds / 1e6 : 0.0,
+                          (unsigned long long)c.compared);
+            os << line;
+            for (size_t k = 0; k < MISMATCH_KIND_NUM; k++) {
+                os << " " << c.mismatches[k];
+            }
+            os << "\n";
+        }
+        for (const Mismatch& m : mismatchSamples) {
+            os << std::hex << m.addr << std::dec << ": "
+               << to_string(m.kind) << " ( " << m.bytes << ")\n"
+               << "  expected: " << m.expected << "\n"
+               << "  actual:   " << m.actual << "\n";
+        }
+    }
+
+   private:
+    size_t maxSamples;
+    ClassCounters counters[OPCODE_CLASS_NUM];
+    std::vector<Mismatch> mismatchSamples;
+
+    void record(ClassCounters& c, ByteSpan bytes, uint64_t addr,
+                size_t length, MismatchKind kind, std::string expected,
+                std::string actual) {
+        c.mismatches[(size_t)kind]++;
+        if (mismatchSamples.size() >= maxSamples) {
+            return;
+        }
+        std::string hex;
+        for (uint64_t i = addr; i < addr + length && i < bytes.size(); i++) {
+            char b[4];
+            std::snprintf(b, sizeof(b), "%02x ", bytes[i]);
+            hex += b;
+        }
+        mismatchSamples.push_back(
+            {addr, kind, hex, std::move(expected), std::move(actual)});
+    }
+};
@@ -10,56 +10,129 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <stack>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "byteclass.h"
+#include "cfg.h"
+#include "concurrent.h"
+#include "coverage.h"
+#include "indirect.h"
 #include "state.h"
+#include "store.h"
+#include "worklist.h"
 
 /**
- * @brief The string representation for unknown instructions.
+ * @struct InstructionSink
+ * @brief Receives the instructions as they are decoded, instead of them being
+ * stored in the disassembler.
  */
-const std::string UNKNOWN_INSTRUCTION = "UNKNOWN-INSTRUCTION";
+struct InstructionSink {
+    virtual ~InstructionSink() = default;
+
+    /**
+     * @brief Receives a disassembled instruction.
+     * @param instruction The disassembled instruction.
+     */
+    virtual void emit(const DisassembledResult &instruction) = 0;
+};
+
+/**
+ * @struct DisasRange
+ * @brief Represents a range passed to the disassembler, or decoded by one
+ * worker.
+ */
+struct DisasRange {
+    uint64_t startAddr; /**< The starting address */
+    uint64_t endAddr;   /**< The ending address (inclusive) */
+};
 
 /**
  * @struct DisAssembler
  * @brief Represents a disassembler for x86 instructions.
  */
 struct DisAssembler {
-    std::vector<bool> isSuccessfullyDisAssembled; /**< Array indicating which
-                                                     bytes have been decoded */
-    const std::vector<unsigned char>
-        &binaryBytes; /**< Byte array of the object source */
-    const std::unordered_map<uint64_t, std::string>
-        &addr2symbol; /**< Mapping of addresses to symbols */
+    CoverageMap coverage; /**< The bytes that have been decoded or visited */
+    ByteSpan binaryBytes; /**< Byte array of the object source */
 
     uint64_t curAddr; /**< The current index to be decoded */
+    State state;      /**< The decoder context reused for every instruction */
 
-    std::unordered_set<std::pair<uint64_t, uint64_t>>
-        disassembledPositions; /**< Set of disassembled positions */
-    std::unordered_map<std::pair<uint64_t, uint64_t>, std::string>
-        disassembledInstructions; /**< Mapping of index to disassembled
-                                     instructions */
-    std::unordered_map<uint64_t, uint64_t>
-        disassembledInstructionsSize; /**< Mapping of address to instruction
-                                           length */
+    InstructionStore
+        disassembledInstructions; /**< The disassembled instructions ordered
+                                     by their ranges */
     std::vector<uint64_t> errorAddrs; /**< Keeps track of error bytes indexes */
     size_t maxInstructionStrSize =
         0; /**< The maximum length of the instruction string */
+    DecodeErrorReport errorReport; /**< The decode errors found so far */
+    std::vector<DisasRange> ranges; /**< The ranges disassembled so far */
+    std::unique_ptr<DecodeStats>
+        stats; /**< The counters, or nullptr unless enableStats() is called */
+    std::unique_ptr<TransferLog>
+        transfers; /**< The control transfers stored, or nullptr unless
+                        enableCFG() is called */
+
+    /**
+     * @brief Constructor for DisAssembler.
+     * @param binaryBytes The byte array of the object source.
+     */
+    explicit DisAssembler(ByteSpan binaryBytes)
+        : DisAssembler(binaryBytes, binaryBytes.size()) {}
 
     /**
      * @brief Constructor for DisAssembler.
      * @param binaryBytes The byte array of the object source.
-     * @param addr2symbol Mapping of addresses to symbols.
+     * @param coverageSize The number of bytes tracked by the coverage map,
+     * 0 when the instructions are only streamed to a sink.
+     * @param coverageBase The first byte tracked by the coverage map, so that
+     * decoding a range only pays for the bytes of the range.
+     */
+    DisAssembler(ByteSpan binaryBytes, size_t coverageSize,
+                 uint64_t coverageBase = 0)
+        : coverage(coverageSize, coverageBase),
+          binaryBytes(binaryBytes),
+          curAddr(0),
+          state(binaryBytes) {}
+
+    virtual ~DisAssembler() = default;
+
+    /**
+     * @brief Starts counting what the decoder and the worklists do.
+     */
+    void enableStats() {
+        if (stats == nullptr) {
+            stats = std::make_unique<DecodeStats>();
+        }
+        state.stats = stats.get();
+    }
+
+    /**
+     * @brief Starts recording the control transfers of the stored
+     * instructions, from which cfg() builds the control flow graph.
+     */
+    void enableCFG() {
+        if (transfers == nullptr) {
+            transfers = std::make_unique<TransferLog>();
+        }
+    }
+
+    /**
+     * @brief Builds the control flow graph of the instructions stored since
+     * enableCFG() has been called.
+     * @param entries The addresses the functions start at, in addition to
+     * the targets of the calls.
      */
-    DisAssembler(const std::vector<unsigned char> &binaryBytes,
-                 const std::unordered_map<uint64_t, std::string> &addr2symbol)
-        : binaryBytes(binaryBytes), addr2symbol(addr2symbol), curAddr(0) {
-        isSuccessfullyDisAssembled =
-            std::vector<bool>(binaryBytes.size(), false);
+    ControlFlowGraph cfg(std::vector<uint64_t> entries = {}) const {
+        return ControlFlowGraph(disassembledInstructions,
+                                transfers == nullptr ? TransferLog()
+                                                     : *transfers,
+                                std::move(entries));
     }
 
     /**
@@ -69,6 +142,16 @@ struct DisAssembler {
      */
     virtual void disas(uint64_t startAddr, uint64_t endAddr = -1) = 0;
 
+    /**
+     * @brief Disassembles again after the bytes of [patchStart, patchEnd)
+     * have been modified in place. Only the instructions overlapping the
+     * patch and the ones whose decoding follows from them are replaced; the
+     * rest of disassembledInstructions is kept.
+     * @param patchStart The first modified byte.
+     * @param patchEnd The byte past the last modified one.
+     */
+    virtual void redisas(uint64_t patchStart, uint64_t patchEnd) = 0;
+
     /**
      * @brief Stores the disassembled instruction.
      * @param instruction The disassembled instruction.
@@ -77,42 +160,59 @@ struct DisAssembler {
         uint64_t nextAddr =
             instruction.startAddr + instruction.disassembledInstructionSize;
 
-        // skip if this has already been decoded
-        for (uint64_t idx = instruction.startAddr; idx < nextAddr; ++idx) {
-            if (isSuccessfullyDisAssembled[idx]) {
-                return;
-            }
+        // skip if this has already been decoded, otherwise mark the region
+        if (!coverage.markDecoded(instruction.startAddr, nextAddr)) {
+            return;
         }
 
-        // mark the decoded regions
-        for (uint64_t idx = instruction.startAddr; idx < nextAddr; ++idx) {
-            isSuccessfullyDisAssembled[idx] = true;
+        flushErrors();
+        disassembledInstructions.put(instruction.startAddr, nextAddr,
+                                     instruction.disassembledInstructionStr,
+                                     instruction.labelAddr);
+        if (transfers != nullptr) {
+            transfers->record(instruction.startAddr,
+                              instruction.disassembledInstructionSize,
+                              instruction.mnemonic, instruction.labelAddr);
         }
+        maxInstructionStrSize =
+            std::max(maxInstructionStrSize,
+                     instruction.disassembledInstructionStr.size());
 
+        return;
+    }
+
+    /**
+     * @brief Stores a record of another store over the same bytes as
+     * storeInstruction() would, without copying its string. Its control
+     * transfer comes with the log of the other disassembler.
+     * @param from The store holding the string of the record.
+     * @param record The record to store.
+     */
+    void storeRecord(const InstructionStore &from,
+                     const StoredInstruction &record) {
+        if (!coverage.markDecoded(record.startAddr, record.endAddr())) {
+            return;
+        }
+        flushErrors();
+        std::string_view str = from.str(record);
+        disassembledInstructions.put(record.startAddr, record.endAddr(), str,
+                                     record.labelAddr);
+        maxInstructionStrSize = std::max(maxInstructionStrSize, str.size());
+    }
+
+    /**
+     * @brief Stores the pending error bytes as one unknown instruction.
+     */
+    void flushErrors() {
         // mark the regions causing errors
         if (!errorAddrs.empty()) {
             uint64_t startErr = errorAddrs[0];
             uint64_t disassembledInstructionSizegthErr = errorAddrs.size();
-            disassembledInstructions[std::make_pair(
-                startErr, startErr + disassembledInstructionSizegthErr)] =
-                UNKNOWN_INSTRUCTION;
-            disassembledPositions.emplace(std::make_pair(
-                startErr, startErr + disassembledInstructionSizegthErr));
+            disassembledInstructions.put(
+                startErr, startErr + disassembledInstructionSizegthErr,
+                UNKNOWN_INSTRUCTION);
             errorAddrs.clear();
         }
-
-        disassembledInstructions[std::make_pair(instruction.startAddr,
-                                                nextAddr)] =
-            instruction.disassembledInstructionStr;
-        maxInstructionStrSize =
-            std::max(maxInstructionStrSize,
-                     instruction.disassembledInstructionStr.size());
-        disassembledPositions.emplace(
-            std::make_pair(instruction.startAddr, nextAddr));
-        disassembledInstructionsSize[instruction.startAddr] =
-            instruction.disassembledInstructionSize;
-
-        return;
     }
 
     /**
@@ -121,24 +221,221 @@ struct DisAssembler {
      * @param disassembledInstructionSizegth The length of the error.
      */
     void storeError(int startAddr, int disassembledInstructionSizegth) {
+        coverage.clearDecoded(startAddr,
+                              startAddr + disassembledInstructionSizegth);
         for (int i = startAddr; i < startAddr + disassembledInstructionSizegth;
              i++) {
-            isSuccessfullyDisAssembled[i] = false;
             errorAddrs.emplace_back(i);
         }
     }
 
+    /**
+     * @brief Removes the results overlapping [startAddr, endAddr) so that the
+     * bytes can be decoded again: the stored ranges, their decoded bits, and
+     * the errors found there.
+     * @param erased Receives the removed records.
+     */
+    void invalidate(uint64_t startAddr, uint64_t endAddr,
+                    std::vector<StoredInstruction> &erased) {
+        size_t n = erased.size();
+        disassembledInstructions.eraseOverlapping(startAddr, endAddr, erased);
+        errorReport.erase(startAddr, endAddr);
+        if (transfers != nullptr) {
+            transfers->erase(startAddr, endAddr);
+        }
+        for (size_t i = n; i < erased.size(); i++) {
+            const StoredInstruction &record = erased[i];
+            coverage.clearDecoded(record.startAddr, record.endAddr());
+            errorReport.erase(record.startAddr, record.endAddr());
+        }
+        errorAddrs.erase(std::remove_if(errorAddrs.begin(), errorAddrs.end(),
+                                        [&](uint64_t addr) {
+                                            return addr >= startAddr &&
+                                                   addr < endAddr;
+                                        }),
+                         errorAddrs.end());
+    }
+
+    /**
+     * @brief Replaces the results overlapping [startAddr, endAddr) with the
+     * ones of a sweep of the bytes, as invalidate() and storing them one by
+     * one would, moving only the results of the range.
+     * @param instructions The sweep of the range.
+     * @param sweptErrors The errors of the sweep. errorReport is expected in
+     * the address order, as a linear sweep finds them.
+     * @param sweptTransfers The transfers of the sweep.
+     * @param erased Receives the removed records.
+     */
+    void replace(uint64_t startAddr, uint64_t endAddr,
+                 const InstructionStore &instructions,
+                 const DecodeErrorReport &sweptErrors,
+                 const TransferLog &sweptTransfers,
+                 std::vector<StoredInstruction> &erased) {
+        size_t n = erased.size();
+        disassembledInstructions.replaceOverlapping(startAddr, endAddr,
+                                                    instructions, erased);
+        // the errors of the removed records go with them
+        uint64_t errorsStart = startAddr;
+        uint64_t errorsEnd = endAddr;
+        for (size_t i = n; i < erased.size(); i++) {
+            const StoredInstruction &record = erased[i];
+            coverage.clearDecoded(record.startAddr, record.endAddr());
+            errorsStart = std::min(errorsStart, record.startAddr);
+            errorsEnd = std::max(errorsEnd, record.endAddr());
+        }
+        for (const StoredInstruction &record : instructions) {
+            coverage.markDecoded(record.startAddr, record.endAddr());
+        }
+        errorReport.replace(errorsStart, errorsEnd, sweptErrors);
+        if (transfers != nullptr) {
+            transfers->replace(startAddr, endAddr, sweptTransfers);
+        }
+        errorAddrs.erase(std::remove_if(errorAddrs.begin(), errorAddrs.end(),
+                                        [&](uint64_t addr) {
+                                            return addr >= startAddr &&
+                                                   addr < endAddr;
+                                        }),
+                         errorAddrs.end());
+        maxInstructionStrSize =
+            std::max(maxInstructionStrSize, instructions.maxStrSize());
+    }
+
+    /**
+     * @brief Returns the lowest address an instruction reading the byte may
+     * start at. An instruction may read bytes past its own range, up to
+     * MAX_INSTRUCTION_LENGTH bytes from its start.
+     */
+    static uint64_t firstReaderAddr(uint64_t addr) {
+        return addr >= MAX_INSTRUCTION_LENGTH - 1
+                   ? addr - (MAX_INSTRUCTION_LENGTH - 1)
+                   : 0;
+    }
+
+    /**
+     * @brief Recomputes maxInstructionStrSize if the longest instruction
+     * string may have been removed.
+     * @param erased The removed records.
+     */
+    void refreshMaxInstructionStrSize(
+        const std::vector<StoredInstruction> &erased) {
+        bool stale = std::any_of(erased.begin(), erased.end(),
+                                 [&](const StoredInstruction &record) {
+                                     return record.strSize >=
+                                            maxInstructionStrSize;
+                                 });
+        if (stale) {
+            maxInstructionStrSize = disassembledInstructions.maxStrSize();
+        }
+    }
+
+    /**
+     * @brief Finds the end of the range passed to disas containing the
+     * address.
+     * @return True if a range contains the address.
+     */
+    bool findRangeEnd(uint64_t addr, uint64_t &endAddr) const {
+        for (const DisasRange &range : ranges) {
+            if (addr >= range.startAddr && addr <= range.endAddr) {
+                endAddr = range.endAddr;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Records a range passed to disas, clamped to the bytes.
+     */
+    void addRange(uint64_t startAddr, uint64_t endAddr) {
+        if (binaryBytes.empty()) {
+            return;
+        }
+        ranges.push_back(
+            {startAddr, std::min<uint64_t>(endAddr, binaryBytes.size() - 1)});
+    }
+
     /**
      * @brief Executes a step in disassembling the instruction.
      * @return The disassembled result.
      */
     DisassembledResult step() {
-        State state(binaryBytes, addr2symbol);
         DisassembledResult instruction = state.step(getCurAddr());
         storeInstruction(instruction);
         return instruction;
     }
 
+    /**
+     * @brief Executes a step in disassembling the instruction without
+     * throwing. A decode error is recorded in errorReport.
+     * @param instruction The disassembled result, valid on DecodeStatus::OK.
+     * @return The decode status.
+     */
+    DecodeStatus tryStep(DisassembledResult &instruction) {
+        DecodeStatus status = tryDecodeStep(instruction);
+        if (status == DecodeStatus::OK) {
+            storeInstruction(instruction);
+        }
+        return status;
+    }
+
+    /**
+     * @brief Decodes and renders the instruction at the current address
+     * without storing it. A decode error is recorded in errorReport.
+     * @param instruction The disassembled result, valid on DecodeStatus::OK.
+     * @return The decode status.
+     */
+    DecodeStatus tryDecodeStep(DisassembledResult &instruction) {
+        DecodeStatus status = state.tryDecode(getCurAddr());
+        if (status != DecodeStatus::OK) {
+            errorReport.add(state.lastError());
+            return status;
+        }
+
+        const DecodedInstruction &decoded = state.decoded;
+        instruction = {decoded.startAddr, decoded.length, decoded.mnemonic,
+                       formatInstruction(decoded), decoded.nextOffset,
+                       labelAddr(decoded)};
+        return status;
+    }
+
+    /**
+     * @brief Merges the results of another disassembler over the same bytes,
+     * as if its instructions had been stored after the ones of this
+     * disassembler. Instructions overlapping already decoded bytes are
+     * dropped.
+     * @param other The disassembler to merge.
+     */
+    void merge(const DisAssembler &other) {
+        for (const StoredInstruction &record : other.disassembledInstructions) {
+            std::string_view instructionStr =
+                other.disassembledInstructions.str(record);
+            if (instructionStr == UNKNOWN_INSTRUCTION) {
+                if (!disassembledInstructions.contains(
+                        {record.startAddr, record.endAddr()})) {
+                    disassembledInstructions.put(
+                        record.startAddr, record.endAddr(), instructionStr);
+                }
+                continue;
+            }
+            storeRecord(other.disassembledInstructions, record);
+        }
+
+        // the pending errors are flushed by the next stored instruction
+        for (uint64_t addr : other.errorAddrs) {
+            storeError(addr, 1);
+        }
+        for (const DecodeError &error : other.errorReport.errors) {
+            errorReport.add(error);
+        }
+        ranges.insert(ranges.end(), other.ranges.begin(), other.ranges.end());
+        if (stats != nullptr && other.stats != nullptr) {
+            stats->merge(*other.stats);
+        }
+        if (transfers != nullptr && other.transfers != nullptr) {
+            transfers->merge(*other.transfers);
+        }
+    }
+
     /**
      * @brief Gets the current address being decoded.
      * @return The current address.
@@ -153,6 +450,35 @@ struct DisAssembler {
 struct LinearSweepDisAssembler : public DisAssembler {
     using DisAssembler::DisAssembler;
 
+    ByteClassMap byteClasses; /**< The classes of the bytes ahead */
+
+    /**
+     * @brief Classifies the block of bytes starting at the current address
+     * and lets the decoder read the prefixes from it.
+     */
+    void startClassifying() {
+        byteClasses.build(binaryBytes, curAddr,
+                          curAddr + BYTE_CLASS_BLOCK_SIZE);
+        state.byteClasses = &byteClasses;
+    }
+
+    /**
+     * @brief Classifies the next block once the sweep has left the current
+     * one.
+     */
+    void classifyAhead() {
+        if (!byteClasses.covers(curAddr)) {
+            byteClasses.build(binaryBytes, curAddr,
+                              curAddr + BYTE_CLASS_BLOCK_SIZE);
+        }
+    }
+
+    /**
+     * @brief Stops the decoder from reading the classes, which are not
+     * updated when the bytes are patched.
+     */
+    void stopClassifying() { state.byteClasses = nullptr; }
+
     /**
      * @brief Disassembles instructions using linear sweep algorithm.
      * @param startAddr The starting address.
@@ -161,19 +487,183 @@ struct LinearSweepDisAssembler : public DisAssembler {
     void disas(uint64_t startAddr, uint64_t endAddr = -1) {
         curAddr = startAddr;
         endAddr = (endAddr < 0) ? binaryBytes.size() - 1 : endAddr;
+        addRange(startAddr, endAddr);
+
+        startClassifying();
+        DisassembledResult instruction;
+        while (curAddr <= endAddr) {
+            classifyAhead();
+            if (tryStep(instruction) == DecodeStatus::OK) {
+                curAddr = instruction.startAddr +
+                          instruction.disassembledInstructionSize;
+            } else {
+                curAddr += 1;
+            }
+        }
+        stopClassifying();
+    }
+
+    /**
+     * @brief Checks whether the sweep of the disassembler has stepped on the
+     * address, as the start of an instruction or on a decode error, after
+     * which the sweep goes on from the next byte.
+     */
+    bool sweptFrom(uint64_t addr) const {
+        if (disassembledInstructions.findStartingAt(addr) != nullptr) {
+            return true;
+        }
+        // the errors of a sweep are found in the address order
+        const std::vector<DecodeError> &errors = errorReport.errors;
+        auto it = std::lower_bound(
+            errors.begin(), errors.end(), addr,
+            [](const DecodeError &e, uint64_t a) { return e.addr < a; });
+        return it != errors.end() && it->addr == addr;
+    }
+
+    /**
+     * @brief Continues the sweep of this disassembler, stopped at curAddr,
+     * with the one of the next chunk, swept speculatively from its start by
+     * another disassembler.
+     *
+     * The sweep of this disassembler may stop past the start of the chunk,
+     * inside an instruction of the chunk. Decoding is the same from any
+     * address both sweeps step on, so the bytes are decoded again from
+     * curAddr only until such an address, and the instructions of the chunk
+     * from there on are kept; the misaligned ones before are dropped. The
+     * result is the same as sweeping the chunk from curAddr.
+     * @param chunk The disassembler of the chunk.
+     * @param range The range of the chunk.
+     */
+    void join(const LinearSweepDisAssembler &chunk, DisasRange range) {
+        DisassembledResult instruction;
+        while (curAddr <= range.endAddr && !chunk.sweptFrom(curAddr)) {
+            if (tryStep(instruction) == DecodeStatus::OK) {
+                curAddr = instruction.startAddr +
+                          instruction.disassembledInstructionSize;
+            } else {
+                curAddr += 1;
+            }
+        }
+        ranges.push_back(range);
+        if (curAddr > range.endAddr) {
+            return;
+        }
+
+        uint64_t syncAddr = curAddr;
+        for (const StoredInstruction &record : chunk.disassembledInstructions) {
+            if (record.startAddr >= syncAddr) {
+                storeRecord(chunk.disassembledInstructions, record);
+            }
+        }
+        for (const DecodeError &error : chunk.errorReport.errors) {
+            if (error.addr >= syncAddr) {
+                errorReport.add(error);
+            }
+        }
+        if (stats != nullptr && chunk.stats != nullptr) {
+            stats->merge(*chunk.stats);
+        }
+        if (transfers != nullptr && chunk.transfers != nullptr) {
+            transfers->merge(*chunk.transfers, syncAddr);
+        }
+        curAddr = chunk.curAddr;
+    }
+
+    /**
+     * @brief Disassembles again after the bytes of [patchStart, patchEnd)
+     * have been modified in place.
+     *
+     * The sweep restarts at the end of the last instruction that cannot
+     * have read the patch, and stops at the first instruction boundary of
+     * the previous sweep past the patch, from where both sweeps agree. The
+     * result is the same as disassembling the modified bytes from scratch.
+     * @param patchStart The first modified byte.
+     * @param patchEnd The byte past the last modified one.
+     */
+    void redisas(uint64_t patchStart, uint64_t patchEnd) {
+        uint64_t invalidStart = firstReaderAddr(patchStart);
+        std::vector<StoredInstruction> erased;
+        bool isInvalidated = false;
+
+        for (const DisasRange &range : ranges) {
+            if (range.endAddr < patchStart || range.startAddr >= patchEnd) {
+                continue;
+            }
+            uint64_t restartAddr = std::max(
+                range.startAddr,
+                disassembledInstructions.lastEndBefore(invalidStart));
+
+            // the sweep is kept aside, then spliced in place of the results
+            // from the restart to where it meets the previous sweep
+            InstructionStore swept;
+            DecodeErrorReport sweptErrors;
+            TransferLog sweptTransfers;
+            std::swap(sweptErrors, errorReport);
+
+            curAddr = restartAddr;
+            DisassembledResult instruction;
+            while (curAddr <= range.endAddr) {
+                if (curAddr >= patchEnd &&
+                    disassembledInstructions.findStartingAt(curAddr)) {
+                    break;
+                }
+                if (tryDecodeStep(instruction) == DecodeStatus::OK) {
+                    uint64_t nextAddr =
+                        curAddr + instruction.disassembledInstructionSize;
+                    swept.put(curAddr, nextAddr,
+                              instruction.disassembledInstructionStr,
+                              instruction.labelAddr);
+                    sweptTransfers.record(
+                        curAddr, instruction.disassembledInstructionSize,
+                        instruction.mnemonic, instruction.labelAddr);
+                    curAddr = nextAddr;
+                } else {
+                    curAddr += 1;
+                }
+            }
+            std::swap(sweptErrors, errorReport);
+
+            // the first splice also drops the instructions that may have
+            // read the patch
+            uint64_t startAddr = restartAddr;
+            uint64_t endAddr = curAddr;
+            if (!isInvalidated) {
+                startAddr = std::min(startAddr, invalidStart);
+                endAddr = std::max(endAddr, patchEnd);
+                isInvalidated = true;
+            }
+            replace(startAddr, endAddr, swept, sweptErrors, sweptTransfers,
+                    erased);
+        }
+        if (!isInvalidated) {
+            invalidate(invalidStart, patchEnd, erased);
+        }
+        refreshMaxInstructionStrSize(erased);
+    }
+
+    /**
+     * @brief Disassembles instructions using linear sweep algorithm, passing
+     * each one to the sink in the address order instead of storing it.
+     * @param startAddr The starting address.
+     * @param endAddr The ending address.
+     * @param sink The sink receiving the instructions.
+     */
+    void disas(uint64_t startAddr, uint64_t endAddr, InstructionSink &sink) {
+        curAddr = startAddr;
 
+        startClassifying();
+        DisassembledResult instruction;
         while (curAddr <= endAddr) {
-            try {
-                DisassembledResult instruction = step();
+            classifyAhead();
+            if (tryDecodeStep(instruction) == DecodeStatus::OK) {
+                sink.emit(instruction);
                 curAddr = instruction.startAddr +
                           instruction.disassembledInstructionSize;
-            } catch (const std::exception &e) {
-                std::stringstream ss;
-                ss << std::hex << curAddr;
-                std::cerr << ss.str() << ": " << e.what() << std::endl;
+            } else {
                 curAddr += 1;
             }
         }
+        stopClassifying();
     }
 };
 
@@ -184,14 +674,16 @@ struct LinearSweepDisAssembler : public DisAssembler {
 struct RecursiveDescentDisAssembler : public DisAssembler {
     using DisAssembler::DisAssembler;
 
+    const IndirectTargets *indirectTargets =
+        nullptr; /**< Resolves the switch tables and seeds the walk with the
+                      code pointers within the range, or nullptr */
+
     /**
      * @brief Pops an address from the stack until a valid address is found.
      * @param stackedAddrs The stack of addresses.
-     * @param visited The visited bytes.
      * @param isDone Flag indicating if the disassembly is done.
      */
-    void popAddr(std::stack<uint64_t> &stackedAddrs, std::vector<bool> &visited,
-                 bool &isDone) {
+    void popAddr(std::stack<uint64_t> &stackedAddrs, bool &isDone) {
         while (true) {
             if (stackedAddrs.empty()) {
                 isDone = true;
@@ -199,7 +691,7 @@ struct RecursiveDescentDisAssembler : public DisAssembler {
             } else {
                 curAddr = stackedAddrs.top();
                 stackedAddrs.pop();
-                if (!isSuccessfullyDisAssembled[curAddr] && !visited[curAddr]) {
+                if (!coverage.isDecodedOrVisited(curAddr)) {
                     break;
                 }
             }
@@ -212,21 +704,271 @@ struct RecursiveDescentDisAssembler : public DisAssembler {
      * @param endAddr The ending address.
      */
     void disas(uint64_t startAddr, uint64_t endAddr = -1) {
+        descend(
+            startAddr, endAddr,
+            [&](DisassembledResult &instruction) {
+                return tryStep(instruction);
+            },
+            stats.get());
+    }
+
+    /**
+     * @brief Disassembles instructions using recursive descent algorithm,
+     * with the instructions decoded ahead by a number of work-stealing
+     * workers.
+     *
+     * The workers follow every target of the control flow instructions from
+     * the range start on, whatever has been decoded on the way, so that
+     * they decode every instruction the walk may reach (see speculate()).
+     * The walk then goes through the same steps as the sequential one,
+     * following the control flow the workers have recorded instead of
+     * decoding, only to decide which instructions are kept, which are then
+     * merged from the shards in the address order. The result is the
+     * sequential one whatever the number of workers and their scheduling,
+     * overlapping instructions included.
+     * @param startAddr The starting address.
+     * @param endAddr The ending address.
+     * @param jobs The number of workers.
+     */
+    void disas(uint64_t startAddr, uint64_t endAddr, size_t jobs) {
+        // the claims cover the range only, the walk decodes the rest
+        uint64_t lastAddr =
+            std::min<uint64_t>(endAddr, binaryBytes.size() - 1);
+        CoverageMap claims(
+            binaryBytes.empty() || startAddr > lastAddr
+                ? 0
+                : lastAddr - startAddr + 1,
+            startAddr);
+        WorkStealingScheduler<uint64_t> scheduler(jobs);
+        ConcurrentStore store(claims, scheduler.workers());
+        speculate(store, scheduler, startAddr, endAddr);
+        for (size_t i = 0; i < store.size(); i++) {
+            scheduler.spawn(i, i);
+        }
+        scheduler.run([&](size_t, uint64_t i) { store.seal(i); });
+
+        // the worklist pushes have been counted by the workers
+        CoverageMap kept(claims.size(), startAddr);
+        descend(
+            startAddr, endAddr,
+            [&](DisassembledResult &instruction) {
+                return replayStep(store, kept, instruction);
+            },
+            nullptr);
+        store.merge(
+            [&](const StoredInstruction &record, const InstructionStore &from) {
+                if (kept.isDecoded(record.startAddr)) {
+                    disassembledInstructions.put(record.startAddr,
+                                                 record.endAddr(),
+                                                 from.str(record),
+                                                 record.labelAddr);
+                }
+            });
+    }
+
+    /**
+     * @brief Disassembles again after the bytes of [patchStart, patchEnd)
+     * have been modified in place.
+     *
+     * The control flow is followed again from every instruction that may
+     * have read the patch. A path stops where it reaches bytes decoded
+     * before outside the patch, whose successors have already been
+     * followed. The instructions reached only through the replaced ones are
+     * kept, since their bytes have not changed.
+     * @param patchStart The first modified byte.
+     * @param patchEnd The byte past the last modified one.
+     */
+    void redisas(uint64_t patchStart, uint64_t patchEnd) {
+        uint64_t invalidStart = firstReaderAddr(patchStart);
+        std::vector<StoredInstruction> erased;
+
+        // the errors and the transfers found before are set aside and
+        // dropped in one pass once the walk is done, so that each
+        // instruction only drops the ones of the walk
+        DecodeErrorReport foundErrors;
+        std::swap(foundErrors, errorReport);
+        TransferLog foundTransfers;
+        if (transfers != nullptr) {
+            std::swap(foundTransfers, *transfers);
+        }
+        std::vector<AddrSpan> invalidated;
+        auto drop = [&](uint64_t startAddr, uint64_t endAddr) {
+            invalidate(startAddr, endAddr, erased);
+            invalidated.push_back({startAddr, endAddr});
+        };
+        drop(invalidStart, patchEnd);
+
+        std::stack<uint64_t> stackedAddrs;
+        for (const StoredInstruction &record : erased) {
+            stackedAddrs.push(record.startAddr);
+        }
+        std::unordered_set<uint64_t> visited;
+
+        auto isPatched = [&](uint64_t addr) {
+            return addr >= invalidStart && addr < patchEnd;
+        };
+
+        DisassembledResult instruction;
+        while (!stackedAddrs.empty()) {
+            curAddr = stackedAddrs.top();
+            stackedAddrs.pop();
+            uint64_t endAddr;
+            if (!findRangeEnd(curAddr, endAddr)) {
+                continue;
+            }
+
+            while (curAddr <= endAddr && visited.count(curAddr) == 0 &&
+                   (isPatched(curAddr) ||
+                    !disassembledInstructions.findCovering(curAddr))) {
+                visited.insert(curAddr);
+                // drop a pending error of the byte before finding it again
+                drop(curAddr, curAddr + 1);
+                if (tryDecodeStep(instruction) != DecodeStatus::OK) {
+                    storeError(curAddr, 1);
+                    curAddr += 1;
+                    continue;
+                }
+
+                uint64_t nextAddr =
+                    curAddr + instruction.disassembledInstructionSize;
+                uint64_t cfAddr =
+                    (uint64_t)((long long)nextAddr + instruction.nextOffset);
+                drop(curAddr, nextAddr);
+                storeInstruction(instruction);
+
+                if (instruction.mnemonic == Mnemonic::RET) {
+                    break;
+                }
+                if (isControlFlowInstruction(instruction.mnemonic) &&
+                    cfAddr != nextAddr) {
+                    stackedAddrs.push(cfAddr);
+                }
+                if (instruction.mnemonic == Mnemonic::JMP &&
+                    cfAddr == nextAddr) {
+                    for (uint64_t target :
+                         switchTargets(disassembledInstructions, curAddr,
+                                       binaryBytes.size() - 1, state,
+                                       stats.get())) {
+                        stackedAddrs.push(target);
+                    }
+                }
+                curAddr = nextAddr;
+            }
+        }
+
+        // the errors of the removed records go with them
+        std::vector<AddrSpan> errorSpans = invalidated;
+        for (const StoredInstruction &record : erased) {
+            errorSpans.push_back({record.startAddr, record.endAddr()});
+        }
+        normalizeSpans(errorSpans);
+        foundErrors.eraseIf([&](const DecodeError &error) {
+            return inSpans(errorSpans, error.addr);
+        });
+        for (const DecodeError &error : errorReport.errors) {
+            foundErrors.add(error);
+        }
+        std::swap(foundErrors, errorReport);
+        if (transfers != nullptr) {
+            normalizeSpans(invalidated);
+            foundTransfers.replace(invalidated, *transfers);
+            std::swap(foundTransfers, *transfers);
+        }
+        refreshMaxInstructionStrSize(erased);
+    }
+
+   private:
+    /**
+     * @brief The addresses [startAddr, endAddr).
+     */
+    using AddrSpan = std::pair<uint64_t, uint64_t>;
+
+    /**
+     * @brief Sorts the spans and merges the overlapping ones.
+     */
+    static void normalizeSpans(std::vector<AddrSpan> &spans) {
+        std::sort(spans.begin(), spans.end());
+        size_t n = 0;
+        for (const AddrSpan &span : spans) {
+            if (n > 0 && span.first <= spans[n - 1].second) {
+                spans[n - 1].second = std::max(spans[n - 1].second,
+                                               span.second);
+            } else {
+                spans[n++] = span;
+            }
+        }
+        spans.resize(n);
+    }
+
+    /**
+     * @brief Checks whether one of the spans, normalized, contains the
+     * address.
+     */
+    static bool inSpans(const std::vector<AddrSpan> &spans, uint64_t addr) {
+        auto it = std::upper_bound(
+            spans.begin(), spans.end(), addr,
+            [](uint64_t a, const AddrSpan &span) { return a < span.first; });
+        return it != spans.begin() && addr < std::prev(it)->second;
+    }
+
+    /**
+     * @brief Follows the control flow from the start of the range, the
+     * other targets being stacked until the path is done.
+     * @param startAddr The starting address.
+     * @param endAddr The ending address.
+     * @param step Decodes and stores the instruction at curAddr as tryStep()
+     * does.
+     * @param counters The counters of the worklist pushes and of the switch
+     * tables, or nullptr.
+     */
+    template <typename F>
+    void descend(uint64_t startAddr, uint64_t endAddr, F step,
+                 DecodeStats *counters) {
         bool isDone = false;
         std::stack<uint64_t> stackedAddrs;
-        std::vector<bool> visited(binaryBytes.size(), false);
+        coverage.clearVisited();
 
         curAddr = startAddr;
         endAddr = (endAddr < 0) ? binaryBytes.size() - 1 : endAddr;
+        addRange(startAddr, endAddr);
 
+        // the length of the instruction of the walk ending at each address,
+        // so that the switch tables are looked back for from their jumps
+        // without reading the store while it is being written
+        std::vector<uint8_t> walkedTo;
+        if (startAddr <= endAddr && startAddr < binaryBytes.size()) {
+            walkedTo.resize(std::min<uint64_t>(endAddr, binaryBytes.size()) -
+                                startAddr + MAX_INSTRUCTION_LENGTH,
+                            0);
+        }
+        auto walked = [&](uint64_t addr) -> uint8_t * {
+            return addr >= startAddr && addr - startAddr < walkedTo.size()
+                       ? &walkedTo[addr - startAddr]
+                       : nullptr;
+        };
+        auto previous = [&](uint64_t addr) {
+            uint8_t *length = walked(addr);
+            return length == nullptr || *length == 0 ? NOT_MAPPED
+                                                     : addr - *length;
+        };
+        // the code pointers are followed once the range start is done
+        std::vector<uint64_t> seeds = codePointersIn(startAddr, endAddr);
+        for (auto it = seeds.rbegin(); it != seeds.rend(); ++it) {
+            stackedAddrs.push(*it);
+        }
+
+        DisassembledResult instruction;
         while (!isDone) {
-            try {
-                DisassembledResult instruction = step();
-                visited[curAddr] = true;
+            if (step(instruction) == DecodeStatus::OK) {
+                coverage.markVisited(curAddr);
                 Mnemonic mnemonic = instruction.mnemonic;
 
                 uint64_t nextAddr = instruction.startAddr +
                                     instruction.disassembledInstructionSize;
+                uint8_t *length = walked(nextAddr);
+                if (length != nullptr && *length == 0) {
+                    *length = instruction.disassembledInstructionSize;
+                }
                 uint64_t cfAddr =
                     (uint64_t)((long long)instruction.startAddr +
                                (long long)
@@ -235,48 +977,308 @@ struct RecursiveDescentDisAssembler : public DisAssembler {
 
                 if (mnemonic == Mnemonic::RET || nextAddr > endAddr) {
                     // return to the callee
-                    popAddr(stackedAddrs, visited, isDone);
+                    popAddr(stackedAddrs, isDone);
                 } else if (isControlFlowInstruction(mnemonic)) {
                     if (nextAddr == cfAddr) {
-                        if (nextAddr <= endAddr && !visited[nextAddr]) {
+                        if (mnemonic == Mnemonic::JMP) {
+                            for (uint64_t target : switchTargets(
+                                     instruction.startAddr, endAddr, state,
+                                     counters, previous)) {
+                                stackedAddrs.push(target);
+                                if (counters != nullptr) {
+                                    counters->pushed(stackedAddrs.size());
+                                }
+                            }
+                        }
+                        if (nextAddr <= endAddr &&
+                            !coverage.isVisited(nextAddr)) {
                             curAddr = nextAddr;
                         } else {
-                            popAddr(stackedAddrs, visited, isDone);
+                            popAddr(stackedAddrs, isDone);
                         }
                     } else {
                         if (nextAddr <= endAddr &&
-                            !isSuccessfullyDisAssembled[nextAddr] &&
-                            !visited[nextAddr]) {
+                            !coverage.isDecodedOrVisited(nextAddr)) {
                             stackedAddrs.push(nextAddr);
+                            if (counters != nullptr) {
+                                counters->pushed(stackedAddrs.size());
+                            }
                         }
-                        if (cfAddr <= endAddr && !visited[cfAddr]) {
+                        // the map may not cover the targets before the range
+                        if (cfAddr <= endAddr && coverage.covers(cfAddr) &&
+                            !coverage.isVisited(cfAddr)) {
                             curAddr = cfAddr;
                         } else {
-                            popAddr(stackedAddrs, visited, isDone);
+                            popAddr(stackedAddrs, isDone);
                         }
                     }
                 } else {
-                    if (nextAddr <= endAddr && !visited[nextAddr]) {
+                    if (nextAddr <= endAddr &&
+                        !coverage.isVisited(nextAddr)) {
                         curAddr = nextAddr;
                     } else {
-                        popAddr(stackedAddrs, visited, isDone);
+                        popAddr(stackedAddrs, isDone);
                     }
                 }
 
-            } catch (const std::exception &e) {
-                visited[curAddr] = true;
-
-                std::stringstream ss;
-                ss << std::hex << curAddr;
-                std::cerr << ss.str() << ": " << e.what() << std::endl;
+            } else {
+                coverage.markVisited(curAddr);
                 storeError(curAddr, 1);
 
-                if (!visited[curAddr + 1] && curAddr + 1 <= endAddr) {
+                if (!coverage.isVisited(curAddr + 1) &&
+                    curAddr + 1 <= endAddr) {
                     curAddr += 1;
                 } else {
-                    popAddr(stackedAddrs, visited, isDone);
+                    popAddr(stackedAddrs, isDone);
                 }
             }
         }
     }
+
+    /**
+     * @brief Returns the code pointers within the range, see
+     * IndirectTargets::codePointersIn().
+     */
+    std::vector<uint64_t> codePointersIn(uint64_t startAddr,
+                                         uint64_t endAddr) const {
+        if (indirectTargets == nullptr) {
+            return {};
+        }
+        return indirectTargets->codePointersIn(startAddr, endAddr);
+    }
+
+    /**
+     * @brief Returns the targets of the indirect jump at the address through
+     * a switch table that the walk may follow, see IndirectTargets::resolve().
+     * The decoded instruction of the state is overwritten.
+     * @param store The instructions falling through to the jump.
+     * @param counters The counters of the resolved tables, or nullptr.
+     */
+    std::vector<uint64_t> switchTargets(const InstructionStore &store,
+                                        uint64_t addr, uint64_t endAddr,
+                                        State &decoder,
+                                        DecodeStats *counters) {
+        return switchTargets(addr, endAddr, decoder, counters,
+                             [&](uint64_t cur) {
+                                 return IndirectTargets::previousStored(store,
+                                                                        cur);
+                             });
+    }
+
+    /**
+     * @brief Returns the targets of the indirect jump as the other
+     * switchTargets() does, with the instructions falling through to it
+     * given by previous, see IndirectTargets::resolve().
+     */
+    template <typename F>
+    std::vector<uint64_t> switchTargets(uint64_t addr, uint64_t endAddr,
+                                        State &decoder, DecodeStats *counters,
+                                        F previous) {
+        if (indirectTargets == nullptr) {
+            return {};
+        }
+        // the instructions decoded again are not counted
+        DecodeStats *decoderStats = decoder.stats;
+        decoder.stats = nullptr;
+        std::vector<uint64_t> resolved =
+            indirectTargets->resolve(addr, decoder, previous);
+        decoder.stats = decoderStats;
+
+        std::vector<uint64_t> targets;
+        for (uint64_t target : resolved) {
+            // the map may not cover the targets before the range
+            if (target <= endAddr && coverage.covers(target)) {
+                targets.push_back(target);
+            }
+        }
+        if (!targets.empty() && counters != nullptr) {
+            counters->jumpTables++;
+        }
+        return targets;
+    }
+
+    /**
+     * @struct DescentWorker
+     * @brief Keeps the decoder of a worker and its shard of the results.
+     */
+    struct DescentWorker {
+        State state;
+        size_t index; /**< The index of the worker and of its shard */
+        ConcurrentStore::Shard &results;
+        DecodeStats stats;
+        std::vector<uint64_t> indirectJumps; /**< Not resolved yet */
+
+        DescentWorker(ByteSpan binaryBytes, ConcurrentStore &store,
+                      size_t index)
+            : state(binaryBytes), index(index), results(store.shard(index)) {}
+    };
+
+    /**
+     * @brief Follows the control flow from the address until an already
+     * claimed address, a return, or the end of the range. The other targets
+     * of the control flow instructions are passed to spawn, and the
+     * indirect jumps are kept for speculate() to resolve.
+     */
+    template <typename F>
+    void walk(ConcurrentStore &store, DescentWorker &worker, uint64_t addr,
+              uint64_t endAddr, F spawn) {
+        ConcurrentStore::Shard &results = worker.results;
+        while (addr <= endAddr && store.claim(addr, worker.index)) {
+            if (worker.state.tryDecode(addr) != DecodeStatus::OK) {
+                // the walk decodes it again for its error
+                addr += 1;
+                continue;
+            }
+
+            const DecodedInstruction &decoded = worker.state.decoded;
+            uint64_t nextAddr = addr + decoded.length;
+            uint64_t cfAddr = (uint64_t)((long long)nextAddr +
+                                         decoded.nextOffset);
+            results.instructions.put(addr, nextAddr,
+                                     formatInstruction(decoded),
+                                     labelAddr(decoded));
+            results.flows.push_back(
+                {addr, decoded.nextOffset, decoded.mnemonic, nullptr});
+
+            if (decoded.mnemonic == Mnemonic::RET) {
+                return;
+            }
+            if (isControlFlowInstruction(decoded.mnemonic) &&
+                cfAddr != nextAddr && cfAddr <= endAddr) {
+                spawn(cfAddr);
+            }
+            if (decoded.mnemonic == Mnemonic::JMP && cfAddr == nextAddr &&
+                indirectTargets != nullptr) {
+                worker.indirectJumps.push_back(addr);
+            }
+            addr = nextAddr;
+        }
+    }
+
+    /**
+     * @brief Decodes every instruction the walk from the range start may
+     * reach into the shards of the store, with the workers of the
+     * scheduler. Each address is claimed on the map of the store, so it is
+     * decoded once.
+     */
+    void speculate(ConcurrentStore &store,
+                   WorkStealingScheduler<uint64_t> &scheduler,
+                   uint64_t startAddr, uint64_t endAddr) {
+        std::vector<DescentWorker> workers;
+        for (size_t i = 0; i < scheduler.workers(); i++) {
+            workers.emplace_back(binaryBytes, store, i);
+        }
+        if (stats != nullptr) {
+            for (DescentWorker &worker : workers) {
+                worker.state.stats = &worker.stats;
+            }
+        }
+
+        std::vector<uint64_t> tasks = codePointersIn(startAddr, endAddr);
+        tasks.insert(tasks.begin(), startAddr);
+        while (!tasks.empty()) {
+            for (uint64_t task : tasks) {
+                scheduler.spawn(0, task);
+            }
+            scheduler.run([&](size_t i, uint64_t addr) {
+                walk(store, workers[i], addr, endAddr, [&](uint64_t target) {
+                    size_t queued = scheduler.spawn(i, target);
+                    if (stats != nullptr) {
+                        workers[i].stats.pushed(queued);
+                    }
+                });
+            });
+
+            // the switch tables are read once every path is done, from the
+            // instructions of all the workers, so that the targets do not
+            // depend on which worker has decoded what
+            tasks.clear();
+            for (DescentWorker &worker : workers) {
+                for (uint64_t jump : worker.indirectJumps) {
+                    for (uint64_t target : switchTargets(
+                             jump, endAddr, worker.state, &worker.stats,
+                             [&](uint64_t cur) {
+                                 return claimedBefore(store, cur);
+                             })) {
+                        if (!store.isClaimed(target)) {
+                            tasks.push_back(target);
+                        }
+                    }
+                }
+                worker.indirectJumps.clear();
+            }
+        }
+
+        if (stats != nullptr) {
+            for (DescentWorker &worker : workers) {
+                stats->merge(worker.stats);
+            }
+            stats->steals += scheduler.steals();
+        }
+    }
+
+    /**
+     * @brief Returns the address of the instruction a worker has decoded
+     * ending at the address, the longest one if there are overlapping ones,
+     * or NOT_MAPPED if there is none.
+     */
+    static uint64_t claimedBefore(const ConcurrentStore &store,
+                                  uint64_t addr) {
+        for (uint64_t length = std::min<uint64_t>(MAX_INSTRUCTION_LENGTH,
+                                                  addr);
+             length > 0; length--) {
+            if (!store.isClaimed(addr - length)) {
+                continue;
+            }
+            for (size_t i = 0; i < store.size(); i++) {
+                const StoredInstruction *record =
+                    store.shard(i).instructions.findStartingAt(addr - length);
+                if (record != nullptr && record->length == length) {
+                    return record->startAddr;
+                }
+            }
+        }
+        return NOT_MAPPED;
+    }
+
+    /**
+     * @brief Steps over the instruction at curAddr as tryStep() does, with
+     * the control flow a worker has recorded, and marks it as kept where
+     * storeInstruction() would store it; its string is merged from the shard
+     * afterwards. Only the addresses the workers have not reached are
+     * decoded, and the ones they have failed to decode again.
+     */
+    DecodeStatus replayStep(const ConcurrentStore &store, CoverageMap &kept,
+                            DisassembledResult &instruction) {
+        if (!store.isClaimed(curAddr)) {
+            return tryStep(instruction);
+        }
+        const ConcurrentStore::Flow *flow = store.findFlow(curAddr);
+        if (flow == nullptr) {
+            // the workers have counted the decoding
+            DecodeStats *decoderStats = state.stats;
+            state.stats = nullptr;
+            DecodeStatus status = tryStep(instruction);
+            state.stats = decoderStats;
+            return status;
+        }
+
+        const StoredInstruction &record = *flow->record;
+        instruction.startAddr = curAddr;
+        instruction.disassembledInstructionSize = record.length;
+        instruction.mnemonic = flow->mnemonic;
+        instruction.nextOffset = flow->nextOffset;
+        instruction.labelAddr = record.labelAddr;
+        if (coverage.markDecoded(curAddr, record.endAddr())) {
+            flushErrors();
+            kept.markDecoded(curAddr, curAddr + 1);
+            if (transfers != nullptr) {
+                transfers->record(curAddr, record.length, flow->mnemonic,
+                                  record.labelAddr);
+            }
+            maxInstructionStrSize =
+                std::max(maxInstructionStrSize, (size_t)record.strSize);
+        }
+        return DecodeStatus::OK;
+    }
 };
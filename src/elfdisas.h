@@ -1,15 +1,34 @@
+#pragma once
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "addrmap.h"
+#include "arena.h"
+#include "boundary.h"
+#include "bytespan.h"
+#include "cache.h"
+#include "columnar.h"
 #include "disassembler.h"
+#include "elfview.h"
 #include "header.h"
+#include "indirect.h"
+#include "stats.h"
+#include "symbols.h"
+#include "writer.h"
 
 const std::vector<std::string> PRINTABLE_SECTIONS = {
     ".plt", ".plt.got", ".plt.sec", ".text", ".init", ".fini"};
@@ -17,237 +36,1130 @@ const std::unordered_map<std::string, std::string> SECTION_LABEL_POSTFIX = {
     {".plt", ""},  {".plt.got", "@plt"}, {".plt.sec", "@plt"},
     {".text", ""}, {".init", ""},        {".fini", ""}};
 
-inline void load(const std::string& binaryPath,
-                 std::vector<unsigned char>& binaryBytes) {
-    if (!binaryPath.empty()) {
-        std::ifstream fh(binaryPath, std::ios::binary);
-        if (fh) {
-            // Read the contents of the file into a vector
-            binaryBytes.assign(std::istreambuf_iterator<char>(fh),
-                               std::istreambuf_iterator<char>());
-        } else {
-            throw std::runtime_error("Failed to open object file: " +
-                                     binaryPath);
+/**
+ * @brief The minimum size of a chunk of a section decoded by one worker.
+ */
+const uint64_t MIN_CHUNK_SIZE = 1 << 16;
+
+/**
+ * @brief The number of chunks per worker, so that workers finishing early
+ * can pick up the remaining chunks.
+ */
+const size_t CHUNKS_PER_JOB = 4;
+
+/**
+ * @brief How far past an even split a chunk boundary is moved to the next
+ * symbol or anchor, where the sweeps of both chunks likely agree.
+ */
+const uint64_t MAX_ANCHOR_DISTANCE = 1 << 12;
+
+/**
+ * @brief Finds the first likely instruction boundary in [startAddr, endAddr):
+ * an endbr64 (f3 0f 1e fa), or the byte after a run of int3 padding.
+ * @return The address, or endAddr if there is none.
+ */
+inline uint64_t findAnchor(ByteSpan bytes, uint64_t startAddr,
+                           uint64_t endAddr) {
+    endAddr = std::min<uint64_t>(endAddr, bytes.size());
+    for (uint64_t addr = startAddr; addr < endAddr; addr++) {
+        if (bytes[addr] == 0xf3 && addr + 4 <= bytes.size() &&
+            bytes[addr + 1] == 0x0f && bytes[addr + 2] == 0x1e &&
+            bytes[addr + 3] == 0xfa) {
+            return addr;
+        }
+        if (addr > 0 && bytes[addr - 1] == 0xcc && bytes[addr] != 0xcc) {
+            return addr;
         }
-    } else {
+    }
+    return endAddr;
+}
+
+/**
+ * @struct SectionRange
+ * @brief Represents the range of a printable section.
+ */
+struct SectionRange {
+    uint64_t startAddr;      /**< The starting address */
+    uint64_t endAddr;        /**< The address past the end */
+    const std::string* name; /**< The name in PRINTABLE_SECTIONS */
+};
+
+inline MappedFile load(const std::string& binaryPath) {
+    if (binaryPath.empty()) {
         throw std::runtime_error(
             "Must provide either a file or string containing object code.");
     }
+    return MappedFile(binaryPath);
 }
 
-inline std::string getStringFromOffset(const std::vector<unsigned char>& x,
-                                       size_t i) {
-    std::string result;
-    while (i < x.size() && x[i] != '\0') {
-        result += x[i];
-        ++i;
+/**
+ * @brief The column the byte dump is aligned to in the streaming mode, where
+ * the longest instruction string is not known in advance.
+ */
+const size_t STREAM_INSTRUCTION_COLUMN = 40;
+
+/**
+ * @class ListingPrinter
+ * @brief Writes the listing of instructions given in the address order, with
+ * the section headers and the symbol labels.
+ */
+class ListingPrinter : public InstructionSink {
+   public:
+    /**
+     * @brief Constructor for ListingPrinter.
+     * @param out The writer of the listing.
+     * @param sections The printable sections in the address order.
+     * @param binaryBytes The byte array of the object source.
+     * @param symbols The symbols labelling the instructions.
+     * @param column The length the instruction strings are padded to.
+     */
+    ListingPrinter(OutputWriter& out, std::vector<SectionRange> sections,
+                   ByteSpan binaryBytes, const SymbolIndex& symbols,
+                   size_t column)
+        : out(out),
+          sections(std::move(sections)),
+          done(this->sections.size(), false),
+          binaryBytes(binaryBytes),
+          symbols(symbols),
+          column(column) {}
+
+    /**
+     * @brief Returns the length of the instruction string once the symbol of
+     * its branch target is inserted.
+     */
+    static size_t labelledSize(const SymbolIndex& symbols,
+                               std::string_view instructionStr,
+                               uint64_t labelAddr) {
+        const Symbol* label = findLabel(symbols, labelAddr);
+        return instructionStr.size() +
+               (label == nullptr ? 0 : label->name.size() + 3);
     }
-    return result;
-}
+
+    /**
+     * @brief Writes the instruction.
+     * @param addr The starting address of the instruction.
+     * @param length The length of the instruction.
+     * @param instructionStr The disassembled instruction string.
+     * @param labelAddr The branch target whose symbol is inserted into the
+     * string, or NO_LABEL.
+     */
+    void print(uint64_t addr, uint64_t length, std::string_view instructionStr,
+               uint64_t labelAddr = NO_LABEL) {
+        // the instructions come in the address order
+        while (sid < sections.size() && sections[sid].endAddr <= addr) {
+            sid++;
+        }
+        if (sid < sections.size() && sections[sid].startAddr <= addr &&
+            !done[sid]) {
+            out.write("\nsection: ").write(*sections[sid].name).write(" ----\n");
+            done[sid] = true;
+            postprefix = SECTION_LABEL_POSTFIX.at(*sections[sid].name);
+        }
+
+        // walk the symbols along the instructions
+        while (nextSymbol < symbols.size() &&
+               symbols[nextSymbol].addr < addr) {
+            nextSymbol++;
+        }
+        if (nextSymbol < symbols.size() && symbols[nextSymbol].addr == addr) {
+            const Symbol& symbol = symbols[nextSymbol];
+            out.put('\n').hex(addr).write(" <").write(symbol.name);
+            out.write(postprefix).write(">:");
+            if (symbol.hasRoffset) {
+                out.write(" #").hex(symbol.roffset);
+            }
+            out.put('\n');
+        }
+
+        out.put(' ').hex(addr).write(": ");
+        size_t size = instructionStr.size();
+        const Symbol* label = findLabel(symbols, labelAddr);
+        if (label == nullptr) {
+            out.write(instructionStr);
+        } else {
+            size_t pos = labelPosition(instructionStr, labelAddr);
+            out.write(instructionStr.substr(0, pos));
+            out.write(" <").write(label->name).put('>');
+            out.write(instructionStr.substr(pos));
+            size += label->name.size() + 3;
+        }
+        if (column > size) {
+            out.fill(' ', column - size);
+        }
+        out.write(" ( ")
+            .hexBytes(binaryBytes.data() + addr, length)
+            .write(")\n");
+    }
+
+    /**
+     * @brief Writes the instruction unless it overlaps the previous ones, as
+     * storeInstruction() would.
+     */
+    void emit(const DisassembledResult& instruction) override {
+        if (instruction.startAddr < endAddr) {
+            return;
+        }
+        endAddr = instruction.startAddr + instruction.disassembledInstructionSize;
+        print(instruction.startAddr, instruction.disassembledInstructionSize,
+              instruction.disassembledInstructionStr, instruction.labelAddr);
+    }
+
+    /**
+     * @brief Writes the end of the listing.
+     */
+    void finish() { out.write("-------------------\nDone!\n"); }
+
+   private:
+    OutputWriter& out;
+    std::vector<SectionRange> sections;
+    std::vector<bool> done; /**< Whether the section header is written */
+    size_t sid = 0;         /**< The first section not ending before */
+    std::string postprefix;
+    uint64_t endAddr = 0;  /**< The end of the last emitted instruction */
+    size_t nextSymbol = 0; /**< The first symbol not before */
+
+    ByteSpan binaryBytes;
+    const SymbolIndex& symbols;
+    size_t column;
+
+    static const Symbol* findLabel(const SymbolIndex& symbols,
+                                   uint64_t labelAddr) {
+        return labelAddr == NO_LABEL ? nullptr : symbols.find(labelAddr);
+    }
+};
 
 struct ELFDisAssembler {
     std::string binaryPath;
     std::string strategy;
 
-    std::vector<unsigned char> binaryBytes;
-    DisAssembler* da;
+    MappedFile binaryFile;
+    ByteSpan binaryBytes;
+    std::unique_ptr<DisAssembler> da;
+    DecodeCache cache; /**< The cache of the sections, disabled by default */
+    PhaseTimes phases; /**< The time spent parsing, decoding and printing */
+    bool collectStats = false; /**< Whether the decoders count, see stats.h */
+    bool recordCFG = false; /**< Whether the control transfers are recorded */
+    uint64_t rangeStart = NOT_MAPPED; /**< The start of disasRange() */
 
+    /**
+     * @brief Holds the tables parsed from the file and the names in them,
+     * released at once with the disassembler.
+     */
+    Arena arena;
+    ElfView elf; /**< The view of the headers and the tables in the file */
     ELF64_FILE_HEADER header;
-    ELF64_SECTION_HEADER shstr;
-    std::unordered_map<std::string, ELF64_SECTION_HEADER> section_headers;
-    std::unordered_map<uint64_t, std::string> addr2symbol;
-    std::unordered_map<int, std::string> pltIdx2symbol;
-    std::unordered_map<uint64_t, uint64_t> addr2roffset;
-    std::unordered_map<int, uint64_t> pltIdx2roffset;
+    AddressMap addressMap; /**< The virtual addresses of the file offsets */
+    ArenaMap<uint64_t, std::string_view> addr2symbol;
+    ArenaMap<int, std::string_view> pltIdx2symbol;
+    ArenaMap<uint64_t, uint64_t> addr2roffset;
+    ArenaMap<int, uint64_t> pltIdx2roffset;
+    ArenaMap<uint64_t, uint64_t> addr2size; /**< The sizes of the symbols */
+    SymbolIndex symbols; /**< The symbols above sorted by address */
+    std::unique_ptr<IndirectTargets>
+        indirectTargets; /**< What recursive descent follows besides the
+                              direct control flow, or nullptr */
 
     ELFDisAssembler(std::string binaryPath, std::string strategy)
-        : binaryPath(binaryPath), strategy(strategy) {
-        load(binaryPath, binaryBytes);
-
-        _parseFileHeader();
-        _parseSectionHeader();
-        _parseSymTabSection();
-        _parseDynSymSection();
-        _parsePltSecSection();
+        : binaryPath(binaryPath),
+          strategy(strategy),
+          binaryFile(load(binaryPath)),
+          binaryBytes(binaryFile.bytes()),
+          addr2symbol(ArenaAllocator<char>(arena)),
+          pltIdx2symbol(ArenaAllocator<char>(arena)),
+          addr2roffset(ArenaAllocator<char>(arena)),
+          pltIdx2roffset(ArenaAllocator<char>(arena)),
+          addr2size(ArenaAllocator<char>(arena)) {
+        phases.time("parse file header", [&]() { _parseFileHeader(); });
+        phases.time("parse section headers", [&]() { _mapAddresses(); });
+        phases.time("parse symbols", [&]() {
+            _parseSymTabSection();
+            _parseDynSymSection();
+            _parsePltSecSection();
+            symbols = SymbolIndex(addr2symbol, addr2roffset);
+        });
+        phases.time("parse code pointers", [&]() { _parseCodePointers(); });
 
         _prepareDA();
     }
 
-    void _prepareDA() {
-        if (strategy == "ls" || strategy == "linearsweep") {
-            da = new LinearSweepDisAssembler(binaryBytes, addr2symbol);
-        } else if (strategy == "rd" || strategy == "recursivedescent") {
-            da = new RecursiveDescentDisAssembler(binaryBytes, addr2symbol);
+    bool _isRecursiveDescent() const {
+        return strategy == "rd" || strategy == "recursivedescent";
+    }
+
+    std::unique_ptr<DisAssembler> _newDA() const {
+        return _newDA({0, binaryBytes.size() - 1});
+    }
+
+    /**
+     * @brief Creates a disassembler keeping track of the bytes of the range
+     * only.
+     */
+    std::unique_ptr<DisAssembler> _newDA(DisasRange range) const {
+        size_t coverageSize = binaryBytes.empty()
+                                  ? 0
+                                  : range.endAddr - range.startAddr + 1;
+        std::unique_ptr<DisAssembler> newDA;
+        if (_isRecursiveDescent()) {
+            auto rd = std::make_unique<RecursiveDescentDisAssembler>(
+                binaryBytes, coverageSize, range.startAddr);
+            rd->indirectTargets = indirectTargets.get();
+            newDA = std::move(rd);
+        } else {
+            newDA = std::make_unique<LinearSweepDisAssembler>(
+                binaryBytes, coverageSize, range.startAddr);
+        }
+        if (collectStats) {
+            newDA->enableStats();
+        }
+        if (recordCFG) {
+            newDA->enableCFG();
+        }
+        return newDA;
+    }
+
+    /**
+     * @brief Starts counting what the decoders do, reported by printStats().
+     */
+    void enableStats() {
+        collectStats = true;
+        da->enableStats();
+    }
+
+    /**
+     * @brief Starts recording the control transfers, for cfg().
+     */
+    void enableCFG() {
+        recordCFG = true;
+        da->enableCFG();
+    }
+
+    /**
+     * @brief Builds the control flow graph of the disassembled instructions,
+     * with the functions starting at the symbols, the entry point, the
+     * sections or the range passed to disasRange(), and the call targets.
+     */
+    ControlFlowGraph cfg() {
+        std::vector<uint64_t> entries;
+        for (const Symbol& symbol : symbols) {
+            entries.push_back(symbol.addr);
+        }
+        entries.push_back(addressMap.toOffset(header.e_entry));
+        if (rangeStart != NOT_MAPPED) {
+            entries.push_back(rangeStart);
         } else {
+            for (const SectionRange& range : _printableSectionRanges()) {
+                entries.push_back(range.startAddr);
+            }
+        }
+        return da->cfg(std::move(entries));
+    }
+
+    /**
+     * @brief Writes the basic blocks of the control flow graph in the
+     * address order, each one with its successors, and a header before the
+     * blocks starting a function.
+     * @param os The output stream.
+     */
+    void printCFG(std::ostream& os) {
+        ControlFlowGraph graph = cfg();
+        std::vector<bool> isEntry(graph.size(), false);
+        for (uint32_t b : graph.functionEntries()) {
+            isEntry[b] = true;
+        }
+
+        std::string line;
+        for (uint32_t b = 0; b < graph.size(); b++) {
+            const BasicBlock& block = graph[b];
+            line.clear();
+            if (isEntry[b]) {
+                line += "\nfunction ";
+                appendHex(line, block.startAddr);
+                const Symbol* symbol = symbols.find(block.startAddr);
+                if (symbol != nullptr) {
+                    line.append(" <").append(symbol->name).append(">");
+                }
+                line += ":\n";
+            }
+            line += " ";
+            appendHex(line, block.startAddr);
+            line += "-";
+            appendHex(line, block.endAddr);
+            line += ": " + std::to_string(block.numInstructions) +
+                    (block.numInstructions == 1 ? " instruction"
+                                                : " instructions");
+            const char* separator = " -> ";
+            for (const Edge& edge : graph.successors(b)) {
+                line.append(separator).append(to_string(edge.kind)).append(" ");
+                if (edge.targetAddr == INDIRECT_TARGET) {
+                    line += "*";
+                } else {
+                    appendHex(line, edge.targetAddr);
+                }
+                separator = ", ";
+            }
+            line += "\n";
+            os << line;
+        }
+        os.flush();
+    }
+
+    void _prepareDA() {
+        if (strategy != "ls" && strategy != "linearsweep" &&
+            !_isRecursiveDescent()) {
             std::cerr << strategy
                       << " is not supported as a valid strategy. We currently "
                          "support [linearsweep (ls), recursivedescent (rd)].";
             std::cerr << "The default strategy (linearsweep) is used for the "
                          "following task."
                       << std::endl;
-            da = new LinearSweepDisAssembler(binaryBytes, addr2symbol);
         }
+        da = _newDA();
+    }
+
+    /**
+     * @brief Disassembles the section, if there is one with the name.
+     * @param section_name The name of the section.
+     * @param jobs The number of workers of recursive descent, see
+     * RecursiveDescentDisAssembler::disas. Linear sweep is sequential.
+     */
+    void disas(const std::string& section_name = ".text", size_t jobs = 1) {
+        size_t sid = elf.findSection(section_name);
+        if (sid == NO_SECTION) {
+            return;
+        }
+        const ELF64_SECTION_HEADER& sh = elf.section(sid);
+        _disasRange(*da, {sh.sh_offset, sh.sh_offset + sh.sh_size - 1}, jobs);
     }
 
-    void disas(std::string section_name = ".text") {
-        if (section_headers.find(section_name) != section_headers.end()) {
-            da->disas((uint64_t)section_headers[section_name].sh_offset,
-                      (uint64_t)section_headers[section_name].sh_offset +
-                          (uint64_t)section_headers[section_name].sh_size - 1);
+    /**
+     * @brief Disassembles the range with the disassembler, using the given
+     * number of workers if it is a recursive descent one.
+     */
+    void _disasRange(DisAssembler& target, DisasRange range, size_t jobs) {
+        if (jobs > 1 && _isRecursiveDescent()) {
+            static_cast<RecursiveDescentDisAssembler&>(target).disas(
+                range.startAddr, range.endAddr, jobs);
+        } else {
+            target.disas(range.startAddr, range.endAddr);
         }
     }
 
-    void print() {
-        std::vector<std::pair<uint64_t, uint64_t>> disassembledPositionsVec(
-            da->disassembledPositions.begin(), da->disassembledPositions.end());
-        std::sort(disassembledPositionsVec.begin(),
-                  disassembledPositionsVec.end());
+    /**
+     * @brief Splits the section into the ranges decoded by the workers.
+     *
+     * With linear sweep, a large section is cut into chunks of at least
+     * MIN_CHUNK_SIZE bytes. Each cut is moved to the next symbol if there is
+     * one nearby, else to the next anchor (see findAnchor()), else left
+     * where it is, e.g. in a stripped binary; the sweeps are joined at any
+     * cut (see LinearSweepDisAssembler::join()), only faster at a real
+     * instruction boundary. Other strategies get the whole section.
+     * @param section_name The name of the section.
+     * @param jobs The number of workers.
+     * @return The ranges in the address order.
+     */
+    std::vector<DisasRange> _splitSection(const std::string& section_name,
+                                         size_t jobs) {
+        std::vector<DisasRange> chunks;
+        size_t sid = elf.findSection(section_name);
+        if (sid == NO_SECTION) {
+            return chunks;
+        }
 
-        std::string postprefix = "";
+        const ELF64_SECTION_HEADER& sh = elf.section(sid);
+        uint64_t startAddr = (uint64_t)sh.sh_offset;
+        uint64_t endAddr = (uint64_t)sh.sh_offset + (uint64_t)sh.sh_size - 1;
+        uint64_t chunkSize = std::max<uint64_t>(
+            (uint64_t)sh.sh_size / (jobs * CHUNKS_PER_JOB), MIN_CHUNK_SIZE);
+        if (_isRecursiveDescent() || (uint64_t)sh.sh_size <= chunkSize) {
+            chunks.push_back({startAddr, endAddr});
+            return chunks;
+        }
 
-        std::unordered_map<std::string, bool> done;
-        for (const std::string& s : PRINTABLE_SECTIONS) {
-            done.insert(std::make_pair(s, false));
-        }
-
-        for (const std::pair<size_t, size_t>& k : disassembledPositionsVec) {
-            for (const std::string& s : PRINTABLE_SECTIONS) {
-                if ((section_headers.find(s) != section_headers.end()) &&
-                    (k.first >= section_headers[s].sh_offset) &&
-                    (k.first < section_headers[s].sh_offset +
-                                   section_headers[s].sh_size)) {
-                    if (!done[s]) {
-                        std::cout << std::endl
-                                  << "section: " << s << " ----" << std::endl;
-                        done[s] = true;
-                        postprefix = SECTION_LABEL_POSTFIX.at(s);
-                    }
+        uint64_t chunkStart = startAddr;
+        while (endAddr - chunkStart >= 2 * chunkSize) {
+            uint64_t cut = chunkStart + chunkSize;
+            uint64_t windowEnd =
+                cut + std::min(MAX_ANCHOR_DISTANCE, chunkSize);
+            size_t i = symbols.lowerBoundIndex(cut);
+            uint64_t boundary =
+                i < symbols.size() && symbols[i].addr < windowEnd
+                    ? symbols[i].addr
+                    : findAnchor(binaryBytes, cut, windowEnd);
+            if (boundary == windowEnd) {
+                boundary = cut;
+            }
+            chunks.push_back({chunkStart, boundary - 1});
+            chunkStart = boundary;
+        }
+        chunks.push_back({chunkStart, endAddr});
+        return chunks;
+    }
+
+    /**
+     * @brief Disassembles the sections, using the given number of workers.
+     *
+     * With linear sweep, each range is decoded by its own disassembler, and
+     * the sweeps are joined in the order of the sections, resynchronizing
+     * where a cut is not an instruction boundary, so that the output does
+     * not depend on the scheduling of the workers; it is the same as the
+     * sequential one. Recursive descent walks the sections in order, each
+     * one with the instructions decoded ahead by work-stealing workers (see
+     * RecursiveDescentDisAssembler::disas), which gives the sequential
+     * output too. With the cache enabled, the results are loaded or saved
+     * by _disasCached(): a linear sweep one section at a time, recursive
+     * descent all the sections at once, since its walk of a section depends
+     * on what the previous ones have decoded.
+     * @param section_names The names of the sections in the order to merge.
+     * @param jobs The number of workers. 1 disassembles sequentially.
+     */
+    void disas(const std::vector<std::string>& section_names, size_t jobs) {
+        if (cache.enabled()) {
+            if (_isRecursiveDescent()) {
+                _disasCached(section_names, jobs);
+            } else {
+                for (const std::string& section_name : section_names) {
+                    _disasCached({section_name}, jobs);
                 }
             }
+            return;
+        }
 
-            if (da->disassembledInstructions.find(k) !=
-                da->disassembledInstructions.end()) {
-                if (addr2symbol.find(k.first) != addr2symbol.end()) {
-                    std::cout << std::endl
-                              << std::hex << k.first << " <"
-                              << addr2symbol.at(k.first) << postprefix + ">:";
-                    if (addr2roffset.find(k.first) != addr2roffset.end()) {
-                        std::cout << " #" << addr2roffset[k.first];
-                    }
+        if (jobs <= 1 || _isRecursiveDescent()) {
+            for (const std::string& section_name : section_names) {
+                disas(section_name, jobs);
+            }
+            return;
+        }
+
+        std::vector<DisasRange> tasks;
+        std::vector<bool> sectionStarts;
+        for (const std::string& section_name : section_names) {
+            std::vector<DisasRange> chunks = _splitSection(section_name, jobs);
+            for (size_t i = 0; i < chunks.size(); i++) {
+                tasks.push_back(chunks[i]);
+                sectionStarts.push_back(i == 0);
+            }
+        }
+
+        std::vector<std::unique_ptr<DisAssembler>> results(tasks.size());
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::atomic<size_t> nextTask(0);
+
+        auto worker = [&]() {
+            size_t i;
+            while ((i = nextTask++) < tasks.size()) {
+                // the last instruction may run past the end of the chunk
+                std::unique_ptr<DisAssembler> local = _newDA(
+                    {tasks[i].startAddr,
+                     std::min<uint64_t>(
+                         tasks[i].endAddr + MAX_INSTRUCTION_LENGTH,
+                         binaryBytes.size() - 1)});
+                local->disas(tasks[i].startAddr, tasks[i].endAddr);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    results[i] = std::move(local);
+                }
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t j = 0; j < std::min(jobs, tasks.size()); j++) {
+            workers.emplace_back(worker);
+        }
+
+        // join the sweeps in the order of the tasks as soon as each one is
+        // done, each section starting a new sweep
+        LinearSweepDisAssembler& ls =
+            static_cast<LinearSweepDisAssembler&>(*da);
+        for (size_t i = 0; i < tasks.size(); i++) {
+            std::unique_ptr<DisAssembler> local;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]() { return results[i] != nullptr; });
+                local = std::move(results[i]);
+            }
+            if (sectionStarts[i]) {
+                ls.curAddr = tasks[i].startAddr;
+            }
+            ls.join(static_cast<const LinearSweepDisAssembler&>(*local),
+                    tasks[i]);
+        }
+
+        for (std::thread& t : workers) {
+            t.join();
+        }
+    }
+
+    /**
+     * @brief Computes the cache key of the ranges: the bytes the decoder may
+     * read and the strategy. The symbols are resolved when printing, so they
+     * are not part of the key.
+     * Recursive descent may follow the control flow backwards out of the
+     * ranges, so every byte before their end is covered, and every byte of
+     * the file if it reads the switch tables and the code pointers.
+     * @param ranges The ranges in the order they are disassembled.
+     */
+    uint64_t _cacheKey(const std::vector<DisasRange>& ranges) const {
+        uint64_t readStart = _isRecursiveDescent() ? 0 : binaryBytes.size();
+        uint64_t readEnd = 0;
+        for (const DisasRange& range : ranges) {
+            readStart = std::min(readStart, range.startAddr);
+            readEnd = std::max(readEnd, range.endAddr + MAX_INSTRUCTION_LENGTH);
+        }
+        readEnd = std::min<uint64_t>(readEnd, binaryBytes.size());
+        bool indirect = _isRecursiveDescent() && indirectTargets != nullptr;
+        if (indirect) {
+            readEnd = binaryBytes.size();
+        }
+
+        uint64_t h = hashBytes((uint64_t)DECODER_TABLE_VERSION);
+        h = hashBytes(_isRecursiveDescent() ? "rd" : "ls", h);
+        h = hashBytes(indirect ? "indirect" : "", h);
+        h = hashBytes((uint64_t)ranges.size(), h);
+        for (const DisasRange& range : ranges) {
+            h = hashBytes(range.startAddr, h);
+            h = hashBytes(range.endAddr, h);
+        }
+        h = hashBytes(binaryBytes.subspan(readStart, readEnd - readStart), h);
+        return h;
+    }
 
-                    std::cout << std::endl;
+    /**
+     * @brief Disassembles the sections in order by a disassembler of their
+     * own, and merges the results: loaded from the cache if it has them,
+     * decoded and saved otherwise. Merging into an empty disassembler gives
+     * the same results as decoding with it.
+     * @param section_names The names of the sections.
+     * @param jobs The number of workers of recursive descent.
+     */
+    void _disasCached(const std::vector<std::string>& section_names,
+                      size_t jobs) {
+        std::vector<DisasRange> ranges;
+        for (const std::string& section_name : section_names) {
+            size_t sid = elf.findSection(section_name);
+            if (sid != NO_SECTION) {
+                const ELF64_SECTION_HEADER& sh = elf.section(sid);
+                ranges.push_back(
+                    {sh.sh_offset, sh.sh_offset + sh.sh_size - 1});
+            }
+        }
+        if (ranges.empty()) {
+            return;
+        }
+
+        uint64_t key = _cacheKey(ranges);
+        std::unique_ptr<DisAssembler> local = _newDA();
+        if (cache.load(key, *local)) {
+            for (const DisasRange& range : ranges) {
+                local->addRange(range.startAddr, range.endAddr);
+            }
+        } else {
+            for (const DisasRange& range : ranges) {
+                _disasRange(*local, range, jobs);
+            }
+            if (!cache.save(key, *local)) {
+                std::cerr << "Failed to write the decode cache: "
+                          << cache.path(key) << std::endl;
+            }
+        }
+        da->merge(*local);
+    }
+
+    /**
+     * @brief Returns the file offsets of the virtual addresses [startAddr,
+     * endAddr).
+     * @throws std::runtime_error if the addresses are not a single run of
+     * bytes of the file.
+     */
+    DisasRange _addressRange(uint64_t startAddr, uint64_t endAddr) const {
+        if (endAddr <= startAddr ||
+            !addressMap.isContiguous(startAddr, endAddr - startAddr)) {
+            std::string range;
+            appendHex(range, startAddr);
+            range += '-';
+            appendHex(range, endAddr);
+            throw std::runtime_error("Address range not mapped in the file: " +
+                                     range);
+        }
+        uint64_t offset = addressMap.toOffset(startAddr);
+        return {offset, offset + (endAddr - startAddr) - 1};
+    }
+
+    /**
+     * @brief Returns the file offsets of the symbol, e.g. a function: its
+     * size if the symbol table has it, otherwise up to the next symbol or
+     * the end of its section.
+     * @throws std::runtime_error if there is no such symbol.
+     */
+    DisasRange _symbolRange(std::string_view name) {
+        for (size_t i = 0; i < symbols.size(); i++) {
+            if (symbols[i].name != name) {
+                continue;
+            }
+            uint64_t startAddr = symbols[i].addr;
+            uint64_t endAddr = startAddr;
+            auto size = addr2size.find(startAddr);
+            if (size != addr2size.end() && size->second > 0) {
+                endAddr = startAddr + size->second;
+            } else {
+                for (size_t sid = 0; sid < elf.numSections(); sid++) {
+                    const ELF64_SECTION_HEADER& sh = elf.section(sid);
+                    if (sh.sh_type != ELF_SECTION_NOBITS &&
+                        startAddr >= sh.sh_offset &&
+                        startAddr - sh.sh_offset < sh.sh_size) {
+                        endAddr = sh.sh_offset + sh.sh_size;
+                        break;
+                    }
                 }
-                std::cout << " " << std::hex << k.first << ": ";
-                std::cout << da->disassembledInstructions.at(k);
-                std::cout << std::string(
-                    da->maxInstructionStrSize -
-                        da->disassembledInstructions.at(k).size(),
-                    ' ');
-
-                std::cout << " ( ";
-                for (int i = k.first; i < k.second; i++) {
-                    std::cout << std::hex << (int)da->binaryBytes[i] << " ";
+                if (i + 1 < symbols.size()) {
+                    endAddr = std::min(endAddr, symbols[i + 1].addr);
                 }
-                std::cout << ")" << std::endl;
             }
+            endAddr = std::min<uint64_t>(endAddr, binaryBytes.size());
+            if (endAddr <= startAddr) {
+                break;
+            }
+            return {startAddr, endAddr - 1};
+        }
+        throw std::runtime_error("No symbol with bytes in the file: " +
+                                 std::string(name));
+    }
+
+    /**
+     * @brief Disassembles only the bytes of the range, e.g. a single
+     * function, instead of the sections. The coverage of the disassembler
+     * is sized to the range, and recursive descent does not follow the
+     * control flow out of it.
+     * @param range The file offsets, see _addressRange() and _symbolRange().
+     * @param jobs The number of workers of recursive descent.
+     */
+    void disasRange(DisasRange range, size_t jobs) {
+        da = _newDA(range);
+        rangeStart = range.startAddr;
+        if (_isRecursiveDescent() && jobs > 1) {
+            static_cast<RecursiveDescentDisAssembler*>(da.get())
+                ->disas(range.startAddr, range.endAddr, jobs);
+        } else {
+            da->disas(range.startAddr, range.endAddr);
+        }
+    }
+
+    /**
+     * @brief Writes the decode errors collected so far.
+     * @param os The output stream.
+     */
+    void printDecodeErrors(std::ostream& os = std::cerr) {
+        da->errorReport.print(os);
+    }
+
+    /**
+     * @brief Returns the ranges of the printable sections in the address
+     * order.
+     */
+    std::vector<SectionRange> _printableSectionRanges() {
+        std::vector<SectionRange> ranges;
+        for (const std::string& s : PRINTABLE_SECTIONS) {
+            size_t sid = elf.findSection(s);
+            if (sid != NO_SECTION) {
+                const ELF64_SECTION_HEADER& sh = elf.section(sid);
+                uint64_t startAddr = (uint64_t)sh.sh_offset;
+                ranges.push_back(
+                    {startAddr, startAddr + (uint64_t)sh.sh_size, &s});
+            }
+        }
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const SectionRange& a, const SectionRange& b) {
+                      return a.startAddr < b.startAddr;
+                  });
+        return ranges;
+    }
+
+    /**
+     * @brief Writes the listing to the output stream.
+     */
+    void print(std::ostream& os = std::cout) {
+        OutputWriter out(os);
+        print(out);
+        out.flush();
+    }
+
+    /**
+     * @brief Writes the listing directly to the file descriptor.
+     */
+    void print(int fd) {
+        OutputWriter out(fd);
+        print(out);
+        out.flush();
+    }
+
+    /**
+     * @brief Writes the listing to the writer.
+     */
+    void print(OutputWriter& out) {
+        const InstructionStore& store = da->disassembledInstructions;
+
+        // the labels of the branch targets widen the strings
+        size_t column = da->maxInstructionStrSize;
+        for (const StoredInstruction& record : store) {
+            if (record.labelAddr != NO_LABEL) {
+                column = std::max(
+                    column, ListingPrinter::labelledSize(
+                                symbols, store.str(record), record.labelAddr));
+            }
+        }
+
+        ListingPrinter printer(out, _printableSectionRanges(), binaryBytes,
+                               symbols, column);
+        for (const StoredInstruction& record : store) {
+            printer.print(record.startAddr, record.length, store.str(record),
+                          record.labelAddr);
+        }
+        printer.finish();
+    }
+
+    /**
+     * @brief Disassembles the sections with linear sweep and writes each
+     * instruction as soon as it is decoded, without storing it.
+     *
+     * The sections are swept in the address order, so the listing has the
+     * same lines as print() except that the byte dumps are aligned to
+     * STREAM_INSTRUCTION_COLUMN.
+     * @param section_names The names of the sections.
+     * @param out The writer of the listing.
+     */
+    void stream(const std::vector<std::string>& section_names,
+                OutputWriter& out) {
+        std::vector<SectionRange> ranges;
+        for (const SectionRange& range : _printableSectionRanges()) {
+            if (range.endAddr > range.startAddr &&
+                std::find(section_names.begin(), section_names.end(),
+                          *range.name) != section_names.end()) {
+                ranges.push_back(range);
+            }
+        }
+
+        LinearSweepDisAssembler ls(binaryBytes, 0);
+        if (collectStats) {
+            ls.enableStats();
+        }
+        ListingPrinter printer(out, _printableSectionRanges(), binaryBytes,
+                               symbols, STREAM_INSTRUCTION_COLUMN);
+        for (const SectionRange& range : ranges) {
+            ls.disas(range.startAddr, range.endAddr - 1, printer);
+        }
+        printer.finish();
+        out.flush();
+
+        // keep the errors so that printDecodeErrors() reports them
+        for (const DecodeError& error : ls.errorReport.errors) {
+            da->errorReport.add(error);
+        }
+        if (collectStats) {
+            da->stats->merge(*ls.stats);
+        }
+    }
+
+    /**
+     * @brief Writes the phase timings, the coverage of the disassembled
+     * ranges, the decode errors by kind and, once enableStats() has been
+     * called, the counters of the decoders.
+     * @param os The output stream.
+     */
+    void printStats(std::ostream& os = std::cerr) {
+        const InstructionStore& store = da->disassembledInstructions;
+        uint64_t rangeBytes = 0;
+        for (const DisasRange& range : da->ranges) {
+            rangeBytes += range.endAddr - range.startAddr + 1;
+        }
+        uint64_t instructions = 0;
+        uint64_t decodedBytes = 0;
+        for (const StoredInstruction& record : store) {
+            if (store.str(record) != UNKNOWN_INSTRUCTION) {
+                instructions++;
+                decodedBytes += record.length;
+            }
+        }
+
+        os << "stats:\n";
+        phases.print(os);
+        os << "  instructions: " << instructions << "\n";
+        os << "  bytes decoded: " << decodedBytes << " of " << rangeBytes
+           << ", undecoded: "
+           << (rangeBytes > decodedBytes ? rangeBytes - decodedBytes : 0)
+           << "\n";
+        for (size_t i = 1; i < DECODE_STATUS_NUM; i++) {
+            if (da->errorReport.counts[i] > 0) {
+                os << "  " << to_string((DecodeStatus)i) << ": "
+                   << da->errorReport.counts[i] << "\n";
+            }
+        }
+        if (da->stats != nullptr) {
+            da->stats->print(os);
+        }
+        os.flush();
+    }
+
+    /**
+     * @brief Writes the boundaries of the instructions of the ranges, found
+     * by sweepBoundaries() without decoding the operands: one line per
+     * instruction with its length, and the target of a relative branch.
+     * The bytes failing to decode are left out, as in the listing.
+     * @param os The output stream.
+     * @param ranges The ranges to sweep; those without a name are headed
+     * by their first address.
+     */
+    void printBoundaries(std::ostream& os,
+                         const std::vector<SectionRange>& ranges) {
+        std::string out;
+        for (const SectionRange& range : ranges) {
+            out.clear();
+            if (range.name != nullptr) {
+                out += "section: " + *range.name + " ----\n";
+            } else {
+                out += "range: ";
+                appendHex(out, range.startAddr);
+                out += " ----\n";
+            }
+            if (range.endAddr > range.startAddr) {
+                sweepBoundaries(
+                    binaryBytes, range.startAddr, range.endAddr - 1,
+                    [&](const InstructionBoundary& boundary) {
+                        out += " ";
+                        appendHex(out, boundary.startAddr);
+                        out += ": ";
+                        out += std::to_string(boundary.length);
+                        if (boundary.isRelativeBranch) {
+                            out += " -> ";
+                            appendHex(out, branchTarget(boundary));
+                        }
+                        out += "\n";
+                    },
+                    da->stats.get());
+            }
+            os << out;
+        }
+        os.flush();
+    }
+
+    /**
+     * @brief Writes the disassembled instructions as a columnar file (see
+     * ColumnarListing), with the printable sections and the symbols.
+     *
+     * The store only keeps the rendered strings, so each instruction is
+     * decoded again for its numeric fields; the bytes not decoded are left
+     * out.
+     * @param path The path of the file.
+     */
+    void exportColumnar(const std::string& path) {
+        ColumnarBuilder builder;
+        std::vector<SectionRange> ranges = _printableSectionRanges();
+        for (const SectionRange& range : ranges) {
+            builder.addSection(range.startAddr, range.endAddr, *range.name);
+        }
+        for (const Symbol& symbol : symbols) {
+            builder.addSymbol(symbol.addr, symbol.name);
+        }
+
+        const InstructionStore& store = da->disassembledInstructions;
+        State state(binaryBytes);
+        size_t section = 0;
+        for (const StoredInstruction& record : store) {
+            if (store.str(record) == UNKNOWN_INSTRUCTION ||
+                state.tryDecode(record.startAddr) != DecodeStatus::OK) {
+                continue;
+            }
+            while (section < ranges.size() &&
+                   ranges[section].endAddr <= record.startAddr) {
+                section++;
+            }
+            uint32_t sectionId = section < ranges.size() &&
+                                         ranges[section].startAddr <=
+                                             record.startAddr
+                                     ? (uint32_t)section
+                                     : NO_ID;
+            const Symbol* symbol = symbols.findPreceding(record.startAddr);
+            builder.addInstruction(
+                state.decoded, sectionId,
+                symbol == nullptr ? NO_ID : (uint32_t)(symbol - &symbols[0]));
         }
-        std::cout << "-------------------" << std::endl;
-        std::cout << "Done!" << std::endl;
+        builder.write(path);
     }
 
     void _parseFileHeader() {
-        std::copy_n(binaryBytes.begin(), sizeof(header),
-                    reinterpret_cast<unsigned char*>(&header));
-        std::copy_n(binaryBytes.begin() + (int)header.e_shoff +
-                        (int)header.e_shstrndx * (int)header.e_shentsize,
-                    sizeof(shstr), reinterpret_cast<unsigned char*>(&shstr));
+        try {
+            elf = ElfView(binaryBytes);
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(std::string(e.what()) + ": " +
+                                     binaryPath);
+        }
+        header = elf.fileHeader();
     }
 
-    void _parseSectionHeader() {
-        for (int sid = 0; sid < (int)header.e_shnum; sid++) {
-            ELF64_SECTION_HEADER sh;
-            std::copy_n(binaryBytes.begin() + (int)header.e_shoff +
-                            sid * (int)header.e_shentsize,
-                        sizeof(sh), reinterpret_cast<unsigned char*>(&sh));
-            std::string section_name = getStringFromOffset(
-                binaryBytes, (int)shstr.sh_offset + (int)sh.sh_name);
-            section_headers.insert(std::make_pair(section_name, sh));
+    /**
+     * @brief Maps the virtual addresses to the file offsets: by the loadable
+     * segments of an executable or a shared object, and by the identity in
+     * a relocatable file, whose sections are not loaded at any address.
+     */
+    void _mapAddresses() {
+        if (header.e_type == ELF_TYPE_REL || header.e_phnum == 0) {
+            for (size_t sid = 0; sid < elf.numSections(); sid++) {
+                const ELF64_SECTION_HEADER& sh = elf.section(sid);
+                if (sh.sh_type != ELF_SECTION_NOBITS &&
+                    sh.sh_offset < binaryBytes.size()) {
+                    addressMap.map(sh.sh_offset, sh.sh_offset,
+                                   std::min<uint64_t>(
+                                       sh.sh_size,
+                                       binaryBytes.size() - sh.sh_offset));
+                }
+            }
+            return;
+        }
+        for (int pid = 0; pid < (int)header.e_phnum; pid++) {
+            uint64_t offset =
+                header.e_phoff + (uint64_t)pid * header.e_phentsize;
+            ELF64_PROGRAM_HEADER ph;
+            if (offset > binaryBytes.size() ||
+                binaryBytes.size() - offset < sizeof(ph)) {
+                break;
+            }
+            std::copy_n(binaryBytes.begin() + offset, sizeof(ph),
+                        reinterpret_cast<unsigned char*>(&ph));
+            if (ph.p_type == ELF_SEGMENT_LOAD &&
+                ph.p_offset < binaryBytes.size()) {
+                addressMap.map(ph.p_vaddr, ph.p_offset,
+                               std::min<uint64_t>(
+                                   ph.p_filesz,
+                                   binaryBytes.size() - ph.p_offset));
+            }
         }
     }
 
+    /**
+     * @brief Returns the file offset of the symbol: the value of a symbol of
+     * a relocatable file is relative to its section, and the one of an
+     * executable is its virtual address.
+     * @return The offset, or NOT_MAPPED for the undefined and absolute
+     * symbols and the ones out of the file.
+     */
+    uint64_t _symbolOffset(const ELF64_SYM& sym) const {
+        if (sym.st_shndx == ELF_SECTION_UNDEF ||
+            sym.st_shndx >= ELF_SECTION_RESERVED ||
+            sym.st_shndx >= elf.numSections()) {
+            return NOT_MAPPED;
+        }
+        if (header.e_type == ELF_TYPE_REL) {
+            return elf.section(sym.st_shndx).sh_offset + sym.st_value;
+        }
+        return addressMap.toOffset(sym.st_value);
+    }
+
+    /**
+     * @brief Labels the offsets of the symbols of .symtab, whose names
+     * point into .strtab.
+     */
     void _parseSymTabSection() {
-        // parse the .symtab section
-        if (section_headers.find(".symtab") != section_headers.end() &&
-            section_headers.find(".strtab") != section_headers.end()) {
-            int symtab_symbol_num = (int)section_headers[".symtab"].sh_size /
-                                    (int)(sizeof(ELF64_SYM));
-            for (int sid = 0; sid < symtab_symbol_num; sid++) {
-                ELF64_SYM sym;
-                std::copy_n(binaryBytes.begin() +
-                                (int)section_headers[".symtab"].sh_offset +
-                                sid * sizeof(ELF64_SYM),
-                            sizeof(sym),
-                            reinterpret_cast<unsigned char*>(&sym));
-
-                std::string sym_name = getStringFromOffset(
-                    binaryBytes, (int)section_headers[".strtab"].sh_offset +
-                                     (int)sym.st_name);
-
-                if (sym_name.size() > 0) {
-                    addr2symbol.insert(std::make_pair(
-                        (uint64_t)((long long)section_headers[".text"]
-                                       .sh_offset +
-                                   (long long)sym.st_value),
-                        sym_name));
+        size_t symtab = elf.findSection(".symtab");
+        size_t strtab = elf.findSection(".strtab");
+        if (symtab == NO_SECTION || strtab == NO_SECTION) {
+            return;
+        }
+        TableView<ELF64_SYM> syms = elf.table<ELF64_SYM>(symtab);
+        StringTable names = elf.strings(strtab);
+        addr2symbol.reserve(syms.size());
+        addr2size.reserve(syms.size());
+        for (size_t sid = 0; sid < syms.size(); sid++) {
+            ELF64_SYM sym = syms[sid];
+            if (sym.st_name == 0) {
+                continue;
+            }
+            std::string_view sym_name = names.at(sym.st_name);
+            uint64_t offset = _symbolOffset(sym);
+            if (sym_name.size() > 0 && offset != NOT_MAPPED &&
+                addr2symbol.insert(std::make_pair(offset, sym_name)).second) {
+                addr2size.insert(std::make_pair(offset, sym.st_size));
+            }
+        }
+    }
+
+    /**
+     * @brief Collects the code pointers of an executable or a shared object,
+     * which recursive descent follows besides the direct control flow: the
+     * addends of the relative relocations, among them the function pointers
+     * of .data.rel.ro and the vtables of a position independent file, and
+     * the entries of .init_array and .fini_array. The addresses of a
+     * relocatable file are not final, so it has none.
+     */
+    void _parseCodePointers() {
+        if (header.e_type == ELF_TYPE_REL) {
+            return;
+        }
+        indirectTargets =
+            std::make_unique<IndirectTargets>(binaryBytes, addressMap);
+        std::vector<uint64_t> addrs;
+        for (size_t sid = 0; sid < elf.numSections(); sid++) {
+            const ELF64_SECTION_HEADER& sh = elf.section(sid);
+            if (sh.sh_type == ELF_SECTION_RELA) {
+                TableView<ELF64_RELA> relas = elf.table<ELF64_RELA>(sid);
+                for (size_t i = 0; i < relas.size(); i++) {
+                    ELF64_RELA rela = relas[i];
+                    if ((uint32_t)rela.r_info == ELF_RELOC_X86_64_RELATIVE) {
+                        addrs.push_back((uint64_t)rela.r_addend);
+                    }
+                }
+            } else if (sh.sh_type == ELF_SECTION_INIT_ARRAY ||
+                       sh.sh_type == ELF_SECTION_FINI_ARRAY) {
+                TableView<uint64_t> words(elf.contents(sid), sizeof(uint64_t));
+                for (size_t i = 0; i < words.size(); i++) {
+                    addrs.push_back(words[i]);
                 }
             }
         }
+        indirectTargets->addCodePointers(addrs);
     }
 
+    /**
+     * @brief Names the entries of the PLT by the symbols of .dynsym their
+     * relocations in .rela.plt refer to, whose names point into .dynstr.
+     */
     void _parseDynSymSection() {
-        if (section_headers.find(".rela.plt") != section_headers.end() &&
-            section_headers.find(".dynsym") != section_headers.end() &&
-            section_headers.find(".dynstr") != section_headers.end()) {
-            int rela_num = (int)section_headers[".rela.plt"].sh_size /
-                           (int)(sizeof(ELF64_RELA));
-            for (int sid = 0; sid < rela_num; sid++) {
-                ELF64_RELA rela;
-                std::copy_n(binaryBytes.begin() +
-                                (int)section_headers[".rela.plt"].sh_offset +
-                                sid * sizeof(ELF64_RELA),
-                            sizeof(rela),
-                            reinterpret_cast<unsigned char*>(&rela));
-
-                ELF64_SYM sym;
-                std::copy_n(binaryBytes.begin() +
-                                (int)section_headers[".dynsym"].sh_offset +
-                                (rela.r_info >> 32) * sizeof(ELF64_SYM),
-                            sizeof(sym),
-                            reinterpret_cast<unsigned char*>(&sym));
-
-                std::string sym_name = getStringFromOffset(
-                    binaryBytes, (int)section_headers[".dynstr"].sh_offset +
-                                     (int)sym.st_name);
-                if (sym_name.size() > 0) {
-                    pltIdx2symbol.insert(std::make_pair(sid, sym_name));
-                    pltIdx2roffset.insert(std::make_pair(sid, rela.r_offset));
-                }
+        size_t relaplt = elf.findSection(".rela.plt");
+        size_t dynsym = elf.findSection(".dynsym");
+        size_t dynstr = elf.findSection(".dynstr");
+        if (relaplt == NO_SECTION || dynsym == NO_SECTION ||
+            dynstr == NO_SECTION) {
+            return;
+        }
+        TableView<ELF64_RELA> relas = elf.table<ELF64_RELA>(relaplt);
+        TableView<ELF64_SYM> syms = elf.table<ELF64_SYM>(dynsym);
+        StringTable names = elf.strings(dynstr);
+        for (size_t sid = 0; sid < relas.size(); sid++) {
+            ELF64_RELA rela = relas[sid];
+            uint64_t symIndex = rela.r_info >> 32;
+            if (symIndex >= syms.size()) {
+                continue;
+            }
+            std::string_view sym_name = names.at(syms[symIndex].st_name);
+            if (sym_name.size() > 0) {
+                pltIdx2symbol.insert(std::make_pair((int)sid, sym_name));
+                pltIdx2roffset.insert(
+                    std::make_pair((int)sid, rela.r_offset));
             }
         }
     }
 
     void _parsePltSecSection() {
-        if (section_headers.find(".plt.sec") != section_headers.end()) {
-            for (const std::pair<int, std::string> kv : pltIdx2symbol) {
-                addr2symbol.insert(
-                    std::make_pair(section_headers[".plt.sec"].sh_offset +
-                                       kv.first * PLT_SEC_ENTRY_SIZE,
-                                   kv.second));
-                addr2roffset.insert(
-                    std::make_pair(section_headers[".plt.sec"].sh_offset +
-                                       kv.first * PLT_SEC_ENTRY_SIZE,
-                                   pltIdx2roffset[kv.first]));
-            }
+        size_t pltsec = elf.findSection(".plt.sec");
+        if (pltsec == NO_SECTION) {
+            return;
+        }
+        uint64_t pltOffset = elf.section(pltsec).sh_offset;
+        for (const auto& kv : pltIdx2symbol) {
+            uint64_t offset = pltOffset + kv.first * PLT_SEC_ENTRY_SIZE;
+            addr2symbol.insert(std::make_pair(offset, kv.second));
+            addr2roffset.insert(
+                std::make_pair(offset, pltIdx2roffset[kv.first]));
         }
     }
 };
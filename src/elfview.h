@@ -0,0 +1,211 @@
+/**
+ * @file
+ * @brief Defines read-only views of the headers, the tables and the string
+ * tables of an ELF64 file, checked against the end of the file once.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bytespan.h"
+#include "header.h"
+
+/**
+ * @brief The index returned for a section not in the file.
+ */
+constexpr size_t NO_SECTION = (size_t)-1;
+
+/**
+ * @class TableView
+ * @brief Represents a read-only view of a table of fixed-size entries, e.g.
+ * the symbols of .symtab, read in place from the bytes. The entries are
+ * copied out one by one on access, since the file does not guarantee their
+ * alignment.
+ */
+template <typename T>
+class TableView {
+   public:
+    TableView() : entrySize(sizeof(T)), count(0) {}
+
+    /**
+     * @brief Constructor for TableView.
+     * @param bytes The bytes of the table, cut to whole entries.
+     * @param entrySize The stride of the entries, at least the size of T.
+     */
+    TableView(ByteSpan bytes, size_t entrySize)
+        : bytes(bytes),
+          entrySize(entrySize < sizeof(T) ? sizeof(T) : entrySize),
+          count(bytes.size() < sizeof(T)
+                    ? 0
+                    : (bytes.size() - sizeof(T)) / this->entrySize + 1) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Returns the entry at the index, which must be less than size().
+     */
+    T operator[](size_t i) const {
+        T entry;
+        std::memcpy(&entry, bytes.data() + i * entrySize, sizeof(T));
+        return entry;
+    }
+
+   private:
+    ByteSpan bytes;
+    size_t entrySize;
+    size_t count;
+};
+
+/**
+ * @class StringTable
+ * @brief Represents a read-only view of a string table, e.g. .strtab, whose
+ * names are returned pointing into the file.
+ */
+class StringTable {
+   public:
+    StringTable() = default;
+    explicit StringTable(ByteSpan bytes) : bytes(bytes) {}
+
+    /**
+     * @brief Returns the '\0'-terminated string at the offset, cut at the
+     * end of the table, or the empty string if the offset is out of it.
+     */
+    std::string_view at(uint64_t offset) const {
+        if (offset >= bytes.size()) {
+            return std::string_view();
+        }
+        const char* str = reinterpret_cast<const char*>(bytes.data() + offset);
+        const void* nul = std::memchr(str, '\0', bytes.size() - offset);
+        return std::string_view(
+            str, nul == nullptr ? bytes.size() - offset
+                                : static_cast<const char*>(nul) - str);
+    }
+
+   private:
+    ByteSpan bytes;
+};
+
+/**
+ * @class ElfView
+ * @brief Represents a read-only view of an ELF64 file. The file header and
+ * the section header table are checked against the end of the file when
+ * the view is created, and the contents of the sections are cut to it, so
+ * that the tables are read without checking each entry.
+ */
+class ElfView {
+   public:
+    ElfView() : header() {}
+
+    /**
+     * @brief Constructor for ElfView.
+     * @param bytes The bytes of the file, which must outlive the view.
+     * @throws std::runtime_error if the bytes are not an ELF64 file or its
+     * section header table is out of them.
+     */
+    explicit ElfView(ByteSpan bytes) : bytes(bytes) {
+        if (bytes.size() < sizeof(header) ||
+            std::memcmp(bytes.data(), "\x7f" "ELF", 4) != 0 ||
+            bytes[4] != 2) {
+            throw std::runtime_error("Not an ELF64 file");
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (header.e_shnum == 0) {
+            return;
+        }
+        if (header.e_shentsize < sizeof(ELF64_SECTION_HEADER) ||
+            header.e_shoff > bytes.size() ||
+            (bytes.size() - header.e_shoff) / header.e_shentsize <
+                header.e_shnum) {
+            throw std::runtime_error("Section headers out of the ELF file");
+        }
+        TableView<ELF64_SECTION_HEADER> sections(
+            bytes.subspan(header.e_shoff,
+                          (size_t)header.e_shnum * header.e_shentsize),
+            header.e_shentsize);
+
+        headers.reserve(sections.size());
+        for (size_t i = 0; i < sections.size(); i++) {
+            headers.push_back(sections[i]);
+        }
+        StringTable names;
+        if (header.e_shstrndx < headers.size()) {
+            names = strings(header.e_shstrndx);
+        }
+        sectionNames.reserve(headers.size());
+        for (const ELF64_SECTION_HEADER& sh : headers) {
+            sectionNames.push_back(names.at(sh.sh_name));
+        }
+    }
+
+    const ELF64_FILE_HEADER& fileHeader() const { return header; }
+    size_t numSections() const { return headers.size(); }
+
+    /**
+     * @brief Returns the header of the section at the index.
+     */
+    const ELF64_SECTION_HEADER& section(size_t index) const {
+        return headers[index];
+    }
+
+    /**
+     * @brief Returns the name of the section at the index, pointing into
+     * the section header string table.
+     */
+    std::string_view sectionName(size_t index) const {
+        return sectionNames[index];
+    }
+
+    /**
+     * @brief Returns the index of the first section of the name, or
+     * NO_SECTION.
+     */
+    size_t findSection(std::string_view name) const {
+        for (size_t i = 0; i < sectionNames.size(); i++) {
+            if (sectionNames[i] == name) {
+                return i;
+            }
+        }
+        return NO_SECTION;
+    }
+
+    /**
+     * @brief Returns the bytes of the section in the file, cut to the end of
+     * the file; none for a section without any (e.g. .bss).
+     */
+    ByteSpan contents(size_t index) const {
+        const ELF64_SECTION_HEADER& sh = headers[index];
+        if (sh.sh_type == ELF_SECTION_NOBITS) {
+            return ByteSpan();
+        }
+        return bytes.subspan(sh.sh_offset, sh.sh_size);
+    }
+
+    /**
+     * @brief Returns the view of the section as a string table.
+     */
+    StringTable strings(size_t index) const {
+        return StringTable(contents(index));
+    }
+
+    /**
+     * @brief Returns the view of the section as a table of T, e.g. the
+     * symbols of .symtab or the relocations of .rela.plt.
+     */
+    template <typename T>
+    TableView<T> table(size_t index) const {
+        return TableView<T>(contents(index), headers[index].sh_entsize);
+    }
+
+   private:
+    ByteSpan bytes;
+    ELF64_FILE_HEADER header;
+    std::vector<ELF64_SECTION_HEADER> headers; /**< By section index */
+    std::vector<std::string_view> sectionNames; /**< By section index */
+};
@@ -1,5 +1,14 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <ostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "constants.h"
+#include "formatter.h"
 
 class OPCODE_LOOKUP_ERROR : public std::runtime_error {
    public:
@@ -19,3 +28,213 @@ class InvalidOperandError : public std::runtime_error {
         : std::runtime_error(message) {}
 };
 
+/**
+ * @enum DecodeStatus
+ * @brief The result of decoding an instruction.
+ */
+enum class DecodeStatus : uint8_t {
+    OK,
+    OPCODE_LOOKUP_ERROR,   // unknown (prefix, opcode, reg)
+    OPERAND_LOOKUP_ERROR,  // unknown (prefix, mnemonic, opcode)
+    INVALID_OPERAND,       // the operand cannot be encoded this way
+    TRUNCATED,             // the instruction runs past the end of the bytes
+};
+
+constexpr size_t DECODE_STATUS_NUM = 5;
+
+inline std::string to_string(DecodeStatus status) {
+    switch (status) {
+        case DecodeStatus::OK:
+            return "OK";
+        case DecodeStatus::OPCODE_LOOKUP_ERROR:
+            return "OPCODE_LOOKUP_ERROR";
+        case DecodeStatus::OPERAND_LOOKUP_ERROR:
+            return "OPERAND_LOOKUP_ERROR";
+        case DecodeStatus::INVALID_OPERAND:
+            return "INVALID_OPERAND";
+        case DecodeStatus::TRUNCATED:
+            return "TRUNCATED";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/**
+ * @struct DecodeError
+ * @brief Describes why an instruction could not be decoded.
+ */
+struct DecodeError {
+    uint64_t addr;       /**< The starting address of the instruction */
+    int opcode;          /**< The opcode parsed so far */
+    int8_t reg;          /**< The reg field of ModRM, or -1 if irrelevant */
+    DecodeStatus status; /**< The kind of the error */
+    Prefix prefix;       /**< The prefix parsed so far */
+    Mnemonic mnemonic;   /**< The mnemonic, if it was already resolved */
+};
+
+/**
+ * @brief Renders the message of the decode error.
+ * @param error The decode error.
+ * @return The message.
+ */
+inline std::string to_string(const DecodeError& error) {
+    std::string opcode;
+    appendHex(opcode, (uint32_t)error.opcode);
+
+    switch (error.status) {
+        case DecodeStatus::OPCODE_LOOKUP_ERROR:
+            if (error.reg >= 0) {
+                return "Unknown combination of the prefix, the opcodeByte and "
+                       "the reg: (" +
+                       to_string(error.prefix) + ", " + opcode + ", " +
+                       std::to_string(error.reg) + ")";
+            }
+            return "Unknown combination of the prefix and the opcodeByte: (" +
+                   to_string(error.prefix) + ", " + opcode + ")";
+        case DecodeStatus::OPERAND_LOOKUP_ERROR:
+            return "Unknown combination of prefix, mnemonic and opcodeByte: (" +
+                   to_string(error.prefix) + ", " +
+                   to_string(error.mnemonic) + ", " + opcode + ")";
+        case DecodeStatus::INVALID_OPERAND:
+            return "Invalid operand encoding for " + to_string(error.mnemonic);
+        case DecodeStatus::TRUNCATED:
+            return "Expected more bytes but there aren't any bytes left.";
+        default:
+            return "";
+    }
+}
+
+/**
+ * @brief Throws the exception corresponding to the decode error.
+ * @param error The decode error.
+ */
+[[noreturn]] inline void throwDecodeError(const DecodeError& error) {
+    switch (error.status) {
+        case DecodeStatus::OPCODE_LOOKUP_ERROR:
+            throw OPCODE_LOOKUP_ERROR(to_string(error));
+        case DecodeStatus::OPERAND_LOOKUP_ERROR:
+            throw OPERAND_LOOKUP_ERROR(to_string(error));
+        case DecodeStatus::INVALID_OPERAND:
+            throw InvalidOperandError(to_string(error));
+        default:
+            throw std::runtime_error(to_string(error));
+    }
+}
+
+/**
+ * @struct DecodeErrorReport
+ * @brief Collects decode errors so that they can be counted and reported in
+ * one batch instead of being printed one by one.
+ */
+struct DecodeErrorReport {
+    std::vector<DecodeError> errors; /**< The errors in the order found */
+    size_t counts[DECODE_STATUS_NUM] = {}; /**< The number of errors by kind */
+
+    /**
+     * @brief Records a decode error.
+     * @param error The decode error.
+     */
+    void add(const DecodeError& error) {
+        errors.emplace_back(error);
+        counts[(size_t)error.status]++;
+    }
+
+    /**
+     * @brief Gets the number of errors of the given kind.
+     */
+    size_t count(DecodeStatus status) const {
+        return counts[(size_t)status];
+    }
+
+    /**
+     * @brief Gets the total number of errors.
+     */
+    size_t size() const { return errors.size(); }
+
+    /**
+     * @brief Discards the errors of the instructions starting in
+     * [startAddr, endAddr), keeping the order of the others.
+     */
+    void erase(uint64_t startAddr, uint64_t endAddr) {
+        eraseIf([&](const DecodeError& error) {
+            return error.addr >= startAddr && error.addr < endAddr;
+        });
+    }
+
+    /**
+     * @brief Discards the errors the predicate holds for, keeping the order
+     * of the others.
+     */
+    template <typename F>
+    void eraseIf(F isErased) {
+        size_t n = 0;
+        for (const DecodeError& error : errors) {
+            if (isErased(error)) {
+                counts[(size_t)error.status]--;
+            } else {
+                errors[n++] = error;
+            }
+        }
+        errors.resize(n);
+    }
+
+    /**
+     * @brief Replaces the errors of the instructions starting in
+     * [startAddr, endAddr) with the ones of the other report, for reports
+     * in the address order, so that only the errors of the range are moved.
+     * @param other The errors replacing them, all within the range.
+     */
+    void replace(uint64_t startAddr, uint64_t endAddr,
+                 const DecodeErrorReport& other) {
+        auto byAddr = [](const DecodeError& error, uint64_t addr) {
+            return error.addr < addr;
+        };
+        auto first =
+            std::lower_bound(errors.begin(), errors.end(), startAddr, byAddr);
+        auto last = std::lower_bound(first, errors.end(), endAddr, byAddr);
+        for (auto it = first; it != last; ++it) {
+            counts[(size_t)it->status]--;
+        }
+        first = errors.erase(first, last);
+        errors.insert(first, other.errors.begin(), other.errors.end());
+        for (size_t i = 0; i < DECODE_STATUS_NUM; i++) {
+            counts[i] += other.counts[i];
+        }
+    }
+
+    /**
+     * @brief Discards all the recorded errors.
+     */
+    void clear() {
+        errors.clear();
+        std::fill(std::begin(counts), std::end(counts), 0);
+    }
+
+    /**
+     * @brief Writes every error followed by the counts by kind.
+     * @param os The output stream.
+     */
+    void print(std::ostream& os) const {
+        if (errors.empty()) {
+            return;
+        }
+
+        std::string buf;
+        for (const DecodeError& error : errors) {
+            appendHex(buf, error.addr);
+            buf += ": " + to_string(error) + "\n";
+        }
+
+        buf += "decode errors: " + std::to_string(errors.size());
+        for (size_t i = 1; i < DECODE_STATUS_NUM; i++) {
+            if (counts[i] > 0) {
+                buf += " " + to_string((DecodeStatus)i) + "=" +
+                       std::to_string(counts[i]);
+            }
+        }
+        buf += "\n";
+
+        os.write(buf.data(), buf.size());
+        os.flush();
+    }
+};
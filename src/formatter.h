@@ -0,0 +1,271 @@
+/**
+ * @file
+ * @brief Renders decoded instructions as text.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "constants.h"
+#include "instruction.h"
+
+/**
+ * @brief The two lowercase hexadecimal digits of every byte value.
+ */
+struct HexDigitPairs {
+    char digits[512];
+
+    constexpr HexDigitPairs() : digits{} {
+        for (int i = 0; i < 256; i++) {
+            digits[2 * i] = "0123456789abcdef"[i >> 4];
+            digits[2 * i + 1] = "0123456789abcdef"[i & 0xF];
+        }
+    }
+};
+
+constexpr HexDigitPairs HEX_DIGIT_PAIRS;
+
+/**
+ * @brief Returns the number of hexadecimal digits of the value.
+ */
+inline size_t hexDigits(uint64_t val) {
+    return val == 0 ? 1 : (67 - __builtin_clzll(val)) / 4;
+}
+
+/**
+ * @brief Appends the hexadecimal representation of the value.
+ * @param out The string to append to.
+ * @param val The value.
+ * @param width The minimum number of digits (zero padded, at most 16).
+ */
+inline void appendHex(std::string& out, uint64_t val, int width = 1) {
+    size_t len = std::max(hexDigits(val), (size_t)width);
+    char buf[16];
+    char* p = buf + len;
+    // two digits per byte from the lowest one, the padding being zeros
+    while (p - buf >= 2) {
+        p -= 2;
+        std::memcpy(p, HEX_DIGIT_PAIRS.digits + 2 * (val & 0xFF), 2);
+        val >>= 8;
+    }
+    if (p != buf) {
+        *--p = HEX_DIGIT_PAIRS.digits[2 * (val & 0xF) + 1];
+    }
+    out.append(buf, len);
+}
+
+/**
+ * @brief Appends the name of the register.
+ * @param out The string to append to.
+ * @param regClass The register class.
+ * @param reg The register id.
+ */
+inline void appendRegister(std::string& out, RegClass regClass, int reg) {
+    switch (regClass) {
+        case RegClass::GPR8:
+            out += REGISTERS8.at(reg);
+            break;
+        case RegClass::GPR16:
+            out += REGISTERS16.at(reg);
+            break;
+        case RegClass::GPR32:
+            out += REGISTERS32.at(reg);
+            break;
+        case RegClass::GPR64:
+            out += REGISTERS64.at(reg);
+            break;
+        case RegClass::XMM:
+            out += "xmm" + std::to_string(reg);
+            break;
+        case RegClass::YMM:
+            out += "ymm" + std::to_string(reg);
+            break;
+        case RegClass::ST:
+            out += "st(" + std::to_string(reg) + ")";
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Returns the name of the register.
+ * @param regClass The register class.
+ * @param reg The register id.
+ * @return The register name.
+ */
+inline std::string registerName(RegClass regClass, int reg) {
+    std::string out;
+    appendRegister(out, regClass, reg);
+    return out;
+}
+
+/**
+ * @brief Appends the displacement as " + 0x..." or " - 0x...".
+ * @param out The string to append to.
+ * @param operand The memory operand.
+ */
+inline void appendDisp(std::string& out, const DecodedOperand& operand) {
+    if (operand.dispSize == 0) {
+        return;
+    }
+    if (operand.disp < 0) {
+        out += " - 0x";
+        appendHex(out, (uint64_t)(-(long long)operand.disp));
+    } else {
+        out += " + 0x";
+        appendHex(out, (uint64_t)operand.disp, operand.dispSize == 4 ? 8 : 1);
+    }
+}
+
+/**
+ * @brief Appends the rendered operand.
+ * @param out The string to append to.
+ * @param instruction The decoded instruction the operand belongs to.
+ * @param operand The operand.
+ */
+inline void appendOperand(std::string& out,
+                          const DecodedInstruction& instruction,
+                          const DecodedOperand& operand) {
+    if (instruction.segment != Segment::NONE &&
+        (isRM(operand.type) || isREG(operand.type) || isM(operand.type))) {
+        out += instruction.segment == Segment::FS ? "fs:" : "gs:";
+    }
+
+    switch (operand.kind) {
+        case OperandKind::REG: {
+            appendRegister(out, operand.regClass, operand.reg);
+            break;
+        }
+        case OperandKind::MEM: {
+            if (operand.base == RIP_REG) {
+                out += "[rip";
+                appendDisp(out, operand);
+                out += "]";
+                break;
+            }
+
+            bool bracketed =
+                operand.base != NO_REG || operand.index != NO_REG;
+            if (bracketed) {
+                out += "[";
+            }
+            if (operand.base == NO_REG) {
+                // absolute address, e.g. 0x00080000
+                if (operand.disp < 0) {
+                    out += "-0x";
+                    appendHex(out, (uint64_t)(-(long long)operand.disp));
+                } else {
+                    out += "0x";
+                    appendHex(out, (uint64_t)operand.disp, 8);
+                }
+            } else {
+                out += REGISTERS64.at(operand.base);
+            }
+            if (operand.index != NO_REG) {
+                out += " + ";
+                out += REGISTERS64.at(operand.index);
+                out += " * ";
+                out += (char)('0' + operand.scale);
+            }
+            if (operand.base != NO_REG) {
+                appendDisp(out, operand);
+            }
+            if (bracketed) {
+                out += "]";
+            }
+            break;
+        }
+        case OperandKind::IMM: {
+            out += "0x";
+            appendHex(out, operand.imm, 2 * operand.immSize);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Renders an operand.
+ * @param instruction The decoded instruction the operand belongs to.
+ * @param operand The operand.
+ * @return The operand string.
+ */
+inline std::string formatOperand(const DecodedInstruction& instruction,
+                                 const DecodedOperand& operand) {
+    std::string out;
+    appendOperand(out, instruction, operand);
+    return out;
+}
+
+/**
+ * @brief Returns the string of the instruction prefix (e.g. lock, rep).
+ * @param instruction The decoded instruction.
+ * @return The prefix string, or an empty string.
+ */
+inline const char* formatInstructionPrefix(
+    const DecodedInstruction& instruction) {
+    switch (instruction.instructionPrefixByte) {
+        case 0xF0:
+            return "lock";
+        case 0xF2:
+            return isControlFlowInstruction(instruction.mnemonic) ? "bnd"
+                                                                  : "repne";
+        case 0xF3:
+            return "rep";
+        case 0x3E:
+            return "notrack";
+        default:
+            return "";
+    }
+}
+
+/**
+ * @brief Renders the decoded instruction. The symbol of a branch target is
+ * not resolved here, but inserted at labelPosition() when the listing is
+ * written.
+ * @param instruction The decoded instruction.
+ * @return The disassembled instruction string.
+ */
+inline std::string formatInstruction(const DecodedInstruction& instruction) {
+    std::string out;
+
+    if (isRelativeBranch(instruction)) {
+        out += to_string(instruction.mnemonic);
+        out += " ";
+        appendHex(out, branchTarget(instruction));
+        out += " ; relative offset = ";
+        out += std::to_string(instruction.nextOffset);
+        return out;
+    }
+
+    const char* prefixStr = formatInstructionPrefix(instruction);
+    if (*prefixStr != '\0') {
+        out += prefixStr;
+        out += " ";
+    }
+    out += to_string(instruction.mnemonic);
+    out += " ";
+    for (size_t i = 0; i < instruction.numOperands; i++) {
+        out += " ";
+        appendOperand(out, instruction, instruction.operands[i]);
+    }
+    return out;
+}
+
+/**
+ * @brief Returns where the label of the branch target goes in the string
+ * rendered by formatInstruction(), i.e. right after the target address.
+ * @param instructionStr The disassembled instruction string.
+ * @param labelAddr The branch target.
+ */
+inline size_t labelPosition(std::string_view instructionStr,
+                            uint64_t labelAddr) {
+    return std::min(instructionStr.find(' ') + 1 + hexDigits(labelAddr),
+                    instructionStr.size());
+}
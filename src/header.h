@@ -1,6 +1,27 @@
+#pragma once
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
+// e_type of a relocatable file, whose sections are not loaded at addresses
+const uint16_t ELF_TYPE_REL = 1;
+// p_type of a loadable segment
+const uint32_t ELF_SEGMENT_LOAD = 1;
+// sh_type of a section without bytes in the file (.bss)
+const uint32_t ELF_SECTION_NOBITS = 8;
+// sh_flags bit of a section holding executable code
+const uint64_t ELF_SECTION_FLAG_EXECINSTR = 0x4;
+// sh_type of the relocations with addends, and of the arrays of the
+// initialization and termination functions
+const uint32_t ELF_SECTION_RELA = 4;
+const uint32_t ELF_SECTION_INIT_ARRAY = 14;
+const uint32_t ELF_SECTION_FINI_ARRAY = 15;
+// r_info type of the x86-64 relocation adding the load address to the addend
+const uint32_t ELF_RELOC_X86_64_RELATIVE = 8;
+// st_shndx of an undefined symbol, and the first reserved section index
+const uint16_t ELF_SECTION_UNDEF = 0;
+const uint16_t ELF_SECTION_RESERVED = 0xff00;
+
 typedef struct {
     unsigned char e_ident[16];
     uint16_t e_type;
@@ -31,6 +52,17 @@ typedef struct {
     uint64_t sh_entsize;
 } ELF64_SECTION_HEADER;
 
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} ELF64_PROGRAM_HEADER;
+
 typedef struct {
     uint32_t st_name;        // 4
     unsigned char st_info;   // 1
@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @brief Defines the discovery of the code reached only through indirect
+ * jumps and calls: the targets of switch tables, and the addresses the code
+ * pointers of the data sections hold.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "addrmap.h"
+#include "bytespan.h"
+#include "state.h"
+#include "store.h"
+
+/**
+ * @brief The most entries read from a switch table, whatever its bound.
+ */
+constexpr uint64_t MAX_JUMP_TABLE_ENTRIES = 1024;
+
+/**
+ * @brief The number of instructions before an indirect jump searched for
+ * the loads of its switch table and the check of its bound.
+ */
+constexpr size_t JUMP_TABLE_LOOKBACK = 8;
+
+/**
+ * @class IndirectTargets
+ * @brief Finds the targets of the indirect jumps through switch tables, and
+ * keeps the known code pointers, as file offsets.
+ *
+ * Two switch patterns are recognized, both after the bound of the index is
+ * checked by `cmp reg, imm` and `ja` (or `jae`):
+ * - position independent: `lea base, [rip + table]`, `movsxd reg,
+ *   [base + index * 4]`, `add reg, base`, `jmp reg`, each entry being the
+ *   offset of its target from the table;
+ * - absolute: `jmp [table + index * 8]`, each entry being the address of
+ *   its target.
+ * A table without a bound is not read, since a guess past its end would
+ * spill decoded data into the listing.
+ */
+class IndirectTargets {
+   public:
+    /**
+     * @brief Constructor for IndirectTargets.
+     * @param binaryBytes The bytes the tables are read from.
+     * @param addressMap The virtual addresses of the file offsets; the
+     * addresses are the offsets if it is empty.
+     */
+    explicit IndirectTargets(ByteSpan binaryBytes,
+                             AddressMap addressMap = AddressMap())
+        : binaryBytes(binaryBytes), addressMap(std::move(addressMap)) {}
+
+    /**
+     * @brief Adds the virtual addresses held by code pointers, e.g. the
+     * addends of relative relocations or the entries of .init_array.
+     * Addresses out of the file are ignored.
+     */
+    void addCodePointers(const std::vector<uint64_t>& addrs) {
+        for (uint64_t addr : addrs) {
+            uint64_t offset = toOffset(addr);
+            if (offset != NOT_MAPPED) {
+                codePointers.push_back(offset);
+            }
+        }
+        std::sort(codePointers.begin(), codePointers.end());
+        codePointers.erase(
+            std::unique(codePointers.begin(), codePointers.end()),
+            codePointers.end());
+    }
+
+    /**
+     * @brief Returns the offsets the code pointers hold within [startAddr,
+     * endAddr], in the address order.
+     */
+    std::vector<uint64_t> codePointersIn(uint64_t startAddr,
+                                         uint64_t endAddr) const {
+        return {std::lower_bound(codePointers.begin(), codePointers.end(),
+                                 startAddr),
+                std::upper_bound(codePointers.begin(), codePointers.end(),
+                                 endAddr)};
+    }
+
+    /**
+     * @brief Finds the targets of the indirect jump at the offset from the
+     * instructions stored right before it, which the jump falls through
+     * from.
+     * @param store The instructions decoded on the way to the jump.
+     * @param addr The offset of the jump.
+     * @param state A decoder over the bytes, whose decoded instruction is
+     * overwritten.
+     * @return The offsets of the targets in the address order, none if the
+     * jump is not through a bounded switch table.
+     */
+    std::vector<uint64_t> resolve(const InstructionStore& store,
+                                  uint64_t addr, State& state) const {
+        return resolve(addr, state, [&](uint64_t cur) {
+            return previousStored(store, cur);
+        });
+    }
+
+    /**
+     * @brief Returns the offset of the instruction of the store ending at
+     * the offset, or NOT_MAPPED if there is none.
+     */
+    static uint64_t previousStored(const InstructionStore& store,
+                                   uint64_t addr) {
+        const StoredInstruction* record = store.findCovering(addr - 1);
+        if (record == nullptr || record->endAddr() != addr ||
+            store.str(*record) == UNKNOWN_INSTRUCTION) {
+            return NOT_MAPPED;
+        }
+        return record->startAddr;
+    }
+
+    /**
+     * @brief Finds the targets of the indirect jump at the offset as
+     * resolve() does, from the instructions given by previous.
+     * @param addr The offset of the jump.
+     * @param state A decoder over the bytes, whose decoded instruction is
+     * overwritten.
+     * @param previous Returns the offset of the instruction ending at the
+     * offset, or NOT_MAPPED if there is none.
+     */
+    template <typename F>
+    std::vector<uint64_t> resolve(uint64_t addr, State& state,
+                                  F previous) const {
+        if (state.tryDecode(addr) != DecodeStatus::OK ||
+            state.decoded.mnemonic != Mnemonic::JMP ||
+            state.decoded.numOperands != 1) {
+            return {};
+        }
+        DecodedOperand target = state.decoded.operands[0];
+        bool isAbsolute = target.kind == OperandKind::MEM &&
+                          target.base == NO_REG && target.index != NO_REG &&
+                          target.scale == 8 && target.dispSize == 4;
+        bool isRelative = target.kind == OperandKind::REG &&
+                          target.regClass == RegClass::GPR64;
+        if (!isAbsolute && !isRelative) {
+            return {};
+        }
+
+        // the instructions falling through to the jump, the closest first
+        std::vector<uint64_t> before;
+        uint64_t cur = addr;
+        while (before.size() < JUMP_TABLE_LOOKBACK && cur > 0) {
+            cur = previous(cur);
+            if (cur == NOT_MAPPED) {
+                break;
+            }
+            before.push_back(cur);
+        }
+
+        uint64_t tableAddr = isAbsolute ? (uint64_t)(int64_t)target.disp
+                                        : NOT_MAPPED;
+        int8_t reg = isRelative ? target.reg : NO_REG;
+        int8_t base = NO_REG;
+        bool loaded = false;
+        uint64_t numEntries = 0;
+        for (size_t i = 0; i < before.size() && numEntries == 0; i++) {
+            if (state.tryDecode(before[i]) != DecodeStatus::OK) {
+                break;
+            }
+            const DecodedInstruction& decoded = state.decoded;
+            const DecodedOperand* ops = decoded.operands;
+            if (isJCCInstruction(decoded.mnemonic)) {
+                bool isAbove = decoded.mnemonic == Mnemonic::JNBE;
+                if (!isAbove && decoded.mnemonic != Mnemonic::JNB) {
+                    return {};  // the index is checked by another jump
+                }
+                if (i + 1 == before.size() ||
+                    state.tryDecode(before[i + 1]) != DecodeStatus::OK ||
+                    state.decoded.mnemonic != Mnemonic::CMP ||
+                    state.decoded.numOperands != 2 ||
+                    state.decoded.operands[1].kind != OperandKind::IMM) {
+                    return {};
+                }
+                numEntries =
+                    state.decoded.operands[1].imm + (isAbove ? 1 : 0);
+            } else if (!isRelative || tableAddr != NOT_MAPPED ||
+                       decoded.numOperands != 2 ||
+                       ops[0].kind != OperandKind::REG) {
+                continue;
+            } else if (base == NO_REG && decoded.mnemonic == Mnemonic::ADD &&
+                       ops[0].reg == reg && ops[1].kind == OperandKind::REG &&
+                       ops[1].regClass == RegClass::GPR64) {
+                base = ops[1].reg;
+            } else if (base != NO_REG && !loaded &&
+                       decoded.mnemonic == Mnemonic::MOVSXD &&
+                       ops[0].reg == reg && ops[1].kind == OperandKind::MEM &&
+                       ops[1].base == base && ops[1].index != NO_REG &&
+                       ops[1].scale == 4 && ops[1].dispSize == 0) {
+                loaded = true;
+            } else if (loaded && decoded.mnemonic == Mnemonic::LEA &&
+                       ops[0].reg == base && ops[1].base == RIP_REG) {
+                uint64_t next = toAddr(before[i] + decoded.length);
+                if (next == NOT_MAPPED) {
+                    return {};
+                }
+                tableAddr = next + (uint64_t)(int64_t)ops[1].disp;
+            }
+        }
+        if (tableAddr == NOT_MAPPED || numEntries == 0) {
+            return {};
+        }
+        return readTable(tableAddr,
+                         std::min(numEntries, MAX_JUMP_TABLE_ENTRIES),
+                         isAbsolute);
+    }
+
+   private:
+    ByteSpan binaryBytes;
+    AddressMap addressMap;
+    std::vector<uint64_t> codePointers; /**< Sorted file offsets */
+
+    uint64_t toOffset(uint64_t addr) const {
+        if (addressMap.empty()) {
+            return addr < binaryBytes.size() ? addr : NOT_MAPPED;
+        }
+        return addressMap.toOffset(addr);
+    }
+
+    uint64_t toAddr(uint64_t offset) const {
+        return addressMap.empty() ? offset : addressMap.toAddr(offset);
+    }
+
+    /**
+     * @brief Reads the targets of the entries of the table at the address.
+     */
+    std::vector<uint64_t> readTable(uint64_t tableAddr, uint64_t numEntries,
+                                    bool isAbsolute) const {
+        uint64_t entrySize = isAbsolute ? 8 : 4;
+        std::vector<uint64_t> targets;
+        for (uint64_t i = 0; i < numEntries; i++) {
+            uint64_t offset = toOffset(tableAddr + i * entrySize);
+            if (offset == NOT_MAPPED ||
+                binaryBytes.size() - offset < entrySize) {
+                break;
+            }
+            uint64_t targetAddr;
+            if (isAbsolute) {
+                std::memcpy(&targetAddr, binaryBytes.data() + offset, 8);
+            } else {
+                int32_t entry;
+                std::memcpy(&entry, binaryBytes.data() + offset, 4);
+                targetAddr = tableAddr + (uint64_t)(int64_t)entry;
+            }
+            uint64_t target = toOffset(targetAddr);
+            if (target != NOT_MAPPED) {
+                targets.push_back(target);
+            }
+        }
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()),
+                      targets.end());
+        return targets;
+    }
+};
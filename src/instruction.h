@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Defines the structured record of a decoded x86 instruction.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.h"
+
+/**
+ * @brief The maximum number of operands of an instruction.
+ */
+constexpr size_t MAX_OPERAND_NUM = 4;
+
+/**
+ * @brief The register id meaning that no register is used.
+ */
+constexpr int8_t NO_REG = -1;
+
+/**
+ * @brief The base register id of RIP-relative addressing.
+ */
+constexpr int8_t RIP_REG = -2;
+
+/**
+ * @enum OperandKind
+ * @brief The kind of a decoded operand.
+ */
+enum class OperandKind : uint8_t {
+    NONE,  // the operand has no encoding in the instruction (e.g. st0, 1)
+    REG,   // a register
+    MEM,   // a memory address
+    IMM,   // an immediate value
+};
+
+/**
+ * @enum RegClass
+ * @brief The register file that the register id of an operand refers to.
+ */
+enum class RegClass : uint8_t {
+    NONE,
+    GPR8,   // REGISTERS8
+    GPR16,  // REGISTERS16
+    GPR32,  // REGISTERS32
+    GPR64,  // REGISTERS64
+    XMM,
+    YMM,
+    ST,  // x87 stack registers
+};
+
+/**
+ * @brief Returns the register class of the operand type.
+ * @param operand The operand type.
+ * @return The register class, or RegClass::NONE if the operand type cannot be
+ * a register.
+ */
+inline RegClass operand2regClass(Operand operand) {
+    if (is8Bit(operand) || operand == Operand::al || operand == Operand::cl) {
+        return RegClass::GPR8;
+    } else if (is16Bit(operand) || operand == Operand::ax ||
+               operand == Operand::dx) {
+        return RegClass::GPR16;
+    } else if (is32Bit(operand) || operand == Operand::eax) {
+        return RegClass::GPR32;
+    } else if (is64Bit(operand) || operand == Operand::rax) {
+        return RegClass::GPR64;
+    } else if (operand == Operand::xmm || operand == Operand::xm128) {
+        return RegClass::XMM;
+    } else if (operand == Operand::ymm || operand == Operand::ym256) {
+        return RegClass::YMM;
+    }
+    return RegClass::NONE;
+}
+
+/**
+ * @enum Segment
+ * @brief The segment override prefix of an instruction.
+ */
+enum class Segment : uint8_t {
+    NONE,
+    FS,
+    GS,
+};
+
+/**
+ * @struct DecodedOperand
+ * @brief Represents one operand of a decoded instruction.
+ */
+struct DecodedOperand {
+    Operand type;       /**< The operand type in the lookup table */
+    OperandKind kind;   /**< The kind of the operand */
+    RegClass regClass;  /**< The register class of a register operand */
+    int8_t reg;         /**< The register id of a register operand */
+    int8_t base;  /**< The base register id (REGISTERS64, RIP_REG or NO_REG) */
+    int8_t index;      /**< The index register id (REGISTERS64 or NO_REG) */
+    uint8_t scale;     /**< The multiplier of the index register */
+    uint8_t dispSize;  /**< The size of the displacement (0, 1 or 4 bytes) */
+    uint8_t immSize;   /**< The size of the immediate value in bytes */
+    int32_t disp;      /**< The sign-extended displacement */
+    uint64_t imm;      /**< The zero-extended immediate value */
+};
+
+/**
+ * @struct DecodedInstruction
+ * @brief Represents a decoded instruction without any heap allocation.
+ */
+struct DecodedInstruction {
+    uint64_t startAddr;   /**< The starting address of the instruction */
+    long long nextOffset; /**< The relative offset of the branch target */
+    Mnemonic mnemonic;    /**< The mnemonic of the instruction */
+    Prefix prefix; /**< The prefix used to look up the instruction */
+    uint8_t instructionPrefixByte; /**< lock/rep/bnd/notrack byte, or 0 */
+    Segment segment;     /**< The segment override prefix */
+    uint8_t length;      /**< The length of the instruction in bytes */
+    uint8_t numOperands; /**< The number of valid entries in operands */
+    DecodedOperand operands[MAX_OPERAND_NUM]; /**< The decoded operands */
+};
+
+/**
+ * @brief Checks whether the instruction is a branch to a relative target.
+ * @param instruction The decoded instruction.
+ * @return True if the only operand is the relative offset of the target.
+ */
+inline bool isRelativeBranch(const DecodedInstruction& instruction) {
+    return isControlFlowInstruction(instruction.mnemonic) &&
+           instruction.numOperands == 1 &&
+           instruction.operands[0].kind == OperandKind::IMM;
+}
+
+/**
+ * @brief Computes the target address of a relative branch.
+ * @param instruction The decoded instruction.
+ * @return The address of the branch target.
+ */
+inline uint64_t branchTarget(const DecodedInstruction& instruction) {
+    return (uint64_t)((long long)instruction.startAddr +
+                      (long long)instruction.length + instruction.nextOffset);
+}
+
+/**
+ * @struct InstructionBoundary
+ * @brief Represents the extent of an instruction and the target of a
+ * relative branch, decoded without the operands.
+ */
+struct InstructionBoundary {
+    uint64_t startAddr;    /**< The starting address of the instruction */
+    long long nextOffset;  /**< The relative offset of the branch target */
+    Mnemonic mnemonic;     /**< The mnemonic of the instruction */
+    uint8_t length;        /**< The length of the instruction in bytes */
+    bool isRelativeBranch; /**< True if nextOffset is a branch target */
+};
+
+/**
+ * @brief Computes the target address of a relative branch.
+ * @param boundary The boundary of the branch.
+ * @return The address of the branch target.
+ */
+inline uint64_t branchTarget(const InstructionBoundary& boundary) {
+    return (uint64_t)((long long)boundary.startAddr +
+                      (long long)boundary.length + boundary.nextOffset);
+}
+
+/**
+ * @brief The label address of an instruction without a target to label.
+ */
+constexpr uint64_t NO_LABEL = ~0ULL;
+
+/**
+ * @brief Returns the address whose symbol labels the instruction.
+ * @param instruction The decoded instruction.
+ * @return The branch target of a relative branch, otherwise NO_LABEL.
+ */
+inline uint64_t labelAddr(const DecodedInstruction& instruction) {
+    return isRelativeBranch(instruction) ? branchTarget(instruction)
+                                         : NO_LABEL;
+}
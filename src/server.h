@@ -0,0 +1,465 @@
+/**
+ * @file
+ * @brief Defines the server mode answering disassembly requests over a Unix
+ * socket, with the parsed files kept between the requests.
+ */
+
+#pragma once
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "addrmap.h"
+#include "elfdisas.h"
+
+/**
+ * @brief The largest frame accepted, so that a bad length does not allocate
+ * without bound.
+ */
+constexpr uint32_t MAX_FRAME_SIZE = 64 << 20;
+
+/**
+ * @brief The number of parsed files kept by default.
+ */
+constexpr size_t DEFAULT_CACHED_FILES = 64;
+
+/**
+ * @brief Writes a frame: the length of the payload in 4 little-endian bytes,
+ * then the payload.
+ * @return False if the peer is gone or the payload is too large.
+ */
+inline bool writeFrame(int fd, std::string_view payload) {
+    if (payload.size() > MAX_FRAME_SIZE) {
+        return false;
+    }
+    uint32_t size = (uint32_t)payload.size();
+    unsigned char length[4] = {(unsigned char)size,
+                               (unsigned char)(size >> 8),
+                               (unsigned char)(size >> 16),
+                               (unsigned char)(size >> 24)};
+    std::string frame((const char*)length, sizeof(length));
+    frame.append(payload);
+    for (size_t done = 0; done < frame.size();) {
+        // a client closing its end must not kill the server with SIGPIPE
+        ssize_t n = ::send(fd, frame.data() + done, frame.size() - done,
+                           MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a frame written by writeFrame().
+ * @return False at the end of the stream, on an error, or if the frame is
+ * larger than MAX_FRAME_SIZE.
+ */
+inline bool readFrame(int fd, std::string& payload) {
+    auto readAll = [fd](char* buf, size_t size) {
+        for (size_t done = 0; done < size;) {
+            ssize_t n = ::read(fd, buf + done, size - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    };
+    unsigned char length[4];
+    if (!readAll((char*)length, sizeof(length))) {
+        return false;
+    }
+    uint32_t size = length[0] | (uint32_t)length[1] << 8 |
+                    (uint32_t)length[2] << 16 | (uint32_t)length[3] << 24;
+    if (size > MAX_FRAME_SIZE) {
+        return false;
+    }
+    payload.resize(size);
+    return readAll(&payload[0], size);
+}
+
+/**
+ * @brief Connects to the server listening on the socket.
+ * @return The connected descriptor, or -1.
+ */
+inline int connectServer(const std::string& socketPath) {
+    sockaddr_un addr = {};
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @struct ServerRequest
+ * @brief Represents a request, one line of space-separated fields:
+ * - `range STRATEGY START-END PATH` disassembles the virtual addresses
+ *   [START, END), in hex;
+ * - `symbol STRATEGY NAME PATH` disassembles the symbol;
+ * - `ping` checks that the server is up;
+ * - `shutdown` stops the server.
+ *
+ * The path is the rest of the line, so it may hold spaces. The response is
+ * `ok` and a newline followed by the listing, or `error` and a newline
+ * followed by the reason.
+ */
+struct ServerRequest {
+    std::string command;  /**< range, symbol, ping or shutdown */
+    std::string strategy; /**< linearsweep (ls) or recursivedescent (rd) */
+    std::string target;   /**< The addresses or the symbol name */
+    std::string path;     /**< The object file */
+
+    /**
+     * @brief Parses a request.
+     * @throws std::invalid_argument if it is malformed.
+     */
+    static ServerRequest parse(std::string_view line) {
+        ServerRequest request;
+        auto field = [&line]() {
+            size_t end = line.find(' ');
+            std::string value(line.substr(0, end));
+            line = end == std::string_view::npos ? std::string_view()
+                                                 : line.substr(end + 1);
+            return value;
+        };
+        request.command = field();
+        if (request.command == "ping" || request.command == "shutdown") {
+            return request;
+        }
+        if (request.command != "range" && request.command != "symbol") {
+            throw std::invalid_argument("Unknown command: " +
+                                        request.command);
+        }
+        request.strategy = field();
+        if (request.strategy != "ls" && request.strategy != "linearsweep" &&
+            request.strategy != "rd" &&
+            request.strategy != "recursivedescent") {
+            throw std::invalid_argument("Unknown strategy: " +
+                                        request.strategy);
+        }
+        request.target = field();
+        request.path = std::string(line);
+        if (request.target.empty() || request.path.empty()) {
+            throw std::invalid_argument("Expected: " + request.command +
+                                        " STRATEGY " +
+                                        (request.command == "range"
+                                             ? "START-END"
+                                             : "NAME") +
+                                        " PATH");
+        }
+        return request;
+    }
+};
+
+/**
+ * @class ParsedFileCache
+ * @brief Keeps the parsed files, their headers, sections and symbols, for
+ * the next requests. A file is parsed again once its inode, size or
+ * modification time changes, and the least recently used file is dropped
+ * when the cache is full.
+ */
+class ParsedFileCache {
+   public:
+    explicit ParsedFileCache(size_t capacity = DEFAULT_CACHED_FILES)
+        : capacity(std::max<size_t>(capacity, 1)) {}
+
+    /**
+     * @brief Returns the parsed file, parsing it unless it is cached and
+     * unchanged.
+     * @throws std::runtime_error if it cannot be read or is not an ELF64
+     * file.
+     */
+    ELFDisAssembler& get(const std::string& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            throw std::runtime_error("Failed to open " + path + " (" +
+                                     std::strerror(errno) + ")");
+        }
+        Entry& entry = entries[path];
+        if (entry.eda == nullptr || entry.dev != st.st_dev ||
+            entry.ino != st.st_ino || entry.size != st.st_size ||
+            entry.mtime.tv_sec != st.st_mtim.tv_sec ||
+            entry.mtime.tv_nsec != st.st_mtim.tv_nsec) {
+            entry.eda.reset();
+            try {
+                entry.eda = std::make_unique<ELFDisAssembler>(path,
+                                                              "linearsweep");
+            } catch (...) {
+                entries.erase(path);
+                throw;
+            }
+            entry.dev = st.st_dev;
+            entry.ino = st.st_ino;
+            entry.size = st.st_size;
+            entry.mtime = st.st_mtim;
+            parses++;
+        }
+        entry.lastUse = ++clock;
+
+        if (entries.size() > capacity) {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (it->second.lastUse < oldest->second.lastUse) {
+                    oldest = it;
+                }
+            }
+            entries.erase(oldest);
+        }
+        return *entries[path].eda;
+    }
+
+    size_t size() const { return entries.size(); }
+
+    uint64_t parses = 0; /**< The number of files parsed so far */
+
+   private:
+    struct Entry {
+        std::unique_ptr<ELFDisAssembler> eda;
+        dev_t dev = 0;
+        ino_t ino = 0;
+        off_t size = 0;
+        timespec mtime = {};
+        uint64_t lastUse = 0;
+    };
+
+    size_t capacity;
+    uint64_t clock = 0;
+    std::unordered_map<std::string, Entry> entries;
+};
+
+/**
+ * @class DisasServer
+ * @brief Answers the requests of ServerRequest over a Unix socket.
+ *
+ * The decoder tables are built once for the process and the parsed files
+ * are kept by a ParsedFileCache, so a request only pays for decoding and
+ * printing its range. Every connection is served by its own thread and may
+ * send any number of requests; the requests are answered one at a time.
+ */
+class DisasServer {
+   public:
+    explicit DisasServer(size_t cachedFiles = DEFAULT_CACHED_FILES)
+        : files(cachedFiles) {}
+
+    /**
+     * @brief Answers a request, stopping the server on a shutdown request.
+     * @return The response payload.
+     */
+    std::string handle(std::string_view line) {
+        bool shutdown = false;
+        std::string response = handle(line, shutdown);
+        if (shutdown) {
+            stop();
+        }
+        return response;
+    }
+
+    /**
+     * @brief Answers a request.
+     * @param shutdown Set if the request is a shutdown request.
+     * @return The response payload.
+     */
+    std::string handle(std::string_view line, bool& shutdown) {
+        try {
+            ServerRequest request = ServerRequest::parse(line);
+            if (request.command == "ping") {
+                return "ok\n";
+            } else if (request.command == "shutdown") {
+                shutdown = true;
+                return "ok\n";
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            ELFDisAssembler& eda = files.get(request.path);
+            eda.strategy = request.strategy;
+            DisasRange range;
+            if (request.command == "range") {
+                std::pair<uint64_t, uint64_t> addrs =
+                    parseAddressRange(request.target);
+                range = eda._addressRange(addrs.first, addrs.second);
+            } else {
+                range = eda._symbolRange(request.target);
+            }
+            eda.disasRange(range, 1);
+            std::ostringstream os;
+            os << "ok\n";
+            eda.print(os);
+            return os.str();
+        } catch (const std::exception& e) {
+            return std::string("error\n") + e.what() + "\n";
+        }
+    }
+
+    /**
+     * @brief Serves the connections of the socket until a shutdown request
+     * or stop(), then waits for the connections to finish their current
+     * request. A stale socket file, which no server listens on, is replaced;
+     * any other file at the path is left as is.
+     * @return False if the socket cannot be listened on, or if the path is
+     * taken.
+     */
+    bool serve(const std::string& socketPath) {
+        sockaddr_un addr = {};
+        if (socketPath.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+
+        if (!removeStaleSocket(addr)) {
+            return false;
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        // only the user may connect
+        mode_t mask = ::umask(0077);
+        bool bound = ::bind(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+        ::umask(mask);
+        if (!bound || ::listen(fd, SOMAXCONN) != 0) {
+            ::close(fd);
+            return false;
+        }
+        listenFd = fd;
+        if (stopping) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+
+        while (!stopping) {
+            int client = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(clients->mtx);
+                clients->fds.push_back(client);
+            }
+            // the thread keeps the list alive until it has left it
+            std::thread([this, client, clients = clients]() {
+                std::string request;
+                bool shutdown = false;
+                // stopping after the response, which would be cut off
+                while (!stopping && !shutdown &&
+                       readFrame(client, request) &&
+                       writeFrame(client, handle(request, shutdown))) {
+                }
+                if (shutdown) {
+                    stop();
+                }
+                std::lock_guard<std::mutex> lock(clients->mtx);
+                clients->fds.erase(std::find(clients->fds.begin(),
+                                             clients->fds.end(), client));
+                ::close(client);
+                clients->done.notify_all();
+            }).detach();
+        }
+
+        // the idle connections are woken up from their reads
+        std::unique_lock<std::mutex> lock(clients->mtx);
+        for (int client : clients->fds) {
+            ::shutdown(client, SHUT_RDWR);
+        }
+        clients->done.wait(lock, [this]() { return clients->fds.empty(); });
+        listenFd = -1;
+        ::close(fd);
+        ::unlink(socketPath.c_str());
+        return true;
+    }
+
+    /**
+     * @brief Makes serve() return, from any thread.
+     */
+    void stop() {
+        stopping = true;
+        int fd = listenFd;
+        if (fd >= 0) {
+            // wakes up accept()
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    /**
+     * @brief Returns the number of files parsed so far.
+     */
+    uint64_t parses() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return files.parses;
+    }
+
+   private:
+    ParsedFileCache files;
+    std::mutex mtx; /**< Guards the files, which one request uses at once */
+    std::atomic<bool> stopping{false};
+    std::atomic<int> listenFd{-1};
+
+    /**
+     * @brief The connections being served.
+     */
+    struct Clients {
+        std::mutex mtx;
+        std::condition_variable done; /**< Notified as a connection ends */
+        std::vector<int> fds;
+    };
+    std::shared_ptr<Clients> clients = std::make_shared<Clients>();
+
+    /**
+     * @brief Removes the socket file at the address if it is left over from
+     * a server gone, i.e. a connection to it is refused.
+     * @return True if nothing is at the address anymore.
+     */
+    static bool removeStaleSocket(const sockaddr_un& addr) {
+        struct stat st;
+        if (::lstat(addr.sun_path, &st) != 0) {
+            return errno == ENOENT;
+        }
+        if (!S_ISSOCK(st.st_mode)) {
+            return false;
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        bool refused =
+            ::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 &&
+            errno == ECONNREFUSED;
+        ::close(fd);
+        return refused && ::unlink(addr.sun_path) == 0;
+    }
+};
@@ -6,47 +6,21 @@
 #pragma once
 #include <algorithm>
 #include <cstdint>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <cstring>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "byteclass.h"
 #include "bytes.h"
+#include "bytespan.h"
 #include "constants.h"
 #include "error.h"
+#include "formatter.h"
+#include "instruction.h"
+#include "stats.h"
 #include "table.h"
 
-/**
- * @brief Decodes the given hexadecimal offset string into a signed long long
- * integer.
- * @param val The hexadecimal offset string.
- * @return The decoded offset.
- */
-inline long long decodeOffset(const std::string& val) {
-    long long offset;
-
-    offset = stoul(val, nullptr, 16);
-
-    if (val.size() <= 2 + 2) {
-        if (offset > 0x7F) {
-            offset -= 0x100;
-        }
-    } else if (val.size() <= 4 + 2) {
-        if (offset > 0x7FFF) {
-            offset -= 0x10000;
-        }
-    } else if (val.size() <= 8 + 2) {
-        if (offset > 0x7FFFFFFF) {
-            offset -= 0x100000000;
-        }
-    }
-
-    return offset;
-}
-
 /**
  * @struct DisassembledResult
  * @brief Represents the result of disassembling an instruction.
@@ -58,6 +32,7 @@ typedef struct {
     std::string
         disassembledInstructionStr; /**< The disassembled instruction string */
     long long nextOffset;           /**< The offset to the next instruction */
+    uint64_t labelAddr = NO_LABEL; /**< The branch target to label */
 } DisassembledResult;
 
 /**
@@ -65,90 +40,113 @@ typedef struct {
  * @brief Represents the state of the disassembler.
  */
 struct State {
-    const std::vector<unsigned char>& objectSource;
-    const std::unordered_map<uint64_t, std::string>& addr2symbol;
+    ByteSpan objectSource;
+    const ByteClassMap* byteClasses = nullptr; /**< Precomputed classes */
+    DecodeStats* stats = nullptr; /**< The counters updated, if any */
 
     bool hasInstructionPrefix, hasSegmentOverridePrefix, hasREX, hasSIB,
         hasDisp8, hasDisp32;
     uint64_t curAddr, disassembledInstructionSize, prefixOffset;
     int instructionPrefixByte, opcodeByte, modrmByte, sibByte;
 
-    std::string prefixInstructionStr;
-    std::string prefixSegmentOverrideStr;
-
     Mnemonic mnemonic;
     Prefix prefix;
+    Segment segment;
     REX rex;
     ModRM modrm;
     SIB sib;
 
     OpEnc opEnc;
-    std::vector<std::string> remOps;
-    std::vector<Operand> operands;
+    const char* remOp;
+    OperandList operands;
 
-    std::string disp8, disp32;
+    int32_t disp;
 
-    std::vector<std::string> disassembledInstruction;
-    std::vector<std::string> disassembledOperands;
+    uint64_t startAddr;
+    int errorReg;
+    DecodeStatus status;
+    DecodedInstruction decoded;
+    InstructionBoundary boundary; /**< The result of decodeLength() */
 
     /**
      * @brief Constructor for State.
      * @param objectSource The object code to disassemble.
-     * @param addr2symbol Mapping of addresses to symbols.
      */
-    State(const std::vector<unsigned char>& objectSource,
-          const std::unordered_map<uint64_t, std::string>& addr2symbol)
-        : objectSource(objectSource),
-          addr2symbol(addr2symbol),
-          hasInstructionPrefix(false),
-          hasSegmentOverridePrefix(false),
-          hasREX(false),
-          hasSIB(false),
-          hasDisp8(false),
-          hasDisp32(false),
-          curAddr(0),
-          disassembledInstructionSize(0),
-          prefixOffset(0),
-          prefix(Prefix::NONE) {}
+    explicit State(ByteSpan objectSource) : objectSource(objectSource) {
+        reset();
+    }
+
+    /**
+     * @brief Clears the per-instruction state so that the same State can
+     * decode the next instruction.
+     */
+    void reset() {
+        hasInstructionPrefix = false;
+        hasSegmentOverridePrefix = false;
+        hasREX = false;
+        hasSIB = false;
+        hasDisp8 = false;
+        hasDisp32 = false;
+        curAddr = 0;
+        disassembledInstructionSize = 0;
+        prefixOffset = 0;
+        instructionPrefixByte = 0;
+        opcodeByte = 0;
+        modrmByte = -1;
+        sibByte = -1;
+        mnemonic = Mnemonic::NOP;
+        prefix = Prefix::NONE;
+        segment = Segment::NONE;
+        rex = REX();
+        modrm = ModRM();
+        sib = SIB();
+        opEnc = OpEnc::NP;
+        remOp = nullptr;
+        operands = OperandList();
+        disp = 0;
+        startAddr = 0;
+        errorReg = NO_REG;
+        status = DecodeStatus::OK;
+    }
+
+    /**
+     * @brief Checks whether a byte is left at the current address.
+     */
+    bool hasByte() const { return curAddr < objectSource.size(); }
+
+    /**
+     * @brief Returns the ByteClass bits of the current byte, from the
+     * precomputed map when it covers the address.
+     * @return The bits, or 0 if no byte is left.
+     */
+    uint8_t curClass() const {
+        if (byteClasses != nullptr && byteClasses->covers(curAddr)) {
+            return (*byteClasses)[curAddr];
+        }
+        return hasByte() ? classifyByte(objectSource, curAddr) : 0;
+    }
 
     /**
      * @brief Parses the endbr instruction.
      * @return True if an endbr instruction is parsed, false otherwise.
      */
     bool parseEndBr() {
-        if (curAddr + 3 < objectSource.size()) {
-            if (objectSource[curAddr] == 0xF3 &&
-                objectSource[curAddr + 1] == 0x0F &&
-                objectSource[curAddr + 2] == 0x1E &&
-                objectSource[curAddr + 3] == 0xFA) {
-                disassembledInstruction.emplace_back(
-                    to_string(Mnemonic::ENDBR64));
-                opEnc = OpEnc::NP;
-                disassembledInstructionSize += 4;
-                curAddr += 4;
-                return true;
-            } else if (objectSource[curAddr] == 0xF3 &&
-                       objectSource[curAddr + 1] == 0x0F &&
-                       objectSource[curAddr + 2] == 0x1E &&
-                       objectSource[curAddr + 3] == 0xFB) {
-                disassembledInstruction.emplace_back(
-                    to_string(Mnemonic::ENDBR32));
-                opEnc = OpEnc::NP;
-                disassembledInstructionSize += 4;
-                curAddr += 4;
-                return true;
-            } else {
-                return false;
-            }
+        if (!(curClass() & BYTE_ENDBR)) {
+            return false;
         }
-        return false;
+        mnemonic = objectSource[curAddr + 3] == 0xFA ? Mnemonic::ENDBR64
+                                                     : Mnemonic::ENDBR32;
+        opEnc = OpEnc::NP;
+        disassembledInstructionSize += 4;
+        curAddr += 4;
+        return true;
     }
 
     /**
      * @brief Parses the operand-size prefixe.
      */
     void parseOperandSizePrefix() {
-        if (objectSource[curAddr] == 0x66) {
+        if (curClass() & BYTE_OPERAND_SIZE_PREFIX) {
             prefix = Prefix::P66;
             disassembledInstructionSize += 1;
             curAddr += 1;
@@ -156,25 +154,20 @@ struct State {
     }
 
     void parseSegmentOverridePrefix() {
-        if (objectSource[curAddr] == 0x64) {
-            hasSegmentOverridePrefix = true;
-            prefixSegmentOverrideStr = "fs";
-            disassembledInstructionSize += 1;
-            curAddr += 1;
-        } else if (objectSource[curAddr] == 0x65) {
-            hasSegmentOverridePrefix = true;
-            prefixSegmentOverrideStr = "gs";
-            disassembledInstructionSize += 1;
-            curAddr += 1;
+        if (!(curClass() & BYTE_SEGMENT_PREFIX)) {
+            return;
         }
+        hasSegmentOverridePrefix = true;
+        segment = objectSource[curAddr] == 0x64 ? Segment::FS : Segment::GS;
+        disassembledInstructionSize += 1;
+        curAddr += 1;
     }
 
     /**
      * @brief Parses instruction prefixes.
      */
     void parsePrefixInstructions() {
-        if (INSTRUCTION_PREFIX_SET.find(objectSource[curAddr]) !=
-            INSTRUCTION_PREFIX_SET.end()) {
+        if (curClass() & BYTE_INSTRUCTION_PREFIX) {
             hasInstructionPrefix = true;
             instructionPrefixByte = objectSource[curAddr];
             prefixOffset = 1;
@@ -188,7 +181,7 @@ struct State {
      */
     void parseREX() {
         // The format of REX prefix is 0100|W|R|X|B
-        if ((objectSource[curAddr] >> 4) == 4) {
+        if (curClass() & BYTE_REX) {
             hasREX = true;
             rex = REX(objectSource[curAddr]);
             disassembledInstructionSize += 1;
@@ -204,158 +197,114 @@ struct State {
 
     /**
      * @brief Parses the opcode byte.
+     * @return The decode status.
      */
-    void parseOpcode() {
+    DecodeStatus parseOpcode() {
+        if (!hasByte()) {
+            return DecodeStatus::TRUNCATED;
+        }
+
         // eat opcode
+        bool twoBytes = curClass() & BYTE_TWO_BYTES_OPCODE;
         opcodeByte = objectSource[curAddr];
         disassembledInstructionSize += 1;
         curAddr += 1;
 
-        int potentialOpCodeByte = (opcodeByte << 8) + objectSource[curAddr];
-
-        if ((TWO_BYTES_OPCODE_PREFIX.find(opcodeByte) !=
-             TWO_BYTES_OPCODE_PREFIX.end()) &&
-            ((OP_LOOKUP.find(std::make_pair(prefix, potentialOpCodeByte)) !=
-              OP_LOOKUP.end()) ||
-             (prefix == Prefix::REXW &&
-              OP_LOOKUP.find(std::make_pair(
-                  Prefix::REX, potentialOpCodeByte)) != OP_LOOKUP.end()) ||
-             (prefix == Prefix::REX &&
-              OP_LOOKUP.find(std::make_pair(
-                  Prefix::NONE, potentialOpCodeByte)) != OP_LOOKUP.end()))) {
-            opcodeByte = potentialOpCodeByte;
-            disassembledInstructionSize += 1;
-            curAddr += 1;
+        if (twoBytes && hasByte()) {
+            int potentialOpCodeByte =
+                (opcodeByte << 8) + objectSource[curAddr];
+            if (lookupOpcode(prefix, potentialOpCodeByte) != nullptr) {
+                opcodeByte = potentialOpCodeByte;
+                disassembledInstructionSize += 1;
+                curAddr += 1;
+            }
         }
 
         // (prefix, opcode) -> (reg, mnemonic)
-        std::unordered_map<int, Mnemonic> reg2mnem;
-        if (OP_LOOKUP.find(std::make_pair(prefix, opcodeByte)) !=
-            OP_LOOKUP.end()) {
-            reg2mnem = OP_LOOKUP.at(std::make_pair(prefix, opcodeByte));
-        } else if (prefix == Prefix::REXW &&
-                   OP_LOOKUP.find(std::make_pair(Prefix::REX, opcodeByte)) !=
-                       OP_LOOKUP.end()) {
-            reg2mnem = OP_LOOKUP.at(std::make_pair(Prefix::REX, opcodeByte));
-            prefix = Prefix::REX;
-        } else if (prefix == Prefix::REX &&
-                   OP_LOOKUP.find(std::make_pair(Prefix::NONE, opcodeByte)) !=
-                       OP_LOOKUP.end()) {
-            reg2mnem = OP_LOOKUP.at(std::make_pair(Prefix::NONE, opcodeByte));
-            prefix = Prefix::NONE;
-        } else {
-            std::stringstream ss;
-            ss << std::hex << opcodeByte;
-            throw OPCODE_LOOKUP_ERROR(
-                "Unknown combination of the prefix and the opcodeByte: (" +
-                to_string(prefix) + ", " + ss.str() + ")");
+        const OpcodeDispatchRow* row = lookupOpcode(prefix, opcodeByte);
+        if (row == nullptr) {
+            return DecodeStatus::OPCODE_LOOKUP_ERROR;
+        }
+        if (stats != nullptr && row->prefix != prefix) {
+            stats->lookupFallbacks[(size_t)prefix][(size_t)row->prefix]++;
         }
+        prefix = row->prefix;
 
         // We sometimes need reg of modrm to determine the opcode
         // e.g. 83 /4 -> AND
         //      83 /1 -> OR
-        if (curAddr < objectSource.size()) {
+        if (hasByte()) {
             modrmByte = objectSource[curAddr];
         }
 
-        if (modrmByte >= 0) {
-            int reg = (modrmByte >> 3) & 0x7;
-            mnemonic = (reg2mnem.find(reg) != reg2mnem.end()) ? reg2mnem.at(reg)
-                                                              : reg2mnem.at(-1);
-        } else {
-            mnemonic = reg2mnem.at(-1);
-        }
-
-        if (hasInstructionPrefix) {
-            if (instructionPrefixByte == 0xF0) {
-                disassembledInstruction.emplace_back("lock");
-            } else if (instructionPrefixByte == 0xF2) {
-                if (isControlFlowInstruction(mnemonic)) {
-                    disassembledInstruction.emplace_back("bnd");
-                } else {
-                    disassembledInstruction.emplace_back("repne");
-                }
-            } else if (instructionPrefixByte == 0xF3) {
-                disassembledInstruction.emplace_back("rep");
-            } else if (instructionPrefixByte == 0x3E) {
-                disassembledInstruction.emplace_back("notrack");
-            }
+        const DecodeEntry& entry =
+            (modrmByte >= 0) ? row->byReg[(modrmByte >> 3) & 0x7]
+                             : row->noModrm;
+        if (!entry.valid) {
+            errorReg = (modrmByte >> 3) & 0x7;
+            return DecodeStatus::OPCODE_LOOKUP_ERROR;
         }
+        mnemonic = entry.mnemonic;
 
-        disassembledInstruction.emplace_back(to_string(mnemonic));
-
-        if (OPERAND_LOOKUP.find(std::make_tuple(
-                prefix, mnemonic, opcodeByte)) != OPERAND_LOOKUP.end()) {
-            std::tuple<OpEnc, std::vector<std::string>, std::vector<Operand>>
-                res = OPERAND_LOOKUP.at(
-                    std::make_tuple(prefix, mnemonic, opcodeByte));
-            opEnc = std::get<0>(res);
-            remOps = std::get<1>(res);
-            operands = std::get<2>(res);
-        } else {
-            std::stringstream ss;
-            ss << std::hex << opcodeByte;
-            throw OPERAND_LOOKUP_ERROR(
-                "Unknown combination of prefix, mnemonic and opcodeByte: (" +
-                to_string(prefix) + ", " + to_string(mnemonic) + ", " +
-                ss.str() + ")");
+        if (entry.operandIdx == NO_OPERAND_SPEC) {
+            return DecodeStatus::OPERAND_LOOKUP_ERROR;
         }
+        const OperandSpec& spec = OPERAND_LOOKUP[entry.operandIdx].spec;
+        opEnc = spec.opEnc;
+        remOp = spec.remOp;
+        operands = spec.operands;
+        return DecodeStatus::OK;
     }
 
     /**
      * @brief Parses the ModRM byte.
+     * @return The decode status.
      */
-    void parseModRM() {
+    DecodeStatus parseModRM() {
         if (hasModrm(opEnc)) {
             if (modrmByte < 0) {
-                throw std::runtime_error(
-                    "Expected ModRM byte but there aren't any bytes left.");
+                return DecodeStatus::TRUNCATED;
             }
             disassembledInstructionSize += 1;
             curAddr += 1;
             modrm = ModRM(modrmByte, rex);
         }
+        return DecodeStatus::OK;
     }
 
     /**
      * @brief Parses the SIB byte.
+     * @return The decode status.
      */
-    void parseSIB() {
+    DecodeStatus parseSIB() {
         if (hasModrm(opEnc) && modrm.hasSib) {
             // eat the sib (1 byte)
-            if (curAddr < objectSource.size()) {
+            if (hasByte()) {
                 sibByte = objectSource[curAddr];
             }
             if (sibByte < 0) {
-                throw std::runtime_error(
-                    "Expected SIB byte but there aren't any bytes left.");
+                return DecodeStatus::TRUNCATED;
             }
             sib = SIB(sibByte, modrm.modByte, rex);
             disassembledInstructionSize += 1;
             curAddr += 1;
         }
+        return DecodeStatus::OK;
     }
 
     /**
      * @brief Parses the address offset.
+     * @return The decode status.
      */
-    void parseAddressOffset() {
+    DecodeStatus parseAddressOffset() {
         if ((hasModrm(opEnc) && modrm.hasDisp8) ||
             (hasModrm(opEnc) && modrm.hasSib && sib.hasDisp8) ||
             (hasModrm(opEnc) && modrm.hasSib && modrm.modByte == 1 &&
              sib.baseByte == 5)) {
-            std::stringstream ss1;
-            ss1 << std::hex << (int)objectSource[curAddr];
-            disp8 = "0x" + ss1.str();
-
-            long long decoded_disp8 = decodeOffset(disp8);
-            if (decoded_disp8 < 0) {
-                std::stringstream ss2;
-                ss2 << std::hex << (-1 * decoded_disp8);
-                disp8 = " - 0x" + ss2.str();
-            } else {
-                disp8 = " + " + disp8;
+            if (!hasByte()) {
+                return DecodeStatus::TRUNCATED;
             }
+            disp = (int8_t)objectSource[curAddr];
 
             hasDisp8 = true;
             disassembledInstructionSize += 1;
@@ -366,162 +315,373 @@ struct State {
             (hasModrm(opEnc) && modrm.hasSib && sib.hasDisp32) ||
             (hasModrm(opEnc) && modrm.hasSib &&
              (modrm.modByte == 0 || modrm.modByte == 2) && sib.baseByte == 5)) {
-            std::vector<uint8_t> _disp32 =
-                std::vector<uint8_t>(objectSource.begin() + curAddr,
-                                     objectSource.begin() + curAddr + 4);
-            std::reverse(_disp32.begin(), _disp32.end());
-            std::stringstream ss;
-            ss << "0x";
-            for (unsigned char x : _disp32) {
-                ss << std::hex << std::setw(2) << std::setfill('0')
-                   << static_cast<int>(x);
-            }
-            disp32 = ss.str();
-
-            long long decoded_disp32 = decodeOffset(disp32);
-            if (decoded_disp32 < 0) {
-                std::stringstream ss;
-                ss << std::hex << (-1 * decoded_disp32);
-                disp32 = " - 0x" + ss.str();
-            } else {
-                disp32 = " + " + disp32;
+            uint64_t disp32;
+            if (!readLittleEndian(4, disp32)) {
+                return DecodeStatus::TRUNCATED;
             }
+            disp = (int32_t)disp32;
 
             hasDisp32 = true;
             disassembledInstructionSize += 4;
             curAddr += 4;
         }
+        return DecodeStatus::OK;
     }
 
     /**
-     * @brief Executes a step in disassembling the instruction.
-     * @param startAddr The starting address of the instruction.
-     * @return The disassembled result.
+     * @brief Reads a little-endian value at the current address.
+     * @param size The number of bytes to read.
+     * @param val The zero-extended value.
+     * @return False if there aren't enough bytes left.
      */
-    DisassembledResult step(uint64_t startAddr) {
-        // ############### Initialize ##############################
-        curAddr = startAddr;
+    bool readLittleEndian(int size, uint64_t& val) const {
+        if (curAddr + size > objectSource.size()) {
+            return false;
+        }
+        val = 0;
+        std::memcpy(&val, objectSource.data() + curAddr, size);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        val = size > 0 ? __builtin_bswap64(val) >> (64 - 8 * size) : 0;
+#endif
+        return true;
+    }
 
-        // the general format of the x86-64 operations
-        // |prefix|REX prefix|opcode|ModR/M|SIB|address offset|immediate|
+    /**
+     * @brief Returns the register id encoded in the opcode (e.g. +rd).
+     * @return The register id, or NO_REG if the opcode does not encode one.
+     */
+    int getOpcodeRegIdx() const {
+        if (remOp == nullptr || remOp[0] < '0' || remOp[0] > '7') {
+            return NO_REG;
+        }
+        return remOp[0] - '0';
+    }
 
-        if (!parseEndBr()) {
-            parsePrefixInstructions();
-            parseSegmentOverridePrefix();
-            parseOperandSizePrefix();
-            parseREX();
-            parseOpcode();
-            parseModRM();
-            parseSIB();
-            parseAddressOffset();
+    /**
+     * @brief Decodes the memory address specified by ModRM and SIB.
+     * @param decodedOperand The operand to fill.
+     */
+    void decodeAddress(DecodedOperand& decodedOperand) {
+        decodedOperand.kind = OperandKind::MEM;
+        decodedOperand.scale = 1;
+        decodedOperand.dispSize = hasDisp32 ? 4 : (hasDisp8 ? 1 : 0);
+        decodedOperand.disp = disp;
+
+        if (modrm.hasSib) {
+            if (sib.baseByte == 5 && modrm.modByte == 0) {
+                decodedOperand.base = NO_REG;
+            } else {
+                decodedOperand.base = sib.baseByte + (rex.rexB ? 8 : 0);
+            }
+            if (sib.indexByte == 4 && (!rex.rexX)) {
+                decodedOperand.index = NO_REG;
+            } else {
+                decodedOperand.index = sib.indexByte + (rex.rexX ? 8 : 0);
+                decodedOperand.scale = SCALE_FACTOR.at(sib.scaleByte);
+            }
+        } else if (modrm.modByte == 0 && modrm.rmByte == 5) {
+            decodedOperand.base = RIP_REG;
+        } else {
+            decodedOperand.base = modrm.rmByte + (rex.rexB ? 8 : 0);
         }
+    }
 
-        // ############### Process Operands ################
-        std::vector<uint8_t> imm;
-        for (Operand operand : operands) {
-            std::string decodedOperandStr;
-
-            if (isA_REG(operand) || operand == Operand::cl ||
-                operand == Operand::dx) {
-                decodedOperandStr = to_string(operand);
-            } else if (operand == Operand::sti) {
-                decodedOperandStr = "st(" + remOps[0] + ")";
-            } else if (isRM(operand) || isREG(operand) || isM(operand)) {
-                if (hasModrm(opEnc)) {
-                    if (isRM(operand) || isM(operand)) {
-                        decodedOperandStr =
-                            modrm.getAddrMode(operand, disp8, disp32);
-                    } else {
-                        decodedOperandStr = modrm.getReg(operand);
-                    }
+    /**
+     * @brief Decodes an operand.
+     * @param operand The operand type.
+     * @param decodedOperand The decoded operand.
+     * @return The decode status.
+     */
+    DecodeStatus decodeOperand(Operand operand,
+                               DecodedOperand& decodedOperand) {
+        decodedOperand = {};
+        decodedOperand.type = operand;
+        decodedOperand.kind = OperandKind::NONE;
+        decodedOperand.reg = NO_REG;
+        decodedOperand.base = NO_REG;
+        decodedOperand.index = NO_REG;
+
+        if (isA_REG(operand) || operand == Operand::cl ||
+            operand == Operand::dx) {
+            decodedOperand.kind = OperandKind::REG;
+            decodedOperand.regClass = operand2regClass(operand);
+            decodedOperand.reg = (operand == Operand::cl)   ? 1
+                                 : (operand == Operand::dx) ? 2
+                                                            : 0;
+        } else if (operand == Operand::sti) {
+            decodedOperand.kind = OperandKind::REG;
+            decodedOperand.regClass = RegClass::ST;
+            decodedOperand.reg = getOpcodeRegIdx();
+            if (decodedOperand.reg == NO_REG) {
+                return DecodeStatus::INVALID_OPERAND;
+            }
+        } else if (isRM(operand) || isREG(operand) || isM(operand)) {
+            if (hasModrm(opEnc)) {
+                if ((isRM(operand) || isM(operand)) && modrm.modByte != 3) {
+                    decodeAddress(decodedOperand);
                 } else {
-                    int regIdx = (hasREX && rex.rexB) ? std::stoi(remOps[0]) + 8
-                                                      : std::stoi(remOps[0]);
-                    if (is8Bit(operand)) {
-                        decodedOperandStr = REGISTERS8.at(regIdx);
-                    } else if (is16Bit(operand)) {
-                        decodedOperandStr = REGISTERS16.at(regIdx);
-                    } else if (is32Bit(operand)) {
-                        decodedOperandStr = REGISTERS32.at(regIdx);
-                    } else if (is64Bit(operand)) {
-                        decodedOperandStr = REGISTERS64.at(regIdx);
-                    } else if (operand == Operand::xm128) {
-                        decodedOperandStr = "xmm" + remOps[0];
+                    int regIdx = (isREG(operand))
+                                     ? modrm.regByte + (rex.rexR ? 8 : 0)
+                                     : modrm.rmByte + (rex.rexB ? 8 : 0);
+                    decodedOperand.kind = OperandKind::REG;
+                    decodedOperand.regClass = operand2regClass(operand);
+                    decodedOperand.reg = regIdx;
+                    if (decodedOperand.regClass == RegClass::NONE) {
+                        // e.g. a register cannot be used as m64
+                        return DecodeStatus::INVALID_OPERAND;
                     }
                 }
-
-                if ((isRM(operand) || isM(operand)) && hasModrm(opEnc) &&
-                    modrm.hasSib) {
-                    decodedOperandStr = sib.getAddr(operand, disp8, disp32);
-                }
-                if (hasSegmentOverridePrefix) {
-                    decodedOperandStr =
-                        prefixSegmentOverrideStr + ":" + decodedOperandStr;
+            } else {
+                if (is8Bit(operand) || is16Bit(operand) || is32Bit(operand) ||
+                    is64Bit(operand)) {
+                    decodedOperand.kind = OperandKind::REG;
+                    decodedOperand.regClass = operand2regClass(operand);
+                    decodedOperand.reg = getOpcodeRegIdx();
+                    if (decodedOperand.reg != NO_REG && hasREX && rex.rexB) {
+                        decodedOperand.reg += 8;
+                    }
+                } else if (operand == Operand::xm128) {
+                    decodedOperand.kind = OperandKind::REG;
+                    decodedOperand.regClass = RegClass::XMM;
+                    decodedOperand.reg = getOpcodeRegIdx();
                 }
-            } else if (isIMM(operand)) {
-                int immSize = 0;
-                if (operand == Operand::imm64 || operand == Operand::ymm) {
-                    immSize = 8;
-                } else if (operand == Operand::imm32 ||
-                           operand == Operand::xmm) {
-                    immSize = 4;
-                } else if (operand == Operand::imm16) {
-                    immSize = 2;
-                } else if (operand == Operand::imm8) {
-                    immSize = 1;
+                if (decodedOperand.kind == OperandKind::REG &&
+                    decodedOperand.reg == NO_REG) {
+                    return DecodeStatus::INVALID_OPERAND;
                 }
-                imm = std::vector<uint8_t>(
-                    objectSource.begin() + curAddr,
-                    objectSource.begin() + curAddr + immSize);
-                std::reverse(imm.begin(), imm.end());
-                disassembledInstructionSize += immSize;
-                curAddr += immSize;
-
-                std::stringstream ss;
-                ss << "0x";
-                for (unsigned char x : imm) {
-                    ss << std::hex << std::setw(2) << std::setfill('0')
-                       << static_cast<int>(x);
+            }
+        } else if (isIMM(operand)) {
+            int immSize = 0;
+            if (operand == Operand::imm64) {
+                immSize = 8;
+            } else if (operand == Operand::imm32) {
+                immSize = 4;
+            } else if (operand == Operand::imm16) {
+                immSize = 2;
+            } else if (operand == Operand::imm8) {
+                immSize = 1;
+            }
+            decodedOperand.kind = OperandKind::IMM;
+            decodedOperand.immSize = immSize;
+            if (!readLittleEndian(immSize, decodedOperand.imm)) {
+                return DecodeStatus::TRUNCATED;
+            }
+            disassembledInstructionSize += immSize;
+            curAddr += immSize;
+        }
+
+        return DecodeStatus::OK;
+    }
+
+    /**
+     * @brief Checks the operand as decodeOperand() does, without decoding
+     * it: only an immediate is read, since it takes bytes.
+     * @param operand The operand type.
+     * @param imm The zero-extended immediate, if the operand is one.
+     * @param immSize The size of the immediate, if the operand is one.
+     * @return The decode status decodeOperand() returns.
+     */
+    DecodeStatus skipOperand(Operand operand, uint64_t& imm, int& immSize) {
+        if (isA_REG(operand) || operand == Operand::cl ||
+            operand == Operand::dx) {
+            return DecodeStatus::OK;
+        } else if (operand == Operand::sti) {
+            if (getOpcodeRegIdx() == NO_REG) {
+                return DecodeStatus::INVALID_OPERAND;
+            }
+        } else if (isRM(operand) || isREG(operand) || isM(operand)) {
+            if (hasModrm(opEnc)) {
+                bool isAddress =
+                    (isRM(operand) || isM(operand)) && modrm.modByte != 3;
+                if (!isAddress &&
+                    operand2regClass(operand) == RegClass::NONE) {
+                    return DecodeStatus::INVALID_OPERAND;
                 }
-                decodedOperandStr = ss.str();
+            } else if ((is8Bit(operand) || is16Bit(operand) ||
+                        is32Bit(operand) || is64Bit(operand) ||
+                        operand == Operand::xm128) &&
+                       getOpcodeRegIdx() == NO_REG) {
+                return DecodeStatus::INVALID_OPERAND;
+            }
+        } else if (isIMM(operand)) {
+            immSize = operand == Operand::imm64   ? 8
+                      : operand == Operand::imm32 ? 4
+                      : operand == Operand::imm16 ? 2
+                      : operand == Operand::imm8  ? 1
+                                                  : 0;
+            if (!readLittleEndian(immSize, imm)) {
+                return DecodeStatus::TRUNCATED;
             }
+            disassembledInstructionSize += immSize;
+            curAddr += immSize;
+        }
+        return DecodeStatus::OK;
+    }
 
-            disassembledOperands.emplace_back(decodedOperandStr);
+    /**
+     * @brief Runs the parse chain of the instruction.
+     * @return The decode status.
+     */
+    DecodeStatus parseInstruction() {
+        // the general format of the x86-64 operations
+        // |prefix|REX prefix|opcode|ModR/M|SIB|address offset|immediate|
+
+        if (parseEndBr()) {
+            return DecodeStatus::OK;
         }
 
-        std::string ao = "";
-        for (std::string& a : disassembledOperands) {
-            ao += " " + a;
+        parsePrefixInstructions();
+        parseSegmentOverridePrefix();
+        parseOperandSizePrefix();
+        parseREX();
+
+        DecodeStatus status = parseOpcode();
+        if (status == DecodeStatus::OK) {
+            status = parseModRM();
+        }
+        if (status == DecodeStatus::OK) {
+            status = parseSIB();
+        }
+        if (status == DecodeStatus::OK) {
+            status = parseAddressOffset();
         }
-        disassembledInstruction.emplace_back(ao);
+        return status;
+    }
 
-        long long nextOffset = 0;
-        std::string disassembledInstructionStr = "";
+    /**
+     * @brief Decodes the instruction without throwing.
+     * @param startAddr The starting address of the instruction.
+     * @return The decode status. On DecodeStatus::OK, the decoded record is
+     * available in `decoded`; otherwise lastError() describes the failure.
+     */
+    DecodeStatus tryDecode(uint64_t startAddr) {
+        decodeInstruction(startAddr);
+        if (stats != nullptr) {
+            (status == DecodeStatus::OK ? stats->decoded : stats->failed)++;
+        }
+        return status;
+    }
 
-        if (isControlFlowInstruction(mnemonic) && operands.size() == 1 &&
-            isIMM(operands[0])) {
-            nextOffset = decodeOffset(disassembledOperands[0]);
-            uint64_t labelAddr =
-                (uint64_t)(((long long)startAddr) +
-                           ((long long)disassembledInstructionSize) +
-                           nextOffset);
-            std::stringstream ss;
-            ss << std::hex << labelAddr;
-            std::string labelName = ss.str();
-            if (addr2symbol.find(labelAddr) != addr2symbol.end()) {
-                labelName += " <" + addr2symbol.at(labelAddr) + ">";
-            }
-            disassembledInstructionStr =
-                to_string(mnemonic) + " " + labelName +
-                " ; relative offset = " + std::to_string(nextOffset);
-        } else {
-            disassembledInstructionStr = disassembledInstruction[0];
-            for (int i = 1; i < disassembledInstruction.size(); i++) {
-                disassembledInstructionStr += " " + disassembledInstruction[i];
+    /**
+     * @brief Decodes the instruction into `decoded`, as tryDecode() does,
+     * without updating the counters.
+     * @return The decode status, also kept in `status`.
+     */
+    DecodeStatus decodeInstruction(uint64_t startAddr) {
+        // ############### Initialize ##############################
+        reset();
+        this->startAddr = startAddr;
+        curAddr = startAddr;
+
+        status = parseInstruction();
+        if (status != DecodeStatus::OK) {
+            return status;
+        }
+
+        // ############### Process Operands ################
+        decoded.numOperands = 0;
+        for (Operand operand : operands) {
+            status =
+                decodeOperand(operand, decoded.operands[decoded.numOperands]);
+            if (status != DecodeStatus::OK) {
+                return status;
             }
+            decoded.numOperands++;
+        }
+
+        decoded.startAddr = startAddr;
+        decoded.length = (uint8_t)disassembledInstructionSize;
+        decoded.mnemonic = mnemonic;
+        decoded.prefix = prefix;
+        decoded.instructionPrefixByte =
+            hasInstructionPrefix ? (uint8_t)instructionPrefixByte : 0;
+        decoded.segment = segment;
+
+        decoded.nextOffset = 0;
+        if (isRelativeBranch(decoded)) {
+            // sign-extend the relative offset
+            const DecodedOperand& imm = decoded.operands[0];
+            int shift = 64 - 8 * imm.immSize;
+            decoded.nextOffset = (long long)(imm.imm << shift) >> shift;
+        }
+
+        return status;
+    }
+
+    /**
+     * @brief Decodes only the length of the instruction and the target of
+     * a relative branch into `boundary`, leaving `decoded` as it is. The
+     * instruction is accepted or rejected as tryDecode() does, so that a
+     * sweep finds the same boundaries, without filling the operands.
+     * @param startAddr The starting address of the instruction.
+     * @return The decode status; lastError() describes a failure.
+     */
+    DecodeStatus decodeLength(uint64_t startAddr) {
+        reset();
+        this->startAddr = startAddr;
+        curAddr = startAddr;
+
+        status = parseInstruction();
+        uint64_t imm = 0;
+        int immSize = 0;
+        for (size_t i = 0; i < operands.size() && status == DecodeStatus::OK;
+             i++) {
+            status = skipOperand(operands[i], imm, immSize);
+        }
+        if (stats != nullptr) {
+            (status == DecodeStatus::OK ? stats->decoded : stats->failed)++;
+        }
+        if (status != DecodeStatus::OK) {
+            return status;
         }
 
-        return {startAddr, disassembledInstructionSize, mnemonic,
-                disassembledInstructionStr, nextOffset};
+        boundary.startAddr = startAddr;
+        boundary.length = (uint8_t)disassembledInstructionSize;
+        boundary.mnemonic = mnemonic;
+        boundary.isRelativeBranch = isControlFlowInstruction(mnemonic) &&
+                                    operands.size() == 1 &&
+                                    isIMM(operands[0]);
+        boundary.nextOffset = 0;
+        if (boundary.isRelativeBranch) {
+            // sign-extend the relative offset
+            int shift = 64 - 8 * immSize;
+            boundary.nextOffset = (long long)(imm << shift) >> shift;
+        }
+        return status;
+    }
+
+    /**
+     * @brief Describes the failure of the last call to tryDecode().
+     * @return The decode error.
+     */
+    DecodeError lastError() const {
+        return {startAddr, opcodeByte, (int8_t)errorReg, status, prefix,
+                mnemonic};
+    }
+
+    /**
+     * @brief Decodes the instruction without rendering it as text.
+     * @param startAddr The starting address of the instruction.
+     * @return The decoded instruction.
+     * @throws The exception corresponding to the decode status, kept for
+     * compatibility with callers of the throwing API.
+     */
+    const DecodedInstruction& decode(uint64_t startAddr) {
+        if (tryDecode(startAddr) != DecodeStatus::OK) {
+            throwDecodeError(lastError());
+        }
+        return decoded;
+    }
+
+    /**
+     * @brief Executes a step in disassembling the instruction.
+     * @param startAddr The starting address of the instruction.
+     * @return The disassembled result.
+     */
+    DisassembledResult step(uint64_t startAddr) {
+        const DecodedInstruction& instruction = decode(startAddr);
+        return {startAddr, instruction.length, instruction.mnemonic,
+                formatInstruction(instruction), instruction.nextOffset,
+                labelAddr(instruction)};
     }
 };
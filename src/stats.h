@@ -0,0 +1,153 @@
+/**
+ * @file
+ * @brief Defines the counters and the phase timings of a run.
+ */
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "table.h"
+
+/**
+ * @struct DecodeStats
+ * @brief Counts what the decoder and the worklists do. The counters are
+ * only updated by the decoders a DecodeStats is attached to, so that a run
+ * without statistics only pays for a pointer test.
+ */
+struct DecodeStats {
+    uint64_t decoded = 0; /**< The instructions decoded successfully */
+    uint64_t failed = 0;  /**< The decode attempts that failed */
+    /**
+     * @brief The lookups of (prefix, opcode) resolved by falling back from
+     * the first prefix to the second (REX.W -> REX -> none).
+     */
+    uint64_t lookupFallbacks[PREFIX_NUM][PREFIX_NUM] = {};
+    uint64_t worklistPushes = 0;  /**< The addresses put on a worklist */
+    uint64_t maxWorklistSize = 0; /**< The longest a worklist has been */
+    uint64_t steals = 0; /**< The tasks taken from another worker's queue */
+    uint64_t jumpTables = 0; /**< The switch tables whose targets are found */
+
+    /**
+     * @brief Records an address put on a worklist of the given size.
+     */
+    void pushed(size_t worklistSize) {
+        worklistPushes++;
+        maxWorklistSize = std::max<uint64_t>(maxWorklistSize, worklistSize);
+    }
+
+    /**
+     * @brief Adds the counters of another decoder.
+     */
+    void merge(const DecodeStats& other) {
+        decoded += other.decoded;
+        failed += other.failed;
+        for (size_t from = 0; from < PREFIX_NUM; from++) {
+            for (size_t to = 0; to < PREFIX_NUM; to++) {
+                lookupFallbacks[from][to] += other.lookupFallbacks[from][to];
+            }
+        }
+        worklistPushes += other.worklistPushes;
+        maxWorklistSize = std::max(maxWorklistSize, other.maxWorklistSize);
+        steals += other.steals;
+        jumpTables += other.jumpTables;
+    }
+
+    /**
+     * @brief Writes the counters, one per line.
+     * @param os The output stream.
+     */
+    void print(std::ostream& os) const {
+        os << "  decoded: " << decoded << "\n";
+        os << "  failed decodes: " << failed << "\n";
+        for (size_t from = 0; from < PREFIX_NUM; from++) {
+            for (size_t to = 0; to < PREFIX_NUM; to++) {
+                if (lookupFallbacks[from][to] > 0) {
+                    os << "  lookup fallback " << to_string((Prefix)from)
+                       << " -> " << to_string((Prefix)to) << ": "
+                       << lookupFallbacks[from][to] << "\n";
+                }
+            }
+        }
+        if (worklistPushes > 0) {
+            os << "  worklist pushes: " << worklistPushes
+               << ", max size: " << maxWorklistSize << ", steals: " << steals
+               << "\n";
+        }
+        if (jumpTables > 0) {
+            os << "  jump tables: " << jumpTables << "\n";
+        }
+    }
+};
+
+/**
+ * @class PhaseTimes
+ * @brief Keeps the wall time spent in each phase of a run, in the order the
+ * phases are first timed. Timing the same phase again adds up.
+ */
+class PhaseTimes {
+   public:
+    /**
+     * @brief Runs the function and adds its wall time to the phase.
+     * @return What the function returns.
+     */
+    template <typename F>
+    auto time(const char* phase, F f) -> decltype(f()) {
+        Timer timer(*this, phase);
+        return f();
+    }
+
+    /**
+     * @brief Adds the duration to the phase.
+     */
+    void add(const char* phase, std::chrono::nanoseconds duration) {
+        for (std::pair<std::string, std::chrono::nanoseconds>& p : phases) {
+            if (p.first == phase) {
+                p.second += duration;
+                return;
+            }
+        }
+        phases.emplace_back(phase, duration);
+    }
+
+    /**
+     * @brief Writes the phases and their times in milliseconds.
+     * @param os The output stream.
+     */
+    void print(std::ostream& os) const {
+        for (const std::pair<std::string, std::chrono::nanoseconds>& p :
+             phases) {
+            char ms[32];
+            std::snprintf(ms, sizeof(ms), "%.3f", p.second.count() / 1e6);
+            os << "  " << p.first << ": " << ms << " ms\n";
+        }
+    }
+
+   private:
+    std::vector<std::pair<std::string, std::chrono::nanoseconds>> phases;
+
+    /**
+     * @brief Adds the time until its destruction to the phase, also when
+     * the timed function throws.
+     */
+    struct Timer {
+        PhaseTimes& times;
+        const char* phase;
+        std::chrono::steady_clock::time_point start;
+
+        Timer(PhaseTimes& times, const char* phase)
+            : times(times),
+              phase(phase),
+              start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            times.add(phase, std::chrono::steady_clock::now() - start);
+        }
+    };
+};
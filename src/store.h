@@ -0,0 +1,589 @@
+/**
+ * @file
+ * @brief Defines an address-ordered store of the disassembled instructions.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "instruction.h"
+
+/**
+ * @brief The string representation for unknown instructions, stored for the
+ * bytes that could not be decoded.
+ */
+const std::string UNKNOWN_INSTRUCTION = "UNKNOWN-INSTRUCTION";
+
+/**
+ * @struct StoredInstruction
+ * @brief Represents a disassembled range in the InstructionStore.
+ */
+struct StoredInstruction {
+    uint64_t startAddr; /**< The starting address */
+    uint64_t strOffset; /**< The offset of the string in the string pool */
+    uint32_t length;    /**< The number of bytes of the range */
+    uint32_t strSize;   /**< The length of the string */
+    uint64_t labelAddr = NO_LABEL; /**< The branch target to label */
+
+    uint64_t endAddr() const { return startAddr + length; }
+};
+
+/**
+ * @brief The number of records a chunk of the InstructionStore is filled
+ * with when the records are appended; a chunk growing to twice as many by
+ * insertions is split.
+ */
+constexpr size_t STORE_CHUNK_SIZE = 512;
+
+/**
+ * @class InstructionStore
+ * @brief Keeps the disassembled instructions as fixed-size records ordered by
+ * their (startAddr, endAddr) range, with the strings in a single pool.
+ *
+ * The records live in sorted chunks of about STORE_CHUNK_SIZE records, so
+ * that inserting or erasing a record in the middle only moves the records
+ * of its chunk. Records put in the address order (e.g. by linear sweep) are
+ * appended as is. The others are kept aside in the put order and merged
+ * into the chunks the next time the store is read: record by record while
+ * they are few, or in one pass over the chunks otherwise, so that reading
+ * between puts costs about the records put since the last read, not the
+ * size of the store. As with a map, putting the same range again replaces
+ * its string.
+ */
+class InstructionStore {
+    using Chunk = std::vector<StoredInstruction>;
+
+   public:
+    using Key = std::pair<uint64_t, uint64_t>;
+
+    /**
+     * @class const_iterator
+     * @brief Visits the records in the address order, chunk after chunk.
+     */
+    class const_iterator {
+       public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = StoredInstruction;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StoredInstruction*;
+        using reference = const StoredInstruction&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return (*chunks)[chunk][pos]; }
+        pointer operator->() const { return &(*chunks)[chunk][pos]; }
+
+        const_iterator& operator++() {
+            if (++pos == (*chunks)[chunk].size()) {
+                chunk++;
+                pos = 0;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator it = *this;
+            ++*this;
+            return it;
+        }
+        const_iterator& operator--() {
+            if (pos == 0) {
+                pos = (*chunks)[--chunk].size();
+            }
+            pos--;
+            return *this;
+        }
+        const_iterator operator--(int) {
+            const_iterator it = *this;
+            --*this;
+            return it;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return chunk == other.chunk && pos == other.pos;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+       private:
+        friend class InstructionStore;
+
+        const std::vector<Chunk>* chunks = nullptr;
+        size_t chunk = 0; /**< The index of the chunk, past the last at the
+                               end */
+        size_t pos = 0;   /**< The index of the record in the chunk */
+
+        const_iterator(const std::vector<Chunk>* chunks, size_t chunk,
+                       size_t pos)
+            : chunks(chunks), chunk(chunk), pos(pos) {}
+    };
+
+    /**
+     * @brief Stores the string of the range [startAddr, endAddr).
+     * @param labelAddr The address whose symbol is inserted into the string
+     * when it is printed, or NO_LABEL.
+     */
+    void put(uint64_t startAddr, uint64_t endAddr, std::string_view str,
+             uint64_t labelAddr = NO_LABEL) {
+        StoredInstruction record = {startAddr, (uint64_t)pool.size(),
+                                    (uint32_t)(endAddr - startAddr),
+                                    (uint32_t)str.size(), labelAddr};
+        pool.append(str.data(), str.size());
+        maxLength = std::max(maxLength, record.length);
+        countWidth(record, true);
+
+        Key cur(startAddr, endAddr);
+        if (!tail.empty() && cur <= tailMax) {
+            tail.push_back(record);
+            return;
+        }
+        if (!chunks.empty()) {
+            StoredInstruction& last = chunks.back().back();
+            if (cur == key(last)) {
+                garbage += last.strSize;
+                countWidth(last, false);
+                last = record;
+                return;
+            } else if (cur < key(last)) {
+                tailMax = cur;
+                tail.push_back(record);
+                return;
+            }
+        }
+        // greater than all the others, including the ones put out of order
+        append(record);
+    }
+
+    /**
+     * @brief Finds the record of the range.
+     * @return The record, or nullptr if the range is not stored.
+     */
+    const StoredInstruction* find(const Key& k) const {
+        normalize();
+        const_iterator it = lowerBound(k);
+        if (it == end() || key(*it) != k) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    /**
+     * @brief Checks whether the range is stored.
+     */
+    bool contains(const Key& k) const { return find(k) != nullptr; }
+
+    /**
+     * @brief Finds the first record starting at the address.
+     * @return The record, or nullptr if no range starts there.
+     */
+    const StoredInstruction* findStartingAt(uint64_t addr) const {
+        const_iterator it = lowerBound(addr);
+        if (it == end() || it->startAddr != addr) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    /**
+     * @brief Finds a record whose range contains the address.
+     * @return The record, or nullptr if no range contains the address.
+     */
+    const StoredInstruction* findCovering(uint64_t addr) const {
+        const_iterator it = lowerBound(addr + 1);
+        while (it != begin()) {
+            --it;
+            if (it->startAddr + maxLength <= addr) {
+                break;
+            }
+            if (it->endAddr() > addr) {
+                return &*it;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Finds the end of the last record ending at or before the
+     * address.
+     * @return The end address, or 0 if there is no such record.
+     */
+    uint64_t lastEndBefore(uint64_t addr) const {
+        uint64_t end = 0;
+        const_iterator it = lowerBound(addr);
+        while (it != begin()) {
+            --it;
+            // the records further back cannot end after the one found
+            if (it->startAddr + maxLength <= end) {
+                break;
+            }
+            if (it->endAddr() <= addr) {
+                end = std::max(end, it->endAddr());
+            }
+        }
+        return end;
+    }
+
+    /**
+     * @brief Removes the records overlapping [startAddr, endAddr).
+     * @param erased Receives the removed records. Their strings stay
+     * readable until the next put or erase.
+     */
+    void eraseOverlapping(uint64_t startAddr, uint64_t endAddr,
+                          std::vector<StoredInstruction>& erased) {
+        compactIfSparse();
+        const_iterator last = lowerBound(endAddr);
+        const_iterator first = last;
+        // a record starting before startAddr may still reach into the range
+        while (first != begin()) {
+            const_iterator prev = std::prev(first);
+            if (prev->startAddr + maxLength <= startAddr) {
+                break;
+            }
+            first = prev;
+        }
+
+        for (size_t c = first.chunk; c < chunks.size() && c <= last.chunk;
+             c++) {
+            Chunk& chunk = chunks[c];
+            auto from = chunk.begin() + (c == first.chunk ? first.pos : 0);
+            auto to = c == last.chunk ? chunk.begin() + last.pos : chunk.end();
+            auto out = from;
+            for (auto it = from; it != to; ++it) {
+                if (it->endAddr() > startAddr && it->startAddr < endAddr) {
+                    erased.push_back(*it);
+                    garbage += it->strSize;
+                    countWidth(*it, false);
+                    numRecords--;
+                } else {
+                    *out++ = *it;
+                }
+            }
+            chunk.erase(out, to);
+        }
+        auto spanEnd = chunks.begin() + std::min(last.chunk + 1,
+                                                 chunks.size());
+        chunks.erase(std::remove_if(chunks.begin() + first.chunk, spanEnd,
+                                    [](const Chunk& chunk) {
+                                        return chunk.empty();
+                                    }),
+                     spanEnd);
+    }
+
+    /**
+     * @brief Replaces the records overlapping [startAddr, endAddr) with the
+     * ones of the run, which are all within the range, as erasing them and
+     * putting the run would, but moving only the records of the chunk the
+     * run goes to.
+     * @param run The records replacing the erased ones.
+     * @param erased Receives the removed records. Their strings stay
+     * readable until the next put or erase.
+     */
+    void replaceOverlapping(uint64_t startAddr, uint64_t endAddr,
+                            const InstructionStore& run,
+                            std::vector<StoredInstruction>& erased) {
+        eraseOverlapping(startAddr, endAddr, erased);
+        if (run.empty()) {
+            return;
+        }
+        Chunk records;
+        for (const StoredInstruction& record : run) {
+            records.push_back(record);
+            records.back().strOffset = pool.size();
+            pool.append(run.str(record));
+            maxLength = std::max(maxLength, record.length);
+            countWidth(records.back(), true);
+        }
+        insert(lowerBound(records.front().startAddr), records);
+    }
+
+    /**
+     * @brief Returns the string of the record.
+     */
+    std::string_view str(const StoredInstruction& record) const {
+        return std::string_view(pool.data() + record.strOffset,
+                                record.strSize);
+    }
+
+    /**
+     * @brief Returns the string of the range, or an empty string if the range
+     * is not stored.
+     */
+    std::string operator[](const Key& k) const {
+        const StoredInstruction* record = find(k);
+        return record == nullptr ? std::string() : std::string(str(*record));
+    }
+
+    /**
+     * @brief Returns the first record in the address order.
+     */
+    const_iterator begin() const {
+        normalize();
+        return const_iterator(&chunks, 0, 0);
+    }
+    const_iterator end() const {
+        normalize();
+        return const_iterator(&chunks, chunks.size(), 0);
+    }
+
+    size_t size() const {
+        normalize();
+        return numRecords;
+    }
+
+    /**
+     * @brief Returns the length of the longest string stored but
+     * UNKNOWN_INSTRUCTION, or 0 if there is none.
+     */
+    size_t maxStrSize() const {
+        normalize();
+        size_t size = widths.size();
+        while (size > 0 && widths[size - 1] == 0) {
+            size--;
+        }
+        return size == 0 ? 0 : size - 1;
+    }
+    bool empty() const { return numRecords == 0 && tail.empty(); }
+
+    void clear() {
+        chunks.clear();
+        tail.clear();
+        pool.clear();
+        numRecords = 0;
+        maxLength = 0;
+        garbage = 0;
+        widths.clear();
+    }
+
+    bool operator==(const InstructionStore& other) const {
+        if (size() != other.size()) {
+            return false;
+        }
+        for (const_iterator a = begin(), b = other.begin(); a != end();
+             ++a, ++b) {
+            if (key(*a) != key(*b) || a->labelAddr != b->labelAddr ||
+                str(*a) != other.str(*b)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+   private:
+    // the records put out of order are merged on the first read, hence
+    // mutable
+    mutable std::vector<Chunk> chunks; /**< Sorted, none of them empty */
+    mutable std::vector<StoredInstruction> tail; /**< Put out of order */
+    Key tailMax; /**< The greatest range of the tail, if any */
+    mutable size_t numRecords = 0; /**< The number of records in the chunks */
+    std::string pool;
+    uint32_t maxLength = 0; /**< The length of the longest range put */
+    mutable size_t garbage = 0; /**< The bytes of the pool not referenced */
+    /** The number of records by the length of their string, but the
+     * UNKNOWN_INSTRUCTION ones */
+    mutable std::vector<size_t> widths;
+
+    static Key key(const StoredInstruction& record) {
+        return Key(record.startAddr, record.endAddr());
+    }
+
+    /**
+     * @brief Counts the record in or out of the widths.
+     */
+    void countWidth(const StoredInstruction& record, bool stored) const {
+        if (str(record) == UNKNOWN_INSTRUCTION) {
+            return;
+        }
+        if (record.strSize >= widths.size()) {
+            widths.resize(record.strSize + 1, 0);
+        }
+        if (stored) {
+            widths[record.strSize]++;
+        } else {
+            widths[record.strSize]--;
+        }
+    }
+
+    /**
+     * @brief Appends the record, greater than all the others, to the last
+     * chunk, or to a new one once the last is full.
+     */
+    void append(const StoredInstruction& record) const {
+        if (chunks.empty() || chunks.back().size() >= STORE_CHUNK_SIZE) {
+            chunks.emplace_back();
+            chunks.back().reserve(STORE_CHUNK_SIZE);
+        }
+        chunks.back().push_back(record);
+        numRecords++;
+    }
+
+    /**
+     * @brief Returns the first record starting at or after the address.
+     */
+    const_iterator lowerBound(uint64_t addr) const {
+        normalize();
+        auto chunk = std::partition_point(
+            chunks.begin(), chunks.end(),
+            [&](const Chunk& c) { return c.back().startAddr < addr; });
+        if (chunk == chunks.end()) {
+            return end();
+        }
+        auto it = std::lower_bound(chunk->begin(), chunk->end(), addr,
+                                   [](const StoredInstruction& record,
+                                      uint64_t addr) {
+                                       return record.startAddr < addr;
+                                   });
+        return const_iterator(&chunks, chunk - chunks.begin(),
+                              it - chunk->begin());
+    }
+
+    /**
+     * @brief Returns the first record whose range is not less than the key.
+     */
+    const_iterator lowerBound(const Key& k) const {
+        auto chunk = std::partition_point(
+            chunks.begin(), chunks.end(),
+            [&](const Chunk& c) { return key(c.back()) < k; });
+        if (chunk == chunks.end()) {
+            return const_iterator(&chunks, chunks.size(), 0);
+        }
+        auto it = std::lower_bound(chunk->begin(), chunk->end(), k,
+                                   [](const StoredInstruction& record,
+                                      const Key& k) {
+                                       return key(record) < k;
+                                   });
+        return const_iterator(&chunks, chunk - chunks.begin(),
+                              it - chunk->begin());
+    }
+
+    /**
+     * @brief Inserts the sorted records before the position, which keeps
+     * the order, then splits the chunk if it has grown too large.
+     */
+    void insert(const_iterator at, const Chunk& records) const {
+        if (chunks.empty()) {
+            for (const StoredInstruction& record : records) {
+                append(record);
+            }
+            return;
+        }
+        if (at.chunk == chunks.size()) {
+            at.chunk--;
+            at.pos = chunks[at.chunk].size();
+        }
+        Chunk& chunk = chunks[at.chunk];
+        chunk.insert(chunk.begin() + at.pos, records.begin(), records.end());
+        numRecords += records.size();
+        if (chunk.size() < 2 * STORE_CHUNK_SIZE) {
+            return;
+        }
+
+        std::vector<Chunk> pieces;
+        for (size_t i = 0; i < chunk.size(); i += STORE_CHUNK_SIZE) {
+            pieces.emplace_back(
+                chunk.begin() + i,
+                chunk.begin() + std::min(i + STORE_CHUNK_SIZE, chunk.size()));
+        }
+        chunks.erase(chunks.begin() + at.chunk);
+        chunks.insert(chunks.begin() + at.chunk,
+                      std::make_move_iterator(pieces.begin()),
+                      std::make_move_iterator(pieces.end()));
+    }
+
+    /**
+     * @brief Rebuilds the pool once most of it is no longer referenced.
+     */
+    void compactIfSparse() {
+        if (garbage <= pool.size() / 2) {
+            return;
+        }
+        normalize();
+        std::string compacted;
+        compacted.reserve(pool.size() - garbage);
+        for (Chunk& chunk : chunks) {
+            for (StoredInstruction& record : chunk) {
+                uint64_t offset = compacted.size();
+                compacted.append(pool, record.strOffset, record.strSize);
+                record.strOffset = offset;
+            }
+        }
+        pool.swap(compacted);
+        garbage = 0;
+    }
+
+    /**
+     * @brief Merges the records put out of order into the chunks, keeping
+     * the last one put for each range.
+     */
+    void normalize() const {
+        if (tail.empty()) {
+            return;
+        }
+        std::stable_sort(tail.begin(), tail.end(),
+                         [](const StoredInstruction& a,
+                            const StoredInstruction& b) {
+                             return key(a) < key(b);
+                         });
+        size_t n = 0;
+        for (size_t i = 0; i < tail.size(); i++) {
+            if (n > 0 && key(tail[n - 1]) == key(tail[i])) {
+                garbage += tail[n - 1].strSize;
+                countWidth(tail[n - 1], false);
+                tail[n - 1] = tail[i];
+            } else {
+                tail[n++] = tail[i];
+            }
+        }
+        tail.resize(n);
+
+        if (tail.size() <= numRecords / STORE_CHUNK_SIZE) {
+            // a few records, each moving the rest of its chunk
+            for (const StoredInstruction& record : tail) {
+                const_iterator it = lowerBound(key(record));
+                if (it != const_iterator(&chunks, chunks.size(), 0) &&
+                    key(*it) == key(record)) {
+                    StoredInstruction& old = chunks[it.chunk][it.pos];
+                    garbage += old.strSize;
+                    countWidth(old, false);
+                    old = record;
+                } else {
+                    insert(it, Chunk(1, record));
+                }
+            }
+        } else {
+            // one merge of the sorted chunks and records
+            Chunk merged;
+            merged.reserve(numRecords + tail.size());
+            size_t t = 0;
+            for (const Chunk& chunk : chunks) {
+                for (const StoredInstruction& record : chunk) {
+                    for (; t < tail.size() && key(tail[t]) < key(record);
+                         t++) {
+                        merged.push_back(tail[t]);
+                    }
+                    if (t < tail.size() && key(tail[t]) == key(record)) {
+                        garbage += record.strSize;
+                        countWidth(record, false);
+                        merged.push_back(tail[t++]);
+                    } else {
+                        merged.push_back(record);
+                    }
+                }
+            }
+            merged.insert(merged.end(), tail.begin() + t, tail.end());
+            chunks.clear();
+            numRecords = 0;
+            tail.clear();
+            for (const StoredInstruction& record : merged) {
+                append(record);
+            }
+        }
+        tail.clear();
+    }
+};
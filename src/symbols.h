@@ -0,0 +1,113 @@
+/**
+ * @file
+ * @brief Defines an address-ordered index of the symbols.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct Symbol
+ * @brief Represents a symbol with its optional relocation offset.
+ */
+struct Symbol {
+    uint64_t addr;         /**< The address of the symbol */
+    std::string_view name; /**< The name, owned by the symbol table */
+    bool hasRoffset;       /**< Whether the symbol has a relocation offset */
+    uint64_t roffset;      /**< The relocation offset, if hasRoffset */
+};
+
+/**
+ * @class SymbolIndex
+ * @brief Keeps the symbols sorted by address in a contiguous array, so that
+ * they can be looked up by binary search or walked along the address-ordered
+ * instructions.
+ */
+class SymbolIndex {
+   public:
+    SymbolIndex() = default;
+
+    /**
+     * @brief Builds the index from the symbols and the relocation offsets
+     * parsed from the object file. The names are not copied, so they must
+     * outlive the index.
+     * @param addr2symbol Mapping of addresses to symbol names.
+     * @param addr2roffset Mapping of addresses to relocation offsets.
+     */
+    template <typename SymbolMap,
+              typename RoffsetMap = std::unordered_map<uint64_t, uint64_t>>
+    SymbolIndex(const SymbolMap& addr2symbol,
+                const RoffsetMap& addr2roffset) {
+        symbols.reserve(addr2symbol.size());
+        for (const auto& kv : addr2symbol) {
+            auto roffset = addr2roffset.find(kv.first);
+            bool hasRoffset = roffset != addr2roffset.end();
+            symbols.push_back({kv.first, kv.second, hasRoffset,
+                               hasRoffset ? roffset->second : 0});
+        }
+        std::sort(symbols.begin(), symbols.end(),
+                  [](const Symbol& a, const Symbol& b) {
+                      return a.addr < b.addr;
+                  });
+    }
+
+    /**
+     * @brief Finds the symbol at the address.
+     * @return The symbol, or nullptr if there is none.
+     */
+    const Symbol* find(uint64_t addr) const {
+        auto it = lowerBound(addr);
+        if (it == symbols.end() || it->addr != addr) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    /**
+     * @brief Finds the nearest symbol at or before the address, e.g. the
+     * function containing it.
+     * @return The symbol, or nullptr if every symbol is after the address.
+     */
+    const Symbol* findPreceding(uint64_t addr) const {
+        auto it = lowerBound(addr);
+        if (it != symbols.end() && it->addr == addr) {
+            return &*it;
+        }
+        if (it == symbols.begin()) {
+            return nullptr;
+        }
+        return &*(it - 1);
+    }
+
+    /**
+     * @brief Returns the index of the first symbol at or after the address.
+     */
+    size_t lowerBoundIndex(uint64_t addr) const {
+        return lowerBound(addr) - symbols.begin();
+    }
+
+    const Symbol& operator[](size_t i) const { return symbols[i]; }
+
+    std::vector<Symbol>::const_iterator begin() const {
+        return symbols.begin();
+    }
+    std::vector<Symbol>::const_iterator end() const { return symbols.end(); }
+
+    size_t size() const { return symbols.size(); }
+    bool empty() const { return symbols.empty(); }
+
+   private:
+    std::vector<Symbol> symbols;
+
+    std::vector<Symbol>::const_iterator lowerBound(uint64_t addr) const {
+        return std::lower_bound(
+            symbols.begin(), symbols.end(), addr,
+            [](const Symbol& symbol, uint64_t addr) {
+                return symbol.addr < addr;
+            });
+    }
+};
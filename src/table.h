@@ -1,17 +1,127 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "constants.h"
 #include "utils.h"
 
+/**
+ * @struct RegMnemonic
+ * @brief Maps the reg field of ModRM (or -1 as the default) to a mnemonic.
+ */
+struct RegMnemonic {
+    int reg;
+    Mnemonic mnemonic;
+};
+
+/**
+ * @struct RegMnemonicMap
+ * @brief Fixed-capacity list of reg -> mnemonic pairs usable in constant
+ * expressions.
+ */
+struct RegMnemonicMap {
+    static constexpr size_t CAPACITY = 16;
+
+    RegMnemonic entries[CAPACITY];
+    size_t num;
+
+    constexpr RegMnemonicMap(std::initializer_list<RegMnemonic> init)
+        : entries{}, num(0) {
+        for (const RegMnemonic& e : init) {
+            entries[num++] = e;
+        }
+    }
+};
+
+/**
+ * @struct OperandList
+ * @brief Fixed-capacity list of operand types usable in constant
+ * expressions.
+ */
+struct OperandList {
+    static constexpr size_t CAPACITY = 4;
+
+    Operand entries[CAPACITY];
+    size_t num;
+
+    constexpr OperandList() : entries{}, num(0) {}
+    constexpr OperandList(std::initializer_list<Operand> init)
+        : entries{}, num(0) {
+        for (Operand e : init) {
+            entries[num++] = e;
+        }
+    }
+
+    constexpr size_t size() const { return num; }
+    constexpr bool empty() const { return num == 0; }
+    constexpr Operand operator[](size_t i) const { return entries[i]; }
+    constexpr const Operand* begin() const { return entries; }
+    constexpr const Operand* end() const { return entries + num; }
+};
+
+/**
+ * @struct OpcodeKey
+ * @brief Key of OP_LOOKUP: (prefix, opcode).
+ */
+struct OpcodeKey {
+    Prefix prefix;
+    int opcode;
+};
+
+/**
+ * @struct OpLookupEntry
+ * @brief An entry of OP_LOOKUP: (prefix, opcode) -> (reg -> mnemonic).
+ */
+struct OpLookupEntry {
+    OpcodeKey key;
+    RegMnemonicMap reg2mnem;
+};
+
+/**
+ * @struct OperandKey
+ * @brief Key of OPERAND_LOOKUP: (prefix, mnemonic, opcode).
+ */
+struct OperandKey {
+    Prefix prefix;
+    Mnemonic mnemonic;
+    int opcode;
+};
+
+/**
+ * @struct OperandSpec
+ * @brief The encoding, the remaining opcode and the operand types of an
+ * instruction.
+ */
+struct OperandSpec {
+    OpEnc opEnc;
+    const char* remOp; /**< e.g. "/r", "ib" or the register index of +rd */
+    OperandList operands;
+};
+
+/**
+ * @struct OperandLookupEntry
+ * @brief An entry of OPERAND_LOOKUP: (prefix, mnemonic, opcode) -> spec.
+ */
+struct OperandLookupEntry {
+    OperandKey key;
+    OperandSpec spec;
+};
+
+/**
+ * @brief The version of the lookup tables and of the instruction formatting.
+ * Bump it whenever either changes, so that decode caches built with the
+ * previous tables are not used.
+ */
+const uint32_t DECODER_TABLE_VERSION = 1;
+
 // Global lookup table for instructions
 // (prefix, opcode) -> (reg -> operator)
-const std::unordered_map<std::pair<Prefix, int>,
-                         std::unordered_map<int, Mnemonic>>
-    OP_LOOKUP = {
+constexpr OpLookupEntry OP_LOOKUP[] = {
         // SETNE
         {{Prefix::NONE, u2d("\x0F\x95")}, {{-1, Mnemonic::SETNE}}},
         {{Prefix::REX, u2d("\x0F\x95")}, {{-1, Mnemonic::SETNE}}},
@@ -711,10 +821,7 @@ const std::unordered_map<std::pair<Prefix, int>,
 
 // Lookup table for operand information
 // (prefix, operator, opcode) -> (encoding, remaining opcodes, operands)
-const std::unordered_map<
-    std::tuple<Prefix, Mnemonic, int>,
-    std::tuple<OpEnc, std::vector<std::string>, std::vector<Operand>>>
-    OPERAND_LOOKUP = {
+constexpr OperandLookupEntry OPERAND_LOOKUP[] = {
         // SETNE
         {{Prefix::NONE, Mnemonic::SETNE, u2d("\x0F\x95")},
          {OpEnc::M, {}, {Operand::rm8}}},
@@ -1942,3 +2049,171 @@ const std::unordered_map<
 const std::vector<std::pair<int, int>> MULTI_BYTES_OPCODES = {
     std::make_pair(4, u2d("\xF3\x0F\x1E\xFA")),
     std::make_pair(4, u2d("\xF3\x0F\x1E\xFB"))};
+
+/**
+ * @brief The index of OPERAND_LOOKUP meaning that no operand spec exists.
+ */
+constexpr uint16_t NO_OPERAND_SPEC = 0xFFFF;
+
+/**
+ * @brief The number of opcode slots in the dispatch table: the one-byte
+ * opcodes followed by 256 slots per two-byte opcode prefix.
+ */
+constexpr size_t OPCODE_SLOT_NUM =
+    256 * (1 + std::size(TWO_BYTES_OPCODE_PREFIX));
+
+constexpr size_t PREFIX_NUM = 4;
+
+/**
+ * @brief Returns the position of the byte in TWO_BYTES_OPCODE_PREFIX, or -1.
+ */
+constexpr int twoBytesOpcodePrefixIdx(int byte) {
+    for (size_t i = 0; i < std::size(TWO_BYTES_OPCODE_PREFIX); ++i) {
+        if (TWO_BYTES_OPCODE_PREFIX[i] == byte) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+inline bool isTwoBytesOpcodePrefix(int byte) {
+    return twoBytesOpcodePrefixIdx(byte) >= 0;
+}
+
+/**
+ * @brief Maps a one- or two-byte opcode to its slot in the dispatch table.
+ * @return The slot, or -1 if the opcode cannot be produced by the decoder
+ *         (e.g. ENDBR, which is parsed separately).
+ */
+constexpr int opcodeSlot(int opcode) {
+    if (opcode >= 0 && opcode <= 0xFF) {
+        return opcode;
+    }
+    if (opcode > 0xFF && opcode <= 0xFFFF) {
+        int idx = twoBytesOpcodePrefixIdx(opcode >> 8);
+        if (idx >= 0) {
+            return 256 * (idx + 1) + (opcode & 0xFF);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @struct DecodeEntry
+ * @brief The mnemonic selected by (prefix, opcode, reg) and the index of its
+ * operand spec in OPERAND_LOOKUP.
+ */
+struct DecodeEntry {
+    Mnemonic mnemonic;
+    bool valid;
+    uint16_t operandIdx;
+};
+
+/**
+ * @struct OpcodeDispatchRow
+ * @brief Everything the decoder needs to know about a (prefix, opcode) pair.
+ */
+struct OpcodeDispatchRow {
+    Prefix prefix; /**< The prefix after falling back (REX.W -> REX -> none) */
+    DecodeEntry byReg[8];  /**< Indexed by the reg field of ModRM */
+    DecodeEntry noModrm;   /**< Used when no ModRM byte is available */
+};
+
+/**
+ * @struct OpcodeDispatchTable
+ * @brief Densely indexed replacement of OP_LOOKUP and OPERAND_LOOKUP.
+ *
+ * slots[prefix][opcodeSlot(opcode)] is the index of the row in rows, where 0
+ * means the combination is unknown.
+ */
+struct OpcodeDispatchTable {
+    uint16_t slots[PREFIX_NUM][OPCODE_SLOT_NUM];
+    OpcodeDispatchRow rows[std::size(OP_LOOKUP) + 1];
+};
+
+/**
+ * @brief Builds the dispatch table from OP_LOOKUP and OPERAND_LOOKUP.
+ *
+ * Duplicated keys keep their first occurrence, like the unordered_map tables
+ * they replace.
+ */
+constexpr OpcodeDispatchTable buildOpcodeDispatchTable() {
+    OpcodeDispatchTable table{};
+    uint16_t rowNum = 1;
+
+    for (const OpLookupEntry& e : OP_LOOKUP) {
+        int slot = opcodeSlot(e.key.opcode);
+        if (slot < 0 || table.slots[(size_t)e.key.prefix][slot] != 0) {
+            continue;
+        }
+        table.slots[(size_t)e.key.prefix][slot] = rowNum;
+
+        OpcodeDispatchRow& row = table.rows[rowNum++];
+        row.prefix = e.key.prefix;
+        for (size_t i = 0; i < e.reg2mnem.num; ++i) {
+            if (e.reg2mnem.entries[i].reg < 0 && !row.noModrm.valid) {
+                row.noModrm = {e.reg2mnem.entries[i].mnemonic, true,
+                               NO_OPERAND_SPEC};
+            }
+        }
+        for (int reg = 0; reg < 8; ++reg) {
+            row.byReg[reg] = row.noModrm;
+            for (size_t i = 0; i < e.reg2mnem.num; ++i) {
+                if (e.reg2mnem.entries[i].reg == reg) {
+                    row.byReg[reg] = {e.reg2mnem.entries[i].mnemonic, true,
+                                      NO_OPERAND_SPEC};
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < std::size(OPERAND_LOOKUP); ++i) {
+        const OperandKey& key = OPERAND_LOOKUP[i].key;
+        int slot = opcodeSlot(key.opcode);
+        if (slot < 0 || table.slots[(size_t)key.prefix][slot] == 0) {
+            continue;
+        }
+        OpcodeDispatchRow& row =
+            table.rows[table.slots[(size_t)key.prefix][slot]];
+        for (int reg = 0; reg <= 8; ++reg) {
+            DecodeEntry& entry = (reg < 8) ? row.byReg[reg] : row.noModrm;
+            if (entry.valid && entry.mnemonic == key.mnemonic &&
+                entry.operandIdx == NO_OPERAND_SPEC) {
+                entry.operandIdx = (uint16_t)i;
+            }
+        }
+    }
+
+    // REX.W falls back to REX, and REX falls back to no prefix. The fallback
+    // of REX.W must point to a row registered with REX itself.
+    for (size_t slot = 0; slot < OPCODE_SLOT_NUM; ++slot) {
+        if (table.slots[(size_t)Prefix::REXW][slot] == 0) {
+            table.slots[(size_t)Prefix::REXW][slot] =
+                table.slots[(size_t)Prefix::REX][slot];
+        }
+    }
+    for (size_t slot = 0; slot < OPCODE_SLOT_NUM; ++slot) {
+        if (table.slots[(size_t)Prefix::REX][slot] == 0) {
+            table.slots[(size_t)Prefix::REX][slot] =
+                table.slots[(size_t)Prefix::NONE][slot];
+        }
+    }
+
+    return table;
+}
+
+constexpr OpcodeDispatchTable OPCODE_DISPATCH = buildOpcodeDispatchTable();
+
+/**
+ * @brief Looks up the dispatch row of (prefix, opcode).
+ * @return The row, or nullptr if the combination is unknown.
+ */
+inline const OpcodeDispatchRow* lookupOpcode(Prefix prefix, int opcode) {
+    int slot = opcodeSlot(opcode);
+    if (slot < 0) {
+        return nullptr;
+    }
+    uint16_t rowIdx = OPCODE_DISPATCH.slots[(size_t)prefix][slot];
+    return rowIdx == 0 ? nullptr : &OPCODE_DISPATCH.rows[rowIdx];
+}
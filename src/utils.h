@@ -51,11 +51,12 @@ struct hash<std::tuple<TT...>> {
 };
 }  // namespace std
 
-inline int u2d(const std::string& utf8_str) {
-    int result = 0;
-    for (unsigned char c : utf8_str) {
-        result = (result << 8) + c;
+template <size_t N>
+constexpr int u2d(const char (&utf8_str)[N]) {
+    unsigned int result = 0;
+    for (size_t i = 0; i + 1 < N; ++i) {
+        result = (result << 8) + static_cast<unsigned char>(utf8_str[i]);
     }
-    return result;
+    return static_cast<int>(result);
 }
 
@@ -0,0 +1,141 @@
+/**
+ * @file
+ * @brief Defines the per-worker queues of a work-stealing scheduler.
+ */
+
+#pragma once
+#include <sched.h>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WorkQueue
+ * @brief Keeps the tasks of a worker. The owner pushes and pops at the back,
+ * in the depth-first order, while idle workers steal the oldest tasks from
+ * the front.
+ */
+template <typename T>
+class WorkQueue {
+   public:
+    /**
+     * @brief Adds a task at the back.
+     * @return The number of tasks queued, including the new one.
+     */
+    size_t push(const T& task) {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(task);
+        return tasks.size();
+    }
+
+    /**
+     * @brief Takes the newest task, used by the owner.
+     * @return False if the queue is empty.
+     */
+    bool pop(T& task) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (tasks.empty()) {
+            return false;
+        }
+        task = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest task, used by the other workers.
+     * @return False if the queue is empty.
+     */
+    bool steal(T& task) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (tasks.empty()) {
+            return false;
+        }
+        task = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+
+   private:
+    std::mutex mtx;
+    std::deque<T> tasks;
+};
+
+/**
+ * @class WorkStealingScheduler
+ * @brief Runs the tasks on a number of workers, each with its own queue.
+ *
+ * A task may spawn new tasks on the queue of the worker running it. The
+ * scheduler returns once every task, including the spawned ones, is done.
+ */
+template <typename T>
+class WorkStealingScheduler {
+   public:
+    explicit WorkStealingScheduler(size_t workers)
+        : queues(workers > 0 ? workers : 1), pending(0), stolen(0) {}
+
+    size_t workers() const { return queues.size(); }
+
+    /**
+     * @brief Returns the number of tasks run by other workers than the one
+     * they were spawned for.
+     */
+    size_t steals() const { return stolen.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Adds a task to the queue of the worker.
+     * @return The number of tasks in the queue, including the new one.
+     */
+    size_t spawn(size_t worker, const T& task) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        return queues[worker].push(task);
+    }
+
+    /**
+     * @brief Runs the tasks until none is left.
+     * @param body Called with the index of the worker and the task. It may
+     * spawn new tasks for the same worker.
+     */
+    template <typename F>
+    void run(F body) {
+        auto worker = [&](size_t i) {
+            T task;
+            while (pending.load(std::memory_order_acquire) > 0) {
+                if (queues[i].pop(task) || stealFor(i, task)) {
+                    body(i, task);
+                    pending.fetch_sub(1, std::memory_order_acq_rel);
+                } else {
+                    sched_yield();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < queues.size(); i++) {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+   private:
+    std::vector<WorkQueue<T>> queues;
+    std::atomic<size_t> pending; /**< The tasks queued or running */
+    std::atomic<size_t> stolen;  /**< The tasks taken by stealFor */
+
+    bool stealFor(size_t i, T& task) {
+        for (size_t k = 1; k < queues.size(); k++) {
+            if (queues[(i + k) % queues.size()].steal(task)) {
+                stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+};
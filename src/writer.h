@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @brief Defines a buffered writer for the disassembly listing.
+ */
+
+#pragma once
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "formatter.h"
+
+/**
+ * @class OutputWriter
+ * @brief Accumulates the output in a large buffer and writes it in big chunks
+ * to either a std::ostream or a file descriptor.
+ */
+class OutputWriter {
+   public:
+    /**
+     * @brief The buffer size at which the output is written out.
+     */
+    static constexpr size_t FLUSH_SIZE = 1 << 20;
+
+    explicit OutputWriter(std::ostream& os) : os(&os), fd(-1) { reserve(); }
+    explicit OutputWriter(int fd) : os(nullptr), fd(fd) { reserve(); }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    ~OutputWriter() {
+        try {
+            flush();
+        } catch (const std::exception&) {
+            // the error cannot be reported from the destructor
+        }
+    }
+
+    OutputWriter& write(std::string_view str) {
+        buf.append(str.data(), str.size());
+        flushIfFull();
+        return *this;
+    }
+
+    OutputWriter& put(char c) {
+        buf += c;
+        flushIfFull();
+        return *this;
+    }
+
+    /**
+     * @brief Writes count copies of the character.
+     */
+    OutputWriter& fill(char c, size_t count) {
+        buf.append(count, c);
+        flushIfFull();
+        return *this;
+    }
+
+    /**
+     * @brief Writes the value in lowercase hexadecimal without the 0x prefix.
+     */
+    OutputWriter& hex(uint64_t val) {
+        appendHex(buf, val);
+        flushIfFull();
+        return *this;
+    }
+
+    /**
+     * @brief Writes the bytes as space-separated hexadecimal values without
+     * zero padding (e.g. "48 8b 5 0 "), each followed by a space.
+     */
+    OutputWriter& hexBytes(const unsigned char* bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            unsigned char b = bytes[i];
+            if (b >= 0x10) {
+                buf += "0123456789abcdef"[b >> 4];
+            }
+            buf += "0123456789abcdef"[b & 0xF];
+            buf += ' ';
+        }
+        flushIfFull();
+        return *this;
+    }
+
+    /**
+     * @brief Writes out the buffered output.
+     */
+    void flush() {
+        if (os != nullptr) {
+            os->write(buf.data(), buf.size());
+            os->flush();
+        } else {
+            const char* p = buf.data();
+            size_t left = buf.size();
+            while (left > 0) {
+                ssize_t n = ::write(fd, p, left);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    buf.clear();
+                    throw std::runtime_error(
+                        std::string("Failed to write the output: ") +
+                        std::strerror(errno));
+                }
+                p += n;
+                left -= n;
+            }
+        }
+        buf.clear();
+    }
+
+   private:
+    std::ostream* os; /**< The output stream, or nullptr */
+    int fd;           /**< The file descriptor used when os is nullptr */
+    std::string buf;  /**< The buffered output */
+
+    void reserve() { buf.reserve(FLUSH_SIZE + FLUSH_SIZE / 4); }
+
+    void flushIfFull() {
+        if (buf.size() >= FLUSH_SIZE) {
+            flush();
+        }
+    }
+};
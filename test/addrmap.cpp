@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "addrmap.h"
+
+TEST(addrmap, TRANSLATE) {
+    AddressMap map;
+    ASSERT_TRUE(map.empty());
+    map.map(0x403000, 0x3000, 0x100);  // out of order
+    map.map(0x400000, 0, 0x1000);
+    map.map(0x401000, 0x1000, 0);  // no bytes in the file
+
+    ASSERT_EQ(map.toOffset(0x400000), 0);
+    ASSERT_EQ(map.toOffset(0x400fff), 0xfff);
+    ASSERT_EQ(map.toOffset(0x401000), NOT_MAPPED);
+    ASSERT_EQ(map.toOffset(0x403010), 0x3010);
+    ASSERT_EQ(map.toOffset(0x403100), NOT_MAPPED);
+    ASSERT_EQ(map.toOffset(0x3ff000), NOT_MAPPED);
+
+    ASSERT_EQ(map.toAddr(0x3010), 0x403010);
+    ASSERT_EQ(map.toAddr(0x2000), NOT_MAPPED);
+
+    ASSERT_TRUE(map.isContiguous(0x400010, 0x100));
+    ASSERT_TRUE(map.isContiguous(0x403000, 0x100));
+    ASSERT_FALSE(map.isContiguous(0x400f00, 0x200));  // across a hole
+    ASSERT_FALSE(map.isContiguous(0x403000, 0));
+}
+
+TEST(addrmap, PARSE_RANGE) {
+    ASSERT_EQ(parseAddressRange("1000-20ff"),
+              (std::pair<uint64_t, uint64_t>(0x1000, 0x20ff)));
+    ASSERT_EQ(parseAddressRange("0x401000-0x401010"),
+              (std::pair<uint64_t, uint64_t>(0x401000, 0x401010)));
+
+    for (const std::string range :
+         {"1000", "1000-20zz", "10zz-2000", "-2000", "1000-", "-", " 10-20",
+          "10- 20", "10--20", "10-20-30", "10000000000000000-1"}) {
+        try {
+            parseAddressRange(range);
+            FAIL() << range;
+        } catch (const std::invalid_argument& e) {
+            ASSERT_NE(std::string(e.what()).find(range), std::string::npos)
+                << e.what();
+        }
+    }
+}
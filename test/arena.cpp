@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+
+TEST(arena, ALLOCATE) {
+    Arena arena;
+    ASSERT_EQ(arena.bytesReserved(), 0);
+
+    char* a = static_cast<char*>(arena.allocate(3, 1));
+    uint64_t* b = static_cast<uint64_t*>(arena.allocate(8, alignof(uint64_t)));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % alignof(uint64_t), 0);
+    ASSERT_GE(reinterpret_cast<char*>(b), a + 3);
+    ASSERT_EQ(arena.bytesReserved(), ARENA_BLOCK_SIZE);
+
+    // small allocations share the blocks
+    for (int i = 0; i < 1000; i++) {
+        arena.allocate(16, 16);
+    }
+    ASSERT_EQ(arena.bytesReserved(), ARENA_BLOCK_SIZE);
+
+    // a large one gets its own block and the current one is kept
+    void* large = arena.allocate(ARENA_BLOCK_SIZE, 64);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(large) % 64, 0);
+    char* c = static_cast<char*>(arena.allocate(1, 1));
+    ASSERT_GT(arena.bytesReserved(), 2 * ARENA_BLOCK_SIZE);
+    ASSERT_LT(arena.bytesReserved(), 3 * ARENA_BLOCK_SIZE);
+    ASSERT_NE(c, nullptr);
+
+    arena.release();
+    ASSERT_EQ(arena.bytesReserved(), 0);
+    ASSERT_NE(arena.allocate(1, 1), nullptr);
+}
+
+TEST(arena, COPY) {
+    Arena arena;
+    std::string name = "main";
+    std::string_view copy = arena.copy(name);
+    name = "_start";
+    ASSERT_EQ(copy, "main");
+    ASSERT_EQ(copy.data()[copy.size()], '\0');
+    ASSERT_EQ(arena.copy(""), "");
+}
+
+TEST(arena, MAP) {
+    Arena arena;
+    ArenaMap<uint64_t, std::string_view> addr2symbol(
+        (ArenaAllocator<char>(arena)));
+    for (uint64_t addr = 0; addr < 10000; addr++) {
+        addr2symbol[addr] = arena.copy(std::to_string(addr));
+    }
+    ASSERT_EQ(addr2symbol.size(), 10000);
+    ASSERT_EQ(addr2symbol.at(1234), "1234");
+    addr2symbol.erase(1234);
+    ASSERT_EQ(addr2symbol.count(1234), 0);
+
+    std::vector<int, ArenaAllocator<int>> values((ArenaAllocator<int>(arena)));
+    for (int i = 0; i < 1000; i++) {
+        values.push_back(i);
+    }
+    ASSERT_EQ(values[999], 999);
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "testutil.h"
+
+namespace {
+
+std::string readFile(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+}  // namespace
+
+TEST(batch, MANIFEST) {
+    std::istringstream manifest("a.o\n\n  \nlib/b.o\r\n/abs/c.o");
+    std::vector<std::string> paths = readManifest(manifest);
+    ASSERT_EQ(paths, (std::vector<std::string>{"a.o", "lib/b.o", "/abs/c.o"}));
+
+    std::vector<BatchJob> jobs =
+        planBatch({"a.o", "x/b.o", "y/b.o", "b.o"}, "out");
+    ASSERT_EQ(jobs.size(), 4);
+    ASSERT_EQ(jobs[0].outputPath, "out/a.o.lst");
+    ASSERT_EQ(jobs[1].inputPath, "x/b.o");
+    ASSERT_EQ(jobs[1].outputPath, "out/b.o.lst");
+    ASSERT_EQ(jobs[2].outputPath, "out/b.o.1.lst");
+    ASSERT_EQ(jobs[3].outputPath, "out/b.o.2.lst");
+}
+
+TEST(batch, RUN) {
+    TempDir dir("batch");
+
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 6; i++) {
+        inputs.push_back(dir.path("f" + std::to_string(i) + ".o"));
+        writeELF(inputs.back(), {
+                                    0xb8, 0x00, 0x00, 0x00, 0x00,  // mov
+                                    0x83, 0xf8, (unsigned char)i,  // cmp
+                                    0x74, 0x02,                    // jz
+                                    0x0f, 0xff,                    // invalid
+                                    0xc3,                          // ret
+                                });
+    }
+    inputs.push_back(dir.path("missing.o"));
+    inputs.push_back(dir.path("notelf.o"));
+    std::ofstream(inputs.back()) << "not an object file";
+
+    BatchOptions options;
+    options.workers = 3;
+    std::ostringstream errors;
+    BatchDisAssembler bda(options, errors);
+    ASSERT_TRUE(makeOutputDir(dir.path("out")));
+    std::vector<BatchJob> jobs = planBatch(inputs, dir.path("out"));
+
+    std::vector<BatchResult> results = bda.run(jobs);
+    ASSERT_EQ(results.size(), jobs.size());
+    for (size_t i = 0; i < 6; i++) {
+        ASSERT_TRUE(results[i].ok) << results[i].error;
+
+        // the same listing as the one written for the file alone
+        ELFDisAssembler eda(inputs[i], "linearsweep");
+        eda.disas(PRINTABLE_SECTIONS, 1);
+        std::ostringstream expected;
+        eda.print(expected);
+        ASSERT_EQ(readFile(jobs[i].outputPath), expected.str());
+        ASSERT_NE(errors.str().find(inputs[i] + ":\n"), std::string::npos);
+    }
+    ASSERT_FALSE(results[6].ok);
+    ASSERT_NE(results[6].error.find("Failed to open"), std::string::npos);
+    ASSERT_FALSE(results[7].ok);
+    ASSERT_NE(results[7].error.find("Not an ELF64"), std::string::npos);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "boundary.h"
+#include "disassembler.h"
+
+namespace {
+
+std::vector<unsigned char> randomBytes(size_t size, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<unsigned char> bytes(size);
+    for (unsigned char& b : bytes) {
+        b = (unsigned char)random();
+    }
+    return bytes;
+}
+
+}  // namespace
+
+TEST(boundary, DECODE_LENGTH) {
+    // jz +4; call -0x10; mov eax 0x11223344; add [rax + rcx * 4 + 0x10] 0x7f
+    std::vector<unsigned char> code = {0x74, 0x04, 0xe8, 0xf0, 0xff, 0xff,
+                                       0xff, 0xb8, 0x44, 0x33, 0x22, 0x11,
+                                       0x83, 0x44, 0x88, 0x10, 0x7f};
+    State state(code);
+    ASSERT_EQ(state.decodeLength(0), DecodeStatus::OK);
+    ASSERT_EQ(state.boundary.length, 2);
+    ASSERT_TRUE(state.boundary.isRelativeBranch);
+    ASSERT_EQ(branchTarget(state.boundary), 6);
+    ASSERT_EQ(state.decodeLength(2), DecodeStatus::OK);
+    ASSERT_EQ(branchTarget(state.boundary), (uint64_t)(7 - 0x10));
+    ASSERT_EQ(state.decodeLength(7), DecodeStatus::OK);
+    ASSERT_EQ(state.boundary.length, 5);
+    ASSERT_FALSE(state.boundary.isRelativeBranch);
+    ASSERT_EQ(state.decodeLength(12), DecodeStatus::OK);
+    ASSERT_EQ(state.boundary.length, 5);
+
+    // the immediate is cut
+    std::vector<unsigned char> truncated(code.begin(), code.begin() + 10);
+    State cut(truncated);
+    ASSERT_EQ(cut.decodeLength(7), DecodeStatus::TRUNCATED);
+}
+
+TEST(boundary, SAME_AS_FULL_DECODE) {
+    std::vector<unsigned char> bytes = randomBytes(1 << 16, 7);
+    State full(bytes);
+    State fast(bytes);
+    size_t decoded = 0;
+    for (uint64_t addr = 0; addr < bytes.size(); addr++) {
+        DecodeStatus status = full.tryDecode(addr);
+        ASSERT_EQ(fast.decodeLength(addr), status) << addr;
+        if (status != DecodeStatus::OK) {
+            ASSERT_EQ(fast.lastError().status, full.lastError().status);
+            continue;
+        }
+        decoded++;
+        ASSERT_EQ(fast.boundary.length, full.decoded.length) << addr;
+        ASSERT_EQ(fast.boundary.mnemonic, full.decoded.mnemonic) << addr;
+        ASSERT_EQ(fast.boundary.isRelativeBranch,
+                  isRelativeBranch(full.decoded))
+            << addr;
+        ASSERT_EQ(fast.boundary.nextOffset, full.decoded.nextOffset) << addr;
+    }
+    ASSERT_GT(decoded, bytes.size() / 4);
+}
+
+TEST(boundary, SWEEP) {
+    std::vector<unsigned char> bytes = randomBytes(1 << 14, 11);
+    LinearSweepDisAssembler lsda(bytes);
+    lsda.disas(0x10, bytes.size() - 0x10);
+
+    std::vector<uint64_t> expected;
+    const InstructionStore& store = lsda.disassembledInstructions;
+    for (const StoredInstruction& record : store) {
+        if (store.str(record) != UNKNOWN_INSTRUCTION) {
+            expected.push_back(record.startAddr);
+        }
+    }
+    std::vector<uint64_t> starts;
+    DecodeStats stats;
+    uint64_t failed = sweepBoundaries(
+        bytes, 0x10, bytes.size() - 0x10,
+        [&](const InstructionBoundary& boundary) {
+            starts.push_back(boundary.startAddr);
+        },
+        &stats);
+    ASSERT_EQ(starts, expected);
+    ASSERT_EQ(failed, lsda.errorReport.errors.size());
+    ASSERT_EQ(stats.decoded, starts.size());
+    ASSERT_EQ(stats.failed, failed);
+}
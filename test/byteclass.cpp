@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "byteclass.h"
+#include "disassembler.h"
+
+namespace {
+
+/**
+ * @brief Returns bytes mostly made of prefixes, escapes and endbr pieces.
+ */
+std::vector<unsigned char> prefixHeavyBytes(size_t size, unsigned seed) {
+    const unsigned char interesting[] = {0xF0, 0xF2, 0xF3, 0x3E, 0x64, 0x65,
+                                         0x66, 0x40, 0x48, 0x4F, 0x0F, 0xD8,
+                                         0xD9, 0xDC, 0x1E, 0xFA, 0xFB, 0x90,
+                                         0x8B, 0xC3};
+    auto next = [&]() { return seed = seed * 1103515245 + 12345; };
+    std::vector<unsigned char> bytes;
+    while (bytes.size() < size) {
+        unsigned r = next() >> 8;
+        if (r % 8 == 0) {
+            const unsigned char endbr[] = {0xF3, 0x0F, 0x1E,
+                                           (unsigned char)(0xFA + r / 8 % 2)};
+            bytes.insert(bytes.end(), endbr, endbr + 4);
+        } else if (r % 8 < 6) {
+            bytes.push_back(interesting[r / 8 % std::size(interesting)]);
+        } else {
+            bytes.push_back(r / 8);
+        }
+    }
+    bytes.resize(size);
+    return bytes;
+}
+
+}  // namespace
+
+TEST(byteclass, CLASSIFY_BYTE) {
+    std::vector<unsigned char> obj = {0xF3, 0x0F, 0x1E, 0xFA, 0x66, 0x48,
+                                      0x0F, 0x64, 0xF3, 0x0F, 0x1E};
+    ByteSpan bytes(obj);
+
+    ASSERT_EQ(classifyByte(bytes, 0), BYTE_INSTRUCTION_PREFIX | BYTE_ENDBR);
+    ASSERT_EQ(classifyByte(bytes, 3), 0);
+    ASSERT_EQ(classifyByte(bytes, 4), BYTE_OPERAND_SIZE_PREFIX);
+    ASSERT_EQ(classifyByte(bytes, 5), BYTE_REX);
+    ASSERT_EQ(classifyByte(bytes, 6), BYTE_TWO_BYTES_OPCODE);
+    ASSERT_EQ(classifyByte(bytes, 7), BYTE_SEGMENT_PREFIX);
+    // the endbr is cut by the end of the bytes
+    ASSERT_EQ(classifyByte(bytes, 8), BYTE_INSTRUCTION_PREFIX);
+}
+
+TEST(byteclass, BULK_MATCHES_SCALAR) {
+    for (unsigned round = 0; round < 200; round++) {
+        std::vector<unsigned char> obj =
+            prefixHeavyBytes(1 + round * 7 % 300, round);
+        ByteSpan bytes(obj);
+        uint64_t startAddr = round * 13 % obj.size();
+        uint64_t endAddr =
+            startAddr + (round * 31 % (obj.size() - startAddr + 1));
+
+        std::vector<uint8_t> bulk(endAddr - startAddr);
+        std::vector<uint8_t> scalar(endAddr - startAddr);
+        classifyBytes(bytes, startAddr, endAddr, bulk.data());
+        classifyBytes(bytes, startAddr, endAddr, scalar.data(),
+                      ClassifyMode::SCALAR);
+        ASSERT_EQ(bulk, scalar) << "round " << round;
+        for (uint64_t addr = startAddr; addr < endAddr; addr++) {
+            ASSERT_EQ(bulk[addr - startAddr], classifyByte(bytes, addr))
+                << "round " << round << " addr " << addr;
+        }
+    }
+}
+
+TEST(byteclass, MAP) {
+    std::vector<unsigned char> obj = prefixHeavyBytes(100, 7);
+    ByteSpan bytes(obj);
+    ByteClassMap map;
+    ASSERT_FALSE(map.covers(0));
+
+    map.build(bytes, 10, 200);  // clamped to the bytes
+    ASSERT_FALSE(map.covers(9));
+    ASSERT_TRUE(map.covers(10));
+    ASSERT_TRUE(map.covers(99));
+    ASSERT_FALSE(map.covers(100));
+    for (uint64_t addr = 10; addr < 100; addr++) {
+        ASSERT_EQ(map[addr], classifyByte(bytes, addr));
+    }
+
+    map.build(bytes, 150, 160);  // past the end
+    ASSERT_FALSE(map.covers(99));
+    ASSERT_FALSE(map.covers(150));
+}
+
+TEST(byteclass, LINEAR_SWEEP) {
+    // spans several blocks so that instructions cross their boundaries
+    std::vector<unsigned char> obj =
+        prefixHeavyBytes(2 * BYTE_CLASS_BLOCK_SIZE + 1000, 3);
+    LinearSweepDisAssembler classified(obj);
+    classified.disas(0, obj.size() - 1);
+    ASSERT_EQ(classified.state.byteClasses, nullptr);
+
+    // the same sweep with the decoder classifying each byte itself
+    LinearSweepDisAssembler plain(obj);
+    DisassembledResult instruction;
+    while (plain.curAddr <= obj.size() - 1) {
+        if (plain.tryStep(instruction) == DecodeStatus::OK) {
+            plain.curAddr = instruction.startAddr +
+                            instruction.disassembledInstructionSize;
+        } else {
+            plain.curAddr += 1;
+        }
+    }
+    ASSERT_EQ(classified.disassembledInstructions,
+              plain.disassembledInstructions);
+    ASSERT_EQ(classified.errorReport.errors.size(),
+              plain.errorReport.errors.size());
+}
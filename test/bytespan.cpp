@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "bytespan.h"
+
+TEST(bytespan, VECTOR) {
+    std::vector<unsigned char> bytes = {0x48, 0x83, 0xc0, 0x01};
+    ByteSpan span(bytes);
+    ASSERT_EQ(span.size(), 4);
+    ASSERT_EQ(span[1], 0x83);
+
+    ByteSpan tail = span.subspan(2);
+    ASSERT_EQ(tail.size(), 2);
+    ASSERT_EQ(tail[0], 0xc0);
+    ASSERT_TRUE(span.subspan(5).empty());
+    ASSERT_EQ(span.subspan(1, 100).size(), 3);
+}
+
+TEST(bytespan, MAPPED_FILE) {
+    std::string path = ::testing::TempDir() + "mydisas-bytespan.bin";
+    {
+        std::ofstream fh(path, std::ios::binary);
+        fh << "\x7f" "ELF";
+    }
+
+    MappedFile file(path);
+    ASSERT_TRUE(file.isMapped());
+    ByteSpan span = file.bytes();
+    ASSERT_EQ(span.size(), 4);
+    ASSERT_EQ(span[0], 0x7f);
+    ASSERT_EQ(span[3], 'F');
+
+    // the mapping is handed over on move
+    MappedFile moved(std::move(file));
+    ASSERT_EQ(moved.bytes().data(), span.data());
+    ASSERT_TRUE(file.bytes().empty());
+
+    std::remove(path.c_str());
+    ASSERT_THROW(MappedFile{path}, std::runtime_error);
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "elfdisas.h"
+#include "testutil.h"
+
+namespace {
+
+const std::vector<unsigned char> obj = {
+    0x90,                    // nop
+    0x48, 0x83, 0xc0, 0x01,  // add rax 0x01
+    0x0f, 0xff,              // invalid
+    0xc3,                    // ret
+    0x48, 0x83,              // truncated
+};
+
+/**
+ * @brief Returns the listing and the decode errors of the file, as main
+ * prints them, with the cache in the directory if it is not "".
+ */
+std::string listing(const std::string& path, const std::string& strategy,
+                    size_t jobs, const std::string& cacheDir) {
+    ELFDisAssembler eda(path, strategy);
+    eda.cache = DecodeCache(cacheDir);
+    eda.disas(PRINTABLE_SECTIONS, jobs);
+    std::ostringstream os;
+    eda.print(os);
+    eda.printDecodeErrors(os);
+    return os.str();
+}
+
+}  // namespace
+
+TEST(cache, HASH) {
+    std::vector<unsigned char> other = obj;
+    other[3] ^= 1;
+    ASSERT_EQ(hashBytes(ByteSpan(obj)), hashBytes(ByteSpan(obj)));
+    ASSERT_NE(hashBytes(ByteSpan(obj)), hashBytes(ByteSpan(other)));
+    ASSERT_NE(hashBytes(ByteSpan(obj), 1), hashBytes(ByteSpan(obj), 2));
+    // the length is part of the hash
+    std::vector<unsigned char> zero = {0};
+    ASSERT_NE(hashBytes(ByteSpan()), hashBytes(ByteSpan(zero)));
+}
+
+TEST(cache, SAVE_LOAD) {
+    TempDir dir("cache");
+    DecodeCache cache(dir.path());
+    LinearSweepDisAssembler decoded(obj);
+    decoded.disas(0, obj.size() - 1);
+    ASSERT_TRUE(cache.save(42, decoded));
+
+    LinearSweepDisAssembler loaded(obj);
+    ASSERT_TRUE(cache.load(42, loaded));
+    ASSERT_EQ(loaded.disassembledInstructions,
+              decoded.disassembledInstructions);
+    ASSERT_EQ(loaded.errorAddrs, decoded.errorAddrs);
+    ASSERT_EQ(loaded.maxInstructionStrSize, decoded.maxInstructionStrSize);
+    ASSERT_EQ(loaded.errorReport.size(), decoded.errorReport.size());
+    ASSERT_EQ(loaded.errorReport.errors[0].addr,
+              decoded.errorReport.errors[0].addr);
+
+    // merging the loaded results is the same as merging the decoded ones
+    LinearSweepDisAssembler fromDecoded(obj);
+    LinearSweepDisAssembler fromLoaded(obj);
+    fromDecoded.merge(decoded);
+    fromLoaded.merge(loaded);
+    ASSERT_EQ(fromLoaded.disassembledInstructions,
+              fromDecoded.disassembledInstructions);
+}
+
+TEST(cache, MISS) {
+    DecodeCache disabled;
+    LinearSweepDisAssembler da(obj);
+    da.disas(0, obj.size() - 1);
+    ASSERT_FALSE(disabled.save(1, da));
+    ASSERT_FALSE(disabled.load(1, da));
+
+    TempDir dir("cache");
+    DecodeCache cache(dir.path());
+    ASSERT_TRUE(cache.save(1, da));
+
+    LinearSweepDisAssembler loaded(obj);
+    ASSERT_FALSE(cache.load(2, loaded));
+
+    // a file stored under another key, or truncated, is not used
+    std::rename(cache.path(1).c_str(), cache.path(2).c_str());
+    ASSERT_FALSE(cache.load(2, loaded));
+    ASSERT_TRUE(cache.save(3, da));
+    ASSERT_EQ(truncate(cache.path(3).c_str(), sizeof(DecodeCacheHeader) + 1),
+              0);
+    ASSERT_FALSE(cache.load(3, loaded));
+    ASSERT_TRUE(loaded.disassembledInstructions.empty());
+
+    // a count whose size wraps to 0, with the pool taking the whole file
+    ASSERT_TRUE(cache.save(4, da));
+    std::vector<unsigned char> bytes;
+    {
+        MappedFile saved(cache.path(4));
+        bytes.assign(saved.bytes().begin(), saved.bytes().end());
+    }
+    DecodeCacheHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::vector<std::pair<uint64_t DecodeCacheHeader::*, size_t>> counts = {
+        {&DecodeCacheHeader::numRecords, sizeof(StoredInstruction)},
+        {&DecodeCacheHeader::numErrorAddrs, sizeof(uint64_t)},
+        {&DecodeCacheHeader::numErrors, sizeof(DecodeError)},
+    };
+    for (const auto& count : counts) {
+        DecodeCacheHeader corrupted = header;
+        corrupted.numRecords = corrupted.numErrorAddrs = 0;
+        corrupted.numErrors = 0;
+        corrupted.*count.first = (uint64_t)1
+                                 << (64 - __builtin_ctzll(count.second));
+        corrupted.poolSize = bytes.size() - sizeof(header);
+        std::memcpy(bytes.data(), &corrupted, sizeof(corrupted));
+        writeFile(cache.path(4), bytes);
+        ASSERT_FALSE(cache.load(4, loaded));
+    }
+    ASSERT_TRUE(loaded.disassembledInstructions.empty());
+}
+
+TEST(cache, SAME_LISTING) {
+    // the walk of .text ends on an error, and the one of .init starts with
+    // one, so recursive descent stores them together
+    TempDir dir("cache");
+    std::string path = dir.path("a.o");
+    writeFile(path, buildELF({
+                        {".text", 1, {0x90, 0x0f}},       // nop; truncated
+                        {".init", 1, {0x06, 0x90, 0xc3}},  // invalid; nop; ret
+                    }));
+
+    for (const char* strategy : {"linearsweep", "recursivedescent"}) {
+        for (size_t jobs : {1, 2}) {
+            std::string expected = listing(path, strategy, jobs, "");
+            std::string cacheDir = dir.path(std::string(strategy) +
+                                            std::to_string(jobs));
+            ASSERT_EQ(listing(path, strategy, jobs, cacheDir), expected)
+                << strategy << " cold, jobs " << jobs;
+            ASSERT_EQ(listing(path, strategy, jobs, cacheDir), expected)
+                << strategy << " warm, jobs " << jobs;
+        }
+    }
+}
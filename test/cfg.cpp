@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "cfg.h"
+#include "disassembler.h"
+
+namespace {
+
+const std::vector<unsigned char> obj = {
+    0x74, 0x03,                    // 0: jz 5
+    0x90,                          // 2: nop
+    0xeb, 0x01,                    // 3: jmp 6
+    0x90,                          // 5: nop
+    0xe8, 0x01, 0x00, 0x00, 0x00,  // 6: call c
+    0xc3,                          // b: ret
+    0xe2, 0xfe,                    // c: loop c
+    0xff, 0xe0,                    // e: jmp rax
+};
+
+void expectSameGraph(const ControlFlowGraph& a, const ControlFlowGraph& b) {
+    ASSERT_EQ(a.size(), b.size());
+    for (uint32_t i = 0; i < a.size(); i++) {
+        ASSERT_EQ(a[i].startAddr, b[i].startAddr);
+        ASSERT_EQ(a[i].endAddr, b[i].endAddr);
+        ASSERT_EQ(a.successors(i).size(), b.successors(i).size());
+        ASSERT_EQ(a.predecessors(i).size(), b.predecessors(i).size());
+    }
+    ASSERT_EQ(a.functionEntries(), b.functionEntries());
+}
+
+}  // namespace
+
+TEST(cfg, BLOCKS_AND_EDGES) {
+    RecursiveDescentDisAssembler rd(obj);
+    rd.enableCFG();
+    rd.disas(0, obj.size() - 1);
+    ControlFlowGraph graph = rd.cfg({0});
+
+    std::vector<uint64_t> starts = {0x0, 0x2, 0x5, 0x6, 0xb, 0xc, 0xe};
+    ASSERT_EQ(graph.size(), starts.size());
+    for (uint32_t b = 0; b < graph.size(); b++) {
+        ASSERT_EQ(graph[b].startAddr, starts[b]);
+    }
+    ASSERT_EQ(graph[1].numInstructions, 2);
+    ASSERT_EQ(graph[1].lastAddr, 0x3);
+
+    ControlFlowGraph::Edges jz = graph.successors(0);
+    ASSERT_EQ(jz.size(), 2);
+    ASSERT_EQ(jz[0].kind, EdgeKind::BRANCH);
+    ASSERT_EQ(jz[0].block, 2);
+    ASSERT_EQ(jz[1].kind, EdgeKind::FALLTHROUGH);
+    ASSERT_EQ(jz[1].block, 1);
+
+    // a block cut by a jump target falls through into it
+    ASSERT_EQ(graph.successors(2).size(), 1);
+    ASSERT_EQ(graph.successors(2)[0].kind, EdgeKind::FALLTHROUGH);
+    ControlFlowGraph::Edges merge = graph.predecessors(3);
+    ASSERT_EQ(merge.size(), 2);
+    ASSERT_EQ(merge[0].block, 1);
+    ASSERT_EQ(merge[0].kind, EdgeKind::JUMP);
+    ASSERT_EQ(merge[1].block, 2);
+
+    ASSERT_EQ(graph.successors(3)[0].kind, EdgeKind::CALL);
+    ASSERT_EQ(graph.successors(4).size(), 0);  // ret
+    ControlFlowGraph::Edges loop = graph.predecessors(5);
+    ASSERT_EQ(loop.size(), 2);
+    ASSERT_EQ(loop[0].kind, EdgeKind::CALL);
+    ASSERT_EQ(loop[1].kind, EdgeKind::LOOP);
+    ASSERT_EQ(loop[1].block, 5);
+
+    ControlFlowGraph::Edges indirect = graph.successors(6);
+    ASSERT_EQ(indirect.size(), 1);
+    ASSERT_EQ(indirect[0].targetAddr, INDIRECT_TARGET);
+    ASSERT_EQ(indirect[0].block, NO_BLOCK);
+
+    // the entry passed and the call target
+    ASSERT_EQ(graph.functionEntries(), (std::vector<uint32_t>{0, 5}));
+
+    ASSERT_EQ(graph.blockAt(0x4), 1);
+    ASSERT_EQ(graph.blockAt(0x5), 2);
+    ASSERT_EQ(graph.blockAt(0xf), 6);
+    ASSERT_EQ(graph.blockAt(0x1), 0);
+    ASSERT_EQ(graph.blockAt(0x10), NO_BLOCK);
+    ASSERT_EQ(graph.blockStartingAt(0x3), NO_BLOCK);
+}
+
+TEST(cfg, PARALLEL_AND_LINEAR) {
+    RecursiveDescentDisAssembler sequential(obj);
+    sequential.enableCFG();
+    sequential.disas(0, obj.size() - 1);
+
+    RecursiveDescentDisAssembler parallel(obj);
+    parallel.enableCFG();
+    parallel.disas(0, obj.size() - 1, 2);
+    expectSameGraph(sequential.cfg({0}), parallel.cfg({0}));
+
+    // every byte is an instruction, so a sweep finds the same graph
+    LinearSweepDisAssembler ls(obj);
+    ls.enableCFG();
+    ls.disas(0, obj.size() - 1);
+    expectSameGraph(sequential.cfg({0}), ls.cfg({0}));
+
+    // without recording there are no transfers to cut the blocks at
+    LinearSweepDisAssembler plain(obj);
+    plain.disas(0, obj.size() - 1);
+    ASSERT_EQ(plain.cfg().size(), 1);
+}
+
+TEST(cfg, REPLACE_TRANSFERS) {
+    // more transfers than a run holds, recorded in the address order
+    TransferLog log;
+    const uint64_t count = 3 * STORE_CHUNK_SIZE;
+    for (uint64_t addr = 0; addr < count * 4; addr += 4) {
+        log.record(addr, 2, Mnemonic::JMP, addr + 2);
+    }
+
+    TransferLog patch;
+    patch.record(1001, 1, Mnemonic::RET, NO_LABEL);
+    patch.record(1002, 7, Mnemonic::CALL, 0);
+    log.replace(1000, 1012, patch);
+    log.replace({{8, 12}, {4000, 4004}}, TransferLog());
+
+    std::vector<uint64_t> addrs;
+    for (const ControlTransfer& t : log.all()) {
+        addrs.push_back(t.addr);
+    }
+    ASSERT_EQ(addrs.size(), count - 3 + 2 - 2);
+    ASSERT_TRUE(std::is_sorted(addrs.begin(), addrs.end()));
+    ASSERT_EQ(std::count(addrs.begin(), addrs.end(), 1001), 1);
+    ASSERT_EQ(std::count(addrs.begin(), addrs.end(), 1004), 0);
+    ASSERT_EQ(std::count(addrs.begin(), addrs.end(), 4000), 0);
+
+    // out of the address order, the replaced ones are recorded last
+    log.record(0, 2, Mnemonic::RET, NO_LABEL);
+    TransferLog late;
+    late.record(2001, 1, Mnemonic::RET, NO_LABEL);
+    log.replace(2000, 2008, late);
+    ASSERT_EQ(log.all().size(), addrs.size() + 1 - 2 + 1);
+    ASSERT_EQ(log.all().back().addr, 2001);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "columnar.h"
+#include "state.h"
+#include "testutil.h"
+
+TEST(columnar, ROUND_TRIP) {
+    std::vector<unsigned char> obj = {
+        0x48, 0x8b, 0x44, 0x24, 0x08,  // mov rax, qword ptr [rsp + 0x08]
+        0x74, 0x01,                    // jz 8
+        0x90,                          // nop
+        0x64, 0x48, 0x8b, 0x04, 0x25,  // mov rax, qword ptr fs:[0x28]
+        0x28, 0x00, 0x00, 0x00,
+    };
+
+    ColumnarBuilder builder;
+    ASSERT_EQ(builder.addSection(0, 7, ".text"), 0);
+    ASSERT_EQ(builder.addSection(8, obj.size(), ".fini"), 1);
+    ASSERT_EQ(builder.addSymbol(0, "main"), 0);
+    ASSERT_EQ(builder.addSymbol(7, "loop"), 1);
+
+    State state(obj);
+    std::vector<uint64_t> starts = {0, 5, 7, 8};
+    for (uint64_t addr : starts) {
+        ASSERT_EQ(state.tryDecode(addr), DecodeStatus::OK);
+        builder.addInstruction(state.decoded, addr < 8 ? 0 : 1,
+                               addr < 7 ? 0 : 1);
+    }
+    TempDir dir("columnar");
+    std::string path = dir.path("listing.mdcol");
+    builder.write(path);
+
+    ColumnarListing listing(path);
+    ASSERT_EQ(listing.size(), starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        ASSERT_EQ(listing.addrs()[i], starts[i]);
+    }
+    ASSERT_EQ(listing.lengths()[0], 5);
+    ASSERT_EQ(listing.lengths()[3], 9);
+    ASSERT_EQ((Mnemonic)listing.mnemonics()[0], Mnemonic::MOV);
+    ASSERT_EQ((Mnemonic)listing.mnemonics()[2], Mnemonic::NOP);
+    ASSERT_EQ((Segment)listing.segments()[3], Segment::FS);
+    ASSERT_EQ(listing.branchTargets()[1], 8);
+    ASSERT_EQ(listing.branchTargets()[0], NO_LABEL);
+
+    ASSERT_EQ(listing.operands(0).size(), 2);
+    const ExportedOperand& mem = listing.operands(0)[1];
+    ASSERT_EQ((OperandKind)mem.kind, OperandKind::MEM);
+    ASSERT_EQ(mem.base, 4);  // rsp
+    ASSERT_EQ(mem.index, NO_REG);
+    ASSERT_EQ(mem.disp, 8);
+    ASSERT_EQ(listing.operands(2).size(), 0);
+    ASSERT_EQ(listing.operands(3)[1].disp, 0x28);
+
+    ASSERT_EQ(listing.sectionIds()[3], 1);
+    ASSERT_EQ(listing.name(listing.sections()[1]), ".fini");
+    ASSERT_EQ(listing.symbolIds()[2], 1);
+    ASSERT_EQ(listing.name(listing.symbols()[listing.symbolIds()[0]]), "main");
+}
+
+TEST(columnar, CORRUPTED) {
+    TempDir dir("columnar");
+    std::string path = dir.path("listing.mdcol");
+    ColumnarBuilder builder;
+    std::vector<unsigned char> obj = {0x90, 0xc3};
+    State state(obj);
+    ASSERT_EQ(state.tryDecode(0), DecodeStatus::OK);
+    builder.addInstruction(state.decoded, NO_ID, NO_ID);
+    builder.write(path);
+    ASSERT_EQ(ColumnarListing(path).size(), 1);
+
+    std::ifstream ifs(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(ifs)),
+                      std::istreambuf_iterator<char>());
+    auto rewrite = [&](const std::string& contents) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+    };
+
+    rewrite(bytes.substr(0, 16));
+    ASSERT_THROW(ColumnarListing{path}, std::runtime_error);
+
+    std::string badMagic = bytes;
+    badMagic[0] = 'X';
+    rewrite(badMagic);
+    ASSERT_THROW(ColumnarListing{path}, std::runtime_error);
+
+    // a column running past the end of the file
+    rewrite(bytes.substr(0, bytes.size() - 8));
+    ASSERT_THROW(ColumnarListing{path}, std::runtime_error);
+
+    // more instructions than the columns hold
+    std::string badCount = bytes;
+    badCount[offsetof(ColumnarHeader, numInstructions)] = 2;
+    rewrite(badCount);
+    ASSERT_THROW(ColumnarListing{path}, std::runtime_error);
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "concurrent.h"
+
+TEST(concurrent, CLAIMS) {
+    const uint64_t size = 4096;
+    CoverageMap coverage(size);
+    ConcurrentStore store(coverage, 4);
+
+    // every worker tries every address, each address being won once
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < store.size(); i++) {
+        threads.emplace_back([&store, i]() {
+            ConcurrentStore::Shard& shard = store.shard(i);
+            for (uint64_t addr = 0; addr < size; addr++) {
+                uint64_t claimed = (addr * 7 + i * 1021) % size;
+                if (store.claim(claimed)) {
+                    shard.instructions.put(claimed, claimed + 1,
+                                           std::to_string(i));
+                }
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    ASSERT_FALSE(store.claim(0));
+    ASSERT_FALSE(store.claim(size));  // out of the map
+
+    uint64_t expected = 0;
+    store.merge(
+        [&](const StoredInstruction& record, const InstructionStore&) {
+            ASSERT_EQ(record.startAddr, expected++);
+        });
+    ASSERT_EQ(expected, size);
+}
+
+TEST(concurrent, MERGE_IN_ORDER) {
+    CoverageMap coverage(32);
+    ConcurrentStore store(coverage, 3);
+    store.shard(0).instructions.put(8, 10, "b");
+    store.shard(0).instructions.put(0, 2, "a");  // out of order
+    store.shard(1).instructions.put(4, 7, "c");
+    store.shard(2).instructions.put(2, 4, "d");
+
+    std::vector<std::pair<uint64_t, std::string>> visited;
+    store.merge(
+        [&](const StoredInstruction& record, const InstructionStore& from) {
+            visited.emplace_back(record.startAddr,
+                                 std::string(from.str(record)));
+        });
+    std::vector<std::pair<uint64_t, std::string>> expected = {
+        {0, "a"}, {2, "d"}, {4, "c"}, {8, "b"}};
+    ASSERT_EQ(visited, expected);
+}
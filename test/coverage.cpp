@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "coverage.h"
+
+TEST(coverage, MARK_DECODED) {
+    CoverageMap coverage(200);
+
+    ASSERT_TRUE(coverage.markDecoded(60, 70));  // across a word boundary
+    ASSERT_TRUE(coverage.isDecoded(60));
+    ASSERT_TRUE(coverage.isDecoded(69));
+    ASSERT_FALSE(coverage.isDecoded(70));
+    ASSERT_FALSE(coverage.isDecoded(59));
+
+    // overlapping ranges are rejected and leave the map unchanged
+    ASSERT_FALSE(coverage.markDecoded(50, 61));
+    ASSERT_FALSE(coverage.isDecoded(50));
+    ASSERT_TRUE(coverage.anyDecoded(0, 61));
+    ASSERT_FALSE(coverage.anyDecoded(0, 60));
+
+    ASSERT_TRUE(coverage.markDecoded(0, 60));
+    ASSERT_TRUE(coverage.markDecoded(70, 200));  // to the end of the map
+    ASSERT_TRUE(coverage.isDecoded(199));
+
+    coverage.clearDecoded(64, 130);
+    ASSERT_TRUE(coverage.isDecoded(63));
+    ASSERT_FALSE(coverage.isDecoded(64));
+    ASSERT_FALSE(coverage.isDecoded(129));
+    ASSERT_TRUE(coverage.isDecoded(130));
+}
+
+TEST(coverage, NEXT_UNDECODED) {
+    CoverageMap coverage(300);
+    coverage.markDecoded(0, 10);
+    coverage.markDecoded(11, 250);
+
+    ASSERT_EQ(coverage.nextUndecoded(0, 300), 10);
+    ASSERT_EQ(coverage.nextUndecoded(11, 300), 250);
+    ASSERT_EQ(coverage.nextUndecoded(11, 200), 200);  // no gap in the range
+    ASSERT_EQ(coverage.nextUndecoded(260, 300), 260);
+    ASSERT_EQ(coverage.nextUndecoded(5, 5), 5);
+}
+
+TEST(coverage, VISITED) {
+    CoverageMap coverage(100);
+    coverage.markVisited(3);
+    coverage.markDecoded(10, 12);
+
+    ASSERT_TRUE(coverage.isVisited(3));
+    ASSERT_FALSE(coverage.isDecoded(3));
+    ASSERT_TRUE(coverage.isDecodedOrVisited(3));
+    ASSERT_TRUE(coverage.isDecodedOrVisited(11));
+    ASSERT_FALSE(coverage.isDecodedOrVisited(4));
+    ASSERT_FALSE(coverage.isVisited(100));  // past the end
+
+    coverage.clearVisited();
+    ASSERT_FALSE(coverage.isVisited(3));
+    ASSERT_TRUE(coverage.isDecoded(10));
+}
+
+TEST(coverage, CLAIM_VISITED) {
+    CoverageMap coverage(100);
+    ASSERT_TRUE(coverage.claimVisited(70));
+    ASSERT_FALSE(coverage.claimVisited(70));
+    ASSERT_TRUE(coverage.isVisited(70));
+    ASSERT_FALSE(coverage.isDecoded(70));
+    ASSERT_FALSE(coverage.claimVisited(100));
+}
+
+TEST(coverage, BASE) {
+    CoverageMap coverage(100, 1000);
+    ASSERT_FALSE(coverage.covers(999));
+    ASSERT_TRUE(coverage.covers(1000));
+    ASSERT_FALSE(coverage.covers(1100));
+
+    // the bytes out of the map are never decoded nor visited
+    ASSERT_TRUE(coverage.markDecoded(990, 1010));
+    ASSERT_FALSE(coverage.isDecoded(995));
+    ASSERT_TRUE(coverage.isDecoded(1000));
+    ASSERT_TRUE(coverage.isDecoded(1009));
+    ASSERT_FALSE(coverage.anyDecoded(0, 1000));
+    ASSERT_EQ(coverage.nextUndecoded(1000, 1100), 1010);
+
+    coverage.markVisited(10);
+    ASSERT_FALSE(coverage.isVisited(10));
+    ASSERT_FALSE(coverage.claimVisited(10));
+    ASSERT_TRUE(coverage.claimVisited(1099));
+    ASSERT_TRUE(coverage.isDecodedOrVisited(1099));
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <cassert>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <set>
@@ -11,14 +12,12 @@
 
 #include "disassembler.h"
 
-const std::unordered_map<uint64_t, std::string> addr2symbol;
-
 TEST(disas, ONE_BYTE) {
     std::vector<unsigned char> obj = {
         0x90,  // nop
         0xC3   // ret
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -36,7 +35,7 @@ TEST(disas, ONE_BYTE_IMM) {
         0x05, 0x44, 0x33, 0x22, 0x11,  // add  eax 0x11223344
         0x2d, 0x44, 0x33, 0x22, 0x11,  // sub  eax 0x11223344
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -67,7 +66,7 @@ TEST(disas, ONE_BYTE_IMM_SIZE) {
         0x48, 0xb8, 0x88, 0x77, 0x66,
         0x55, 0x44, 0x33, 0x22, 0x11  // mov rax 0x1122334455667788
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -101,7 +100,7 @@ TEST(disas, SEVERAL_ADD) {
         0x01, 0x84, 0x00, 0x00,
         0x80, 0x00, 0x00  // add  [rax + rax * 1 + 0x00008000] eax
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -143,7 +142,7 @@ TEST(disas, MODRM_REG) {
         0x01, 0x30,  // add [rax] esi
         0x01, 0x38   // add [rax] edi
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -196,7 +195,7 @@ TEST(disas, MODRM_MOD11) {
                                       0x01, 0xc6,  // add esi eax
                                       0x01, 0xc7,  // add edi eax
                                       0x03, 0xc0};
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -250,7 +249,7 @@ TEST(disas, MODRM_MOD_DISP) {
         0x8b, 0x48, 0x01,                    // mov ecx [rax + 0x1]
         0x8b, 0x88, 0x00, 0x01, 0x00, 0x00,  // mov ecx [rax + 0x00000100]
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -275,7 +274,7 @@ TEST(disas, MODRM_MOD00_RM101) {
         0x8b, 0x8d, 0x00, 0x01, 0x00, 0x00,       // mov ecx [rbp + 0x00000100]
         0x8b, 0x0c, 0x25, 0x00, 0x00, 0x08, 0x00  // mov ecx 0x00080000
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -305,7 +304,7 @@ TEST(disas, MODRM_SIB_RSP) {
         0x8b, 0x14, 0x48,        // mov edx [rax * rcx * 2]
         0x8b, 0x14, 0x24         // mov edx [rsp]
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -333,7 +332,7 @@ TEST(disas, ADD_IMM) {
         0x01, 0xc0,        // add eax eax
         0x83, 0xc0, 0x01,  // add eax 0x01
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -358,7 +357,7 @@ TEST(disas, MODRM_OPCODE) {
         0x83, 0xf0, 0x01,  // xor eax 0x01
         0x83, 0xf8, 0x01,  // cmp eax 0x01
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -406,7 +405,7 @@ TEST(disas, REXW) {
         0x83, 0xc0, 0x01,        // add eax 0x01
         0x48, 0x83, 0xc0, 0x01,  // add rax 0x01
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -425,7 +424,7 @@ TEST(disas, REXRXB) {
         0x42, 0x01, 0x04, 0x91,  // add [rcx + r10 * 4] eax
         0x41, 0x01, 0x04, 0x91   // add [r9 + rdx * 4] eax
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -450,7 +449,7 @@ TEST(disas, TWOBYTE) {
         0x00, 0x00, 0x00, 0x00,  // movsx rax 0x00000000
         0x48, 0x63, 0xc3,        // movsx rax ebx
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -475,7 +474,7 @@ TEST(disas, CFInstructions) {
         0xeb, 0x04,                    // jmp 12
         0xeb, 0xf2,                    // jmp 0
     };
-    LinearSweepDisAssembler disas(obj, addr2symbol);
+    LinearSweepDisAssembler disas(obj);
 
     disas.curAddr = 0;
     disas.step();
@@ -498,3 +497,381 @@ TEST(disas, CFInstructions) {
     //           "jmp -3 ; relative offset = -14");
 }
 
+
+TEST(decode, STRUCTURED_RECORD) {
+    std::vector<unsigned char> obj = {
+        0x42, 0x8b, 0x54, 0x88, 0xf0,  // mov edx [rax + r9 * 4 - 0x10]
+        0x48, 0x83, 0xc0, 0x01,        // add rax 0x01
+        0xeb, 0xf2,                    // jmp -14
+    };
+    State state(obj);
+
+    const DecodedInstruction& mov = state.decode(0);
+    ASSERT_EQ(mov.length, 5);
+    ASSERT_EQ(mov.mnemonic, Mnemonic::MOV);
+    ASSERT_EQ(mov.numOperands, 2);
+    ASSERT_EQ(mov.operands[0].kind, OperandKind::REG);
+    ASSERT_EQ(mov.operands[0].regClass, RegClass::GPR32);
+    ASSERT_EQ(mov.operands[0].reg, 2);
+    ASSERT_EQ(mov.operands[1].kind, OperandKind::MEM);
+    ASSERT_EQ(mov.operands[1].base, 0);
+    ASSERT_EQ(mov.operands[1].index, 9);
+    ASSERT_EQ(mov.operands[1].scale, 4);
+    ASSERT_EQ(mov.operands[1].dispSize, 1);
+    ASSERT_EQ(mov.operands[1].disp, -0x10);
+    ASSERT_EQ(formatInstruction(mov),
+              "mov  edx [rax + r9 * 4 - 0x10]");
+
+    // the same State is reused for the following instructions
+    const DecodedInstruction& add = state.decode(5);
+    ASSERT_EQ(add.length, 4);
+    ASSERT_EQ(add.operands[0].regClass, RegClass::GPR64);
+    ASSERT_EQ(add.operands[1].kind, OperandKind::IMM);
+    ASSERT_EQ(add.operands[1].immSize, 1);
+    ASSERT_EQ(add.operands[1].imm, 1);
+
+    const DecodedInstruction& jmp = state.decode(9);
+    ASSERT_TRUE(isRelativeBranch(jmp));
+    ASSERT_EQ(jmp.nextOffset, -14);
+    ASSERT_EQ(branchTarget(jmp), 11 - 14);
+}
+
+TEST(decode, HEX_FORMAT) {
+    const uint64_t values[] = {0,    1,          0xf,        0x10,
+                               0xff, 0x100,      0xabcde,    0x7fffffff,
+                               ~0ULL, 1ULL << 63, 0x123456789ULL};
+    for (uint64_t val : values) {
+        for (int width : {1, 2, 3, 8, 16}) {
+            char expected[32];
+            std::snprintf(expected, sizeof(expected), "%0*llx", width,
+                          (unsigned long long)val);
+            std::string out = "0x";
+            appendHex(out, val, width);
+            ASSERT_EQ(out, std::string("0x") + expected);
+        }
+        ASSERT_EQ(hexDigits(val),
+                  (size_t)std::snprintf(nullptr, 0, "%llx",
+                                        (unsigned long long)val));
+    }
+}
+
+TEST(decode, STATUS) {
+    std::vector<unsigned char> obj = {
+        0x0f, 0xff,  // unknown opcode
+        0x48, 0x8b,  // mov without ModRM
+    };
+    State state(obj);
+
+    ASSERT_EQ(state.tryDecode(0), DecodeStatus::OPCODE_LOOKUP_ERROR);
+    ASSERT_EQ(state.lastError().addr, 0);
+    ASSERT_EQ(state.tryDecode(2), DecodeStatus::TRUNCATED);
+    ASSERT_EQ(state.lastError().addr, 2);
+
+    // the throwing API is kept for compatibility
+    ASSERT_THROW(state.decode(0), OPCODE_LOOKUP_ERROR);
+    ASSERT_THROW(state.decode(2), std::runtime_error);
+}
+
+TEST(decode, ERROR_REPORT) {
+    std::vector<unsigned char> obj = {
+        0x48, 0x83, 0xc0,  // add rax without the immediate
+    };
+    LinearSweepDisAssembler disas(obj);
+    disas.disas(0, obj.size() - 1);
+
+    // every byte is retried and fails, and the errors are only collected
+    ASSERT_EQ(disas.errorReport.size(), 3);
+    ASSERT_EQ(disas.errorReport.count(DecodeStatus::TRUNCATED), 2);
+    // c0 /r needs the ModRM byte to resolve the mnemonic
+    ASSERT_EQ(disas.errorReport.count(DecodeStatus::OPCODE_LOOKUP_ERROR), 1);
+    ASSERT_EQ(disas.errorReport.errors[1].addr, 1);
+    ASSERT_TRUE(disas.disassembledInstructions.empty());
+
+    std::stringstream ss;
+    disas.errorReport.print(ss);
+    ASSERT_NE(
+        ss.str().find("decode errors: 3 OPCODE_LOOKUP_ERROR=1 TRUNCATED=2"),
+        std::string::npos);
+}
+
+TEST(disas, MERGE) {
+    std::vector<unsigned char> obj = {
+        0x48, 0x83, 0xc0, 0x01,  // add rax 0x01
+        0x48, 0x83, 0xc0, 0x01,  // add rax 0x01
+        0xc3,                    // ret
+    };
+
+    LinearSweepDisAssembler whole(obj);
+    whole.disas(0, obj.size() - 1);
+
+    // decode the halves separately and merge them in the address order
+    LinearSweepDisAssembler first(obj), second(obj);
+    first.disas(0, 3);
+    second.disas(4, obj.size() - 1);
+
+    LinearSweepDisAssembler merged(obj);
+    merged.merge(first);
+    merged.merge(second);
+
+    ASSERT_EQ(merged.disassembledInstructions, whole.disassembledInstructions);
+    ASSERT_EQ(merged.maxInstructionStrSize, whole.maxInstructionStrSize);
+
+    // the instructions overlapping already decoded bytes are dropped
+    LinearSweepDisAssembler overlapping(obj);
+    overlapping.disas(2, 2);
+    merged.merge(overlapping);
+    ASSERT_EQ(merged.disassembledInstructions, whole.disassembledInstructions);
+}
+
+struct CollectingSink : public InstructionSink {
+    std::vector<std::pair<uint64_t, std::string>> instructions;
+
+    void emit(const DisassembledResult& instruction) override {
+        instructions.emplace_back(instruction.startAddr,
+                                  instruction.disassembledInstructionStr);
+    }
+};
+
+TEST(disas, STREAMING) {
+    std::vector<unsigned char> obj = {
+        0x90,                    // nop
+        0x48, 0x83, 0xc0, 0x01,  // add rax 0x01
+        0xc3,                    // ret
+        0x48, 0x83,              // truncated
+    };
+
+    CollectingSink sink;
+    LinearSweepDisAssembler disas(obj, 0);
+    disas.disas(0, obj.size() - 1, sink);
+
+    ASSERT_EQ(sink.instructions.size(), 3);
+    ASSERT_EQ(sink.instructions[0].second, "nop ");
+    ASSERT_EQ(sink.instructions[2].first, 5);
+    ASSERT_EQ(sink.instructions[2].second, "ret ");
+    // nothing is stored, and the errors are still collected
+    ASSERT_TRUE(disas.disassembledInstructions.empty());
+    ASSERT_GT(disas.errorReport.size(), 0);
+}
+
+TEST(disas, PARALLEL_RECURSIVE_DESCENT) {
+    std::vector<unsigned char> obj = {
+        0xe8, 0x05, 0x00, 0x00, 0x00,  // call a
+        0x74, 0x02,                    // je 9
+        0x90,                          // nop
+        0xc3,                          // ret
+        0xc3,                          // ret
+        0x48, 0x83, 0xc0, 0x01,        // add rax 0x01
+        0xc3,                          // ret
+        0x0f, 0xff,                    // unreachable
+    };
+
+    RecursiveDescentDisAssembler sequential(obj);
+    sequential.disas(0, obj.size() - 1);
+
+    // the result is the sequential one
+    for (size_t jobs : {1, 2, 4}) {
+        RecursiveDescentDisAssembler parallel(obj);
+        parallel.disas(0, obj.size() - 1, jobs);
+        ASSERT_EQ(parallel.disassembledInstructions,
+                  sequential.disassembledInstructions);
+        ASSERT_EQ(parallel.disassembledInstructions.size(), 7);
+        ASSERT_EQ(parallel.errorReport.size(), 0);
+    }
+}
+
+TEST(disas, RANGED_RECURSIVE_DESCENT) {
+    std::vector<unsigned char> obj = {
+        0x90, 0x90, 0x90, 0xc3,  // out of the range
+        0x90,                    // nop
+        0x74, 0xf9,              // je 0
+        0xeb, 0xfb,              // jmp 4
+    };
+
+    // the coverage only tracks the range, and the walk stays within it
+    for (size_t jobs : {1, 2}) {
+        RecursiveDescentDisAssembler ranged(obj, 5, 4);
+        if (jobs == 1) {
+            ranged.disas(4, 8);
+        } else {
+            ranged.disas(4, 8, jobs);
+        }
+        ASSERT_EQ(ranged.coverage.size(), 5);
+        ASSERT_EQ(ranged.disassembledInstructions.size(), 3);
+        for (const StoredInstruction& record :
+             ranged.disassembledInstructions) {
+            ASSERT_GE(record.startAddr, 4);
+        }
+    }
+}
+
+namespace {
+
+std::vector<std::pair<uint64_t, DecodeStatus>> errorList(
+    const DecodeErrorReport& report) {
+    std::vector<std::pair<uint64_t, DecodeStatus>> list;
+    for (const DecodeError& error : report.errors) {
+        list.emplace_back(error.addr, error.status);
+    }
+    return list;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> transferList(
+    const DisAssembler& da) {
+    std::vector<std::pair<uint64_t, uint64_t>> list;
+    for (const ControlTransfer& t : da.transfers->all()) {
+        list.emplace_back(t.addr, t.target);
+    }
+    return list;
+}
+
+}  // namespace
+
+TEST(disas, JOIN_LINEAR_SWEEP) {
+    std::vector<unsigned char> obj = {
+        0x48, 0x83, 0xc0, 0x01,        // add rax 0x01
+        0xb8, 0x90, 0x90, 0x90, 0x90,  // mov eax 0x90909090
+        0x0f, 0xff,                    // invalid
+        0x90,                          // nop
+        0xc3,                          // ret
+    };
+
+    LinearSweepDisAssembler sequential(obj);
+    sequential.disas(0, obj.size() - 1);
+
+    // cut anywhere, including inside the mov and the invalid bytes
+    for (uint64_t cut = 1; cut < obj.size(); cut++) {
+        LinearSweepDisAssembler first(obj), second(obj);
+        first.disas(0, cut - 1);
+        second.disas(cut, obj.size() - 1);
+
+        LinearSweepDisAssembler joined(obj);
+        joined.curAddr = 0;
+        joined.join(first, {0, cut - 1});
+        joined.join(second, {cut, obj.size() - 1});
+        ASSERT_EQ(joined.disassembledInstructions,
+                  sequential.disassembledInstructions)
+            << "cut at " << cut;
+        ASSERT_EQ(errorList(joined.errorReport),
+                  errorList(sequential.errorReport));
+    }
+}
+
+TEST(disas, PARALLEL_OVERLAPPING) {
+    std::vector<unsigned char> obj = {
+        0x74, 0x01,                    // je 3
+        0xb8, 0x90, 0xc3, 0x0f, 0xff,  // mov eax 0xff0fc390, or nop; ret
+        0x0f, 0xff,                    // invalid
+        0xc3,                          // ret
+    };
+
+    // the branch target is kept, not the instruction falling through over it
+    RecursiveDescentDisAssembler sequential(obj);
+    sequential.disas(0, obj.size() - 1);
+    ASSERT_NE(sequential.disassembledInstructions.findStartingAt(3), nullptr);
+    ASSERT_EQ(sequential.disassembledInstructions.findStartingAt(2), nullptr);
+    ASSERT_GT(sequential.errorReport.size(), 0);
+
+    // whichever worker decodes which address first
+    for (size_t jobs : {2, 3, 4}) {
+        for (int run = 0; run < 20; run++) {
+            RecursiveDescentDisAssembler parallel(obj);
+            parallel.disas(0, obj.size() - 1, jobs);
+            ASSERT_EQ(parallel.disassembledInstructions,
+                      sequential.disassembledInstructions);
+            ASSERT_EQ(errorList(parallel.errorReport),
+                      errorList(sequential.errorReport));
+        }
+    }
+}
+
+TEST(disas, REDISAS_LINEAR) {
+    const std::vector<std::vector<unsigned char>> pieces = {
+        {0x90},                    // nop
+        {0x48, 0x83, 0xc0, 0x01},  // add rax 0x01
+        {0x8b, 0x45, 0x10},        // mov eax [rbp+0x10]
+        {0xe8, 0x00, 0x00, 0x00, 0x00},  // call
+        {0x0f, 0xff},              // invalid
+        {0xc3},                    // ret
+    };
+    const std::vector<unsigned char> patchBytes = {0x48, 0x0f, 0x90,
+                                                   0xe8, 0xff, 0x83};
+
+    unsigned seed = 1;
+    auto next = [&]() { return seed = seed * 1103515245 + 12345; };
+    for (int round = 0; round < 200; round++) {
+        // a few objects spanning many chunks of the store
+        size_t size = round % 20 == 0 ? 16 * STORE_CHUNK_SIZE : 64;
+        std::vector<unsigned char> obj;
+        while (obj.size() < size) {
+            const std::vector<unsigned char>& piece =
+                pieces[(next() >> 8) % pieces.size()];
+            obj.insert(obj.end(), piece.begin(), piece.end());
+        }
+
+        LinearSweepDisAssembler patched(obj);
+        patched.enableCFG();
+        patched.disas(0, obj.size() - 1);
+
+        // patch the bytes in place, as the disassembler only views them
+        uint64_t patchStart = (next() >> 8) % obj.size();
+        uint64_t patchEnd =
+            std::min<uint64_t>(patchStart + 1 + (next() >> 8) % 4,
+                               obj.size());
+        for (uint64_t i = patchStart; i < patchEnd; i++) {
+            obj[i] = patchBytes[(next() >> 8) % patchBytes.size()];
+        }
+        patched.redisas(patchStart, patchEnd);
+
+        LinearSweepDisAssembler fresh(obj);
+        fresh.enableCFG();
+        fresh.disas(0, obj.size() - 1);
+        ASSERT_EQ(patched.disassembledInstructions,
+                  fresh.disassembledInstructions)
+            << "round " << round;
+        ASSERT_EQ(errorList(patched.errorReport),
+                  errorList(fresh.errorReport))
+            << "round " << round;
+        ASSERT_EQ(transferList(patched), transferList(fresh))
+            << "round " << round;
+        ASSERT_EQ(patched.maxInstructionStrSize, fresh.maxInstructionStrSize);
+    }
+}
+
+TEST(disas, REDISAS_RECURSIVE) {
+    std::vector<unsigned char> obj = {
+        0xe8, 0x05, 0x00, 0x00, 0x00,  // call a
+        0x74, 0x02,                    // je 9
+        0x90,                          // nop
+        0xc3,                          // ret
+        0xc3,                          // ret
+        0x48, 0x83, 0xc0, 0x01,        // add rax 0x01
+        0xc3,                          // ret
+        0x90, 0xc3,                    // unreachable
+    };
+
+    RecursiveDescentDisAssembler patched(obj);
+    patched.disas(0, obj.size() - 1);
+    ASSERT_EQ(patched.disassembledInstructions.size(), 7);
+
+    // replace the add by nops, the path rejoins the ret at e
+    obj[10] = obj[11] = obj[12] = obj[13] = 0x90;
+    patched.redisas(10, 14);
+
+    RecursiveDescentDisAssembler fresh(obj);
+    fresh.disas(0, obj.size() - 1);
+    ASSERT_EQ(patched.disassembledInstructions,
+              fresh.disassembledInstructions);
+    ASSERT_EQ(patched.disassembledInstructions.size(), 10);
+
+    // turn the ret at 9 into a jump to the unreachable bytes
+    obj[9] = 0xeb;
+    obj[10] = 0x04;  // jmp f
+    patched.redisas(9, 11);
+    ASSERT_EQ(patched.disassembledInstructions[std::make_pair(9, 11)],
+              "jmp f ; relative offset = 4");
+    ASSERT_EQ(patched.disassembledInstructions[std::make_pair(15, 16)],
+              "nop ");
+    // the nops at b-d are kept, the one at a is replaced by the jump
+    ASSERT_FALSE(patched.disassembledInstructions.contains({10, 11}));
+    ASSERT_TRUE(patched.disassembledInstructions.contains({11, 12}));
+}
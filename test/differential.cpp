@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "differential.h"
+
+namespace {
+
+// call c; xor eax eax; jz b; mov eax [rbp - 0x8]; movzx eax al; (bad) in
+// 64-bit mode
+const std::vector<unsigned char> code = {
+    0xe8, 0x07, 0x00, 0x00, 0x00, 0x31, 0xc0, 0x74,
+    0x02, 0x8b, 0x45, 0xf8, 0x0f, 0xb6, 0xc0, 0x06,
+};
+
+const char* const LISTING =
+    "t.bin:     file format binary\n"
+    "\n"
+    "Disassembly of section .data:\n"
+    "\n"
+    "0000000000000000 <.data>:\n"
+    "   0:\te8 07 00 00 00       \tcall   0xc\n"
+    "   5:\t31 c0                \txor    eax,eax\n"
+    "   7:\t74 02                \tje     0xb\n"
+    "   9:\t8b 45 f8             \tmov    eax,DWORD PTR [rbp-0x8]\n"
+    "   c:\t0f b6 c0             \tmovzx  eax,al\n"
+    "   f:\t06                   \t(bad)\n"
+    "  10:\t48 b8 01 00 00 00 00 \tmovabs rax,0x1\n"
+    "  17:\t00 00 00 \n"
+    "  1a:\tf0 01 03             \tlock add DWORD PTR [rbx],eax\n";
+
+}  // namespace
+
+TEST(differential, OPCODE_CLASSES) {
+    std::vector<unsigned char> bytes = {0x66, 0x48, 0x0f, 0x38, 0x00,
+                                        0xd9, 0xc9, 0xc5, 0x0f, 0x66};
+    ASSERT_EQ(opcodeClass(bytes, 0), OpcodeClass::THREE_BYTE);
+    ASSERT_EQ(opcodeClass(bytes, 2), OpcodeClass::THREE_BYTE);
+    ASSERT_EQ(opcodeClass(bytes, 4), OpcodeClass::ONE_BYTE);
+    ASSERT_EQ(opcodeClass(bytes, 5), OpcodeClass::X87);
+    ASSERT_EQ(opcodeClass(bytes, 7), OpcodeClass::VEX);
+    ASSERT_EQ(opcodeClass(bytes, 8), OpcodeClass::TWO_BYTE);
+    ASSERT_EQ(opcodeClass(bytes, 9), OpcodeClass::PREFIXES);
+}
+
+TEST(differential, PARSE_OBJDUMP) {
+    std::istringstream is(LISTING);
+    std::vector<ReferenceInstruction> instructions = parseObjdump(is);
+    ASSERT_EQ(instructions.size(), 8);
+    ASSERT_EQ(instructions[0].addr, 0);
+    ASSERT_EQ(instructions[0].length, 5);
+    ASSERT_EQ(instructions[0].mnemonic, "call");
+    ASSERT_EQ(instructions[3].operands, "eax,DWORD PTR [rbp-0x8]");
+    ASSERT_TRUE(instructions[5].bad);
+    ASSERT_EQ(instructions[6].length, 10);  // continued on the next line
+    ASSERT_EQ(instructions[7].mnemonic, "add");  // without lock
+}
+
+TEST(differential, NORMALIZE) {
+    ASSERT_EQ(splitInstruction("rep stos  [rdi] al"),
+              (std::pair<std::string, std::string>("stos", "[rdi] al")));
+    ASSERT_EQ(canonicalMnemonic("je"), canonicalMnemonic("jz"));
+    ASSERT_EQ(canonicalMnemonic("ja"), "jnbe");
+    ASSERT_EQ(canonicalMnemonic("cmovae"), canonicalMnemonic("cmovnb"));
+    ASSERT_EQ(canonicalMnemonic("jmp"), "jmp");
+    ASSERT_EQ(canonicalMnemonic("movabs"), "mov");
+    ASSERT_EQ(normalizeOperands("eax,DWORD PTR [rip+0x1f69f]        # 24530"),
+              normalizeOperands("eax [rip + 0x0001f69f]"));
+    ASSERT_EQ(normalizeOperands("4828 <main+0x18>"), "4828");
+    ASSERT_EQ(normalizeOperands("[rax + rax * 1 + 0x00]"), "[rax+rax*1+0x0]");
+    ASSERT_NE(normalizeOperands("eax,0x10"), normalizeOperands("eax 0x01"));
+}
+
+TEST(differential, COMPARE) {
+    std::istringstream is(LISTING);
+    std::vector<ReferenceInstruction> reference = parseObjdump(is);
+    reference.resize(6);
+
+    DifferentialTester agreeing;
+    agreeing.compare(code, reference);
+    ASSERT_EQ(agreeing.mismatches(), 0) << [&]() {
+        std::ostringstream os;
+        agreeing.print(os);
+        return os.str();
+    }();
+    ASSERT_EQ(agreeing.classCounters(OpcodeClass::ONE_BYTE).compared, 5);
+
+    reference[1].length = 3;
+    reference[2].mnemonic = "jne";
+    reference[3].operands = "eax,DWORD PTR [rbp-0x10]";
+    reference[5].bad = false;
+    DifferentialTester tester(2);
+    tester.compare(code, reference);
+    const ClassCounters& c = tester.classCounters(OpcodeClass::ONE_BYTE);
+    ASSERT_EQ(c.mismatches[(size_t)MismatchKind::LENGTH], 1);
+    ASSERT_EQ(c.mismatches[(size_t)MismatchKind::MNEMONIC], 1);
+    ASSERT_EQ(c.mismatches[(size_t)MismatchKind::OPERANDS], 1);
+    ASSERT_EQ(c.mismatches[(size_t)MismatchKind::UNDECODED], 1);
+    ASSERT_EQ(tester.mismatches(), 4);
+    ASSERT_EQ(tester.samples().size(), 2);
+    ASSERT_EQ(tester.samples()[0].addr, 5);
+    ASSERT_EQ(tester.samples()[0].bytes, "31 c0 74 ");  // the longer one
+
+    tester.measure(code);
+    ASSERT_EQ(tester.classCounters(OpcodeClass::TWO_BYTE).instructions, 1);
+    ASSERT_EQ(tester.classCounters(OpcodeClass::ONE_BYTE).failed, 1);
+}
+
+TEST(differential, OBJDUMP) {
+    if (std::system("objdump --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP() << "objdump is not installed";
+    }
+    std::vector<unsigned char> agreeing(code.begin(), code.begin() + 15);
+    DifferentialTester tester;
+    tester.compare(agreeing, runObjdump(agreeing));
+    std::ostringstream os;
+    tester.print(os);
+    ASSERT_EQ(tester.mismatches(), 0) << os.str();
+    ASSERT_EQ(tester.classCounters(OpcodeClass::ONE_BYTE).compared, 4);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "elfview.h"
+#include "testutil.h"
+
+namespace {
+
+/**
+ * @brief Returns an ELF64 relocatable file with .text, .symtab, .strtab and
+ * .shstrtab, the section headers last.
+ */
+std::vector<unsigned char> elfWithSymbols() {
+    const char strtab[] = "\0main\0helper";
+    ELF64_SYM syms[3] = {};
+    syms[1].st_name = 1;
+    syms[1].st_shndx = 1;
+    syms[2].st_name = 6;
+    syms[2].st_shndx = 1;
+    syms[2].st_value = 2;
+
+    std::vector<unsigned char> symtab;
+    appendBytes(symtab, syms);
+    return buildELF({
+        {".text", 1, {0x90, 0x90, 0xc3}},
+        {".symtab", 2, symtab, 3, sizeof(ELF64_SYM)},
+        {".strtab", 3, {strtab, strtab + sizeof(strtab)}},
+    });
+}
+
+}  // namespace
+
+TEST(elfview, SECTIONS_AND_SYMBOLS) {
+    std::vector<unsigned char> bytes = elfWithSymbols();
+    ElfView elf(bytes);
+    ASSERT_EQ(elf.numSections(), 5);
+    ASSERT_EQ(elf.sectionName(1), ".text");
+    ASSERT_EQ(elf.findSection(".shstrtab"), 4);
+    ASSERT_EQ(elf.findSection(".dynsym"), NO_SECTION);
+    ASSERT_EQ(elf.contents(1).size(), 3);
+    ASSERT_EQ(elf.contents(1)[2], 0xc3);
+
+    // the names point into the file
+    TableView<ELF64_SYM> syms =
+        elf.table<ELF64_SYM>(elf.findSection(".symtab"));
+    StringTable names = elf.strings(elf.findSection(".strtab"));
+    ASSERT_EQ(syms.size(), 3);
+    ASSERT_EQ(names.at(syms[1].st_name), "main");
+    ASSERT_EQ(names.at(syms[2].st_name), "helper");
+    ASSERT_EQ(syms[2].st_value, 2);
+    ASSERT_GE(names.at(syms[2].st_name).data(),
+              reinterpret_cast<const char*>(bytes.data()));
+    ASSERT_EQ(names.at(1000), "");
+}
+
+TEST(elfview, BOUNDS) {
+    std::vector<unsigned char> bytes = elfWithSymbols();
+    ELF64_FILE_HEADER header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    // the last section header is cut
+    std::vector<unsigned char> truncated(bytes.begin(), bytes.end() - 1);
+    ASSERT_THROW(ElfView{truncated}, std::runtime_error);
+    std::vector<unsigned char> notElf(bytes.begin(), bytes.begin() + 16);
+    ASSERT_THROW(ElfView{notElf}, std::runtime_error);
+
+    // a table reaching past the end of the file is cut to it
+    std::vector<unsigned char> oversized = bytes;
+    ELF64_SECTION_HEADER symtab;
+    uint64_t symtabHeader = header.e_shoff + 2 * sizeof(symtab);
+    std::memcpy(&symtab, oversized.data() + symtabHeader, sizeof(symtab));
+    symtab.sh_size = 1 << 20;
+    std::memcpy(oversized.data() + symtabHeader, &symtab, sizeof(symtab));
+    ElfView elf(oversized);
+    ASSERT_EQ(elf.table<ELF64_SYM>(2).size(),
+              (oversized.size() - symtab.sh_offset) / sizeof(ELF64_SYM));
+
+    // a string running to the end of the file stops there
+    StringTable strings(ByteSpan(bytes.data(), 4));
+    ASSERT_EQ(strings.at(1).size(), 3);
+}
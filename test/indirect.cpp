@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "disassembler.h"
+#include "indirect.h"
+
+namespace {
+
+// switch (edi) with the entries relative to the table at 0x20
+const std::vector<unsigned char> relativeSwitch = {
+    0x83, 0xff, 0x02,                          // 0: cmp edi 2
+    0x77, 0x17,                                // 3: ja 1c
+    0x48, 0x8d, 0x15, 0x14, 0x00, 0x00, 0x00,  // 5: lea rdx [rip + 0x14]
+    0x48, 0x63, 0x04, 0xba,                    // c: movsxd rax [rdx + rdi * 4]
+    0x48, 0x01, 0xd0,                          // 10: add rax rdx
+    0xff, 0xe0,                                // 13: jmp rax
+    0x90, 0xc3,                                // 15: case 0
+    0x90, 0xc3,                                // 17: case 1
+    0x90, 0xc3,                                // 19: case 2
+    0xcc,                                      // 1b
+    0xc3,                                      // 1c: default
+    0xcc, 0xcc, 0xcc,                          // 1d
+    0xf5, 0xff, 0xff, 0xff,                    // 20: 15 - 20
+    0xf7, 0xff, 0xff, 0xff,                    // 24: 17 - 20
+    0xf9, 0xff, 0xff, 0xff,                    // 28: 19 - 20
+};
+const uint64_t RELATIVE_CODE_END = 0x1f;
+
+// switch (edi) with the addresses of the cases in the table at 0x18
+std::vector<unsigned char> absoluteSwitch(unsigned char boundCheck) {
+    return {
+        0x83, 0xff, 0x01,                          // 0: cmp edi 1
+        boundCheck, 0x0d,                          // 3: ja 12
+        0xff, 0x24, 0xfd, 0x18, 0x00, 0x00, 0x00,  // 5: jmp [0x18 + rdi * 8]
+        0x90, 0xc3,                                // c
+        0x90, 0xc3,                                // e: case 0
+        0x90, 0xc3,                                // 10: case 1
+        0xc3,                                      // 12: default
+        0xcc, 0xcc, 0xcc, 0xcc, 0xcc,              // 13
+        0x0e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 18
+        0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 20
+    };
+}
+const uint64_t ABSOLUTE_CODE_END = 0x17;
+
+}  // namespace
+
+TEST(indirect, RELATIVE_TABLE) {
+    RecursiveDescentDisAssembler plain(relativeSwitch);
+    plain.disas(0, RELATIVE_CODE_END);
+    ASSERT_NE(plain.disassembledInstructions.findStartingAt(0x15), nullptr);
+    ASSERT_EQ(plain.disassembledInstructions.findStartingAt(0x17), nullptr);
+
+    IndirectTargets targets(relativeSwitch);
+    ASSERT_EQ(targets.resolve(plain.disassembledInstructions, 0x13,
+                              plain.state),
+              (std::vector<uint64_t>{0x15, 0x17, 0x19}));
+    // the jump falls through from nothing decoded
+    ASSERT_TRUE(
+        targets.resolve(InstructionStore(), 0x13, plain.state).empty());
+
+    RecursiveDescentDisAssembler rd(relativeSwitch);
+    rd.indirectTargets = &targets;
+    rd.enableStats();
+    rd.disas(0, RELATIVE_CODE_END);
+    for (uint64_t addr : {0x17, 0x18, 0x19, 0x1a}) {
+        ASSERT_NE(rd.disassembledInstructions.findStartingAt(addr), nullptr);
+    }
+    ASSERT_EQ(rd.disassembledInstructions.findStartingAt(0x1b), nullptr);
+    ASSERT_EQ(rd.stats->jumpTables, 1);
+
+    RecursiveDescentDisAssembler parallel(relativeSwitch);
+    parallel.indirectTargets = &targets;
+    parallel.disas(0, RELATIVE_CODE_END, 2);
+    ASSERT_EQ(parallel.disassembledInstructions.size(),
+              rd.disassembledInstructions.size());
+}
+
+TEST(indirect, PARALLEL_LOOKBACK) {
+    // the walks from the code pointers may claim the instructions falling
+    // through to the jump before the walk reaching the jump does
+    IndirectTargets targets(relativeSwitch);
+    targets.addCodePointers({0x05, 0x0c, 0x10});
+    RecursiveDescentDisAssembler sequential(relativeSwitch);
+    sequential.indirectTargets = &targets;
+    sequential.disas(0, RELATIVE_CODE_END);
+    ASSERT_NE(sequential.disassembledInstructions.findStartingAt(0x17),
+              nullptr);
+
+    for (size_t jobs : {2, 4}) {
+        for (int run = 0; run < 20; run++) {
+            RecursiveDescentDisAssembler parallel(relativeSwitch);
+            parallel.indirectTargets = &targets;
+            parallel.enableStats();
+            parallel.disas(0, RELATIVE_CODE_END, jobs);
+            ASSERT_EQ(parallel.disassembledInstructions,
+                      sequential.disassembledInstructions);
+            // the table is read by the workers, whichever decoded the jump
+            ASSERT_EQ(parallel.stats->jumpTables, 1);
+        }
+    }
+}
+
+TEST(indirect, ABSOLUTE_TABLE) {
+    std::vector<unsigned char> obj = absoluteSwitch(0x77);  // ja
+    IndirectTargets targets(obj);
+    RecursiveDescentDisAssembler rd(obj);
+    rd.indirectTargets = &targets;
+    rd.disas(0, ABSOLUTE_CODE_END);
+    ASSERT_NE(rd.disassembledInstructions.findStartingAt(0x0e), nullptr);
+    ASSERT_NE(rd.disassembledInstructions.findStartingAt(0x10), nullptr);
+    ASSERT_EQ(rd.disassembledInstructions.findStartingAt(0x13), nullptr);
+
+    // a table whose bound is not checked is not read
+    std::vector<unsigned char> unbounded = absoluteSwitch(0x74);  // jz
+    IndirectTargets unboundedTargets(unbounded);
+    RecursiveDescentDisAssembler guess(unbounded);
+    guess.indirectTargets = &unboundedTargets;
+    guess.disas(0, ABSOLUTE_CODE_END);
+    ASSERT_EQ(guess.disassembledInstructions.findStartingAt(0x0e), nullptr);
+}
+
+TEST(indirect, CODE_POINTERS) {
+    std::vector<unsigned char> obj = absoluteSwitch(0x74);
+    IndirectTargets targets(obj);
+    targets.addCodePointers({0x10, 0x0e, 0x10, 0x1000});
+    ASSERT_EQ(targets.codePointersIn(0, ABSOLUTE_CODE_END),
+              (std::vector<uint64_t>{0x0e, 0x10}));
+    ASSERT_EQ(targets.codePointersIn(0x0f, ABSOLUTE_CODE_END),
+              (std::vector<uint64_t>{0x10}));
+
+    // the addresses are translated to file offsets
+    AddressMap addressMap;
+    addressMap.map(0x400000, 0, obj.size());
+    IndirectTargets mapped(obj, addressMap);
+    mapped.addCodePointers({0x40000e, 0x0e});
+    ASSERT_EQ(mapped.codePointersIn(0, ABSOLUTE_CODE_END),
+              (std::vector<uint64_t>{0x0e}));
+
+    RecursiveDescentDisAssembler rd(obj);
+    rd.indirectTargets = &targets;
+    rd.disas(0, ABSOLUTE_CODE_END);
+    ASSERT_NE(rd.disassembledInstructions.findStartingAt(0x0e), nullptr);
+    ASSERT_NE(rd.disassembledInstructions.findStartingAt(0x10), nullptr);
+}
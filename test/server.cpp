@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+#include "testutil.h"
+
+namespace {
+
+/**
+ * @brief Returns the response main would print for --range of the file.
+ */
+std::string expectedListing(const std::string& path, uint64_t startAddr,
+                            uint64_t endAddr) {
+    ELFDisAssembler eda(path, "linearsweep");
+    eda.disasRange(eda._addressRange(startAddr, endAddr), 1);
+    std::ostringstream os;
+    os << "ok\n";
+    eda.print(os);
+    return os.str();
+}
+
+}  // namespace
+
+TEST(server, PARSE_REQUEST) {
+    ServerRequest request =
+        ServerRequest::parse("range rd 1000-1010 /tmp/a dir/b.o");
+    ASSERT_EQ(request.command, "range");
+    ASSERT_EQ(request.strategy, "rd");
+    ASSERT_EQ(request.target, "1000-1010");
+    ASSERT_EQ(request.path, "/tmp/a dir/b.o");
+    ASSERT_EQ(ServerRequest::parse("ping").command, "ping");
+
+    ASSERT_THROW(ServerRequest::parse("list ls main a.o"),
+                 std::invalid_argument);
+    ASSERT_THROW(ServerRequest::parse("symbol fast main a.o"),
+                 std::invalid_argument);
+    ASSERT_THROW(ServerRequest::parse("symbol ls main"),
+                 std::invalid_argument);
+}
+
+TEST(server, CACHED_FILES) {
+    TempDir dir("server");
+    std::string path = dir.path("a.o");
+    writeELF(path, {0x90, 0x48, 0x01, 0xd8, 0xc3});  // nop; add rax rbx; ret
+
+    DisasServer server;
+    std::string request = "range ls 40-45 " + path;
+    std::string listing = server.handle(request);
+    ASSERT_EQ(listing, expectedListing(path, 0x40, 0x45));
+    ASSERT_NE(listing.find("add  rax rbx"), std::string::npos);
+    ASSERT_EQ(server.handle("range rd 41-45 " + path),
+              server.handle("range ls 41-45 " + path));
+    ASSERT_EQ(server.parses(), 1);
+
+    // a modified file is parsed again
+    writeELF(path, {0x90, 0x90, 0xc3});
+    ASSERT_EQ(server.handle("range ls 40-43 " + path),
+              expectedListing(path, 0x40, 0x43));
+    ASSERT_EQ(server.parses(), 2);
+
+    ASSERT_EQ(server.handle("range ls 1000-1010 " + path).rfind("error\n", 0),
+              0);
+    ASSERT_EQ(server.handle("range ls 40 " + path).rfind("error\n", 0), 0);
+    ASSERT_EQ(server.handle("symbol ls main " + path).rfind("error\n", 0),
+              0);
+    std::string missing =
+        server.handle("range ls 40-43 " + dir.path("b.o"));
+    ASSERT_EQ(missing.rfind("error\nFailed to open", 0), 0);
+    ASSERT_EQ(server.parses(), 2);
+}
+
+TEST(server, SOCKET) {
+    TempDir dir("server");
+    std::string path = dir.path("a.o");
+    std::string socketPath = dir.path("mydisas.sock");
+    writeELF(path, {0x90, 0xc3});
+
+    DisasServer server;
+    bool served = false;
+    std::thread serving([&]() { served = server.serve(socketPath); });
+
+    int fd = -1;
+    for (int i = 0; i < 1000 && fd < 0; i++) {
+        fd = connectServer(socketPath);
+        if (fd < 0) {
+            usleep(1000);
+        }
+    }
+    ASSERT_GE(fd, 0);
+    std::string response;
+    ASSERT_TRUE(writeFrame(fd, "ping"));
+    ASSERT_TRUE(readFrame(fd, response));
+    ASSERT_EQ(response, "ok\n");
+    ASSERT_TRUE(writeFrame(fd, "range ls 40-42 " + path));
+    ASSERT_TRUE(readFrame(fd, response));
+    ASSERT_EQ(response, expectedListing(path, 0x40, 0x42));
+
+    // an idle connection does not keep the server up
+    int idle = connectServer(socketPath);
+    ASSERT_GE(idle, 0);
+    ASSERT_TRUE(writeFrame(fd, "shutdown"));
+    ASSERT_TRUE(readFrame(fd, response));
+    ASSERT_EQ(response, "ok\n");
+    serving.join();
+    ASSERT_TRUE(served);
+    ASSERT_FALSE(readFrame(idle, response));
+    ASSERT_NE(access(socketPath.c_str(), F_OK), 0);
+
+    close(fd);
+    close(idle);
+}
+
+TEST(server, SOCKET_PATH_TAKEN) {
+    TempDir dir("server");
+    std::string socketPath = dir.path("mydisas.sock");
+
+    // a file which is not a socket is kept
+    writeFile(socketPath, {'k', 'e', 'e', 'p'});
+    DisasServer server;
+    ASSERT_FALSE(server.serve(socketPath));
+    std::ifstream ifs(socketPath);
+    std::string content;
+    ifs >> content;
+    ASSERT_EQ(content, "keep");
+    ASSERT_EQ(unlink(socketPath.c_str()), 0);
+
+    // a socket nothing listens on anymore is replaced
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(bind(stale, (const sockaddr*)&addr, sizeof(addr)), 0);
+    close(stale);
+    bool served = false;
+    std::thread serving([&]() { served = server.serve(socketPath); });
+    int fd = -1;
+    for (int i = 0; i < 1000 && fd < 0; i++) {
+        fd = connectServer(socketPath);
+        if (fd < 0) {
+            usleep(1000);
+        }
+    }
+    ASSERT_GE(fd, 0);
+
+    // the socket of a running server is not taken over
+    DisasServer other;
+    ASSERT_FALSE(other.serve(socketPath));
+    std::string response;
+    ASSERT_TRUE(writeFrame(fd, "ping"));
+    ASSERT_TRUE(readFrame(fd, response));
+    ASSERT_EQ(response, "ok\n");
+    server.stop();
+    serving.join();
+    ASSERT_TRUE(served);
+    close(fd);
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "disassembler.h"
+#include "stats.h"
+
+TEST(stats, DECODER_COUNTERS) {
+    std::vector<unsigned char> obj = {
+        0x48, 0x83, 0xc0, 0x01,  // add rax 0x01 (REX.W row)
+        0x41, 0x50,              // push r8 (REX falls back to no prefix)
+        0x0f, 0xff,              // invalid
+        0xc3,                    // ret
+    };
+
+    LinearSweepDisAssembler plain(obj);
+    plain.disas(0, obj.size() - 1);
+    ASSERT_EQ(plain.stats, nullptr);
+    ASSERT_EQ(plain.state.stats, nullptr);
+
+    LinearSweepDisAssembler counted(obj);
+    counted.enableStats();
+    counted.disas(0, obj.size() - 1);
+    ASSERT_EQ(counted.disassembledInstructions,
+              plain.disassembledInstructions);
+
+    const DecodeStats& stats = *counted.stats;
+    ASSERT_EQ(stats.failed, counted.errorReport.errors.size());
+    ASSERT_GE(stats.decoded, 3);
+    ASSERT_EQ(stats.lookupFallbacks[(size_t)Prefix::REX][(size_t)Prefix::NONE],
+              1);
+    ASSERT_EQ(stats.worklistPushes, 0);
+
+    // the counters of merged disassemblers add up
+    LinearSweepDisAssembler merged(obj);
+    merged.enableStats();
+    merged.merge(counted);
+    merged.merge(counted);
+    ASSERT_EQ(merged.stats->decoded, 2 * stats.decoded);
+    ASSERT_EQ(merged.stats->failed, 2 * stats.failed);
+}
+
+TEST(stats, WORKLIST) {
+    std::vector<unsigned char> obj = {
+        0x74, 0x02,  // jz 4
+        0xeb, 0x02,  // jmp 6
+        0x90,        // nop
+        0xc3,        // ret
+        0x75, 0xfc,  // jnz 4
+        0xc3,        // ret
+    };
+
+    RecursiveDescentDisAssembler sequential(obj);
+    sequential.enableStats();
+    sequential.disas(0, obj.size() - 1);
+    ASSERT_GT(sequential.stats->worklistPushes, 0);
+    ASSERT_GE(sequential.stats->maxWorklistSize, 1);
+
+    RecursiveDescentDisAssembler parallel(obj);
+    parallel.enableStats();
+    parallel.disas(0, obj.size() - 1, 2);
+    ASSERT_EQ(parallel.stats->worklistPushes, 3);  // one per branch target
+    ASSERT_EQ(parallel.stats->decoded,
+              parallel.disassembledInstructions.size());
+
+    std::ostringstream os;
+    parallel.stats->print(os);
+    ASSERT_NE(os.str().find("worklist pushes: 3"), std::string::npos);
+}
+
+TEST(stats, PHASES) {
+    PhaseTimes phases;
+    ASSERT_EQ(phases.time("decode", []() { return 42; }), 42);
+    phases.add("print", std::chrono::milliseconds(2));
+    phases.add("decode", std::chrono::milliseconds(1));
+    ASSERT_THROW(phases.time("print",
+                             []() { throw std::runtime_error("failed"); }),
+                 std::runtime_error);
+
+    std::ostringstream os;
+    phases.print(os);
+    std::string report = os.str();
+    // in the order the phases are first timed, the times adding up
+    ASSERT_LT(report.find("decode: 1."), report.find("print: 2."));
+}
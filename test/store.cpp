@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "store.h"
+
+TEST(store, IN_ORDER) {
+    InstructionStore store;
+    store.put(0, 1, "nop ");
+    store.put(1, 2, "ret ");
+
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_EQ(store[std::make_pair(0, 1)], "nop ");
+    ASSERT_EQ(store[std::make_pair(1, 2)], "ret ");
+    ASSERT_EQ(store[std::make_pair(0, 2)], "");
+    ASSERT_FALSE(store.contains({1, 3}));
+}
+
+TEST(store, OUT_OF_ORDER) {
+    InstructionStore store;
+    store.put(9, 11, "jmp");
+    store.put(0, 5, "mov");
+    store.put(5, 9, "add");
+    store.put(0, 5, "mov2");  // the same range replaces the string
+
+    std::vector<uint64_t> addrs;
+    std::vector<std::string> strs;
+    for (const StoredInstruction& record : store) {
+        addrs.push_back(record.startAddr);
+        strs.emplace_back(store.str(record));
+    }
+    ASSERT_EQ(addrs, std::vector<uint64_t>({0, 5, 9}));
+    ASSERT_EQ(strs, std::vector<std::string>({"mov2", "add", "jmp"}));
+    ASSERT_EQ(store.find({5, 9})->length, 4);
+    ASSERT_EQ(store.find({5, 9})->endAddr(), 9);
+
+    // appending after reading keeps the order
+    store.put(11, 12, "ret");
+    store.put(2, 3, "nop");
+    ASSERT_EQ(store.begin()->startAddr, 0);
+    ASSERT_EQ(std::prev(store.end())->startAddr, 11);
+    ASSERT_EQ(store.size(), 5);
+
+    // past the records put out of order, the puts replace the same ranges
+    store.put(1, 2, "inc");
+    store.put(12, 13, "nop");
+    store.put(12, 13, "int3");
+    store.put(1, 2, "dec");
+    ASSERT_EQ(store[std::make_pair(12, 13)], "int3");
+    ASSERT_EQ(store[std::make_pair(1, 2)], "dec");
+    ASSERT_EQ(store.size(), 7);
+
+    store.clear();
+    ASSERT_TRUE(store.empty());
+}
+
+TEST(store, ERASE_OVERLAPPING) {
+    InstructionStore store;
+    store.put(0, 5, "mov");
+    store.put(5, 9, "add");
+    store.put(9, 11, "jmp");
+    store.put(11, 12, "ret");
+
+    ASSERT_EQ(store.findStartingAt(5)->endAddr(), 9);
+    ASSERT_EQ(store.findStartingAt(6), nullptr);
+    ASSERT_EQ(store.findCovering(7)->startAddr, 5);
+    ASSERT_EQ(store.findCovering(12), nullptr);
+    ASSERT_EQ(store.lastEndBefore(10), 9);
+    ASSERT_EQ(store.lastEndBefore(4), 0);
+
+    std::vector<StoredInstruction> erased;
+    store.eraseOverlapping(8, 10, erased);
+    ASSERT_EQ(erased.size(), 2);
+    ASSERT_EQ(store.str(erased[0]), "add");
+    ASSERT_EQ(store.str(erased[1]), "jmp");
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_EQ(store.lastEndBefore(11), 5);
+
+    // the strings of the remaining records survive the pool compaction
+    for (int i = 0; i < 8; i++) {
+        store.put(5, 9, "add");
+        store.eraseOverlapping(5, 9, erased);
+    }
+    ASSERT_EQ(store[std::make_pair(0, 5)], "mov");
+    ASSERT_EQ(store[std::make_pair(11, 12)], "ret");
+}
+
+TEST(store, INTERLEAVED_ACROSS_CHUNKS) {
+    // puts in a scrambled order, read back after each one, as a map would
+    InstructionStore store;
+    std::map<std::pair<uint64_t, uint64_t>, std::string> expected;
+    const uint64_t count = 5 * STORE_CHUNK_SIZE;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t addr = (i * 7919) % count * 2;
+        std::string str = "insn " + std::to_string(i % 97);
+        store.put(addr, addr + 2, str);
+        expected[{addr, addr + 2}] = str;
+        ASSERT_EQ(store[std::make_pair(addr, addr + 2)], str);
+        if (i % 64 == 0) {
+            ASSERT_EQ(store.findCovering(addr + 1)->startAddr, addr);
+        }
+    }
+    // the same ranges again, first a few, then most of them at once
+    for (uint64_t i = 0; i < count; i += count / 4) {
+        store.put(i * 2, i * 2 + 2, "again");
+        expected[{i * 2, i * 2 + 2}] = "again";
+    }
+    ASSERT_EQ(store.size(), expected.size());
+    for (uint64_t i = 1; i < count; i += 2) {
+        store.put(i * 2, i * 2 + 2, "twice");
+        expected[{i * 2, i * 2 + 2}] = "twice";
+    }
+
+    ASSERT_EQ(store.size(), expected.size());
+    auto it = expected.begin();
+    for (const StoredInstruction& record : store) {
+        ASSERT_EQ(record.startAddr, it->first.first);
+        ASSERT_EQ(record.endAddr(), it->first.second);
+        ASSERT_EQ(store.str(record), it->second);
+        ++it;
+    }
+    ASSERT_EQ(std::prev(store.end())->startAddr, (count - 1) * 2);
+}
+
+TEST(store, REPLACE_OVERLAPPING) {
+    InstructionStore store;
+    const uint64_t count = 3 * STORE_CHUNK_SIZE;
+    for (uint64_t addr = 0; addr < count * 4; addr += 4) {
+        store.put(addr, addr + 4, "mov");
+    }
+
+    // the run replaces [1000, 1012) inside the middle chunk
+    InstructionStore run;
+    for (uint64_t addr = 1002; addr < 1012; addr++) {
+        run.put(addr, addr + 1, "nop");
+    }
+    std::vector<StoredInstruction> erased;
+    store.replaceOverlapping(1002, 1012, run, erased);
+    ASSERT_EQ(erased.size(), 3);
+    ASSERT_EQ(erased[0].startAddr, 1000);
+    ASSERT_EQ(store.size(), count - 3 + 10);
+    ASSERT_EQ(store.findCovering(1001), nullptr);
+    ASSERT_EQ(store[std::make_pair(1002, 1003)], "nop");
+    ASSERT_EQ(store.findStartingAt(1012)->endAddr(), 1016);
+
+    // splitting the chunk the run grows keeps every record in order
+    InstructionStore big;
+    for (uint64_t addr = 0; addr < 2 * STORE_CHUNK_SIZE; addr++) {
+        big.put(4000 + addr, 4001 + addr, "inc");
+    }
+    store.replaceOverlapping(4000, 4000 + 2 * STORE_CHUNK_SIZE, big, erased);
+    uint64_t prevEnd = 0;
+    size_t n = 0;
+    for (const StoredInstruction& record : store) {
+        ASSERT_GE(record.startAddr, prevEnd);
+        prevEnd = record.endAddr();
+        n++;
+    }
+    ASSERT_EQ(n, store.size());
+    ASSERT_EQ(store[std::make_pair(4000, 4001)], "inc");
+    ASSERT_EQ(store[std::make_pair(0, 4)], "mov");
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "elfdisas.h"
+#include "symbols.h"
+
+TEST(symbols, INDEX) {
+    std::unordered_map<uint64_t, std::string> addr2symbol = {
+        {0x40, "main"}, {0x10, "_start"}, {0x80, "puts"}};
+    std::unordered_map<uint64_t, uint64_t> addr2roffset = {{0x80, 0x4018}};
+    SymbolIndex symbols(addr2symbol, addr2roffset);
+
+    ASSERT_EQ(symbols.size(), 3);
+    ASSERT_EQ(symbols[0].name, "_start");
+    ASSERT_EQ(symbols[2].name, "puts");
+    ASSERT_TRUE(symbols[2].hasRoffset);
+    ASSERT_EQ(symbols[2].roffset, 0x4018);
+    ASSERT_FALSE(symbols[1].hasRoffset);
+
+    ASSERT_EQ(symbols.find(0x40)->name, "main");
+    ASSERT_EQ(symbols.find(0x41), nullptr);
+    ASSERT_EQ(symbols.findPreceding(0x7f)->name, "main");
+    ASSERT_EQ(symbols.findPreceding(0x10)->name, "_start");
+    ASSERT_EQ(symbols.findPreceding(0xf), nullptr);
+    ASSERT_EQ(symbols.lowerBoundIndex(0x41), 2);
+}
+
+TEST(symbols, LABELS) {
+    std::unordered_map<uint64_t, std::string> addr2symbol = {
+        {0, "start"}, {0xc, "subroutine"}};
+    SymbolIndex symbols(addr2symbol, {});
+    std::vector<unsigned char> obj = {
+        0xe8, 0x07, 0x00, 0x00, 0x00,  // call c <subroutine>
+        0xeb, 0xf9,                    // jmp 0 <start>
+    };
+
+    LinearSweepDisAssembler disas(obj);
+    disas.disas(0, obj.size() - 1);
+    // the strings keep the numeric target only
+    ASSERT_EQ(disas.disassembledInstructions[std::make_pair(0, 5)],
+              "call c ; relative offset = 7");
+
+    std::ostringstream os;
+    {
+        OutputWriter out(os);
+        size_t column = ListingPrinter::labelledSize(
+            symbols, "call c ; relative offset = 7", 0xc);
+        ASSERT_EQ(column, 41);
+        ListingPrinter printer(out, {}, obj, symbols, column);
+        for (const StoredInstruction& record :
+             disas.disassembledInstructions) {
+            printer.print(record.startAddr, record.length,
+                          disas.disassembledInstructions.str(record),
+                          record.labelAddr);
+        }
+    }
+    ASSERT_EQ(os.str(),
+              "\n0 <start>:\n"
+              " 0: call c <subroutine> ; relative offset = 7 ( e8 7 0 0 0 )\n"
+              " 5: jmp 0 <start> ; relative offset = -7      ( eb f9 )\n");
+}
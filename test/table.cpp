@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include "table.h"
+
+TEST(table, OPCODE_DISPATCH) {
+    // 83 /5 -> SUB r/m32, imm8
+    const OpcodeDispatchRow* row = lookupOpcode(Prefix::NONE, 0x83);
+    ASSERT_NE(row, nullptr);
+    ASSERT_EQ(row->byReg[5].mnemonic, Mnemonic::SUB);
+    ASSERT_NE(row->byReg[5].operandIdx, NO_OPERAND_SPEC);
+    ASSERT_EQ(OPERAND_LOOKUP[row->byReg[5].operandIdx].spec.opEnc, OpEnc::MI);
+
+    // two-byte opcode
+    row = lookupOpcode(Prefix::NONE, 0x0FAF);
+    ASSERT_NE(row, nullptr);
+    ASSERT_EQ(row->noModrm.mnemonic, Mnemonic::IMUL);
+
+    // unknown combination
+    ASSERT_EQ(lookupOpcode(Prefix::P66, 0x01), nullptr);
+    ASSERT_EQ(lookupOpcode(Prefix::NONE, 0x0FFF), nullptr);
+}
+
+TEST(table, OPCODE_DISPATCH_FALLBACK) {
+    // REX.W -> REX
+    const OpcodeDispatchRow* row = lookupOpcode(Prefix::REXW, 0x88);
+    ASSERT_NE(row, nullptr);
+    ASSERT_EQ(row->prefix, Prefix::REX);
+
+    // REX -> none
+    row = lookupOpcode(Prefix::REX, 0x01);
+    ASSERT_NE(row, nullptr);
+    ASSERT_EQ(row->prefix, Prefix::NONE);
+
+    // REX.W never falls back to none directly
+    ASSERT_NE(lookupOpcode(Prefix::NONE, 0xE8), nullptr);
+    ASSERT_EQ(lookupOpcode(Prefix::REXW, 0xE8), nullptr);
+}
@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @brief Defines the helpers shared by the tests: ELF64 files built in
+ * memory, and temporary directories removed with everything in them.
+ */
+
+#pragma once
+#include <ftw.h>
+#include <stdlib.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "header.h"
+
+/**
+ * @struct TestSection
+ * @brief A section of the ELF64 file built by buildELF().
+ */
+struct TestSection {
+    std::string name;                   /**< The name of the section */
+    uint32_t type;                      /**< sh_type */
+    std::vector<unsigned char> content; /**< The bytes of the section */
+    uint32_t link = 0;                  /**< sh_link */
+    uint64_t entsize = 0;               /**< sh_entsize */
+};
+
+/**
+ * @brief Appends the bytes of the value.
+ */
+template <typename T>
+void appendBytes(std::vector<unsigned char>& bytes, const T& value) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(value));
+}
+
+/**
+ * @brief Returns an ELF64 relocatable file holding the sections in the
+ * order given, from index 1 on, then .shstrtab, with the section headers
+ * last. The first section starts right after the file header.
+ */
+inline std::vector<unsigned char> buildELF(
+    const std::vector<TestSection>& sections) {
+    std::string shstrtab(1, '\0');
+    std::vector<ELF64_SECTION_HEADER> headers(sections.size() + 2);
+    uint64_t offset = sizeof(ELF64_FILE_HEADER);
+    for (size_t i = 0; i < sections.size(); i++) {
+        ELF64_SECTION_HEADER& sh = headers[i + 1];
+        sh.sh_name = shstrtab.size();
+        sh.sh_type = sections[i].type;
+        sh.sh_offset = offset;
+        sh.sh_size = sections[i].content.size();
+        sh.sh_link = sections[i].link;
+        sh.sh_entsize = sections[i].entsize;
+        shstrtab += sections[i].name + '\0';
+        offset += sh.sh_size;
+    }
+    ELF64_SECTION_HEADER& names = headers.back();
+    names.sh_name = shstrtab.size();
+    names.sh_type = 3;
+    shstrtab += std::string(".shstrtab") + '\0';
+    names.sh_offset = offset;
+    names.sh_size = shstrtab.size();
+
+    ELF64_FILE_HEADER header = {};
+    std::memcpy(header.e_ident, "\x7f" "ELF", 4);
+    header.e_ident[4] = 2;  // 64-bit
+    header.e_ident[5] = 1;  // little endian
+    header.e_ident[6] = 1;
+    header.e_type = 1;
+    header.e_machine = 62;  // x86-64
+    header.e_ehsize = sizeof(header);
+    header.e_shentsize = sizeof(ELF64_SECTION_HEADER);
+    header.e_shnum = headers.size();
+    header.e_shstrndx = headers.size() - 1;
+    header.e_shoff = offset + shstrtab.size();
+
+    std::vector<unsigned char> bytes;
+    appendBytes(bytes, header);
+    for (const TestSection& section : sections) {
+        bytes.insert(bytes.end(), section.content.begin(),
+                     section.content.end());
+    }
+    bytes.insert(bytes.end(), shstrtab.begin(), shstrtab.end());
+    for (const ELF64_SECTION_HEADER& sh : headers) {
+        appendBytes(bytes, sh);
+    }
+    return bytes;
+}
+
+/**
+ * @brief Writes the bytes to the file, replacing it.
+ */
+inline void writeFile(const std::string& path,
+                      const std::vector<unsigned char>& bytes) {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+/**
+ * @brief Writes an ELF64 file with a .text section holding the code, at
+ * the file offset 0x40.
+ */
+inline void writeELF(const std::string& path,
+                     const std::vector<unsigned char>& code) {
+    writeFile(path, buildELF({{".text", 1, code}}));
+}
+
+/**
+ * @class TempDir
+ * @brief A directory under /tmp, removed with its files when the test is
+ * done.
+ */
+class TempDir {
+   public:
+    /**
+     * @param prefix Starts the name of the directory, e.g. the test suite.
+     * @throws std::runtime_error if the directory cannot be created.
+     */
+    explicit TempDir(const std::string& prefix) {
+        std::string name = "/tmp/mydisas-" + prefix + "-XXXXXX";
+        if (mkdtemp(&name[0]) == nullptr) {
+            throw std::runtime_error("Failed to create " + name + ": " +
+                                     std::strerror(errno));
+        }
+        dir = name;
+    }
+
+    ~TempDir() {
+        nftw(dir.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& path() const { return dir; }
+
+    /**
+     * @brief Returns the path of the name in the directory.
+     */
+    std::string path(const std::string& name) const { return dir + "/" + name; }
+
+   private:
+    std::string dir;
+
+    static int removeEntry(const char* path, const struct stat*, int,
+                           struct FTW*) {
+        std::remove(path);
+        return 0;
+    }
+};
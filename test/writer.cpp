@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+
+#include "writer.h"
+
+TEST(writer, FORMAT) {
+    std::stringstream ss;
+    {
+        OutputWriter out(ss);
+        const unsigned char bytes[] = {0x48, 0x8b, 0x05, 0x00};
+        out.put(' ').hex(0x11b9).write(": ").write("mov ");
+        out.fill(' ', 3).write("( ").hexBytes(bytes, 4).write(")\n");
+        // nothing is written until the buffer is flushed
+        ASSERT_TRUE(ss.str().empty());
+    }
+    ASSERT_EQ(ss.str(), " 11b9: mov    ( 48 8b 5 0 )\n");
+}
+
+TEST(writer, FILE_DESCRIPTOR) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+
+    OutputWriter out(fds[1]);
+    out.write("Done!").put('\n');
+    out.flush();
+    close(fds[1]);
+
+    char buf[16] = {};
+    ASSERT_EQ(read(fds[0], buf, sizeof(buf)), 6);
+    ASSERT_EQ(std::string(buf), "Done!\n");
+    close(fds[0]);
+}